@@ -7,7 +7,6 @@
 
 #define BUTTON_GPIO_NUM CONFIG_EXAMPLE_BUTTON_GPIO_NUM
 #define TASK_STACK_SIZE (1024 * 2)
-#define RESULT_DELAY_SEC (10)
 
 static char *TAG = "button";
 esp_hass_client_handle_t client;
@@ -23,11 +22,32 @@ button_config_t gpio_btn_cfg = {
 esp_hass_call_service_config_t call_service_config =
     ESP_HASS_CALL_SERVICE_CONFIG_DEFAULT();
 
+/* the command is serialized once, and only the ID is filled on each click */
+esp_hass_prepared_command_handle_t prepared;
+
+static void
+call_service_result(void *args, int id, esp_hass_message_t *msg)
+{
+	if (msg->success) {
+		ESP_LOGI(TAG, "calling service %s on entity %s successful",
+		    call_service_config.service, call_service_config.entity_id);
+	} else {
+		ESP_LOGE(TAG, "server returned failure");
+	}
+}
+
 static void
 button_single_click_cb(void *arg)
 {
+	esp_err_t err = ESP_FAIL;
+
 	ESP_LOGI(TAG, "BUTTON_SINGLE_CLICK");
-	esp_hass_call_service(client, &call_service_config);
+	err = esp_hass_prepared_command_send(client, prepared,
+	    call_service_result, NULL, NULL);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_prepared_command_send(): %s",
+		    esp_err_to_name(err));
+	}
 }
 
 static void
@@ -41,8 +61,11 @@ task_button(void *args)
 	call_service_config.domain = domain;
 	call_service_config.service = service;
 	call_service_config.entity_id = entity_id;
-	call_service_config.delay = (RESULT_DELAY_SEC * 1000 /
-	    portTICK_PERIOD_MS);
+	if (esp_hass_prepare_call_service(client, &call_service_config,
+		&prepared) != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_prepare_call_service()");
+		goto fail;
+	}
 	gpio_btn = iot_button_create(&gpio_btn_cfg);
 	if (NULL == gpio_btn) {
 		ESP_LOGE(TAG, "Button create failed");
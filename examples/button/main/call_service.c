@@ -92,8 +92,8 @@ call_service(esp_hass_client_handle_t client, call_service_config_t *config,
 		    CONFIG_EXAMPLE_CALL_SERVICE_ENTITI_ID);
 	} else {
 		ESP_LOGE(TAG, "server returned failure");
-		json_error = cJSON_GetObjectItemCaseSensitive(msg->json,
-		    "error");
+		json_error = cJSON_GetObjectItemCaseSensitive(
+		    esp_hass_message_get_json(msg), "error");
 		json_error_msg = cJSON_GetObjectItemCaseSensitive(json_error,
 		    "message");
 		if (cJSON_IsString(json_error_msg) &&
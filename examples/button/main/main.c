@@ -50,6 +50,7 @@
 #define MESSAGE_QUEUE_LEN (5)
 
 static const char *TAG = "example";
+
 static EventGroupHandle_t s_wifi_event_group;
 static int s_retry_num = 0;
 bool is_time_to_stop = false;
@@ -145,46 +146,27 @@ wifi_init()
 static void
 message_handler(void *args, esp_event_base_t base, int32_t id, void *event_data)
 {
-	esp_hass_client_handle_t client = NULL;
 	esp_hass_message_t *msg = NULL;
 	char *json_string = NULL;
 	cJSON *event = NULL;
-	cJSON *data = NULL;
-	cJSON *entity_ids = NULL;
 
-	client = (esp_hass_client_handle_t)args;
 	msg = (esp_hass_message_t *)event_data;
 
 	if (msg->type != HASS_MESSAGE_TYPE_EVENT) {
 		ESP_LOGW(TAG, "msg->type is not HASS_MESSAGE_TYPE_EVENT");
 		goto end;
 	}
-	if (msg->json == NULL) {
-		ESP_LOGW(TAG, "msg->json is NULL");
-		goto end;
-	}
-
-	/* filter events other than one of EXAMPLE_CALL_SERVICE_ENTITI_ID */
-	event = cJSON_GetObjectItemCaseSensitive(msg->json, "event");
-	if (!cJSON_IsObject(event)) {
-		goto end;
-	}
-	data = cJSON_GetObjectItemCaseSensitive(event, "data");
-	if (!cJSON_IsObject(data)) {
-		goto end;
-	}
 
-	/* entity_id can be a string, or an array of strings.  the events we
-	 * are looking for always have a single entity_id. ignore events with
-	 * multiple entity_id.
+	/* the handler is called with the events of
+	 * EXAMPLE_CALL_SERVICE_ENTITI_ID only. the message is parsed only for
+	 * the events.
 	 */
-	entity_ids = cJSON_GetObjectItemCaseSensitive(data, "entity_id");
-	if (cJSON_IsArray(entity_ids) || !cJSON_IsString(entity_ids) ||
-	    entity_ids->valuestring == NULL) {
+	if (esp_hass_message_get_json(msg) == NULL) {
+		ESP_LOGW(TAG, "esp_hass_message_get_json() returned NULL");
 		goto end;
 	}
-	if (strcmp(entity_ids->valuestring,
-		CONFIG_EXAMPLE_CALL_SERVICE_ENTITI_ID) != 0) {
+	event = cJSON_GetObjectItemCaseSensitive(msg->json, "event");
+	if (!cJSON_IsObject(event)) {
 		goto end;
 	}
 
@@ -199,9 +181,6 @@ end:
 		free(json_string);
 		json_string = NULL;
 	}
-
-	/* give the semaphore so that event source can delete it */
-	esp_hass_message_semaphore_give(client);
 	return;
 }
 
@@ -329,10 +308,11 @@ app_main(void)
 		goto fail;
 	}
 
-	/* register message_handler */
-	err = esp_hass_event_handler_register(client, message_handler);
+	/* register message_handler for the entity */
+	err = esp_hass_entity_handler_register(client,
+	    CONFIG_EXAMPLE_CALL_SERVICE_ENTITI_ID, message_handler);
 	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "esp_hass_event_handler_register(): %s",
+		ESP_LOGE(TAG, "esp_hass_entity_handler_register(): %s",
 		    esp_err_to_name(err));
 		goto fail;
 	}
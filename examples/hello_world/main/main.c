@@ -147,12 +147,10 @@ message_handler(void *args, esp_event_base_t base, int32_t id, void *event_data)
 {
 	char *json_string = NULL;
 	esp_hass_message_t *msg = NULL;
-	esp_hass_client_handle_t client;
 
 	msg = (esp_hass_message_t *)event_data;
-	client = (esp_hass_client_handle_t)args;
 
-	json_string = cJSON_Print(msg->json);
+	json_string = cJSON_Print(esp_hass_message_get_json(msg));
 	if (json_string == NULL) {
 		ESP_LOGE(TAG, "cJSON_Print");
 	} else {
@@ -161,9 +159,6 @@ message_handler(void *args, esp_event_base_t base, int32_t id, void *event_data)
 	if (json_string != NULL) {
 		free(json_string);
 	}
-	if (esp_hass_message_semaphore_give(client) != pdTRUE) {
-		ESP_LOGE(TAG, "esp_hass_message_semaphore_give()");
-	}
 }
 
 void
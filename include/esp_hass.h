@@ -51,6 +51,7 @@ extern "C" {
 #include <esp_websocket_client.h>
 #include <freertos/queue.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * Home Assistant message types.
@@ -77,6 +78,7 @@ typedef enum {
 	HASS_MESSAGE_TYPE_RESULT,
 	HASS_MESSAGE_TYPE_SUBSCRIBE_EVENTS,
 	HASS_MESSAGE_TYPE_SUBSCRIBE_TRIGGER,
+	HASS_MESSAGE_TYPE_SUPPORTED_FEATURES,
 	HASS_MESSAGE_TYPE_UNSUBSCRIBE_EVENTS,
 	HASS_MESSAGE_TYPE_VALIDATE_CONFIG,
 
@@ -95,6 +97,104 @@ typedef enum {
 	HASS_MESSAGE_STATUS_MAX,
 } esp_hass_message_status_t;
 
+/**
+ * Maximum length of `event_type` in `esp_hass_message_t`, including NULL.
+ */
+#define ESP_HASS_EVENT_TYPE_MAX_LEN (64)
+
+/**
+ * Maximum number of paths in `projection_paths` of `esp_hass_config_t`.
+ */
+#define ESP_HASS_PROJECTION_MAX_FIELDS CONFIG_ESP_HASS_PROJECTION_MAX_FIELDS
+
+/**
+ * Maximum length of the value of a projected field, including NULL.
+ */
+#define ESP_HASS_FIELD_VALUE_MAX_LEN CONFIG_ESP_HASS_PROJECTION_VALUE_MAX_LEN
+
+/**
+ * Types of projected fields
+ */
+typedef enum {
+	HASS_FIELD_TYPE_MISSING = 0, /*!< The path is not in the message */
+	HASS_FIELD_TYPE_STRING,	     /*!< A string */
+	HASS_FIELD_TYPE_NUMBER,	     /*!< A number */
+	HASS_FIELD_TYPE_BOOL,	     /*!< `true` or `false` */
+	HASS_FIELD_TYPE_NULL,	     /*!< `null` */
+	HASS_FIELD_TYPE_OBJECT,	     /*!< An object. The value is empty */
+	HASS_FIELD_TYPE_ARRAY,	     /*!< An array. The value is empty */
+} esp_hass_field_type_t;
+
+/**
+ * A field projected from a message
+ */
+typedef struct {
+	esp_hass_field_type_t type; /*!< Type of the field */
+	bool truncated; /*!< The value was longer than `value`, and truncated */
+	double number;	/*!< The number, or 1 for `true`, 0 for `false` */
+	char value[ESP_HASS_FIELD_VALUE_MAX_LEN]; /*!< An unescaped string, or
+						     the text of a number, or
+						     a literal */
+} esp_hass_field_t;
+
+/**
+ * Fields projected from a message, in the order of `projection_paths` of
+ * `esp_hass_config_t`.
+ */
+typedef struct {
+	size_t n_fields; /*!< Number of fields */
+	esp_hass_field_t fields[ESP_HASS_PROJECTION_MAX_FIELDS]; /*!< Fields */
+} esp_hass_projection_t;
+
+/**
+ * Maximum length of a state in `esp_hass_state_t`, including NULL.
+ */
+#define ESP_HASS_STATE_MAX_LEN CONFIG_ESP_HASS_STATE_MAX_LEN
+
+/**
+ * Maximum number of attributes in `state_changed_attributes` of
+ * `esp_hass_config_t`.
+ */
+#define ESP_HASS_STATE_CHANGED_MAX_ATTRIBUTES (32)
+
+/**
+ * An entity, i.e. an interned `entity_id`. Compare entities instead of
+ * `entity_id` strings. See esp_hass_client_get_entity().
+ */
+typedef uint16_t esp_hass_entity_t;
+
+/**
+ * An entity that is not known, because the table of entities is full.
+ */
+#define ESP_HASS_ENTITY_NONE ((esp_hass_entity_t)0xffff)
+
+/**
+ * `old_state`, or `new_state`, of a `state_changed` event
+ */
+typedef struct {
+	bool present;	/*!< The state is not `null`, which it is when the
+			   entity has been added, or removed */
+	bool is_number; /*!< `state` is a number, such as a sensor value */
+	bool truncated; /*!< `state` was longer than `value`, and truncated */
+	double number;	/*!< `state` as a number if `is_number` */
+	int64_t last_changed; /*!< `last_changed` in microseconds since the
+				 epoch, or zero */
+	char value[ESP_HASS_STATE_MAX_LEN]; /*!< `state` */
+} esp_hass_state_t;
+
+/**
+ * A `state_changed` event decoded into a fixed layout
+ */
+typedef struct {
+	esp_hass_entity_t entity;   /*!< `entity_id`, or ESP_HASS_ENTITY_NONE */
+	esp_hass_state_t old_state; /*!< `old_state` */
+	esp_hass_state_t new_state; /*!< `new_state` */
+	uint32_t attributes_changed; /*!< Bit `i` is set when attribute `i` of
+					`state_changed_attributes` in
+					`esp_hass_config_t` differs between
+					the states */
+} esp_hass_state_changed_t;
+
 /**
  * Home Assistant Mesage
  */
@@ -103,9 +203,49 @@ typedef struct {
 	int id; /*!< Message ID if any. -1 if the message does not have `id`
 		   field */
 	bool success; /*!< Command result status */
-	cJSON *json;  /*!< Pointer to cJSON struct of the message */
+	cJSON *json;  /*!< Pointer to cJSON struct of the message. NULL
+			 until `esp_hass_message_get_json()` is called when
+			 CONFIG_ESP_HASS_LAZY_PARSER is enabled. Use the
+			 function to work with any parser */
+	char event_type[ESP_HASS_EVENT_TYPE_MAX_LEN]; /*!< `event_type` of
+							 an event message, or
+							 empty */
+	const char *raw; /*!< The message text, if the JSON is parsed on
+			    demand, or NULL */
+	size_t raw_len;	 /*!< Length of `raw` */
+	const esp_hass_projection_t
+	    *projection; /*!< Fields of `projection_paths` in
+			    `esp_hass_config_t`, or NULL if no paths are
+			    registered */
+	const esp_hass_state_changed_t
+	    *state_changed; /*!< The decoded `state_changed` event, or NULL.
+			       See `decode_state_changed` of
+			       `esp_hass_subscribe_config_t` */
+	void *block; /*!< Private to esp_hass. The memory of the message,
+			which copies of the message share */
 } esp_hass_message_t;
 
+/**
+ * A lock-free ring of pointers, which can be used in place of a queue of
+ * messages. See esp_hass_ring_create().
+ */
+typedef struct esp_hass_ring *esp_hass_ring_handle_t;
+
+/**
+ * What the client does with an event when the event lane, i.e.
+ * `event_queue`, or `event_ring`, is full.
+ */
+typedef enum {
+	HASS_OVERLOAD_POLICY_DROP_NEWEST = 0, /*!< Drop the event */
+	HASS_OVERLOAD_POLICY_DROP_OLDEST,     /*!< Drop the oldest event in
+						 the lane, and send the event */
+	HASS_OVERLOAD_POLICY_COALESCE, /*!< Replace a `state_changed` event of
+					  the same entity in the lane with the
+					  newer one, whether or not the lane
+					  is full. Drop other events when the
+					  lane is full */
+} esp_hass_overload_policy_t;
+
 /**
  * esp_hass configuration
  */
@@ -114,15 +254,41 @@ typedef struct {
 	int timeout_sec;    /*!< Timeout in second when no response is back
 				     from the server. */
 	int command_send_timeout_sec; /*!< Timeout in second when a command is
-					 sent */
+					 queued, or sent */
 	int result_recv_timeout_sec;  /*!< Timeout in second when a command is
 					 sent, but no response is back from the
 					 server */
 	esp_websocket_client_config_t
 	    *ws_config; /*!< configuration of esp_websocket_client */
 	QueueHandle_t
-	    result_queue; /*!< A queue handle for results. Must not be NULL */
-	QueueHandle_t event_queue; /*!< An optional queue handle for events */
+	    result_queue; /*!< A queue handle for results of commands sent
+			     with esp_hass_send_message_json(). Must not be
+			     NULL */
+	QueueHandle_t event_queue; /*!< An optional queue handle for events.
+				      The client does not wait for space in
+				      the queue so that results are not
+				      delayed. See `overload_policy` */
+	esp_hass_ring_handle_t
+	    result_ring; /*!< An optional ring for results, used instead of
+			    `result_queue` */
+	esp_hass_ring_handle_t event_ring; /*!< An optional ring for events,
+					      used instead of `event_queue` */
+	esp_hass_overload_policy_t
+	    overload_policy; /*!< What to do with events when the event lane
+				is full */
+	const char *const *projection_paths; /*!< An optional NULL-terminated
+						array of paths to project
+						into `projection` of received
+						messages, such as
+						`event.data.entity_id` */
+	const char *const
+	    *state_changed_attributes; /*!< An optional NULL-terminated
+					  array of attribute names whose
+					  changes are set in
+					  `attributes_changed` of decoded
+					  `state_changed` events. The array
+					  must be valid while the client is
+					  used */
 } esp_hass_config_t;
 
 /**
@@ -132,7 +298,57 @@ typedef struct {
 	{                                                                      \
 		.access_token = NULL, .timeout_sec = 10, .ws_config = NULL,    \
 		.result_queue = NULL, .event_queue = NULL,                     \
+		.result_ring = NULL, .event_ring = NULL,                       \
+		.overload_policy = HASS_OVERLOAD_POLICY_DROP_NEWEST,           \
 		.command_send_timeout_sec = 10, .result_recv_timeout_sec = 10, \
+		.projection_paths = NULL, .state_changed_attributes = NULL,    \
+	}
+
+/**
+ * esp_hass_client_subscribe_events_with_config() configuration.
+ */
+typedef struct {
+	char *event_type; /*!< Type of event to subscribe, or NULL to subscribe
+			     to all events */
+	bool decode_state_changed; /*!< Decode `state_changed` events of the
+				      subscription into `state_changed` of
+				      messages */
+	int *subscription; /*!< If not NULL, set to the ID of the subscription,
+			      which esp_hass_client_unsubscribe_events()
+			      takes */
+} esp_hass_subscribe_config_t;
+
+/**
+ * ID of an event passed to message handlers, for messages whose type is
+ * unknown. The ID of other messages is their type, i.e.
+ * HASS_MESSAGE_TYPE_PONG, or the ID of their `event_type`.
+ */
+#define ESP_HASS_EVENT_ID_UNKNOWN ((int32_t)HASS_MESSAGE_TYPE_MAX)
+
+/**
+ * ID of the first registered `event_type`. An event message whose
+ * `event_type` is not registered has the ID HASS_MESSAGE_TYPE_EVENT. See
+ * esp_hass_client_get_event_id().
+ */
+#define ESP_HASS_EVENT_ID_EVENT_TYPE_BASE ((int32_t)0x100)
+
+/**
+ * ID of `state_changed` events, which is always registered.
+ */
+#define ESP_HASS_EVENT_ID_STATE_CHANGED (ESP_HASS_EVENT_ID_EVENT_TYPE_BASE + 0)
+
+/**
+ * ID of `call_service` events, which is always registered.
+ */
+#define ESP_HASS_EVENT_ID_CALL_SERVICE (ESP_HASS_EVENT_ID_EVENT_TYPE_BASE + 1)
+
+/**
+ * A macro to initialize esp_hass_subscribe_config_t with defaults.
+ */
+#define ESP_HASS_SUBSCRIBE_CONFIG_DEFAULT()                        \
+	{                                                          \
+		.event_type = NULL, .decode_state_changed = false, \
+		.subscription = NULL,                              \
 	}
 
 /**
@@ -155,11 +371,81 @@ typedef struct {
 		.delay = portMAX_DELAY,                             \
 	}
 
+/**
+ * Maximum number of messages passed to a batch handler at once.
+ */
+#define ESP_HASS_BATCH_MAX_MESSAGES (32)
+
+/**
+ * A handler that is called with messages in batches. `args` is
+ * `esp_hass_client_handle_t`, and `msgs` are `n` messages in the order they
+ * were received.
+ */
+typedef void (*esp_hass_batch_handler_t)(void *args,
+    esp_hass_message_t *const *msgs, size_t n);
+
+/**
+ * esp_hass_batch_handler_register() configuration.
+ */
+typedef struct {
+	int32_t event_id;     /*!< The ID of messages, or ESP_EVENT_ANY_ID */
+	size_t max_messages;  /*!< Number of messages to call the handler
+				 with, up to ESP_HASS_BATCH_MAX_MESSAGES */
+	uint32_t max_wait_ms; /*!< Milliseconds that a message waits at most
+				 for others. With 0, the handler is called
+				 with the messages received at once */
+} esp_hass_batch_config_t;
+
+/**
+ * A macro to initialize esp_hass_batch_config_t with defaults.
+ */
+#define ESP_HASS_BATCH_CONFIG_DEFAULT()                      \
+	{                                                    \
+		.event_id = ESP_EVENT_ANY_ID,                \
+		.max_messages = ESP_HASS_BATCH_MAX_MESSAGES, \
+		.max_wait_ms = 0,                            \
+	}
+
+/**
+ * A handler of the result of a command, sent with
+ * esp_hass_send_command_async(). `args` is passed to
+ * esp_hass_send_command_async(), `id` is the ID of the command, and `msg` is
+ * the result, which is released after the handler returns.
+ */
+typedef void (*esp_hass_result_handler_t)(void *args, int id,
+    esp_hass_message_t *msg);
+
+/**
+ * Maximum length of the error message of a result, including the terminating
+ * null.
+ */
+#define ESP_HASS_ERROR_MESSAGE_MAX_LEN (64)
+
+/**
+ * The outcome of a command sent in a pipeline.
+ */
+typedef struct {
+	int id;	       /*!< The ID of the command, or 0 if it is not sent */
+	esp_err_t err; /*!< ESP_OK if successful, ESP_FAIL if the server has
+			  returned failure, or the error of sending the
+			  command, or of waiting for the result */
+	char error_message[ESP_HASS_ERROR_MESSAGE_MAX_LEN]; /*!< `message` of
+							       `error` in the
+							       result, if any
+							     */
+} esp_hass_command_result_t;
+
 /**
  * The esp_hass client handle
  */
 typedef struct esp_hass_client *esp_hass_client_handle_t;
 
+/**
+ * A handle of a command that has been serialized once, and is sent many
+ * times. See esp_hass_prepare_call_service().
+ */
+typedef struct esp_hass_prepared_command *esp_hass_prepared_command_handle_t;
+
 /**
  * @brief Initilize hass client. This function should be called before any
  * `esp_hass_*` function.
@@ -209,11 +495,14 @@ esp_err_t esp_hass_client_stop(esp_hass_client_handle_t client);
  * @brief Sending ping request. See:
  * https://developers.home-assistant.io/docs/api/websocket#pings-and-pongs
  *
+ * The request is queued as esp_hass_send_message_json() queues a message.
+ *
  * @param[in] client The hass client.
  *
  * @return
- *	- ESP_OK if successful
- *	- ESP_FAIL if failed
+ *	- ESP_OK if the request has been queued
+ *	- ESP_ERR_TIMEOUT if the request is not queued for sending in
+ *	  `command_send_timeout_sec`
  */
 esp_err_t esp_hass_client_ping(esp_hass_client_handle_t client);
 
@@ -244,6 +533,61 @@ esp_err_t esp_hass_client_auth(esp_hass_client_handle_t client);
 esp_err_t esp_hass_client_subscribe_events(esp_hass_client_handle_t client,
     char *event_type);
 
+/**
+ * @brief Subscribe to events with a configuration.
+ *
+ * With `decode_state_changed`, `state_changed` events of the subscription
+ * are decoded before they are passed to handlers, and handlers read the
+ * fields of `state_changed` of the message instead of looking up the JSON.
+ *
+ * `event_type` is registered so that handlers can be registered with its
+ * ID. See esp_hass_client_get_event_id().
+ *
+ * @param[in] client The hass client
+ * @param[in] config The configuration
+ *
+ * @return
+ *   - ESP_OK if successful
+ *   - ESP_ERR_INVALID_ARG if client or config is NULL
+ *   - ESP_ERR_NO_MEM if too many subscriptions decode `state_changed`
+ *   - ESP_FAIL if failed
+ */
+esp_err_t esp_hass_client_subscribe_events_with_config(
+    esp_hass_client_handle_t client, const esp_hass_subscribe_config_t *config);
+
+/**
+ * @brief Unsubscribe from events.
+ *
+ * @param[in] client The hass client
+ * @param[in] subscription The ID of the subscription. See `subscription` of
+ * esp_hass_subscribe_config_t.
+ *
+ * @return
+ *   - ESP_OK if successful
+ *   - ESP_ERR_INVALID_ARG if an argument is invalid
+ *   - ESP_FAIL if failed
+ */
+esp_err_t esp_hass_client_unsubscribe_events(esp_hass_client_handle_t client,
+    int subscription);
+
+/**
+ * @brief Fire an event, and wait for the result.
+ *
+ * @param[in] client The hass client
+ * @param[in] event_type The type of the event
+ * @param[in] event_data The data of the event as a JSON object, such as
+ * `{"button":1}`, or NULL. The text is sent as is.
+ *
+ * @return
+ *   - ESP_OK if successful
+ *   - ESP_ERR_INVALID_ARG if an argument is invalid
+ *   - ESP_ERR_INVALID_SIZE if the command is larger than
+ *     CONFIG_ESP_HASS_TX_BUFFER_SIZE
+ *   - ESP_FAIL if failed
+ */
+esp_err_t esp_hass_fire_event(esp_hass_client_handle_t client,
+    const char *event_type, const char *event_data);
+
 /**
  * @brief See if WebSocket is connected.
  *
@@ -265,15 +609,317 @@ bool esp_hass_client_is_connected(esp_hass_client_handle_t client);
 bool esp_hass_client_is_authenticated(esp_hass_client_handle_t client);
 
 /**
- * @brief Destroy `esp_hass_message_t`, free() the memory allocated for the
+ * @brief Destroy `esp_hass_message_t`, i.e. release the reference to the
  * message. Must be called after receiving a message from the queue, and done
- * with the message.
+ * with the message. The message is freed when no other references remain.
  *
  * @return
  * - ESP_OK if success
  */
 esp_err_t esp_hass_message_destroy(esp_hass_message_t *msg);
 
+/**
+ * @brief Take a reference to a message so that the message is not freed
+ * until the reference is released with esp_hass_message_release().
+ *
+ * A message handler calls this function to keep a message after the handler
+ * returns, i.e. to pass the message to another task. Without a reference,
+ * `event_data` passed to handlers is valid only while the handler runs.
+ *
+ * @param[in] msg The message, or a copy of the message.
+ *
+ * @return
+ * - The message, which is valid until the reference is released
+ * - NULL if msg is NULL
+ */
+esp_hass_message_t *esp_hass_message_retain(esp_hass_message_t *msg);
+
+/**
+ * @brief Release a reference to a message. The message is freed when the
+ * last reference is released.
+ *
+ * @param[in] msg The message, or a copy of the message.
+ */
+void esp_hass_message_release(esp_hass_message_t *msg);
+
+/**
+ * @brief Create a ring, a bounded lock-free queue of pointers.
+ *
+ * Tasks send, and receive pointers without a lock. A task that waits for a
+ * pointer, or for space, blocks on a semaphore, which is given only while
+ * a task waits. A ring can be used in place of `result_queue`, and
+ * `event_queue` of esp_hass_config_t.
+ *
+ * @param[in] capacity Number of pointers, which is rounded up to a power of
+ * two, and at least 2.
+ *
+ * @return
+ * - The ring
+ * - NULL if capacity is out of range, or out of memory
+ */
+esp_hass_ring_handle_t esp_hass_ring_create(size_t capacity);
+
+/**
+ * @brief Delete a ring. Pointers in the ring are not freed.
+ *
+ * @param[in] ring The ring.
+ */
+void esp_hass_ring_delete(esp_hass_ring_handle_t ring);
+
+/**
+ * @brief Send a pointer to a ring.
+ *
+ * @param[in] ring The ring.
+ * @param[in] item The pointer.
+ * @param[in] ticks Ticks to wait for space when the ring is full.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if ring is NULL
+ * - ESP_ERR_TIMEOUT if the ring is full
+ */
+esp_err_t esp_hass_ring_send(esp_hass_ring_handle_t ring, void *item,
+    TickType_t ticks);
+
+/**
+ * @brief Receive a pointer from a ring.
+ *
+ * @param[in] ring The ring.
+ * @param[out] item The pointer.
+ * @param[in] ticks Ticks to wait for a pointer when the ring is empty.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if ring, or item is NULL
+ * - ESP_ERR_TIMEOUT if the ring is empty
+ */
+esp_err_t esp_hass_ring_receive(esp_hass_ring_handle_t ring, void **item,
+    TickType_t ticks);
+
+/**
+ * @brief Receive pointers from a ring. Waits for the first pointer, and
+ * takes the pointers in the ring without waiting, up to max.
+ *
+ * @param[in] ring The ring.
+ * @param[out] items The pointers.
+ * @param[in] max Maximum number of pointers.
+ * @param[out] n Number of pointers received.
+ * @param[in] ticks Ticks to wait for a pointer when the ring is empty.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is NULL, or max is zero
+ * - ESP_ERR_TIMEOUT if the ring is empty
+ */
+esp_err_t esp_hass_ring_receive_batch(esp_hass_ring_handle_t ring,
+    void **items, size_t max, size_t *n, TickType_t ticks);
+
+/**
+ * @brief Get the name of a message type, i.e. the value of `type` field.
+ *
+ * @param[in] type The message type.
+ *
+ * @return
+ * - The name, i.e. `call_service` for HASS_MESSAGE_TYPE_CALL_SERVICE
+ * - NULL if type is invalid
+ */
+const char *esp_hass_message_type_to_string(esp_hass_message_type_t type);
+
+/**
+ * @brief Get the message type from a name.
+ *
+ * @param[in] type The name, which does not have to be null-terminated.
+ * @param[in] len Length of `type`.
+ *
+ * @return
+ * - The message type
+ * - HASS_MESSAGE_TYPE_UNKNOWN if the name is unknown
+ */
+esp_hass_message_type_t esp_hass_message_type_from_string(const char *type,
+    size_t len);
+
+/**
+ * @brief Get the JSON of a message.
+ *
+ * `type`, `id`, `success`, and `event_type` of a message are available
+ * without parsing the message. With CONFIG_ESP_HASS_LAZY_PARSER, the rest of
+ * the message is parsed when this function is called for the first time.
+ * The parsed JSON is shared by copies of the message, and is freed when the
+ * message is freed.
+ *
+ * A message must not be accessed by multiple tasks at the same time, as
+ * parsing writes to it. A message that is passed to both a batch handler
+ * and a worker has been parsed before, so that calling this function from
+ * them only reads it.
+ *
+ * The JSON must not be modified, nor its items be deleted, because, with
+ * CONFIG_ESP_HASS_ARENA, the items are not allocated by cJSON.
+ *
+ * @param[in] msg The message.
+ *
+ * @return
+ * - Pointer to cJSON struct of the message. Do not free it.
+ * - NULL if msg is NULL, or the message is not a valid JSON.
+ */
+cJSON *esp_hass_message_get_json(esp_hass_message_t *msg);
+
+/**
+ * @brief Get a field projected from a message.
+ *
+ * A path registered with `projection_paths` of `esp_hass_config_t` is a
+ * list of object keys separated by `.`. Received messages are scanned for
+ * the paths, and the values are copied to `projection` of the message
+ * without parsing the rest of the message. A handler that only needs
+ * these fields does not have to call esp_hass_message_get_json().
+ *
+ * @param[in] msg The message, or a copy of it.
+ * @param[in] index Index of the path in `projection_paths`.
+ *
+ * @return
+ * - Pointer to the field
+ * - NULL if msg is NULL, index is out of range, or the path is not in the
+ *   message
+ */
+const esp_hass_field_t *esp_hass_message_get_field(
+    const esp_hass_message_t *msg, size_t index);
+
+/**
+ * @brief Get the decoded `state_changed` event of a message.
+ *
+ * @param[in] msg The message, or a copy of it.
+ *
+ * @return
+ * - Pointer to the event
+ * - NULL if msg is NULL, or the message has not been decoded
+ */
+const esp_hass_state_changed_t *esp_hass_message_get_state_changed(
+    const esp_hass_message_t *msg);
+
+/**
+ * @brief Get the entity of an `entity_id`, which is added to the table of
+ * entities if it is not there yet. The entity does not change while the
+ * client exists.
+ *
+ * @param[in] client The hass client
+ * @param[in] entity_id The `entity_id`, such as `light.kitchen`
+ * @param[out] entity The entity
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is NULL
+ * - ESP_ERR_NO_MEM if the table is full, see
+ *   CONFIG_ESP_HASS_ENTITY_TABLE_SIZE
+ */
+esp_err_t esp_hass_client_get_entity(esp_hass_client_handle_t client,
+    const char *entity_id, esp_hass_entity_t *entity);
+
+/**
+ * @brief Get the `entity_id` of an entity.
+ *
+ * @param[in] client The hass client
+ * @param[in] entity The entity
+ *
+ * @return
+ * - The `entity_id`
+ * - NULL if the entity is unknown
+ */
+const char *esp_hass_client_get_entity_id(esp_hass_client_handle_t client,
+    esp_hass_entity_t entity);
+
+/**
+ * @brief Get the ID of an `event_type`, which is registered if it is not
+ * registered yet. Message handlers registered with the ID are called with
+ * events of the type only. The ID does not change while the client exists.
+ *
+ * The `event_type` of a subscription is registered by
+ * esp_hass_client_subscribe_events_with_config().
+ *
+ * @param[in] client The hass client
+ * @param[in] event_type The `event_type`, such as `automation_triggered`
+ * @param[out] event_id The ID
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is NULL
+ * - ESP_ERR_NO_MEM if too many types are registered
+ */
+esp_err_t esp_hass_client_get_event_id(esp_hass_client_handle_t client,
+    const char *event_type, int32_t *event_id);
+
+/**
+ * Usage of arenas, the memory blocks that parsed messages are allocated from
+ * with CONFIG_ESP_HASS_ARENA.
+ */
+typedef struct {
+	size_t last; /*!< Bytes used by the last parsed message */
+	size_t peak; /*!< Maximum bytes used by a message */
+	uint32_t messages;  /*!< Number of messages parsed */
+	uint32_t overflows; /*!< Number of messages that did not fit in
+			       CONFIG_ESP_HASS_ARENA_BLOCK_SIZE */
+} esp_hass_arena_stats_t;
+
+/**
+ * @brief Get the usage of arenas, which helps to tune
+ * CONFIG_ESP_HASS_ARENA_BLOCK_SIZE.
+ *
+ * @param[out] stats The usage.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_hass_get_arena_stats(esp_hass_arena_stats_t *stats);
+
+/**
+ * Usage of the message pool of a client.
+ */
+typedef struct {
+	uint32_t capacity;  /*!< Number of messages in the pool,
+			       CONFIG_ESP_HASS_MESSAGE_POOL_SIZE */
+	uint32_t exhausted; /*!< Number of messages that found the pool
+			       empty. Events are dropped, and other messages
+			       are allocated */
+} esp_hass_message_pool_stats_t;
+
+/**
+ * @brief Get the usage of the message pool, which helps to tune
+ * CONFIG_ESP_HASS_MESSAGE_POOL_SIZE.
+ *
+ * @param[in] client The hass client
+ * @param[out] stats The usage.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if client or stats is NULL
+ */
+esp_err_t esp_hass_client_get_message_pool_stats(
+    esp_hass_client_handle_t client, esp_hass_message_pool_stats_t *stats);
+
+/**
+ * Events that the client did not pass to handlers as they were received.
+ */
+typedef struct {
+	uint32_t dropped;   /*!< Number of events dropped because the event
+			       lane was full */
+	uint32_t coalesced; /*!< Number of `state_changed` events replaced by
+			       newer ones of the same entity */
+} esp_hass_overload_stats_t;
+
+/**
+ * @brief Get the number of events dropped, or coalesced by the overload
+ * policy, which helps to tune the size of the event lane, and
+ * `overload_policy`.
+ *
+ * @param[in] client The hass client
+ * @param[out] stats The counters.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if client or stats is NULL
+ */
+esp_err_t esp_hass_client_get_overload_stats(esp_hass_client_handle_t client,
+    esp_hass_overload_stats_t *stats);
+
 /**
  * @brief Get Home Assistant version. The version is only available after
  * authentication attempt.
@@ -285,13 +931,26 @@ esp_err_t esp_hass_message_destroy(esp_hass_message_t *msg);
 char *esp_hass_client_get_ha_version(esp_hass_client_handle_t client);
 
 /**
- * @brief Send a JSON message.
+ * @brief Send a JSON message with a new ID without waiting for the result.
+ *
+ * The message is queued, and esp_hass_task_tx sends it, so that ESP_OK means
+ * that the message has been queued, not that it has been sent. When the
+ * message fails to be sent, it is dropped, and the error is only logged with
+ * the ID; no result is passed to `result_queue`, and a task waiting for the
+ * result times out. Use esp_hass_send_command_async() to be notified of
+ * the failure.
  *
  * @param[in] client The hass client
- * @param[in] json cJSON object
+ * @param[in] json cJSON object, without `id`
  *
  * @return
- * - ESP_OK if success
+ * - ESP_OK if the message has been queued
+ * - ESP_ERR_INVALID_ARG if client, or json is NULL
+ * - ESP_ERR_NO_MEM if the message is larger than
+ *   CONFIG_ESP_HASS_TX_BUFFER_SIZE, and out of memory
+ * - ESP_ERR_TIMEOUT if the message is not queued for sending in
+ *   `command_send_timeout_sec`
+ * - ESP_FAIL if the ID is not added to the message
  */
 esp_err_t esp_hass_send_message_json(esp_hass_client_handle_t client,
     cJSON *json);
@@ -308,6 +967,170 @@ esp_err_t esp_hass_send_message_json(esp_hass_client_handle_t client,
 esp_err_t esp_hass_call_service(esp_hass_client_handle_t client,
     esp_hass_call_service_config_t *config);
 
+/**
+ * @brief Send a command without waiting for the result. The command is given
+ * an ID, and added to the table of pending commands, so that many commands
+ * can be in flight at once.
+ *
+ * The command is queued, and esp_hass_task_tx sends it, so that the caller
+ * never waits for the network. When the command fails to be sent, the result
+ * is a failure whose error code is `send_failed`.
+ *
+ * When the result is received, the websocket task calls `callback` with the
+ * result. The callback must not block. When `callback` is NULL, wait for the
+ * result with esp_hass_wait_result().
+ *
+ * @param[in] client The hass client
+ * @param[in] json cJSON object of the command, without `id`
+ * @param[in] callback The handler of the result, or NULL
+ * @param[in] args Passed to callback
+ * @param[out] id The ID of the command, or NULL
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if client, or json is NULL
+ * - ESP_ERR_NO_MEM if too many commands are in flight,
+ *   CONFIG_ESP_HASS_PENDING_COMMANDS_MAX, or if the command is larger than
+ *   CONFIG_ESP_HASS_TX_BUFFER_SIZE, and out of memory
+ * - ESP_ERR_TIMEOUT if the command is not queued for sending in
+ *   `command_send_timeout_sec`
+ */
+esp_err_t esp_hass_send_command_async(esp_hass_client_handle_t client,
+    cJSON *json, esp_hass_result_handler_t callback, void *args, int *id);
+
+/**
+ * @brief Call a service without waiting for the result. See
+ * esp_hass_send_command_async().
+ *
+ * @param[in] client The hass client
+ * @param[in] config esp_hass_call_service_config_t. `delay` is not used.
+ * @param[in] callback The handler of the result, or NULL
+ * @param[in] args Passed to callback
+ * @param[out] id The ID of the command, or NULL
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if client, or config is NULL
+ * - ESP_ERR_NO_MEM if too many commands are in flight
+ * - ESP_ERR_TIMEOUT if the command is not queued for sending in
+ *   `command_send_timeout_sec`
+ */
+esp_err_t esp_hass_call_service_async(esp_hass_client_handle_t client,
+    const esp_hass_call_service_config_t *config,
+    esp_hass_result_handler_t callback, void *args, int *id);
+
+/**
+ * @brief Call services in a pipeline. The commands are written back to back
+ * without waiting for results, as many as CONFIG_ESP_HASS_PENDING_COMMANDS_MAX
+ * at once, and the results are gathered as they come back. Calling N
+ * services takes about one round trip instead of N.
+ *
+ * Each result waits for `result_recv_timeout_sec` of esp_hass_config_t;
+ * `delay` of the configurations is not used.
+ *
+ * @param[in] client The hass client
+ * @param[in] configs Configurations of the services
+ * @param[in] n Number of services
+ * @param[out] results The outcome of each service, in the order of configs
+ *
+ * @return
+ * - ESP_OK if all the services are called successfully
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ * - ESP_FAIL if any service has failed. See results
+ */
+esp_err_t esp_hass_call_services(esp_hass_client_handle_t client,
+    const esp_hass_call_service_config_t *configs, size_t n,
+    esp_hass_command_result_t *results);
+
+/**
+ * @brief Serialize a call_service command once, for commands that are sent
+ * many times, such as the command of a button. Sending the prepared command
+ * only writes the ID, and copies the prepared text, which keeps the latency
+ * from a trigger to the wire low.
+ *
+ * The strings of the configuration are copied, and `delay` is not used.
+ *
+ * @param[in] client The hass client
+ * @param[in] config The configuration of the service
+ * @param[out] prepared The prepared command. Delete it with
+ * esp_hass_prepared_command_delete() when it is no longer used.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ * - ESP_ERR_INVALID_SIZE if the command, with the longest ID, is larger
+ *   than CONFIG_ESP_HASS_TX_BUFFER_SIZE
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_prepare_call_service(esp_hass_client_handle_t client,
+    const esp_hass_call_service_config_t *config,
+    esp_hass_prepared_command_handle_t *prepared);
+
+/**
+ * @brief Send a prepared command with a new ID without waiting for the result.
+ * The result is passed to `callback`, or to esp_hass_wait_result() when
+ * `callback` is NULL.
+ *
+ * @param[in] client The hass client
+ * @param[in] prepared The prepared command
+ * @param[in] callback The handler of the result, or NULL
+ * @param[in] args Passed to the handler
+ * @param[out] id The ID of the command, or NULL
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ * - ESP_ERR_NO_MEM if too many commands are in flight
+ * - ESP_ERR_TIMEOUT if the command is not queued for sending in
+ *   `command_send_timeout_sec`
+ */
+esp_err_t esp_hass_prepared_command_send(esp_hass_client_handle_t client,
+    esp_hass_prepared_command_handle_t prepared,
+    esp_hass_result_handler_t callback, void *args, int *id);
+
+/**
+ * @brief Delete a prepared command.
+ *
+ * @param[in] prepared The prepared command, or NULL
+ */
+void esp_hass_prepared_command_delete(
+    esp_hass_prepared_command_handle_t prepared);
+
+/**
+ * @brief Wait for the result of a command sent without a callback. The
+ * command is removed from the table of pending commands unless the result is
+ * not for the command. Release the result with esp_hass_message_release().
+ *
+ * @param[in] client The hass client
+ * @param[in] id The ID of the command
+ * @param[out] msg The result
+ * @param[in] ticks Ticks to wait for the result
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid, or the command has a
+ *   callback
+ * - ESP_ERR_NOT_FOUND if the command is not pending
+ * - ESP_ERR_TIMEOUT if the result has not been received
+ */
+esp_err_t esp_hass_wait_result(esp_hass_client_handle_t client, int id,
+    esp_hass_message_t **msg, TickType_t ticks);
+
+/**
+ * @brief Remove a command whose result is no longer needed, e.g. after the
+ * connection is lost. No task must wait for the result.
+ *
+ * @param[in] client The hass client
+ * @param[in] id The ID of the command
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if client is NULL
+ * - ESP_ERR_NOT_FOUND if the command is not pending, or its callback is
+ *   being called
+ */
+esp_err_t esp_hass_command_cancel(esp_hass_client_handle_t client, int id);
+
 /**
  * @brief Register an event message handler function.
  *
@@ -322,32 +1145,118 @@ esp_err_t esp_hass_call_service(esp_hass_client_handle_t client,
  * *event_data);
  *
  * `args` is `esp_hass_client_handle_t`. `base` is the base event, and `id` is
- * event id, and `event_data` is `esp_hass_message_t *`.
+ * event id, and `event_data` is `esp_hass_message_t *`, the received message
+ * itself, not a copy. The handler must not destroy the message.
+ *
+ * The event ID is the message type, i.e. HASS_MESSAGE_TYPE_PONG, or, for an
+ * event message, the ID of its `event_type`, i.e.
+ * ESP_HASS_EVENT_ID_STATE_CHANGED. The handler is called with all the
+ * messages. See esp_hass_event_handler_register_with_id() to receive some of
+ * them.
  *
  * The handler is called by `esp_hass_task_event_source` task, which keeps
- * feeding messages into the handler.
+ * feeding messages into the handler, one message at a time. The handlers run
+ * on the stack of the task, CONFIG_ESP_HASS_TASK_EVENT_SOURCE_STACK_SIZE, and
+ * a handler that blocks delays the following messages.
  *
- * The handler should call `esp_hass_message_semaphore_give()` when the passed
- * message is no longer needed.
+ * The message is released after all the handlers have returned. A handler
+ * that keeps the message longer must take a reference with
+ * `esp_hass_message_retain()`, and release it with
+ * `esp_hass_message_release()`.
  *
  * @param[in] client The hass client.
  * @param[in] callback A callback function
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if client or callback is NULL
+ * - ESP_ERR_NO_MEM if too many handlers are registered
  */
 esp_err_t esp_hass_event_handler_register(esp_hass_client_handle_t client,
     esp_event_handler_t callback);
 
 /**
- * @brief Give semaphore to release message from message handler.
+ * @brief Register a message handler that is called with the messages of an
+ * event ID only. Other handlers are not called with messages that they have
+ * not registered for.
+ *
+ * @param[in] client The hass client.
+ * @param[in] event_id The message type, i.e. HASS_MESSAGE_TYPE_RESULT, the ID
+ * of an `event_type`, i.e. ESP_HASS_EVENT_ID_STATE_CHANGED, or
+ * ESP_EVENT_ANY_ID for all the messages.
+ * @param[in] callback A callback function
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if client or callback is NULL
+ * - ESP_ERR_NO_MEM if too many handlers are registered
+ */
+esp_err_t esp_hass_event_handler_register_with_id(
+    esp_hass_client_handle_t client, int32_t event_id,
+    esp_event_handler_t callback);
+
+/**
+ * @brief Register a message handler that is called with the events of an
+ * entity only, i.e. events whose `event.data.entity_id` is `entity_id`.
+ *
+ * The entity of an event is looked up once, whether one, or many, handlers
+ * are registered, and only the handlers of the entity are called. Handlers
+ * of an entity are called in the order of registration, after the handlers
+ * registered with esp_hass_event_handler_register(). Events with multiple
+ * `entity_id` are not passed to entity handlers.
+ *
+ * @param[in] client The hass client.
+ * @param[in] entity_id The `entity_id`, such as `light.kitchen`
+ * @param[in] callback A callback function
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is NULL
+ * - ESP_ERR_NO_MEM if too many handlers are registered, or the table of
+ *   entities is full, see CONFIG_ESP_HASS_ENTITY_TABLE_SIZE
+ */
+esp_err_t esp_hass_entity_handler_register(esp_hass_client_handle_t client,
+    const char *entity_id, esp_event_handler_t callback);
+
+/**
+ * @brief Register a handler that is called with messages in batches.
+ *
+ * `esp_hass_task_event_source` takes references of the messages of
+ * `event_id`, and calls the handler once with up to `max_messages` of them,
+ * when `max_messages` are pending, or when the first pending message has
+ * waited for `max_wait_ms`. A handler that redraws a display, or writes to
+ * the flash, once for a batch does less work than once for each message.
+ *
+ * The handler is called by `esp_hass_task_event_source` even when there are
+ * workers. The messages are released after the handler has returned.
+ *
+ * When there are workers, a worker may handle a message while the message
+ * is in a batch. Such messages are parsed before they are shared, so that
+ * esp_hass_message_get_json() is safe to call from both. The handler must
+ * not change the messages otherwise.
+ *
+ * @param[in] client The hass client.
+ * @param[in] config The configuration.
+ * @param[in] callback A callback function
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ * - ESP_ERR_NO_MEM if too many batch handlers are registered
+ */
+esp_err_t esp_hass_batch_handler_register(esp_hass_client_handle_t client,
+    const esp_hass_batch_config_t *config, esp_hass_batch_handler_t callback);
+
+/**
+ * @brief Does nothing. Messages are released after handlers return, and
+ * handlers no longer have to signal that they are done with a message.
  *
- * Use this function when the message can be destroyed with
- * esp_hass_message_destroy, usually at the end of the message handler.
- * After the call, the message given to the handler is destroyed by another
- * task.
+ * @deprecated Use esp_hass_message_retain() to keep a message instead.
  *
  * @param[in] client The hass client.
  *
  * @return
- * - pdTRUE if releasing semaphore succeeds, otherwise pdFALSE
+ * - pdTRUE
  */
 BaseType_t esp_hass_message_semaphore_give(esp_hass_client_handle_t client);
 
@@ -0,0 +1,198 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <stdalign.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN (alignof(max_align_t))
+#define ARENA_ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_HEADER_SIZE ARENA_ALIGN_UP(sizeof(esp_hass_arena_block_t))
+
+static const char *TAG = "esp_hass:arena";
+
+static esp_hass_arena_stats_t stats = { 0 };
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static char *
+block_data(esp_hass_arena_block_t *block)
+{
+	return (char *)block + ARENA_HEADER_SIZE;
+}
+
+/* chain a block that has at least `size` bytes */
+static esp_err_t
+arena_grow(esp_hass_arena_t *arena, size_t size)
+{
+	esp_hass_arena_block_t *block = NULL;
+	size_t block_size;
+
+	block_size = arena->head == NULL ? arena->block_size :
+						 arena->head->size * 2;
+	if (block_size < size) {
+		block_size = size;
+	}
+	block = heap_caps_malloc(ARENA_HEADER_SIZE + block_size, arena->caps);
+	if (block == NULL) {
+		ESP_LOGE(TAG, "heap_caps_malloc(): Out of memory: %u bytes",
+		    (unsigned int)(ARENA_HEADER_SIZE + block_size));
+		return ESP_ERR_NO_MEM;
+	}
+	block->next = arena->head;
+	block->size = block_size;
+	block->used = 0;
+	arena->head = block;
+	arena->blocks++;
+	return ESP_OK;
+}
+
+/* hand out `size` bytes at `align` from the current block */
+static void *
+arena_alloc(esp_hass_arena_t *arena, size_t size, size_t align)
+{
+	size_t offset = 0;
+	void *ptr = NULL;
+
+	if (arena->head != NULL) {
+		offset = (arena->head->used + align - 1) & ~(align - 1);
+	}
+	if (arena->head == NULL || offset + size > arena->head->size) {
+		if (arena_grow(arena, size) != ESP_OK) {
+			return NULL;
+		}
+		offset = 0;
+	}
+	ptr = block_data(arena->head) + offset;
+	arena->used += offset + size - arena->head->used;
+	arena->head->used = offset + size;
+	return ptr;
+}
+
+esp_err_t
+esp_hass_arena_init(esp_hass_arena_t *arena, size_t block_size,
+    uint32_t caps)
+{
+	if (arena == NULL || block_size == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	arena->head = NULL;
+	arena->block_size = ARENA_ALIGN_UP(block_size);
+	arena->used = 0;
+	arena->blocks = 0;
+	arena->caps = caps;
+	return ESP_OK;
+}
+
+void *
+esp_hass_arena_alloc(esp_hass_arena_t *arena, size_t size)
+{
+	return arena_alloc(arena, size, ARENA_ALIGN);
+}
+
+char *
+esp_hass_arena_strndup(esp_hass_arena_t *arena, const char *str,
+    size_t len)
+{
+	char *copy = NULL;
+
+	copy = arena_alloc(arena, len + 1, 1);
+	if (copy == NULL) {
+		return NULL;
+	}
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+void
+esp_hass_arena_free(esp_hass_arena_t *arena)
+{
+	esp_hass_arena_block_t *block = NULL;
+
+	if (arena == NULL) {
+		return;
+	}
+	while (arena->head != NULL) {
+		block = arena->head;
+		arena->head = block->next;
+		heap_caps_free(block);
+	}
+	arena->used = 0;
+	arena->blocks = 0;
+}
+
+void
+esp_hass_arena_move(esp_hass_arena_t *dst, esp_hass_arena_t *src)
+{
+	esp_hass_arena_block_t *last = NULL;
+
+	if (dst->head == NULL) {
+		*dst = *src;
+	} else if (src->head != NULL) {
+
+		/* chain the blocks of dst after those of src so that the
+		 * current block of src stays the current one
+		 */
+		last = src->head;
+		while (last->next != NULL) {
+			last = last->next;
+		}
+		last->next = dst->head;
+		dst->head = src->head;
+		dst->used += src->used;
+		dst->blocks += src->blocks;
+	}
+	src->head = NULL;
+	src->used = 0;
+	src->blocks = 0;
+}
+
+void
+esp_hass_arena_record(const esp_hass_arena_t *arena)
+{
+	ESP_LOGD(TAG, "message used %u bytes in %u block(s)",
+	    (unsigned int)arena->used, (unsigned int)arena->blocks);
+	portENTER_CRITICAL(&stats_mux);
+	stats.last = arena->used;
+	if (arena->used > stats.peak) {
+		stats.peak = arena->used;
+	}
+	stats.messages++;
+	if (arena->blocks > 1) {
+		stats.overflows++;
+	}
+	portEXIT_CRITICAL(&stats_mux);
+}
+
+esp_err_t
+esp_hass_get_arena_stats(esp_hass_arena_stats_t *out)
+{
+	if (out == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	portENTER_CRITICAL(&stats_mux);
+	*out = stats;
+	portEXIT_CRITICAL(&stats_mux);
+	return ESP_OK;
+}
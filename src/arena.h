@@ -0,0 +1,125 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __ARENA__H__
+#define __ARENA__H__
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(CONFIG_ESP_HASS_ARENA)
+#define ESP_HASS_ARENA_BLOCK_SIZE CONFIG_ESP_HASS_ARENA_BLOCK_SIZE
+#else
+#define ESP_HASS_ARENA_BLOCK_SIZE (0)
+#endif
+
+/**
+ * A block of an arena. The memory handed out follows the header.
+ */
+typedef struct esp_hass_arena_block {
+	struct esp_hass_arena_block *next; /*!< The previous block */
+	size_t size;			   /*!< Size of the memory in bytes */
+	size_t used; /*!< Bytes handed out from the memory */
+} esp_hass_arena_block_t;
+
+/**
+ * A bump allocator for the nodes of a parsed message. Allocations are not
+ * freed one by one. All of them are released at once when the arena is
+ * freed.
+ *
+ * The arena allocates a block of `block_size` bytes when the first
+ * allocation is requested. When the block is exhausted, another block,
+ * twice as large as the last one, is chained.
+ */
+typedef struct {
+	esp_hass_arena_block_t *head; /*!< The current block */
+	size_t block_size;	      /*!< Size of the first block */
+	size_t used;		      /*!< Bytes handed out in total */
+	uint32_t blocks;	      /*!< Number of blocks */
+	uint32_t caps;		      /*!< Memory capabilities of blocks */
+} esp_hass_arena_t;
+
+/**
+ * @brief Initialize an arena. Memory is not allocated until the first
+ * allocation.
+ *
+ * @param[in] arena The arena.
+ * @param[in] block_size Size of the first block in bytes.
+ * @param[in] caps Memory capabilities passed to heap_caps_malloc().
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if arena is NULL, or block_size is zero
+ */
+esp_err_t esp_hass_arena_init(esp_hass_arena_t *arena, size_t block_size,
+    uint32_t caps);
+
+/**
+ * @brief Allocate memory aligned for any type from the arena.
+ *
+ * @param[in] arena The arena.
+ * @param[in] size Size in bytes.
+ *
+ * @return
+ * - Pointer to the memory, which is not initialized
+ * - NULL if out of memory
+ */
+void *esp_hass_arena_alloc(esp_hass_arena_t *arena, size_t size);
+
+/**
+ * @brief Copy a string to the arena.
+ *
+ * @param[in] arena The arena.
+ * @param[in] str The string, which does not have to be null-terminated.
+ * @param[in] len Length of `str`.
+ *
+ * @return
+ * - Pointer to the null-terminated copy
+ * - NULL if out of memory
+ */
+char *esp_hass_arena_strndup(esp_hass_arena_t *arena, const char *str,
+    size_t len);
+
+/**
+ * @brief Free all the memory allocated from the arena. The arena can be
+ * used again.
+ *
+ * @param[in] arena The arena.
+ */
+void esp_hass_arena_free(esp_hass_arena_t *arena);
+
+/**
+ * @brief Move the memory of an arena to another. `src` is left empty, and
+ * can be used again. When `dst` is not empty, the memory of both is kept in
+ * `dst`.
+ *
+ * @param[out] dst The arena to move to.
+ * @param[in] src The arena to move from.
+ */
+void esp_hass_arena_move(esp_hass_arena_t *dst, esp_hass_arena_t *src);
+
+/**
+ * @brief Record the usage of an arena holding a parsed message in the
+ * statistics returned by esp_hass_get_arena_stats().
+ *
+ * @param[in] arena The arena.
+ */
+void esp_hass_arena_record(const esp_hass_arena_t *arena);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_hass.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+
+#include "batch.h"
+
+esp_err_t
+esp_hass_batch_init(esp_hass_batch_t *batch,
+    const esp_hass_batch_config_t *config, esp_hass_batch_handler_t callback,
+    void *args)
+{
+	if (batch == NULL || config == NULL || callback == NULL ||
+	    config->max_messages == 0 ||
+	    config->max_messages > ESP_HASS_BATCH_MAX_MESSAGES) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(batch, 0, sizeof(*batch));
+	batch->callback = callback;
+	batch->args = args;
+	batch->event_id = config->event_id;
+	batch->max_messages = config->max_messages;
+	batch->max_wait = pdMS_TO_TICKS(config->max_wait_ms);
+	return ESP_OK;
+}
+
+void
+esp_hass_batch_free(esp_hass_batch_t *batch)
+{
+	size_t i;
+
+	if (batch == NULL) {
+		return;
+	}
+	for (i = 0; i < batch->n; i++) {
+		esp_hass_message_release(batch->msgs[i]);
+	}
+	batch->n = 0;
+}
+
+void
+esp_hass_batch_add(esp_hass_batch_t *batch, esp_hass_message_t *msg,
+    int32_t event_id, TickType_t now)
+{
+	if (batch->event_id != ESP_EVENT_ANY_ID &&
+	    batch->event_id != event_id) {
+		return;
+	}
+	if (batch->n == 0) {
+		batch->first_at = now;
+	}
+	batch->msgs[batch->n++] = esp_hass_message_retain(msg);
+	if (batch->n >= batch->max_messages) {
+		esp_hass_batch_flush(batch);
+	}
+}
+
+void
+esp_hass_batch_flush(esp_hass_batch_t *batch)
+{
+	if (batch->n == 0) {
+		return;
+	}
+	batch->callback(batch->args, batch->msgs, batch->n);
+	esp_hass_batch_free(batch);
+}
+
+void
+esp_hass_batch_poll(esp_hass_batch_t *batch, TickType_t now)
+{
+	if (esp_hass_batch_ticks_to_wait(batch, now) == 0) {
+		esp_hass_batch_flush(batch);
+	}
+}
+
+TickType_t
+esp_hass_batch_ticks_to_wait(const esp_hass_batch_t *batch, TickType_t now)
+{
+	TickType_t waited;
+
+	if (batch->n == 0) {
+		return portMAX_DELAY;
+	}
+
+	/* the difference is correct when the tick count wraps around */
+	waited = now - batch->first_at;
+	return waited >= batch->max_wait ? 0 : batch->max_wait - waited;
+}
@@ -0,0 +1,109 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __BATCH__H__
+#define __BATCH__H__
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <freertos/FreeRTOS.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The pending messages of a batch handler. A batch is owned by the task that
+ * dispatches messages, and is not safe to use from other tasks.
+ */
+typedef struct {
+	esp_hass_batch_handler_t callback; /*!< The handler */
+	void *args;			   /*!< Passed to the handler */
+	int32_t event_id;    /*!< The ID of messages, or ESP_EVENT_ANY_ID */
+	size_t max_messages; /*!< Number of messages to call the handler with */
+	TickType_t max_wait; /*!< Ticks that a message waits at most */
+	esp_hass_message_t *msgs[ESP_HASS_BATCH_MAX_MESSAGES]; /*!< Pending
+								  messages */
+	size_t n;	     /*!< Number of pending messages */
+	TickType_t first_at; /*!< When the first pending message was added */
+} esp_hass_batch_t;
+
+/**
+ * @brief Initialize a batch.
+ *
+ * @param[in] batch The batch.
+ * @param[in] config The configuration.
+ * @param[in] callback The handler.
+ * @param[in] args Passed to the handler.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ */
+esp_err_t esp_hass_batch_init(esp_hass_batch_t *batch,
+    const esp_hass_batch_config_t *config, esp_hass_batch_handler_t callback,
+    void *args);
+
+/**
+ * @brief Release the pending messages without calling the handler.
+ *
+ * @param[in] batch The batch.
+ */
+void esp_hass_batch_free(esp_hass_batch_t *batch);
+
+/**
+ * @brief Add a message to a batch if the batch is for the event ID of the
+ * message. The batch takes a reference of the message, and calls the handler
+ * when it is full.
+ *
+ * @param[in] batch The batch.
+ * @param[in] msg The message.
+ * @param[in] event_id The event ID of the message.
+ * @param[in] now The tick count.
+ */
+void esp_hass_batch_add(esp_hass_batch_t *batch, esp_hass_message_t *msg,
+    int32_t event_id, TickType_t now);
+
+/**
+ * @brief Call the handler with the pending messages, and release them.
+ *
+ * @param[in] batch The batch.
+ */
+void esp_hass_batch_flush(esp_hass_batch_t *batch);
+
+/**
+ * @brief Call the handler if the first pending message has waited for
+ * `max_wait`.
+ *
+ * @param[in] batch The batch.
+ * @param[in] now The tick count.
+ */
+void esp_hass_batch_poll(esp_hass_batch_t *batch, TickType_t now);
+
+/**
+ * @brief Get the ticks until the handler is due.
+ *
+ * @param[in] batch The batch.
+ * @param[in] now The tick count.
+ *
+ * @return
+ * - portMAX_DELAY if no message is pending
+ * - Ticks until the first pending message has waited for `max_wait`, or 0
+ */
+TickType_t esp_hass_batch_ticks_to_wait(const esp_hass_batch_t *batch,
+    TickType_t now);
+
+#endif
@@ -31,20 +31,38 @@
 #include <esp_err.h>
 #include <esp_event.h>
 #include <esp_hass.h>
+#include <esp_heap_caps.h>
 #include <esp_log.h>
 #include <esp_tls.h>
 #include <esp_websocket_client.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 
+#include "arena.h"
+#include "batch.h"
+#include "intern.h"
+#include "json_stream.h"
+#include "lane.h"
 #include "parser.h"
+#include "pending.h"
+#include "pool.h"
+#include "ring.h"
+#include "rx_buffer.h"
+#include "tx.h"
+#include "workers.h"
+#include "writer.h"
 
-#define ESP_HASS_RX_BUFFER_SIZE_BYTE (1024 * 10 + 1) // 10KB + NULL
 #define ESP_HASS_QUEUE_SEND_WAIT_MS (1000)
 #define ESP_HASS_VERSION_STRING_MAX_LEN (32)
-#define ESP_HASS_SEMAPHORE_TAKE_TIMEOUT_MS \
-	CONFIG_ESP_HASS_SEMAPHORE_TAKE_TIMEOUT_MS
+#define ESP_HASS_DECODED_SUBSCRIPTIONS_MAX (4)
+#define ESP_HASS_EVENT_HANDLERS_MAX (8)
+#define ESP_HASS_EVENT_TYPES_MAX (32)
+#define ESP_HASS_ENTITY_HANDLERS_MAX (32)
+#define ENTITY_HANDLER_NONE (0xff)
+#define ESP_HASS_EVENT_BATCH_MAX (8)
+#define ESP_HASS_BATCH_HANDLERS_MAX (4)
 
 ESP_EVENT_DEFINE_BASE(HASS_EVENTS);
 
@@ -59,35 +77,261 @@ typedef struct {
 
 } hass_config_storage_t;
 
+/* a handler registered with esp_hass_event_handler_register() */
+typedef struct {
+	esp_event_handler_t callback;
+	void *args;
+	int32_t event_id; /* the ID of messages, or ESP_EVENT_ANY_ID */
+} event_handler_t;
+
+/*
+ * a handler registered with esp_hass_entity_handler_register(). the handlers
+ * of an entity are chained by `next`, from the head of the entity.
+ */
+typedef struct {
+	esp_event_handler_t callback;
+	void *args;
+	_Atomic uint8_t next;
+} entity_handler_t;
+
 struct esp_hass_client {
 	esp_websocket_client_handle_t ws_client_handle;
 	hass_config_storage_t config;
 	TimerHandle_t shutdown_signal_timer;
-	int message_id;
-	char *rx_buffer;
+	_Atomic int message_id;
+#if defined(CONFIG_ESP_HASS_STREAMING_PARSER)
+	esp_hass_json_stream_t json_stream;
+#else
+	esp_hass_rx_buffer_t rx_buffer;
+#endif
+	/* messages may outlive the client in queues of the application, or in
+	 * handlers that retained them, so the pool is freed with the last one.
+	 */
+	esp_hass_pool_t *message_pool;
+
+	/* message_pool->exhausted when the last message was dispatched, which
+	 * tells a dropped event from a message that failed to parse. owned by
+	 * the websocket task.
+	 */
+	uint32_t pool_exhausted;
+	esp_hass_projection_spec_t projection;
+	esp_hass_intern_t entities;
+	esp_hass_intern_t event_types;
+	const char *const *state_changed_attributes;
+	_Atomic int decoded_subscriptions[ESP_HASS_DECODED_SUBSCRIPTIONS_MAX];
 	bool is_authenticated;
 	char ha_version[ESP_HASS_VERSION_STRING_MAX_LEN];
-	cJSON *json;
-	QueueHandle_t event_queue;
+
+	/* commands are written into frames, and sent by esp_hass_task_tx */
+	esp_hass_tx_t tx;
+
+	esp_hass_event_lane_t event_lane;
+
+	/* esp_hass_task_event_source, which gives event_source_stopped when
+	 * it receives the stop item from the lane
+	 */
+	TaskHandle_t event_source_task;
+	SemaphoreHandle_t event_source_stopped;
+	esp_hass_workers_t workers;
+	esp_hass_pending_t pending;
 	QueueHandle_t result_queue;
-	esp_event_loop_handle_t event_loop_handle;
-	SemaphoreHandle_t message_semaphore;
+	esp_hass_ring_handle_t result_ring;
+
+	/* handlers are appended under the lock, and published by n_handlers,
+	 * so that the event source task reads them without the lock.
+	 */
+	event_handler_t handlers[ESP_HASS_EVENT_HANDLERS_MAX];
+	_Atomic int n_handlers;
+	SemaphoreHandle_t handlers_lock;
+
+	/* the first handler of each entity, indexed by the entity */
+	_Atomic uint8_t *entity_handler_heads;
+	entity_handler_t entity_handlers[ESP_HASS_ENTITY_HANDLERS_MAX];
+	_Atomic int n_entity_handlers;
+
+	/* batch handlers, published as handlers are. the pending messages are
+	 * owned by the event source task.
+	 */
+	esp_hass_batch_t batches[ESP_HASS_BATCH_HANDLERS_MAX];
+	_Atomic int n_batches;
 };
 
+/* the pool to take received messages from, or NULL to allocate them */
+static esp_hass_pool_t *
+message_pool(esp_hass_client_handle_t client)
+{
+	return CONFIG_ESP_HASS_MESSAGE_POOL_SIZE > 0 ? client->message_pool :
+							 NULL;
+}
+
 static void
 shutdown_handler(TimerHandle_t xTimer)
 {
 	ESP_LOGW(TAG, "timeout: No data received, shuting down");
 }
 
+/* the ID of the next command */
+static int
+next_message_id(esp_hass_client_handle_t client)
+{
+	return atomic_fetch_add_explicit(&client->message_id, 1,
+		   memory_order_relaxed) +
+	    1;
+}
+
+/* ticks to wait for a command to be sent */
+static TickType_t
+send_ticks(esp_hass_client_handle_t client)
+{
+	return client->config.command_send_timeout_sec * 1000 /
+	    portTICK_PERIOD_MS;
+}
+
+/* send a text. only esp_hass_task_tx sends. */
+static esp_err_t
+send_text(esp_hass_client_handle_t client, const char *text, size_t len)
+{
+	int length;
+
+	length = esp_websocket_client_send_text(client->ws_client_handle, text,
+	    len, send_ticks(client));
+	if (length < 0) {
+		ESP_LOGE(TAG, "esp_websocket_client_send_text(): failed");
+		return ESP_FAIL;
+	} else if ((size_t)length != len) {
+		ESP_LOGE(TAG,
+		    "esp_websocket_client_send_text(): failed: data: %d bytes, data actually sent %d bytes",
+		    (int)len, length);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/* send frames queued since the last call. runs in esp_hass_task_tx. */
+static void
+send_frames(void *context, esp_hass_tx_frame_t *const *frames, size_t n)
+{
+	esp_hass_client_handle_t client = context;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		ESP_LOGD(TAG, "Sending message id: %d", frames[i]->id);
+		if (send_text(client,
+			frames[i]->heap_text != NULL ? frames[i]->heap_text :
+						       frames[i]->text,
+			frames[i]->w.len) == ESP_OK) {
+			continue;
+		}
+		ESP_LOGE(TAG, "message id %d has not been sent",
+		    frames[i]->id);
+
+		/* only a command in the table has a result to fail */
+		if (frames[i]->id != 0) {
+			esp_hass_pending_fail(&client->pending,
+			    frames[i]->id);
+		}
+	}
+}
+
+/*
+ * take a frame to write a message into. take the ID of the message after this
+ * so that messages are queued in the order of their IDs.
+ */
+static esp_hass_tx_frame_t *
+begin_message(esp_hass_client_handle_t client)
+{
+	return esp_hass_tx_begin(&client->tx, send_ticks(client));
+}
+
+/*
+ * queue a command written into `frame`. the command is added to the table of
+ * pending commands so that the result is routed to `callback`, or to
+ * esp_hass_pending_wait(). the frame is returned when the command is not
+ * queued. never waits for the network.
+ */
+static esp_err_t
+send_command(esp_hass_client_handle_t client, esp_hass_tx_frame_t *frame,
+    int id, esp_hass_result_handler_t callback, void *args)
+{
+	esp_err_t err = ESP_FAIL;
+
+	/* the result may arrive before the text has been sent */
+	err = esp_hass_pending_add(&client->pending, id, callback, args);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_pending_add(): %s",
+		    esp_err_to_name(err));
+		esp_hass_tx_abort(&client->tx, frame);
+		return err;
+	}
+	frame->id = id;
+	esp_hass_tx_commit(&client->tx, frame);
+	return ESP_OK;
+}
+
+#if defined(CONFIG_ESP_HASS_COALESCE_MESSAGES)
+static void
+supported_features_result(void *args, int id, esp_hass_message_t *msg)
+{
+	if (msg->success) {
+		ESP_LOGI(TAG, "coalesce_messages enabled");
+	} else {
+		ESP_LOGW(TAG, "supported_features failed");
+	}
+}
+
+/* ask the server to send messages in arrays */
+static esp_err_t
+send_supported_features(esp_hass_client_handle_t client)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_tx_frame_t *frame = NULL;
+	int id;
+
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
+	}
+	id = next_message_id(client);
+	err = esp_hass_write_supported_features(&frame->w, id);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_write_supported_features(): %s",
+		    esp_err_to_name(err));
+		esp_hass_tx_abort(&client->tx, frame);
+		return err;
+	}
+
+	/* the result is not for the caller of any API */
+	return send_command(client, frame, id, supported_features_result,
+	    NULL);
+}
+#endif
+
+/*
+ * send a result to result_ring if any, or result_queue. the websocket task
+ * waits for space for results only so that results never wait behind events.
+ */
+static esp_err_t
+send_result(esp_hass_client_handle_t client, esp_hass_message_t *msg)
+{
+	if (client->result_ring != NULL) {
+		return esp_hass_ring_send(client->result_ring, msg,
+		    ESP_HASS_QUEUE_SEND_WAIT_MS / portTICK_PERIOD_MS);
+	}
+	if (xQueueSend(client->result_queue, &msg,
+		ESP_HASS_QUEUE_SEND_WAIT_MS / portTICK_PERIOD_MS) != pdTRUE) {
+		return ESP_ERR_TIMEOUT;
+	}
+	return ESP_OK;
+}
+
 static void
 message_handler(esp_hass_client_handle_t client, esp_hass_message_t *msg)
 {
 	esp_err_t err = ESP_FAIL;
-	BaseType_t rtos_err = pdFALSE;
+	cJSON *ha_version = NULL;
 
-	assert(client != NULL && msg != NULL && msg->json != NULL);
-	assert(client->result_queue != NULL);
+	assert(client != NULL && msg != NULL);
+	assert(client->result_queue != NULL || client->result_ring != NULL);
 
 	switch (msg->type) {
 
@@ -100,11 +344,15 @@ message_handler(esp_hass_client_handle_t client, esp_hass_message_t *msg)
 	case HASS_MESSAGE_TYPE_AUTH_REQUIRED:
 		client->is_authenticated = false;
 
-		/* ha_version is present in auth-related messages only */
-		if (strlcpy(client->ha_version,
-			cJSON_GetObjectItem(msg->json, "ha_version")
-			    ->valuestring,
-			sizeof(client->ha_version)) >=
+		/* ha_version is present in auth-related messages only. the
+		 * message may not have it, or may fail to be parsed.
+		 */
+		ha_version = cJSON_GetObjectItem(esp_hass_message_get_json(msg),
+		    "ha_version");
+		if (!cJSON_IsString(ha_version)) {
+			ESP_LOGW(TAG, "ha_version not found in response");
+		} else if (strlcpy(client->ha_version, ha_version->valuestring,
+			       sizeof(client->ha_version)) >=
 		    sizeof(client->ha_version)) {
 			ESP_LOGW(TAG, "ha_version in response too long");
 		}
@@ -129,12 +377,24 @@ message_handler(esp_hass_client_handle_t client, esp_hass_message_t *msg)
 			ESP_LOGE(TAG, "esp_hass_message_destroy(): %s",
 			    esp_err_to_name(err));
 		}
+#if defined(CONFIG_ESP_HASS_COALESCE_MESSAGES)
+		err = send_supported_features(client);
+		if (err != ESP_OK) {
+			ESP_LOGW(TAG, "send_supported_features(): %s",
+			    esp_err_to_name(err));
+		}
+#endif
 		break;
 	case HASS_MESSAGE_TYPE_RESULT:
-		rtos_err = xQueueSend(client->result_queue, &msg,
-		    ESP_HASS_QUEUE_SEND_WAIT_MS / portTICK_PERIOD_MS);
-		if (rtos_err != pdTRUE) {
-			ESP_LOGW(TAG, "xQueueSend(): failed");
+
+		/* route the result to the command waiting for it, if any */
+		if (esp_hass_pending_resolve(&client->pending, msg) == ESP_OK) {
+			break;
+		}
+		err = send_result(client, msg);
+		if (err != ESP_OK) {
+			ESP_LOGW(TAG, "send_result(): %s",
+			    esp_err_to_name(err));
 			err = esp_hass_message_destroy(msg);
 			if (err != ESP_OK) {
 				ESP_LOGE(TAG, "esp_hass_message_destroy(): %s",
@@ -145,40 +405,194 @@ message_handler(esp_hass_client_handle_t client, esp_hass_message_t *msg)
 	case HASS_MESSAGE_TYPE_PONG:
 	case HASS_MESSAGE_TYPE_EVENT:
 	default:
-		if (client->event_queue == NULL) {
-			break;
+		/* the lane releases the message when it is dropped */
+		esp_hass_event_lane_send(&client->event_lane, msg);
+	}
+}
+
+/* see if events of a subscription are decoded */
+static bool
+is_decoded_subscription(esp_hass_client_handle_t client, int id)
+{
+	int i;
+
+	for (i = 0; i < ESP_HASS_DECODED_SUBSCRIPTIONS_MAX; i++) {
+		if (id > 0 && atomic_load(&client->decoded_subscriptions[i]) ==
+			id) {
+			return true;
 		}
-		rtos_err = xQueueSend(client->event_queue, &msg,
-		    ESP_HASS_QUEUE_SEND_WAIT_MS / portTICK_PERIOD_MS);
-		if (rtos_err != pdTRUE) {
-			ESP_LOGW(TAG, "xQueueSend(): failed");
-			err = esp_hass_message_destroy(msg);
-			if (err != ESP_OK) {
-				ESP_LOGE(TAG, "esp_hass_message_destroy(): %s",
-				    esp_err_to_name(err));
+	}
+	return false;
+}
+
+/* project the fields of a received message, decode it, and handle it */
+static void
+dispatch_message(esp_hass_client_handle_t client, esp_hass_message_t *msg)
+{
+	uint32_t exhausted;
+
+	exhausted = atomic_load(&client->message_pool->exhausted);
+	if (msg == NULL && exhausted != client->pool_exhausted) {
+		ESP_LOGW(TAG, "message pool exhausted, event dropped");
+	} else if (msg == NULL) {
+		ESP_LOGE(TAG, "failed to parse the message");
+	}
+	client->pool_exhausted = exhausted;
+	if (msg == NULL) {
+		return;
+	}
+	if (client->projection.n_paths > 0 &&
+	    esp_hass_message_project(msg, &client->projection) != ESP_OK) {
+		ESP_LOGW(TAG, "esp_hass_message_project(): failed");
+	}
+	if (msg->type == HASS_MESSAGE_TYPE_EVENT &&
+	    is_decoded_subscription(client, msg->id) &&
+	    esp_hass_message_decode_state_changed(msg, &client->entities,
+		client->state_changed_attributes) == ESP_FAIL) {
+		ESP_LOGW(TAG,
+		    "esp_hass_message_decode_state_changed(): failed");
+	}
+	message_handler(client, msg);
+}
+
+#if defined(CONFIG_ESP_HASS_STREAMING_PARSER)
+/*
+ * dispatch the elements of a coalesced array. the messages are destroyed
+ * independently, so an element in the arena of the array is copied out of
+ * it.
+ */
+static void
+receive_array(esp_hass_client_handle_t client, cJSON *json,
+    esp_hass_arena_t *arena)
+{
+	cJSON *item = NULL;
+	cJSON *copy = NULL;
+
+	while ((item = json->child) != NULL) {
+		cJSON_DetachItemViaPointer(json, item);
+		copy = item;
+		if (arena->head != NULL) {
+			copy = cJSON_Duplicate(item, true);
+			if (copy == NULL) {
+				ESP_LOGE(TAG, "cJSON_Duplicate(): failed");
+				continue;
 			}
 		}
+		dispatch_message(client,
+		    esp_hass_message_from_json(copy, NULL,
+			message_pool(client)));
+	}
+	if (arena->head != NULL) {
+		esp_hass_arena_free(arena);
+	} else {
+		cJSON_Delete(json);
+	}
+}
+
+/*
+ * feed a fragment to the streaming parser, and dispatch the messages when
+ * the last fragment of the payload has been parsed.
+ */
+static void
+receive_fragment(esp_hass_client_handle_t client,
+    esp_websocket_event_data_t *data)
+{
+	esp_hass_arena_t arena = { 0 };
+	cJSON *json = NULL;
+
+	if (data->payload_offset == 0) {
+		esp_hass_json_stream_reset(&client->json_stream);
+	}
+
+	/* the parser ignores the rest of the payload after an error */
+	if (esp_hass_json_stream_feed(&client->json_stream, data->data_ptr,
+		data->data_len) != ESP_OK) {
+		goto fail;
+	}
+	if (data->payload_offset + data->data_len < data->payload_len) {
+
+		/* expect other fragments to arrive */
+		return;
+	}
+	json = esp_hass_json_stream_finish(&client->json_stream, &arena);
+	if (cJSON_IsArray(json)) {
+		receive_array(client, json, &arena);
+		return;
+	}
+	dispatch_message(client,
+	    esp_hass_message_from_json(json, &arena, message_pool(client)));
+	return;
+fail:
+	if (data->payload_offset + data->data_len == data->payload_len) {
+		ESP_LOGE(TAG, "failed to parse the message");
+	}
+}
+#else
+/*
+ * copy a fragment to its offset in rx_buffer, and dispatch the messages
+ * when the payload is complete.
+ */
+static void
+receive_fragment(esp_hass_client_handle_t client,
+    esp_websocket_event_data_t *data)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_frame_t frame;
+	const char *text = NULL;
+	size_t text_len = 0;
+
+	err = esp_hass_rx_buffer_write(&client->rx_buffer,
+	    data->payload_offset, data->data_ptr, data->data_len,
+	    data->payload_len);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_rx_buffer_write(): %s, payload_len: %d",
+		    esp_err_to_name(err), data->payload_len);
+		return;
+	}
+	if (data->payload_offset + data->data_len < data->payload_len) {
+
+		/* expect other fragments to arrive */
+		return;
 	}
+
+	/* now we have a complete json string, which is a message, or an
+	 * array of messages
+	 */
+	ESP_LOGV(TAG, "client->rx_buffer: `%s`", client->rx_buffer.data);
+	esp_hass_frame_init(&frame, client->rx_buffer.data,
+	    client->rx_buffer.len);
+	while (esp_hass_frame_next(&frame, &text, &text_len) == ESP_OK) {
+#if defined(CONFIG_ESP_HASS_LAZY_PARSER)
+		dispatch_message(client,
+		    esp_hass_message_scan(text, text_len,
+			message_pool(client)));
+#else
+		dispatch_message(client,
+		    esp_hass_message_parse((char *)text, text_len,
+			message_pool(client)));
+#endif
+	}
+	esp_hass_rx_buffer_reset(&client->rx_buffer);
 }
+#endif
 
 static void
 websocket_event_handler(void *handler_args, esp_event_base_t base,
     int32_t event_id, void *event_data)
 {
-	int data_string_len;
-	char *data_string;
-
 	esp_hass_client_handle_t client = (esp_hass_client_handle_t)
 	    handler_args;
 	esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)
 	    event_data;
-	esp_hass_message_t *hass_message;
 	switch (event_id) {
 	case WEBSOCKET_EVENT_CONNECTED:
 		ESP_LOGI(TAG, "WEBSOCKET_EVENT_CONNECTED");
 		break;
 	case WEBSOCKET_EVENT_DISCONNECTED:
 		ESP_LOGI(TAG, "WEBSOCKET_EVENT_DISCONNECTED");
+
+		/* results of the commands in flight never arrive */
+		esp_hass_pending_fail_all(&client->pending);
 		break;
 	case WEBSOCKET_EVENT_DATA:
 		xTimerReset(client->shutdown_signal_timer, portMAX_DELAY);
@@ -212,48 +626,8 @@ websocket_event_handler(void *handler_args, esp_event_base_t base,
 			break;
 		}
 
-		/* data->data_len is not null-terminated string, but bytes.
-		 * create a string from it. responses from Home Assistant
-		 * server are always a string
-		 */
-		data_string_len = data->data_len + 1;
-		data_string = calloc(1, data_string_len);
-		if (data_string == NULL) {
-			ESP_LOGE(TAG, "Out of memory");
-			break;
-		}
-		snprintf(data_string, data_string_len, "%.*s", data->data_len,
-		    (char *)data->data_ptr);
-		if (strlcat(client->rx_buffer, data_string,
-			ESP_HASS_RX_BUFFER_SIZE_BYTE) >=
-		    ESP_HASS_RX_BUFFER_SIZE_BYTE) {
-			ESP_LOGE(TAG,
-			    "rx_buffer overflow detected. rx_buffer size: %d, payload_len: %d",
-			    ESP_HASS_RX_BUFFER_SIZE_BYTE, data->payload_len);
-			strlcpy(client->rx_buffer, "",
-			    ESP_HASS_RX_BUFFER_SIZE_BYTE);
-			free(data_string);
-			break;
-		}
-		free(data_string);
-
-		if (data->payload_offset + data->data_len < data->payload_len) {
-
-			/* expect other fragments to arrive */
-			break;
-		}
-
-		/* now we have a complete json string */
-		ESP_LOGV(TAG, "client->rx_buffer: `%s`", client->rx_buffer);
-		hass_message = esp_hass_message_parse(client->rx_buffer,
-		    strlen(client->rx_buffer));
-		if (hass_message == NULL) {
-			ESP_LOGE(TAG, "esp_hass_message_parse(): failed");
-			break;
-		} else {
-			message_handler(client, hass_message);
-		}
-		strlcpy(client->rx_buffer, "", ESP_HASS_RX_BUFFER_SIZE_BYTE);
+		/* responses from Home Assistant server are always a string */
+		receive_fragment(client, data);
 		break;
 	case WEBSOCKET_EVENT_ERROR:
 		ESP_LOGI(TAG, "WEBSOCKET_EVENT_ERROR");
@@ -266,22 +640,139 @@ websocket_event_handler(void *handler_args, esp_event_base_t base,
 BaseType_t
 esp_hass_message_semaphore_give(esp_hass_client_handle_t client)
 {
-	return xSemaphoreGive(client->message_semaphore);
+	return pdTRUE;
+}
+
+/*
+ * call the handlers of the entity of an event. the entity is looked up once
+ * for all of them.
+ */
+static void
+call_entity_handlers(esp_hass_client_handle_t client, esp_hass_message_t *msg,
+    int32_t event_id)
+{
+	esp_hass_entity_t entity;
+	entity_handler_t *handler = NULL;
+	uint8_t i;
+
+	if (atomic_load_explicit(&client->n_entity_handlers,
+		memory_order_relaxed) == 0 ||
+	    esp_hass_message_get_entity(msg, &client->entities, &entity) !=
+		ESP_OK) {
+		return;
+	}
+	i = atomic_load_explicit(&client->entity_handler_heads[entity],
+	    memory_order_acquire);
+	while (i != ENTITY_HANDLER_NONE) {
+		handler = &client->entity_handlers[i];
+		handler->callback(handler->args, HASS_EVENTS, event_id, msg);
+		i = atomic_load_explicit(&handler->next, memory_order_acquire);
+	}
+}
+
+/* call the handlers of a message, and release the message */
+static void
+call_handlers(esp_hass_client_handle_t client, esp_hass_message_t *msg)
+{
+	int32_t event_id;
+	int n_handlers;
+	int i;
+
+	if (msg == NULL) {
+		return;
+	}
+	event_id = esp_hass_message_event_id(msg, &client->event_types);
+	n_handlers = atomic_load_explicit(&client->n_handlers,
+	    memory_order_acquire);
+	for (i = 0; i < n_handlers; i++) {
+		if (client->handlers[i].event_id != ESP_EVENT_ANY_ID &&
+		    client->handlers[i].event_id != event_id) {
+			continue;
+		}
+		client->handlers[i].callback(client->handlers[i].args,
+		    HASS_EVENTS, event_id, msg);
+	}
+	call_entity_handlers(client, msg, event_id);
+	esp_hass_message_release(msg);
+}
+
+/* add a message to the batches of batch handlers */
+static void
+add_to_batches(esp_hass_client_handle_t client, esp_hass_message_t *msg,
+    TickType_t now)
+{
+	int32_t event_id;
+	int n_batches;
+	int i;
+
+	n_batches = atomic_load_explicit(&client->n_batches,
+	    memory_order_acquire);
+	if (n_batches == 0 || msg == NULL) {
+		return;
+	}
+
+	/* a batch handler, and a worker, may use the message at the same
+	 * time. parse it before it is shared so that neither of them parses
+	 * it, i.e. writes to it.
+	 */
+	if (CONFIG_ESP_HASS_WORKERS > 0) {
+		esp_hass_message_get_json(msg);
+	}
+	event_id = esp_hass_message_event_id(msg, &client->event_types);
+	for (i = 0; i < n_batches; i++) {
+		esp_hass_batch_add(&client->batches[i], msg, event_id, now);
+	}
+}
+
+/* call the batch handlers that are due, and return the ticks until the next
+ * one is due */
+static TickType_t
+poll_batches(esp_hass_client_handle_t client)
+{
+	TickType_t now = xTaskGetTickCount();
+	TickType_t ticks = portMAX_DELAY;
+	TickType_t batch_ticks;
+	int n_batches;
+	int i;
+
+	n_batches = atomic_load_explicit(&client->n_batches,
+	    memory_order_acquire);
+	for (i = 0; i < n_batches; i++) {
+		esp_hass_batch_poll(&client->batches[i], now);
+		batch_ticks =
+		    esp_hass_batch_ticks_to_wait(&client->batches[i], now);
+		if (batch_ticks < ticks) {
+			ticks = batch_ticks;
+		}
+	}
+	return ticks;
+}
+
+/* call the handlers of a message in a worker */
+static void
+worker_dispatch(void *context, esp_hass_message_t *msg)
+{
+	call_handlers(context, msg);
 }
 
 /*
- * A task to listen to the event queue. When a message is received, post the
- * event message to user-defined event handler.
+ * A task to listen to the event queue, or the event ring. When a message is
+ * received, pass the message to user-defined event handlers. The handlers are
+ * called by this task, or by the worker of the entity when there are workers,
+ * with the message itself, which is released after the handlers have
+ * returned. The task stops when esp_hass_destroy() sends the stop item.
  */
 static void
 esp_hass_task_event_source(void *args)
 {
-	esp_hass_message_t *msg = NULL;
-	int32_t event_id = 0;
-	esp_err_t err = ESP_FAIL;
+	esp_hass_message_t *msgs[ESP_HASS_EVENT_BATCH_MAX];
+	size_t n, i;
+	esp_err_t err;
+	TickType_t ticks = portMAX_DELAY;
+	TickType_t now;
 	esp_hass_client_handle_t client = (esp_hass_client_handle_t)args;
 
-	if (client->event_queue == NULL) {
+	if (!esp_hass_event_lane_is_enabled(&client->event_lane)) {
 
 		/* event_queue is optional */
 		ESP_LOGD(TAG,
@@ -290,86 +781,304 @@ esp_hass_task_event_source(void *args)
 	}
 
 	while (1) {
-		if (xQueueReceive(client->event_queue, &msg, portMAX_DELAY) !=
-		    pdTRUE) {
-			ESP_LOGE(TAG, "xQueueReceive():");
-			continue;
-		}
-		event_id++;
-		err = esp_event_post_to(client->event_loop_handle, HASS_EVENTS,
-		    event_id, msg, sizeof(esp_hass_message_t), portMAX_DELAY);
-		if (err != ESP_OK) {
-			ESP_LOGE(TAG, "esp_event_post_to(): %s",
+		/* take all the events in a ring at once, or wake up when a
+		 * batch handler is due */
+		err = esp_hass_event_lane_receive(&client->event_lane, msgs,
+		    ESP_HASS_EVENT_BATCH_MAX, &n, ticks);
+		if (err != ESP_OK && err != ESP_ERR_TIMEOUT) {
+			ESP_LOGE(TAG, "esp_hass_event_lane_receive(): %s",
 			    esp_err_to_name(err));
+			continue;
 		}
-		if (xSemaphoreTake(client->message_semaphore,
-			ESP_HASS_SEMAPHORE_TAKE_TIMEOUT_MS /
-			    portTICK_PERIOD_MS) == pdFALSE) {
-			ESP_LOGW(TAG,
-			    "xSemaphoreTake(): timeout. register a handler with esp_hass_event_handler_register(), or increase CONFIG_ESP_HASS_SEMAPHORE_TAKE_TIMEOUT_MS");
-		}
-
-		if (msg != NULL) {
-			esp_hass_message_destroy(msg);
+		now = xTaskGetTickCount();
+		for (i = 0; i < n; i++) {
+			if (msgs[i] ==
+			    ESP_HASS_EVENT_LANE_STOP(&client->event_lane)) {
+				goto stop;
+			}
+			add_to_batches(client, msgs[i], now);
+			if (CONFIG_ESP_HASS_WORKERS == 0) {
+				call_handlers(client, msgs[i]);
+			} else if (esp_hass_workers_send(&client->workers,
+				       msgs[i], portMAX_DELAY) != ESP_OK) {
+				esp_hass_message_release(msgs[i]);
+			}
 		}
-		vTaskDelay(
-		    pdMS_TO_TICKS(CONFIG_ESP_HASS_TASK_EVENT_SOURCE_DELAY_MS));
+		ticks = poll_batches(client);
 	}
-	delete : vTaskDelete(NULL);
+stop:
+	xSemaphoreGive(client->event_source_stopped);
+delete:
+	vTaskDelete(NULL);
 }
 
 esp_err_t
 esp_hass_event_handler_register(esp_hass_client_handle_t client,
     esp_event_handler_t callback)
 {
-	return esp_event_handler_instance_register_with(
-	    client->event_loop_handle, HASS_EVENTS, ESP_EVENT_ANY_ID, callback,
-	    (void *)client, NULL);
+	return esp_hass_event_handler_register_with_id(client, ESP_EVENT_ANY_ID,
+	    callback);
 }
 
-void
-esp_hass_hello_world()
-{
-	ESP_LOGI(TAG, "Hello world");
-}
-
-esp_hass_client_handle_t
-esp_hass_init(esp_hass_config_t *config)
+esp_err_t
+esp_hass_event_handler_register_with_id(esp_hass_client_handle_t client,
+    int32_t event_id, esp_event_handler_t callback)
 {
 	esp_err_t err = ESP_FAIL;
-	esp_hass_client_handle_t hass_client = NULL;
+	int n;
 
-	if (config == NULL) {
-		ESP_LOGE(TAG, "esp_hass_init(): Invalid arg");
+	if (client == NULL || callback == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (xSemaphoreTake(client->handlers_lock, portMAX_DELAY) != pdTRUE) {
+		return ESP_FAIL;
+	}
+	n = atomic_load_explicit(&client->n_handlers, memory_order_relaxed);
+	if (n >= ESP_HASS_EVENT_HANDLERS_MAX) {
+		ESP_LOGE(TAG, "too many handlers");
+		err = ESP_ERR_NO_MEM;
 		goto fail;
 	}
+	client->handlers[n].callback = callback;
+	client->handlers[n].args = (void *)client;
+	client->handlers[n].event_id = event_id;
+	atomic_store_explicit(&client->n_handlers, n + 1,
+	    memory_order_release);
+	err = ESP_OK;
+fail:
+	xSemaphoreGive(client->handlers_lock);
+	return err;
+}
 
-	hass_client = calloc(1, sizeof(struct esp_hass_client));
-	if (hass_client == NULL) {
-		ESP_LOGE(TAG, "calloc(): Out of memory");
+esp_err_t
+esp_hass_entity_handler_register(esp_hass_client_handle_t client,
+    const char *entity_id, esp_event_handler_t callback)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_entity_t entity;
+	entity_handler_t *handler = NULL;
+	_Atomic uint8_t *tail = NULL;
+	uint8_t i;
+	int n;
+
+	if (client == NULL || entity_id == NULL || callback == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (xSemaphoreTake(client->handlers_lock, portMAX_DELAY) != pdTRUE) {
+		return ESP_FAIL;
+	}
+	n = atomic_load_explicit(&client->n_entity_handlers,
+	    memory_order_relaxed);
+	if (n >= ESP_HASS_ENTITY_HANDLERS_MAX) {
+		ESP_LOGE(TAG, "too many entity handlers");
+		err = ESP_ERR_NO_MEM;
 		goto fail;
 	}
-
-	hass_client->message_id = 0;
-	hass_client->rx_buffer = calloc(1, ESP_HASS_RX_BUFFER_SIZE_BYTE);
-	ESP_LOGD(TAG, "hass_client->rx_buffer: `%s`", hass_client->rx_buffer);
-	if (hass_client->rx_buffer == NULL) {
-		ESP_LOGE(TAG, "Out of memory: rx_buffer");
+	err = esp_hass_client_get_entity(client, entity_id, &entity);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_client_get_entity(): %s",
+		    esp_err_to_name(err));
 		goto fail;
 	}
-	hass_client->config.access_token = config->access_token;
-	hass_client->config.ws_config = config->ws_config;
-	hass_client->config.timeout_sec = config->timeout_sec;
-	hass_client->config.command_send_timeout_sec =
+	handler = &client->entity_handlers[n];
+	handler->callback = callback;
+	handler->args = (void *)client;
+	atomic_store_explicit(&handler->next, ENTITY_HANDLER_NONE,
+	    memory_order_relaxed);
+
+	/* append the handler so that handlers are called in the order of
+	 * registration. the dispatcher sees the handler when it is linked.
+	 */
+	tail = &client->entity_handler_heads[entity];
+	while ((i = atomic_load_explicit(tail, memory_order_relaxed)) !=
+	    ENTITY_HANDLER_NONE) {
+		tail = &client->entity_handlers[i].next;
+	}
+	atomic_store_explicit(tail, n, memory_order_release);
+	atomic_store_explicit(&client->n_entity_handlers, n + 1,
+	    memory_order_relaxed);
+	err = ESP_OK;
+fail:
+	xSemaphoreGive(client->handlers_lock);
+	return err;
+}
+
+esp_err_t
+esp_hass_batch_handler_register(esp_hass_client_handle_t client,
+    const esp_hass_batch_config_t *config, esp_hass_batch_handler_t callback)
+{
+	esp_err_t err = ESP_FAIL;
+	int n;
+
+	if (client == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (xSemaphoreTake(client->handlers_lock, portMAX_DELAY) != pdTRUE) {
+		return ESP_FAIL;
+	}
+	n = atomic_load_explicit(&client->n_batches, memory_order_relaxed);
+	if (n >= ESP_HASS_BATCH_HANDLERS_MAX) {
+		ESP_LOGE(TAG, "too many batch handlers");
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+	err = esp_hass_batch_init(&client->batches[n], config, callback,
+	    (void *)client);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_batch_init(): %s", esp_err_to_name(err));
+		goto fail;
+	}
+	atomic_store_explicit(&client->n_batches, n + 1,
+	    memory_order_release);
+fail:
+	xSemaphoreGive(client->handlers_lock);
+	return err;
+}
+
+void
+esp_hass_hello_world()
+{
+	ESP_LOGI(TAG, "Hello world");
+}
+
+esp_hass_client_handle_t
+esp_hass_init(esp_hass_config_t *config)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_client_handle_t hass_client = NULL;
+	esp_hass_workers_config_t workers_config = { 0 };
+	esp_hass_tx_config_t tx_config = { 0 };
+	int i;
+
+	if (config == NULL) {
+		ESP_LOGE(TAG, "esp_hass_init(): Invalid arg");
+		goto fail;
+	}
+
+	hass_client = calloc(1, sizeof(struct esp_hass_client));
+	if (hass_client == NULL) {
+		ESP_LOGE(TAG, "calloc(): Out of memory");
+		goto fail;
+	}
+
+	hass_client->message_id = 0;
+#if defined(CONFIG_ESP_HASS_STREAMING_PARSER)
+	err = esp_hass_json_stream_init(&hass_client->json_stream,
+	    CONFIG_ESP_HASS_RX_BUFFER_SIZE, CONFIG_ESP_HASS_RX_BUFFER_MAX_SIZE,
+	    ESP_HASS_ARENA_BLOCK_SIZE, ESP_HASS_RX_BUFFER_CAPS);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_json_stream_init(): %s",
+		    esp_err_to_name(err));
+		goto fail;
+	}
+#else
+	err = esp_hass_rx_buffer_init(&hass_client->rx_buffer,
+	    CONFIG_ESP_HASS_RX_BUFFER_SIZE, CONFIG_ESP_HASS_RX_BUFFER_MAX_SIZE,
+	    ESP_HASS_RX_BUFFER_CAPS);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_rx_buffer_init(): %s",
+		    esp_err_to_name(err));
+		goto fail;
+	}
+#endif
+	hass_client->message_pool = esp_hass_message_pool_create(
+	    CONFIG_ESP_HASS_MESSAGE_POOL_SIZE);
+	if (hass_client->message_pool == NULL) {
+		ESP_LOGE(TAG, "esp_hass_message_pool_create(): failed");
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+	err = esp_hass_projection_spec_init(&hass_client->projection,
+	    config->projection_paths);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_projection_spec_init(): %s",
+		    esp_err_to_name(err));
+		goto fail;
+	}
+	err = esp_hass_intern_init(&hass_client->entities,
+	    CONFIG_ESP_HASS_ENTITY_TABLE_SIZE);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_intern_init(): %s",
+		    esp_err_to_name(err));
+		goto fail;
+	}
+	if (CONFIG_ESP_HASS_ENTITY_TABLE_SIZE > 0) {
+		hass_client->entity_handler_heads = malloc(
+		    CONFIG_ESP_HASS_ENTITY_TABLE_SIZE *
+		    sizeof(*hass_client->entity_handler_heads));
+		if (hass_client->entity_handler_heads == NULL) {
+			ESP_LOGE(TAG, "malloc(): Out of memory");
+			goto fail;
+		}
+		for (i = 0; i < CONFIG_ESP_HASS_ENTITY_TABLE_SIZE; i++) {
+			atomic_init(&hass_client->entity_handler_heads[i],
+			    ENTITY_HANDLER_NONE);
+		}
+	}
+	err = esp_hass_event_types_init(&hass_client->event_types,
+	    ESP_HASS_EVENT_TYPES_MAX);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_event_types_init(): %s",
+		    esp_err_to_name(err));
+		goto fail;
+	}
+	for (i = 0; config->state_changed_attributes != NULL &&
+	     config->state_changed_attributes[i] != NULL;
+	     i++) {
+		if (i >= ESP_HASS_STATE_CHANGED_MAX_ATTRIBUTES) {
+			ESP_LOGE(TAG, "too many state_changed_attributes");
+			goto fail;
+		}
+	}
+	hass_client->state_changed_attributes =
+	    config->state_changed_attributes;
+	hass_client->config.access_token = config->access_token;
+	hass_client->config.ws_config = config->ws_config;
+	hass_client->config.timeout_sec = config->timeout_sec;
+	hass_client->config.command_send_timeout_sec =
 	    config->command_send_timeout_sec;
 	hass_client->config.result_recv_timeout_sec =
 	    config->result_recv_timeout_sec;
-	hass_client->event_queue = config->event_queue;
 	hass_client->result_queue = config->result_queue;
-	if (hass_client->result_queue == NULL) {
-		ESP_LOGE(TAG, "result_queue must not be NULL");
+	hass_client->result_ring = config->result_ring;
+	if (hass_client->result_queue == NULL &&
+	    hass_client->result_ring == NULL) {
+		ESP_LOGE(TAG, "result_queue, or result_ring must not be NULL");
 		goto fail;
 	}
+	err = esp_hass_event_lane_init(&hass_client->event_lane,
+	    config->event_queue, config->event_ring, config->overload_policy,
+	    &hass_client->entities, &hass_client->event_types);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_event_lane_init(): %s",
+		    esp_err_to_name(err));
+		goto fail;
+	}
+	err = esp_hass_pending_init(&hass_client->pending,
+	    CONFIG_ESP_HASS_PENDING_COMMANDS_MAX);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_pending_init(): %s",
+		    esp_err_to_name(err));
+		goto fail;
+	}
+	if (CONFIG_ESP_HASS_WORKERS > 0 &&
+	    esp_hass_event_lane_is_enabled(&hass_client->event_lane)) {
+		workers_config.n_workers = CONFIG_ESP_HASS_WORKERS;
+		workers_config.queue_size = CONFIG_ESP_HASS_WORKER_QUEUE_SIZE;
+		workers_config.stack_size = CONFIG_ESP_HASS_WORKER_STACK_SIZE;
+		workers_config.priority = uxTaskPriorityGet(NULL);
+		workers_config.core_id = CONFIG_ESP_HASS_WORKER_CORE_ID;
+		workers_config.dispatch = worker_dispatch;
+		workers_config.context = hass_client;
+		workers_config.entities = &hass_client->entities;
+		err = esp_hass_workers_init(&hass_client->workers,
+		    &workers_config);
+		if (err != ESP_OK) {
+			ESP_LOGE(TAG, "esp_hass_workers_init(): %s",
+			    esp_err_to_name(err));
+			goto fail;
+		}
+	}
 	if (hass_client->config.ws_config == NULL) {
 		ESP_LOGE(TAG, "ws_config must not be NULL");
 		goto fail;
@@ -379,9 +1088,14 @@ esp_hass_init(esp_hass_config_t *config)
 		goto fail;
 	}
 	hass_client->is_authenticated = false;
-	hass_client->json = NULL;
-	hass_client->message_semaphore = xSemaphoreCreateBinary();
-	if (hass_client->message_semaphore == NULL) {
+	hass_client->handlers_lock = xSemaphoreCreateMutex();
+	if (hass_client->handlers_lock == NULL) {
+		ESP_LOGE(TAG, "xSemaphoreCreateMutex(): Out of memory");
+		goto fail;
+	}
+	hass_client->event_source_stopped = xSemaphoreCreateBinary();
+	if (hass_client->event_source_stopped == NULL) {
+		ESP_LOGE(TAG, "xSemaphoreCreateBinary(): Out of memory");
 		goto fail;
 	}
 	ESP_LOGI(TAG, "API URI: %s", hass_client->config.ws_config->uri);
@@ -397,6 +1111,16 @@ esp_hass_init(esp_hass_config_t *config)
 		ESP_LOGE(TAG, "esp_websocket_client_init(): fail");
 		goto fail;
 	}
+	tx_config.n_frames = CONFIG_ESP_HASS_TX_FRAMES;
+	tx_config.stack_size = CONFIG_ESP_HASS_TASK_TX_STACK_SIZE;
+	tx_config.priority = uxTaskPriorityGet(NULL);
+	tx_config.send = send_frames;
+	tx_config.context = hass_client;
+	err = esp_hass_tx_init(&hass_client->tx, &tx_config);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_tx_init(): %s", esp_err_to_name(err));
+		goto fail;
+	}
 
 	hass_client->shutdown_signal_timer =
 	    xTimerCreate("Websocket shutdown timer",
@@ -415,22 +1139,6 @@ esp_hass_init(esp_hass_config_t *config)
 		goto fail;
 	}
 
-	esp_event_loop_args_t loop_args = {
-		.queue_size = CONFIG_ESP_HASS_TASK_EVENT_SOURCE_QUEUE_SIZE,
-		.task_name = "esp_hass_task_event_source",
-		.task_priority = uxTaskPriorityGet(NULL),
-		.task_stack_size = CONFIG_ESP_HASS_TASK_EVENT_SOURCE_STACK_SIZE,
-		.task_core_id = tskNO_AFFINITY
-	};
-
-	err = esp_event_loop_create(&loop_args,
-	    &hass_client->event_loop_handle);
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "esp_event_loop_create(): %s",
-		    esp_err_to_name(err));
-		goto fail;
-	}
-
 	return hass_client;
 fail:
 	esp_hass_destroy(hass_client);
@@ -441,21 +1149,31 @@ esp_err_t
 esp_hass_destroy(esp_hass_client_handle_t client)
 {
 	esp_err_t err = ESP_FAIL;
+	int i;
 
 	if (client == NULL) {
 		goto success;
 	}
+
+	/* stop the websocket task first, so that no event handler sends a
+	 * message, or resets the timer, while they are freed. fails when the
+	 * client has not been started.
+	 */
+	if (client->ws_client_handle != NULL &&
+	    esp_websocket_client_stop(client->ws_client_handle) == ESP_OK) {
+		ESP_LOGD(TAG, "websocket client stopped");
+	}
 	if (client->shutdown_signal_timer != NULL &&
 	    xTimerDelete(client->shutdown_signal_timer, portMAX_DELAY) !=
 		pdPASS) {
 		ESP_LOGW(TAG, "xTimerDelete(): fail");
 	}
 	client->shutdown_signal_timer = NULL;
-	if (client->json != NULL) {
-		cJSON_Delete(client->json);
-		client->json = NULL;
-	}
 
+	/* the writer stops after the queued messages. those that fail to be
+	 * sent are resolved with failure.
+	 */
+	esp_hass_tx_free(&client->tx);
 	if (client->ws_client_handle != NULL &&
 	    (err = esp_websocket_client_destroy(client->ws_client_handle) !=
 		    ESP_OK)) {
@@ -464,9 +1182,38 @@ esp_hass_destroy(esp_hass_client_handle_t client)
 	}
 	client->ws_client_handle = NULL;
 
-	if (client->rx_buffer != NULL) {
-		free(client->rx_buffer);
-		client->rx_buffer = NULL;
+#if defined(CONFIG_ESP_HASS_STREAMING_PARSER)
+	esp_hass_json_stream_free(&client->json_stream);
+#else
+	esp_hass_rx_buffer_free(&client->rx_buffer);
+#endif
+
+	/* no more events are sent to the lane. the event source task hands
+	 * the queued events to handlers, or workers, and stops.
+	 */
+	if (client->event_source_task != NULL &&
+	    esp_hass_event_lane_stop(&client->event_lane, portMAX_DELAY) ==
+		ESP_OK) {
+		xSemaphoreTake(client->event_source_stopped, portMAX_DELAY);
+	}
+	client->event_source_task = NULL;
+	if (client->event_source_stopped != NULL) {
+		vSemaphoreDelete(client->event_source_stopped);
+	}
+	esp_hass_workers_free(&client->workers);
+	for (i = 0; i < ESP_HASS_BATCH_HANDLERS_MAX; i++) {
+		esp_hass_batch_free(&client->batches[i]);
+	}
+	esp_hass_event_lane_free(&client->event_lane);
+	esp_hass_pending_fail_all(&client->pending);
+	esp_hass_pending_free(&client->pending);
+	esp_hass_pool_delete(client->message_pool);
+	esp_hass_projection_spec_free(&client->projection);
+	esp_hass_intern_free(&client->entities);
+	esp_hass_intern_free(&client->event_types);
+	free(client->entity_handler_heads);
+	if (client->handlers_lock != NULL) {
+		vSemaphoreDelete(client->handlers_lock);
 	}
 	free(client);
 	client = NULL;
@@ -500,11 +1247,15 @@ esp_hass_client_start(esp_hass_client_handle_t client)
 		goto fail;
 	}
 
-	if (xTaskCreate(esp_hass_task_event_source,
+	/* the task keeps running while the client is stopped */
+	if (client->event_source_task == NULL &&
+	    xTaskCreate(esp_hass_task_event_source,
 		"esp_hass_task_event_source",
 		CONFIG_ESP_HASS_TASK_EVENT_SOURCE_STACK_SIZE, client,
-		uxTaskPriorityGet(NULL), NULL) != pdTRUE) {
+		uxTaskPriorityGet(NULL),
+		&client->event_source_task) != pdTRUE) {
 		ESP_LOGE(TAG, "xTaskCreate(): Out of memory");
+		client->event_source_task = NULL;
 		goto fail;
 	}
 
@@ -535,93 +1286,54 @@ fail:
 	return err;
 }
 
-static esp_err_t
-esp_hass_create_message_auth(esp_hass_client_handle_t client)
+esp_err_t
+esp_hass_client_auth(esp_hass_client_handle_t client)
 {
 	esp_err_t err = ESP_FAIL;
+	esp_hass_tx_frame_t *frame = NULL;
 
 	if (client == NULL) {
-		ESP_LOGE(TAG, "client is NULL");
-		err = ESP_ERR_INVALID_ARG;
-		goto fail;
+		return ESP_ERR_INVALID_ARG;
 	}
-
-	if (client->json != NULL) {
-		cJSON_Delete(client->json);
-		client->json = NULL;
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
 	}
-	client->json = cJSON_CreateObject();
-	if (cJSON_AddStringToObject(client->json, "type", "auth") == NULL) {
-		ESP_LOGE(TAG, "cJSON_AddStringToObject(): type auth");
-		err = ESP_FAIL;
-		goto fail;
-	}
-	if (cJSON_AddStringToObject(client->json, "access_token",
-		client->config.access_token) == NULL) {
-		ESP_LOGE(TAG, "cJSON_AddStringToObject(): type access_token");
-		err = ESP_FAIL;
-		goto fail;
+	err = esp_hass_write_auth(&frame->w, client->config.access_token);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_write_auth(): %s", esp_err_to_name(err));
+		esp_hass_tx_abort(&client->tx, frame);
+		return err;
 	}
-
-	err = ESP_OK;
-fail:
-	return err;
+	ESP_LOGI(TAG, "Sending auth message");
+	esp_hass_tx_commit(&client->tx, frame);
+	return ESP_OK;
 }
 
 esp_err_t
-esp_hass_client_auth(esp_hass_client_handle_t client)
+esp_hass_client_ping(esp_hass_client_handle_t client)
 {
 	esp_err_t err = ESP_FAIL;
-	char *json_string = NULL;
-	int length, json_string_length;
+	esp_hass_tx_frame_t *frame = NULL;
 
 	if (client == NULL) {
-		err = ESP_ERR_INVALID_ARG;
-		goto fail;
+		return ESP_ERR_INVALID_ARG;
 	}
-
-	err = esp_hass_create_message_auth(client);
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "esp_hass_create_message_auth(): %s",
-		    esp_err_to_name(err));
-		goto fail;
-	}
-
-	json_string = cJSON_Print(client->json);
-	if (json_string == NULL) {
-		ESP_LOGE(TAG, "cJSON_Print(): failed");
-		err = ESP_FAIL;
-		goto fail;
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
 	}
-	ESP_LOGI(TAG, "Sending auth message");
-	json_string_length = strlen(json_string);
-	length = esp_websocket_client_send_text(client->ws_client_handle,
-	    json_string, json_string_length,
-	    client->config.command_send_timeout_sec * 1000 /
-		portTICK_PERIOD_MS);
-	if (length < 0) {
-		ESP_LOGE(TAG, "esp_websocket_client_send_text(): failed");
-		err = ESP_FAIL;
-		goto fail;
-	} else if (json_string_length != length) {
-		ESP_LOGE(TAG,
-		    "esp_websocket_client_send_text(): failed: data: %d bytes, data actually sent %d bytes",
-		    json_string_length, length);
-		err = ESP_FAIL;
-		goto fail;
+	frame->id = next_message_id(client);
+	err = esp_hass_write_ping(&frame->w, frame->id);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_write_ping(): %s", esp_err_to_name(err));
+		esp_hass_tx_abort(&client->tx, frame);
+		return err;
 	}
 
-	err = ESP_OK;
-fail:
-	if (json_string != NULL) {
-		free(json_string);
-		json_string = NULL;
-	}
-	if (client != NULL && client->json != NULL) {
-		cJSON_Delete(client->json);
-		client->json = NULL;
-	}
-	return err;
+	/* pong is not a result, and is passed to handlers */
+	esp_hass_tx_commit(&client->tx, frame);
+	return ESP_OK;
 }
 
 bool
@@ -642,110 +1354,94 @@ esp_hass_client_is_authenticated(esp_hass_client_handle_t client)
 	return client->is_authenticated;
 }
 
-static esp_err_t
-esp_hass_create_message_subscribe_events(esp_hass_client_handle_t client,
+esp_err_t
+esp_hass_client_subscribe_events(esp_hass_client_handle_t client,
     char *event_type)
 {
-	esp_err_t err = ESP_FAIL;
-
-	if (client == NULL) {
-		err = ESP_ERR_INVALID_ARG;
-		goto fail;
-	}
+	esp_hass_subscribe_config_t config =
+	    ESP_HASS_SUBSCRIBE_CONFIG_DEFAULT();
 
-	if (client->json != NULL) {
-		cJSON_Delete(client->json);
-		client->json = NULL;
-	}
-	client->json = cJSON_CreateObject();
-	if (cJSON_AddNumberToObject(client->json, "id", ++client->message_id) ==
-	    NULL) {
-		err = ESP_FAIL;
-		goto fail;
-	}
-	if (cJSON_AddStringToObject(client->json, "type", "subscribe_events") ==
-	    NULL) {
-		err = ESP_FAIL;
-		goto fail;
-	}
-	if (event_type != NULL) {
-		if (cJSON_AddStringToObject(client->json, "event_type",
-			event_type) == NULL) {
-			err = ESP_FAIL;
-			goto fail;
-		}
-	}
-	err = ESP_OK;
-	return err;
-fail:
-	if (client->json != NULL) {
-		cJSON_Delete(client->json);
-		client->json = NULL;
-	}
-	return err;
+	config.event_type = event_type;
+	return esp_hass_client_subscribe_events_with_config(client, &config);
 }
 
 esp_err_t
-esp_hass_client_subscribe_events(esp_hass_client_handle_t client,
-    char *event_type)
+esp_hass_client_subscribe_events_with_config(esp_hass_client_handle_t client,
+    const esp_hass_subscribe_config_t *config)
 {
 	esp_err_t err = ESP_FAIL;
-	char *json_string = NULL;
-	int length, json_string_length;
 	esp_hass_message_t *msg = NULL;
+	esp_hass_tx_frame_t *frame = NULL;
+	_Atomic int *decoded = NULL;
+	int32_t event_id;
+	int id, unused, i;
 
-	if (client == NULL) {
+	if (client == NULL || config == NULL) {
 		err = ESP_ERR_INVALID_ARG;
 		goto fail;
 	}
-	assert(client->result_queue != NULL);
 
-	err = esp_hass_create_message_subscribe_events(client, event_type);
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "esp_hass_create_message_subscribe_events(): %s",
-		    esp_err_to_name(err));
+	/* events may arrive before the result is received. register the
+	 * type, and mark the subscription, before sending the command.
+	 */
+	if (config->event_type != NULL &&
+	    esp_hass_client_get_event_id(client, config->event_type,
+		&event_id) != ESP_OK) {
+		ESP_LOGW(TAG, "too many event types, `%s` has no event ID",
+		    config->event_type);
+	}
+	frame = begin_message(client);
+	if (frame == NULL) {
+		err = ESP_ERR_TIMEOUT;
 		goto fail;
 	}
-
-	json_string = cJSON_Print(client->json);
-	if (json_string == NULL) {
-		ESP_LOGE(TAG, "cJSON_Print(): failed");
-		err = ESP_FAIL;
-		goto fail;
+	id = next_message_id(client);
+	if (config->decode_state_changed) {
+		for (i = 0; i < ESP_HASS_DECODED_SUBSCRIPTIONS_MAX; i++) {
+			unused = 0;
+			if (atomic_compare_exchange_strong(
+				&client->decoded_subscriptions[i], &unused,
+				id)) {
+				decoded = &client->decoded_subscriptions[i];
+				break;
+			}
+		}
+		if (decoded == NULL) {
+			ESP_LOGE(TAG,
+			    "too many subscriptions decode state_changed, maximum: %d",
+			    ESP_HASS_DECODED_SUBSCRIPTIONS_MAX);
+			esp_hass_tx_abort(&client->tx, frame);
+			err = ESP_ERR_NO_MEM;
+			goto fail;
+		}
 	}
+
 	ESP_LOGI(TAG, "Sending subscribe_events command");
-	json_string_length = strlen(json_string);
-	length = esp_websocket_client_send_text(client->ws_client_handle,
-	    json_string, json_string_length,
-	    client->config.command_send_timeout_sec * 1000 /
-		portTICK_PERIOD_MS);
-	if (length < 0) {
-		ESP_LOGE(TAG, "esp_websocket_client_send_text(): failed");
-		err = ESP_FAIL;
-		goto fail;
-	} else if (json_string_length != length) {
-		ESP_LOGE(TAG,
-		    "esp_websocket_client_send_text(): failed: data: %d bytes, data actually sent %d bytes",
-		    json_string_length, length);
-		err = ESP_FAIL;
-		goto fail;
+	err = esp_hass_write_subscribe_events(&frame->w, id,
+	    config->event_type);
+	if (err == ESP_OK) {
+		err = send_command(client, frame, id, NULL, NULL);
+	} else {
+		esp_hass_tx_abort(&client->tx, frame);
 	}
-	if (xQueueReceive(client->result_queue, &msg,
-		client->config.result_recv_timeout_sec * 1000 /
-		    portTICK_PERIOD_MS) != pdTRUE) {
-		ESP_LOGE(TAG, "xQueueReceive(): timeout");
-		err = ESP_FAIL;
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "send_command(): %s", esp_err_to_name(err));
 		goto fail;
 	}
-	if (msg->type != HASS_MESSAGE_TYPE_RESULT) {
-		ESP_LOGE(TAG,
-		    "Unexpected response from the server: result type: %d",
-		    msg->type);
+	err = esp_hass_pending_wait(&client->pending, id, &msg,
+	    client->config.result_recv_timeout_sec * 1000 /
+		portTICK_PERIOD_MS);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_pending_wait(): %s",
+		    esp_err_to_name(err));
 		err = ESP_FAIL;
 		goto fail;
 	}
 	if (msg->success) {
 		ESP_LOGI(TAG, "subscription command success");
+		if (config->subscription != NULL) {
+			*config->subscription = id;
+		}
 	} else {
 		ESP_LOGE(TAG, "subscription command failed");
 		err = ESP_FAIL;
@@ -753,18 +1449,106 @@ esp_hass_client_subscribe_events(esp_hass_client_handle_t client,
 	}
 	err = ESP_OK;
 fail:
+	if (err != ESP_OK && decoded != NULL) {
+		atomic_store(decoded, 0);
+	}
 	if (msg != NULL) {
 		esp_hass_message_destroy(msg);
 	}
-	if (json_string != NULL) {
-		free(json_string);
-		json_string = NULL;
+	return err;
+}
+
+/* wait for the result of a command that has been sent */
+static esp_err_t
+wait_success(esp_hass_client_handle_t client, int id, const char *command)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_message_t *msg = NULL;
+	esp_hass_command_result_t result;
+
+	err = esp_hass_pending_wait(&client->pending, id, &msg,
+	    client->config.result_recv_timeout_sec * 1000 /
+		portTICK_PERIOD_MS);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "%s: esp_hass_pending_wait(): %s", command,
+		    esp_err_to_name(err));
+		return ESP_FAIL;
 	}
-	if (client->json != NULL) {
-		cJSON_Delete(client->json);
-		client->json = NULL;
+	esp_hass_command_result_set(&result, msg);
+	esp_hass_message_destroy(msg);
+	if (result.err != ESP_OK) {
+		ESP_LOGE(TAG, "%s: server returned failure: `%s`", command,
+		    result.error_message);
 	}
-	return err;
+	return result.err;
+}
+
+esp_err_t
+esp_hass_client_unsubscribe_events(esp_hass_client_handle_t client,
+    int subscription)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_tx_frame_t *frame = NULL;
+	int id, expected, i;
+
+	if (client == NULL || subscription <= 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
+	}
+	id = next_message_id(client);
+	err = esp_hass_write_unsubscribe_events(&frame->w, id, subscription);
+	if (err == ESP_OK) {
+		err = send_command(client, frame, id, NULL, NULL);
+	} else {
+		esp_hass_tx_abort(&client->tx, frame);
+	}
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "send_command(): %s", esp_err_to_name(err));
+		return err;
+	}
+	err = wait_success(client, id, "unsubscribe_events");
+	if (err != ESP_OK) {
+		return err;
+	}
+	for (i = 0; i < ESP_HASS_DECODED_SUBSCRIPTIONS_MAX; i++) {
+		expected = subscription;
+		atomic_compare_exchange_strong(
+		    &client->decoded_subscriptions[i], &expected, 0);
+	}
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_fire_event(esp_hass_client_handle_t client, const char *event_type,
+    const char *event_data)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_tx_frame_t *frame = NULL;
+	int id;
+
+	if (client == NULL || event_type == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
+	}
+	id = next_message_id(client);
+	err = esp_hass_write_fire_event(&frame->w, id, event_type,
+	    event_data);
+	if (err == ESP_OK) {
+		err = send_command(client, frame, id, NULL, NULL);
+	} else {
+		esp_hass_tx_abort(&client->tx, frame);
+	}
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "send_command(): %s", esp_err_to_name(err));
+		return err;
+	}
+	return wait_success(client, id, "fire_event");
 }
 
 char *
@@ -773,120 +1557,210 @@ esp_hass_client_get_ha_version(esp_hass_client_handle_t client)
 	return client->ha_version;
 }
 
+esp_err_t
+esp_hass_client_get_message_pool_stats(esp_hass_client_handle_t client,
+    esp_hass_message_pool_stats_t *stats)
+{
+	if (client == NULL || stats == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	stats->capacity = client->message_pool->capacity;
+	stats->exhausted = atomic_load(&client->message_pool->exhausted);
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_client_get_overload_stats(esp_hass_client_handle_t client,
+    esp_hass_overload_stats_t *stats)
+{
+	if (client == NULL || stats == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	esp_hass_event_lane_get_stats(&client->event_lane, stats);
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_client_get_entity(esp_hass_client_handle_t client,
+    const char *entity_id, esp_hass_entity_t *entity)
+{
+	if (client == NULL || entity_id == NULL || entity == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return esp_hass_intern(&client->entities, entity_id, strlen(entity_id),
+	    true, entity);
+}
+
+const char *
+esp_hass_client_get_entity_id(esp_hass_client_handle_t client,
+    esp_hass_entity_t entity)
+{
+	if (client == NULL) {
+		return NULL;
+	}
+	return esp_hass_intern_string(&client->entities, entity);
+}
+
+esp_err_t
+esp_hass_client_get_event_id(esp_hass_client_handle_t client,
+    const char *event_type, int32_t *event_id)
+{
+	if (client == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return esp_hass_event_types_get_id(&client->event_types, event_type,
+	    true, event_id);
+}
+
 esp_err_t
 esp_hass_message_destroy(esp_hass_message_t *msg)
 {
 	if (msg == NULL) {
 		goto success;
 	}
-	if (msg->json != NULL) {
-		cJSON_Delete(msg->json);
-		msg->json = NULL;
-	}
-	free(msg);
+	esp_hass_message_release(msg);
 	msg = NULL;
 success:
 	return ESP_OK;
 }
 
+/*
+ * print a JSON object with an ID into a frame. a message that does not fit
+ * in the frame is printed into memory allocated by cJSON, which the writer
+ * frees after sending it.
+ */
+static esp_err_t
+print_json(esp_hass_tx_frame_t *frame, cJSON *json, int id)
+{
+	if (cJSON_AddNumberToObject(json, "id", id) == NULL) {
+		return ESP_FAIL;
+	}
+	if (cJSON_PrintPreallocated(json, frame->w.buf, frame->w.size,
+		false)) {
+		frame->w.len = strlen(frame->w.buf);
+		return ESP_OK;
+	}
+	ESP_LOGD(TAG, "larger than CONFIG_ESP_HASS_TX_BUFFER_SIZE, allocating");
+	frame->heap_text = cJSON_PrintUnformatted(json);
+	if (frame->heap_text == NULL) {
+		ESP_LOGE(TAG, "cJSON_PrintUnformatted(): Out of memory");
+		return ESP_ERR_NO_MEM;
+	}
+	frame->w.len = strlen(frame->heap_text);
+	return ESP_OK;
+}
+
 esp_err_t
 esp_hass_send_message_json(esp_hass_client_handle_t client, cJSON *json)
 {
-	int length, json_string_length;
 	esp_err_t err = ESP_FAIL;
-	char *json_string = NULL;
+	esp_hass_tx_frame_t *frame = NULL;
+	int id;
 
-	if (client == NULL) {
-		err = ESP_ERR_INVALID_ARG;
-		goto fail;
+	if (client == NULL || json == NULL) {
+		return ESP_ERR_INVALID_ARG;
 	}
-
-	if (cJSON_AddNumberToObject(json, "id", ++client->message_id) == NULL) {
-		err = ESP_FAIL;
-		goto fail;
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
+	}
+	id = next_message_id(client);
+	err = print_json(frame, json, id);
+	if (err != ESP_OK) {
+		esp_hass_tx_abort(&client->tx, frame);
+		return err;
 	}
+	ESP_LOGI(TAG, "Sending message id: %d", id);
+	frame->id = id;
+	esp_hass_tx_commit(&client->tx, frame);
+	return ESP_OK;
+}
 
-	json_string = cJSON_Print(json);
-	if (json_string == NULL) {
-		ESP_LOGE(TAG, "cJSON_Print(): failed");
-		err = ESP_FAIL;
-		goto fail;
+esp_err_t
+esp_hass_send_command_async(esp_hass_client_handle_t client, cJSON *json,
+    esp_hass_result_handler_t callback, void *args, int *id)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_tx_frame_t *frame = NULL;
+	int command_id;
+
+	if (client == NULL || json == NULL) {
+		return ESP_ERR_INVALID_ARG;
 	}
-	ESP_LOGI(TAG, "Sending message id: %d", client->message_id);
-	json_string_length = strlen(json_string);
-	length = esp_websocket_client_send_text(client->ws_client_handle,
-	    json_string, json_string_length,
-	    client->config.command_send_timeout_sec);
-	if (length < 0) {
-		ESP_LOGE(TAG, "esp_websocket_client_send_text(): failed");
-		err = ESP_FAIL;
-		goto fail;
-	} else if (json_string_length != length) {
-		ESP_LOGE(TAG,
-		    "esp_websocket_client_send_text(): failed: data: %d bytes, data actually sent %d bytes",
-		    json_string_length, length);
-		err = ESP_FAIL;
-		goto fail;
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
 	}
-	err = ESP_OK;
-fail:
-	if (json_string != NULL) {
-		free(json_string);
-		json_string = NULL;
+	command_id = next_message_id(client);
+	err = print_json(frame, json, command_id);
+	if (err == ESP_OK) {
+		err = send_command(client, frame, command_id, callback, args);
+	} else {
+		esp_hass_tx_abort(&client->tx, frame);
+	}
+	if (err == ESP_OK && id != NULL) {
+		*id = command_id;
 	}
 	return err;
 }
 
-static cJSON *
-create_call_service_json(esp_hass_call_service_config_t *config)
+esp_err_t
+esp_hass_wait_result(esp_hass_client_handle_t client, int id,
+    esp_hass_message_t **msg, TickType_t ticks)
 {
-	cJSON *json = NULL;
-	cJSON *target = NULL;
+	if (client == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return esp_hass_pending_wait(&client->pending, id, msg, ticks);
+}
 
-	json = cJSON_CreateObject();
-	if (json == NULL) {
-		ESP_LOGE(TAG, "cJSON_CreateObject()");
-		goto fail;
+esp_err_t
+esp_hass_command_cancel(esp_hass_client_handle_t client, int id)
+{
+	if (client == NULL) {
+		return ESP_ERR_INVALID_ARG;
 	}
-	if (cJSON_AddStringToObject(json, "type", "call_service") == NULL) {
-		ESP_LOGE(TAG, "cJSON_AddStringToObject()");
-		goto fail;
+	return esp_hass_pending_cancel(&client->pending, id);
+}
+
+esp_err_t
+esp_hass_call_service_async(esp_hass_client_handle_t client,
+    const esp_hass_call_service_config_t *config,
+    esp_hass_result_handler_t callback, void *args, int *id)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_tx_frame_t *frame = NULL;
+	int command_id;
+
+	if (client == NULL || config == NULL || config->domain == NULL ||
+	    config->service == NULL) {
+		return ESP_ERR_INVALID_ARG;
 	}
-	if (cJSON_AddStringToObject(json, "domain", config->domain) == NULL) {
-		ESP_LOGE(TAG, "cJSON_AddStringToObject()");
+	ESP_LOGD(TAG, "domain: `%s` service: `%s` entity_id: `%s`",
+	    config->domain, config->service,
+	    config->entity_id != NULL ? config->entity_id : "");
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
+	}
+	command_id = next_message_id(client);
+	err = esp_hass_write_call_service(&frame->w, command_id, config);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_write_call_service(): %s",
+		    esp_err_to_name(err));
+		esp_hass_tx_abort(&client->tx, frame);
 		goto fail;
 	}
-	if (cJSON_AddStringToObject(json, "service", config->service) == NULL) {
-		ESP_LOGE(TAG, "cJSON_AddStringToObject()");
+	err = send_command(client, frame, command_id, callback, args);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "send_command(): `%s`", esp_err_to_name(err));
 		goto fail;
 	}
-
-	target = cJSON_CreateObject();
-	if (target == NULL) {
-		ESP_LOGE(TAG, "cJSON_CreateObject()");
-		goto fail_target;
-	}
-	if (cJSON_AddStringToObject(target, "entity_id", config->entity_id) ==
-	    NULL) {
-		ESP_LOGE(TAG, "cJSON_AddStringToObject()");
-		goto fail_target;
-	}
-	if (cJSON_AddItemToObject(json, "target", target) != true) {
-		ESP_LOGE(TAG, "cJSON_AddItemToObject()");
-		goto fail_target;
-	}
-	return json;
-fail_target:
-	if (target != NULL) {
-		cJSON_Delete(target);
-		target = NULL;
+	if (id != NULL) {
+		*id = command_id;
 	}
 fail:
-	if (json != NULL) {
-		cJSON_Delete(json);
-		json = NULL;
-	}
-	return NULL;
+	return err;
 }
 
 esp_err_t
@@ -894,51 +1768,32 @@ esp_hass_call_service(esp_hass_client_handle_t client,
     esp_hass_call_service_config_t *config)
 {
 	esp_err_t err = ESP_FAIL;
-	cJSON *json = NULL;
-	cJSON *json_error = NULL;
-	cJSON *json_error_msg = NULL;
 	esp_hass_message_t *msg = NULL;
+	esp_hass_command_result_t result;
+	int id;
 
-	ESP_LOGD(TAG, "domain: `%s` service: `%s` entity_id: `%s`",
-	    config->domain, config->service, config->entity_id);
-	json = create_call_service_json(config);
-	if (json == NULL) {
-		ESP_LOGE(TAG, "create_call_service_json:");
-		err = ESP_FAIL;
+	err = esp_hass_call_service_async(client, config, NULL, NULL, &id);
+	if (err != ESP_OK) {
 		goto fail;
 	}
-	err = esp_hass_send_message_json(client, json);
+
+	/* wait for the result of this command, not the next result */
+	err = esp_hass_wait_result(client, id, &msg, config->delay);
 	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "esp_hass_send_message_json: `%s`",
+		ESP_LOGE(TAG, "failed to receive result: %s",
 		    esp_err_to_name(err));
-		goto fail;
-	}
-	if (xQueueReceive(client->result_queue, &msg, config->delay) !=
-	    pdTRUE) {
-		ESP_LOGE(TAG, "failed to receive result: timeout");
-		err = ESP_FAIL;
-		goto fail;
-	}
-	if (msg->type != HASS_MESSAGE_TYPE_RESULT) {
-		ESP_LOGE(TAG,
-		    "Unexpected response from the server: result type: %d",
-		    msg->type);
 		err = ESP_FAIL;
 		goto fail;
 	}
-	if (msg->success) {
+	esp_hass_command_result_set(&result, msg);
+	if (result.err == ESP_OK) {
 		ESP_LOGI(TAG, "calling service %s on entity %s successful",
 		    config->service, config->entity_id);
 	} else {
 		ESP_LOGE(TAG, "server returned failure");
-		json_error = cJSON_GetObjectItemCaseSensitive(msg->json,
-		    "error");
-		json_error_msg = cJSON_GetObjectItemCaseSensitive(json_error,
-		    "message");
-		if (cJSON_IsString(json_error_msg) &&
-		    (json_error_msg->valuestring != NULL)) {
+		if (result.error_message[0] != '\0') {
 			ESP_LOGE(TAG, "error message: `%s`",
-			    json_error_msg->valuestring);
+			    result.error_message);
 		}
 		err = ESP_FAIL;
 		goto fail;
@@ -949,17 +1804,137 @@ fail:
 		esp_hass_message_destroy(msg);
 		msg = NULL;
 	}
-	if (json != NULL) {
-		cJSON_Delete(json);
-		json = NULL;
+	return err;
+}
+
+typedef struct {
+	esp_hass_client_handle_t client;
+	const esp_hass_call_service_config_t *configs;
+} call_services_t;
+
+static esp_err_t
+call_services_send(void *context, size_t i, int *id)
+{
+	call_services_t *c = context;
+
+	return esp_hass_call_service_async(c->client, &c->configs[i], NULL,
+	    NULL, id);
+}
+
+esp_err_t
+esp_hass_call_services(esp_hass_client_handle_t client,
+    const esp_hass_call_service_config_t *configs, size_t n,
+    esp_hass_command_result_t *results)
+{
+	esp_err_t err = ESP_FAIL;
+	call_services_t c = { .client = client, .configs = configs };
+	size_t i;
+
+	if (client == NULL || (n > 0 && (configs == NULL || results == NULL))) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	err = esp_hass_pending_pipeline(&client->pending, n, call_services_send,
+	    &c, results,
+	    client->config.result_recv_timeout_sec * 1000 / portTICK_PERIOD_MS);
+	for (i = 0; i < n; i++) {
+		if (results[i].err == ESP_FAIL &&
+		    results[i].error_message[0] != '\0') {
+			ESP_LOGE(TAG, "calling service %s on entity %s: `%s`",
+			    configs[i].service, configs[i].entity_id,
+			    results[i].error_message);
+		} else if (results[i].err != ESP_OK) {
+			ESP_LOGE(TAG, "calling service %s on entity %s: %s",
+			    configs[i].service, configs[i].entity_id,
+			    esp_err_to_name(results[i].err));
+		}
 	}
-	if (json_error != NULL) {
-		cJSON_Delete(json_error);
-		json_error = NULL;
+	return err;
+}
+
+/* a command that has been serialized once */
+struct esp_hass_prepared_command {
+	esp_hass_template_t template;
+};
+
+esp_err_t
+esp_hass_prepare_call_service(esp_hass_client_handle_t client,
+    const esp_hass_call_service_config_t *config,
+    esp_hass_prepared_command_handle_t *prepared)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_prepared_command_handle_t p = NULL;
+	esp_hass_writer_t w;
+	char *buf = NULL;
+
+	if (client == NULL || config == NULL || config->domain == NULL ||
+	    config->service == NULL || prepared == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	p = calloc(1, sizeof(*p));
+	buf = malloc(CONFIG_ESP_HASS_TX_BUFFER_SIZE);
+	if (p == NULL || buf == NULL) {
+		ESP_LOGE(TAG, "malloc(): Out of memory");
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+
+	/* the command is written into a buffer of the size of a frame. the ID
+	 * is written when the command is sent.
+	 */
+	esp_hass_writer_init(&w, buf, CONFIG_ESP_HASS_TX_BUFFER_SIZE);
+	err = esp_hass_write_call_service(&w, 0, config);
+	if (err == ESP_OK) {
+		err = esp_hass_template_init(&p->template, &w);
 	}
-	if (json_error_msg != NULL) {
-		cJSON_Delete(json_error_msg);
-		json_error_msg = NULL;
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_prepare_call_service(): %s",
+		    esp_err_to_name(err));
+		goto fail;
 	}
+	*prepared = p;
+	p = NULL;
+fail:
+	free(buf);
+	free(p);
 	return err;
 }
+
+esp_err_t
+esp_hass_prepared_command_send(esp_hass_client_handle_t client,
+    esp_hass_prepared_command_handle_t prepared,
+    esp_hass_result_handler_t callback, void *args, int *id)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_tx_frame_t *frame = NULL;
+	int command_id;
+
+	if (client == NULL || prepared == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	frame = begin_message(client);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
+	}
+	command_id = next_message_id(client);
+	err = esp_hass_template_write(&prepared->template, &frame->w,
+	    command_id);
+	if (err == ESP_OK) {
+		err = send_command(client, frame, command_id, callback, args);
+	} else {
+		esp_hass_tx_abort(&client->tx, frame);
+	}
+	if (err == ESP_OK && id != NULL) {
+		*id = command_id;
+	}
+	return err;
+}
+
+void
+esp_hass_prepared_command_delete(esp_hass_prepared_command_handle_t prepared)
+{
+	if (prepared == NULL) {
+		return;
+	}
+	esp_hass_template_free(&prepared->template);
+	free(prepared);
+}
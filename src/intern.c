@@ -0,0 +1,208 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+
+#define FNV_OFFSET_BASIS (2166136261u)
+#define FNV_PRIME (16777619u)
+
+static const char *TAG = "esp_hass:intern";
+
+esp_err_t
+esp_hass_intern_init(esp_hass_intern_t *table, size_t capacity)
+{
+	esp_err_t err = ESP_FAIL;
+	size_t i;
+
+	if (table == NULL || capacity > ESP_HASS_INTERN_MAX_CAPACITY) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(table, 0, sizeof(*table));
+	atomic_init(&table->count, 0);
+	table->lock = xSemaphoreCreateMutex();
+	if (table->lock == NULL) {
+		ESP_LOGE(TAG, "xSemaphoreCreateMutex(): Out of memory");
+		return ESP_ERR_NO_MEM;
+	}
+	if (capacity == 0) {
+		return ESP_OK;
+	}
+
+	/* keep the load factor at most a half so that probes are short */
+	table->n_slots = 1;
+	while (table->n_slots < capacity * 2) {
+		table->n_slots <<= 1;
+	}
+	table->capacity = capacity;
+	table->strings = heap_caps_calloc(table->capacity,
+	    sizeof(table->strings[0]), MALLOC_CAP_DEFAULT);
+	table->slots = heap_caps_calloc(table->n_slots,
+	    sizeof(table->slots[0]), MALLOC_CAP_DEFAULT);
+	if (table->strings == NULL || table->slots == NULL) {
+		ESP_LOGE(TAG, "heap_caps_calloc(): Out of memory");
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+	for (i = 0; i < table->n_slots; i++) {
+		atomic_init(&table->slots[i], 0);
+	}
+	return ESP_OK;
+fail:
+	esp_hass_intern_free(table);
+	return err;
+}
+
+void
+esp_hass_intern_free(esp_hass_intern_t *table)
+{
+	size_t i;
+
+	if (table == NULL) {
+		return;
+	}
+	if (table->strings != NULL) {
+		for (i = 0; i < atomic_load(&table->count); i++) {
+			free(table->strings[i]);
+		}
+		heap_caps_free(table->strings);
+	}
+	if (table->slots != NULL) {
+		heap_caps_free((void *)table->slots);
+	}
+	if (table->lock != NULL) {
+		vSemaphoreDelete(table->lock);
+	}
+	memset(table, 0, sizeof(*table));
+}
+
+static uint32_t
+hash(const char *str, size_t len)
+{
+	uint32_t h = FNV_OFFSET_BASIS;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t)str[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+/*
+ * find the slot of a string, or the empty slot where it would be added. a
+ * slot never becomes empty again, so that the probe of a lookup stops at
+ * the first empty slot.
+ */
+static uint16_t
+probe(esp_hass_intern_t *table, const char *str, size_t len, uint16_t *id)
+{
+	uint16_t mask = table->n_slots - 1;
+	uint16_t i = hash(str, len) & mask;
+	uint16_t v;
+	const char *s = NULL;
+
+	for (;;) {
+		v = atomic_load_explicit(&table->slots[i],
+		    memory_order_acquire);
+		if (v == 0) {
+			*id = 0;
+			return i;
+		}
+		s = table->strings[v - 1];
+		if (strncmp(s, str, len) == 0 && s[len] == '\0') {
+			*id = v;
+			return i;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+esp_err_t
+esp_hass_intern(esp_hass_intern_t *table, const char *str, size_t len,
+    bool add, uint16_t *id)
+{
+	esp_err_t err = ESP_FAIL;
+	uint16_t slot, found, count;
+	char *copy = NULL;
+
+	if (table == NULL || str == NULL || id == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (table->capacity == 0) {
+		return add ? ESP_ERR_NO_MEM : ESP_ERR_NOT_FOUND;
+	}
+	probe(table, str, len, &found);
+	if (found != 0) {
+		*id = found - 1;
+		return ESP_OK;
+	}
+	if (!add) {
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	/* another task may have added the string before the lock is taken */
+	xSemaphoreTake(table->lock, portMAX_DELAY);
+	slot = probe(table, str, len, &found);
+	if (found != 0) {
+		*id = found - 1;
+		err = ESP_OK;
+		goto fail;
+	}
+	count = atomic_load(&table->count);
+	if (count >= table->capacity) {
+		ESP_LOGW(TAG, "the table is full, capacity: %d",
+		    table->capacity);
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+	copy = malloc(len + 1);
+	if (copy == NULL) {
+		ESP_LOGE(TAG, "malloc(): Out of memory");
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	table->strings[count] = copy;
+	atomic_store(&table->count, count + 1);
+	atomic_store_explicit(&table->slots[slot], count + 1,
+	    memory_order_release);
+	*id = count;
+	err = ESP_OK;
+fail:
+	xSemaphoreGive(table->lock);
+	return err;
+}
+
+const char *
+esp_hass_intern_string(esp_hass_intern_t *table, uint16_t id)
+{
+	if (table == NULL || id >= atomic_load(&table->count)) {
+		return NULL;
+	}
+	return table->strings[id];
+}
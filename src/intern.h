@@ -0,0 +1,105 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __INTERN__H__
+#define __INTERN__H__
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Maximum capacity of an intern table.
+ */
+#define ESP_HASS_INTERN_MAX_CAPACITY (0x4000)
+
+/**
+ * A table of strings, such as `entity_id`, that maps each string to a small
+ * integer so that consumers compare integers instead of strings.
+ *
+ * The table is an open-addressing hash table of a fixed capacity. Strings
+ * are never removed, and an id is valid until the table is freed. Lookups
+ * do not take the lock. Tasks that add strings take the lock, and publish a
+ * string after it has been copied.
+ */
+typedef struct {
+	char **strings;		 /*!< The strings by id */
+	_Atomic uint16_t *slots; /*!< id + 1 of the string in each slot, or
+				    zero */
+	uint16_t n_slots;	 /*!< Number of slots, a power of two */
+	uint16_t capacity;	 /*!< Maximum number of strings */
+	_Atomic uint16_t count;	 /*!< Number of strings */
+	SemaphoreHandle_t lock;	 /*!< The lock for adding strings */
+} esp_hass_intern_t;
+
+/**
+ * @brief Allocate an intern table.
+ *
+ * @param[in] table The table.
+ * @param[in] capacity Maximum number of strings. Zero is allowed, and no
+ * strings are added.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if table is NULL, or capacity is too large
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_intern_init(esp_hass_intern_t *table, size_t capacity);
+
+/**
+ * @brief Free an intern table, and its strings.
+ *
+ * @param[in] table The table.
+ */
+void esp_hass_intern_free(esp_hass_intern_t *table);
+
+/**
+ * @brief Find a string, and optionally add it.
+ *
+ * @param[in] table The table.
+ * @param[in] str The string, which does not have to be null-terminated.
+ * @param[in] len Length of `str`.
+ * @param[in] add Add the string when it is not in the table.
+ * @param[out] id The id of the string.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if table, str, or id is NULL
+ * - ESP_ERR_NOT_FOUND if the string is not in the table, and `add` is false
+ * - ESP_ERR_NO_MEM if the table is full, or out of memory
+ */
+esp_err_t esp_hass_intern(esp_hass_intern_t *table, const char *str,
+    size_t len, bool add, uint16_t *id);
+
+/**
+ * @brief Get a string by its id.
+ *
+ * @param[in] table The table.
+ * @param[in] id The id.
+ *
+ * @return
+ * - The null-terminated string
+ * - NULL if id is unknown
+ */
+const char *esp_hass_intern_string(esp_hass_intern_t *table, uint16_t id);
+
+#endif
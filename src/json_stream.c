@@ -0,0 +1,674 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "json_stream.h"
+#include "rx_buffer.h"
+
+static const char *TAG = "esp_hass:json_stream";
+
+static bool
+is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool
+is_number_char(char c)
+{
+	return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+	    c == 'e' || c == 'E';
+}
+
+static void
+token_clear(esp_hass_json_stream_t *stream)
+{
+	stream->token.len = 0;
+	if (stream->token.data != NULL) {
+		stream->token.data[0] = '\0';
+	}
+}
+
+static esp_err_t
+stream_fail(esp_hass_json_stream_t *stream, const char *reason)
+{
+	ESP_LOGE(TAG, "parse error: %s", reason);
+	stream->state = JSON_STREAM_STATE_ERROR;
+	return ESP_FAIL;
+}
+
+static char *
+stream_strndup(esp_hass_json_stream_t *stream, const char *str, size_t len)
+{
+	char *copy = NULL;
+
+	if (stream->use_arena) {
+		return esp_hass_arena_strndup(&stream->arena, str, len);
+	}
+	copy = cJSON_malloc(len + 1);
+	if (copy == NULL) {
+		return NULL;
+	}
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+/* create an item as cJSON_New_Item() does */
+static cJSON *
+stream_new_item(esp_hass_json_stream_t *stream, int type)
+{
+	cJSON *item = NULL;
+
+	if (stream->use_arena) {
+		item = esp_hass_arena_alloc(&stream->arena, sizeof(cJSON));
+	} else {
+		item = cJSON_malloc(sizeof(cJSON));
+	}
+	if (item == NULL) {
+		return NULL;
+	}
+	memset(item, 0, sizeof(cJSON));
+	item->type = type;
+	return item;
+}
+
+/* release memory that has not been attached to the tree */
+static void
+stream_free(esp_hass_json_stream_t *stream, void *ptr)
+{
+	if (!stream->use_arena) {
+		cJSON_free(ptr);
+	}
+}
+
+/* the state after a value has been completed */
+static void
+stream_value_done(esp_hass_json_stream_t *stream)
+{
+	stream->state = stream->depth == 0 ? JSON_STREAM_STATE_DONE :
+						   JSON_STREAM_STATE_NEXT;
+}
+
+/*
+ * attach a new item to the current container, or make it the root. the
+ * pending key, if any, is moved to the item.
+ */
+static esp_err_t
+stream_attach(esp_hass_json_stream_t *stream, cJSON *item)
+{
+	cJSON *parent = NULL;
+
+	if (item == NULL) {
+		return stream_fail(stream, "out of memory");
+	}
+	if (stream->depth == 0) {
+		stream->root = item;
+		return ESP_OK;
+	}
+	parent = stream->stack[stream->depth - 1];
+	if (cJSON_IsObject(parent)) {
+		item->string = stream->key;
+		stream->key = NULL;
+	}
+
+	/* append in O(1). like cJSON, prev of the first child points to the
+	 * last child.
+	 */
+	if (parent->child == NULL) {
+		parent->child = item;
+		item->prev = item;
+	} else {
+		item->prev = parent->child->prev;
+		parent->child->prev->next = item;
+		parent->child->prev = item;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t
+stream_open(esp_hass_json_stream_t *stream, bool is_object)
+{
+	cJSON *item = NULL;
+
+	if (stream->depth >= ESP_HASS_JSON_STREAM_MAX_DEPTH) {
+		return stream_fail(stream, "too deeply nested");
+	}
+	item = stream_new_item(stream, is_object ? cJSON_Object : cJSON_Array);
+	if (stream_attach(stream, item) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	stream->stack[stream->depth++] = item;
+	stream->state = is_object ? JSON_STREAM_STATE_KEY_OR_END :
+					  JSON_STREAM_STATE_VALUE_OR_END;
+	return ESP_OK;
+}
+
+static esp_err_t
+stream_close(esp_hass_json_stream_t *stream, char c)
+{
+	cJSON *container = stream->stack[stream->depth - 1];
+
+	if ((c == '}') != cJSON_IsObject(container)) {
+		return stream_fail(stream, "mismatched bracket");
+	}
+	stream->depth--;
+	stream_value_done(stream);
+	return ESP_OK;
+}
+
+static esp_err_t
+stream_end_string(esp_hass_json_stream_t *stream)
+{
+	const char *token = stream->token.data != NULL ? stream->token.data :
+							 "";
+	cJSON *item = NULL;
+
+	if (stream->is_key) {
+		stream->key = stream_strndup(stream, token, stream->token.len);
+		if (stream->key == NULL) {
+			return stream_fail(stream, "out of memory");
+		}
+		stream->state = JSON_STREAM_STATE_COLON;
+		return ESP_OK;
+	}
+	item = stream_new_item(stream, cJSON_String);
+	if (item != NULL) {
+		item->valuestring = stream_strndup(stream, token,
+		    stream->token.len);
+		if (item->valuestring == NULL) {
+			stream_free(stream, item);
+			item = NULL;
+		}
+	}
+	if (stream_attach(stream, item) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	stream_value_done(stream);
+	return ESP_OK;
+}
+
+static esp_err_t
+stream_end_number(esp_hass_json_stream_t *stream)
+{
+	char *end = NULL;
+	cJSON *item = NULL;
+	double number;
+
+	number = strtod(stream->token.data, &end);
+	if (end != stream->token.data + stream->token.len) {
+		return stream_fail(stream, "invalid number");
+	}
+
+	/* saturate valueint as cJSON_CreateNumber() does */
+	item = stream_new_item(stream, cJSON_Number);
+	if (item != NULL) {
+		item->valuedouble = number;
+		if (number >= INT_MAX) {
+			item->valueint = INT_MAX;
+		} else if (number <= (double)INT_MIN) {
+			item->valueint = INT_MIN;
+		} else {
+			item->valueint = (int)number;
+		}
+	}
+	if (stream_attach(stream, item) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	stream_value_done(stream);
+	return ESP_OK;
+}
+
+static esp_err_t
+stream_end_literal(esp_hass_json_stream_t *stream)
+{
+	cJSON *item = NULL;
+
+	stream->literal[stream->literal_len] = '\0';
+	if (strcmp(stream->literal, "true") == 0) {
+		item = stream_new_item(stream, cJSON_True);
+	} else if (strcmp(stream->literal, "false") == 0) {
+		item = stream_new_item(stream, cJSON_False);
+	} else if (strcmp(stream->literal, "null") == 0) {
+		item = stream_new_item(stream, cJSON_NULL);
+	} else {
+		return stream_fail(stream, "invalid literal");
+	}
+	if (stream_attach(stream, item) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	stream_value_done(stream);
+	return ESP_OK;
+}
+
+static esp_err_t
+stream_append(esp_hass_json_stream_t *stream, const char *data, size_t len)
+{
+	if (esp_hass_rx_buffer_append(&stream->token, data, len) != ESP_OK) {
+		return stream_fail(stream, "token too long");
+	}
+	return ESP_OK;
+}
+
+/* append a code point to the token in UTF-8 */
+static esp_err_t
+stream_append_codepoint(esp_hass_json_stream_t *stream, uint32_t cp)
+{
+	char utf8[4];
+	size_t len = 0;
+
+	if (cp < 0x80) {
+		utf8[len++] = (char)cp;
+	} else if (cp < 0x800) {
+		utf8[len++] = (char)(0xc0 | (cp >> 6));
+		utf8[len++] = (char)(0x80 | (cp & 0x3f));
+	} else if (cp < 0x10000) {
+		utf8[len++] = (char)(0xe0 | (cp >> 12));
+		utf8[len++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		utf8[len++] = (char)(0x80 | (cp & 0x3f));
+	} else {
+		utf8[len++] = (char)(0xf0 | (cp >> 18));
+		utf8[len++] = (char)(0x80 | ((cp >> 12) & 0x3f));
+		utf8[len++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		utf8[len++] = (char)(0x80 | (cp & 0x3f));
+	}
+	return stream_append(stream, utf8, len);
+}
+
+static esp_err_t
+stream_end_unicode(esp_hass_json_stream_t *stream)
+{
+	uint32_t cp = stream->codepoint;
+
+	if (stream->high_surrogate != 0) {
+		if (cp < 0xdc00 || cp > 0xdfff) {
+			return stream_fail(stream, "invalid surrogate pair");
+		}
+		cp = 0x10000 + ((stream->high_surrogate - 0xd800) << 10) +
+		    (cp - 0xdc00);
+		stream->high_surrogate = 0;
+	} else if (cp >= 0xd800 && cp <= 0xdbff) {
+		stream->high_surrogate = cp;
+		stream->state = JSON_STREAM_STATE_SURROGATE;
+		return ESP_OK;
+	} else if (cp >= 0xdc00 && cp <= 0xdfff) {
+		return stream_fail(stream, "invalid surrogate pair");
+	}
+	stream->state = JSON_STREAM_STATE_STRING;
+	return stream_append_codepoint(stream, cp);
+}
+
+static esp_err_t
+stream_escape(esp_hass_json_stream_t *stream, char c)
+{
+	char unescaped;
+
+	switch (c) {
+	case '"':
+	case '\\':
+	case '/':
+		unescaped = c;
+		break;
+	case 'b':
+		unescaped = '\b';
+		break;
+	case 'f':
+		unescaped = '\f';
+		break;
+	case 'n':
+		unescaped = '\n';
+		break;
+	case 'r':
+		unescaped = '\r';
+		break;
+	case 't':
+		unescaped = '\t';
+		break;
+	case 'u':
+		stream->codepoint = 0;
+		stream->hex_digits = 0;
+		stream->state = JSON_STREAM_STATE_UNICODE;
+		return ESP_OK;
+	default:
+		return stream_fail(stream, "invalid escape");
+	}
+	stream->state = JSON_STREAM_STATE_STRING;
+	return stream_append(stream, &unescaped, 1);
+}
+
+static esp_err_t
+stream_hex(esp_hass_json_stream_t *stream, char c)
+{
+	uint32_t digit;
+
+	if (c >= '0' && c <= '9') {
+		digit = c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		digit = c - 'a' + 10;
+	} else if (c >= 'A' && c <= 'F') {
+		digit = c - 'A' + 10;
+	} else {
+		return stream_fail(stream, "invalid unicode escape");
+	}
+	stream->codepoint = (stream->codepoint << 4) | digit;
+	if (++stream->hex_digits < 4) {
+		return ESP_OK;
+	}
+	return stream_end_unicode(stream);
+}
+
+/* the first character of a value */
+static esp_err_t
+stream_begin_value(esp_hass_json_stream_t *stream, char c)
+{
+	switch (c) {
+	case '{':
+		return stream_open(stream, true);
+	case '[':
+		return stream_open(stream, false);
+	case '"':
+		token_clear(stream);
+		stream->is_key = false;
+		stream->state = JSON_STREAM_STATE_STRING;
+		return ESP_OK;
+	case 't':
+	case 'f':
+	case 'n':
+		stream->literal[0] = c;
+		stream->literal_len = 1;
+		stream->state = JSON_STREAM_STATE_LITERAL;
+		return ESP_OK;
+	default:
+		if (c == '-' || (c >= '0' && c <= '9')) {
+			token_clear(stream);
+			stream->state = JSON_STREAM_STATE_NUMBER;
+			return stream_append(stream, &c, 1);
+		}
+	}
+	return stream_fail(stream, "unexpected character");
+}
+
+esp_err_t
+esp_hass_json_stream_init(esp_hass_json_stream_t *stream, size_t token_size,
+    size_t token_max_size, size_t arena_block_size, uint32_t caps)
+{
+	esp_err_t err = ESP_FAIL;
+
+	if (stream == NULL) {
+		err = ESP_ERR_INVALID_ARG;
+		goto fail;
+	}
+	memset(stream, 0, sizeof(*stream));
+	err = esp_hass_rx_buffer_init(&stream->token, token_size,
+	    token_max_size, caps);
+	if (err != ESP_OK) {
+		goto fail;
+	}
+	if (arena_block_size > 0) {
+		err = esp_hass_arena_init(&stream->arena, arena_block_size,
+		    caps);
+		if (err != ESP_OK) {
+			goto fail;
+		}
+		stream->use_arena = true;
+	}
+	stream->state = JSON_STREAM_STATE_VALUE;
+fail:
+	return err;
+}
+
+void
+esp_hass_json_stream_reset(esp_hass_json_stream_t *stream)
+{
+	if (stream->use_arena) {
+		esp_hass_arena_free(&stream->arena);
+	} else {
+		if (stream->root != NULL) {
+			cJSON_Delete(stream->root);
+		}
+		if (stream->key != NULL) {
+			cJSON_free(stream->key);
+		}
+	}
+	stream->root = NULL;
+	stream->key = NULL;
+	stream->depth = 0;
+	stream->high_surrogate = 0;
+	stream->literal_len = 0;
+	stream->state = JSON_STREAM_STATE_VALUE;
+	esp_hass_rx_buffer_reset(&stream->token);
+}
+
+void
+esp_hass_json_stream_free(esp_hass_json_stream_t *stream)
+{
+	if (stream == NULL) {
+		return;
+	}
+	esp_hass_json_stream_reset(stream);
+	esp_hass_rx_buffer_free(&stream->token);
+}
+
+esp_err_t
+esp_hass_json_stream_feed(esp_hass_json_stream_t *stream, const char *data,
+    size_t len)
+{
+	const char *p = data;
+	const char *end = data + len;
+	const char *run = NULL;
+	esp_err_t err = ESP_OK;
+	char c;
+
+	if (stream == NULL || data == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	while (p < end && err == ESP_OK) {
+		c = *p;
+		switch (stream->state) {
+		case JSON_STREAM_STATE_VALUE_OR_END:
+			if (c == ']') {
+				err = stream_close(stream, c);
+				p++;
+				break;
+			}
+			/* FALLTHROUGH */
+		case JSON_STREAM_STATE_VALUE:
+			if (!is_space(c)) {
+				err = stream_begin_value(stream, c);
+			}
+			p++;
+			break;
+		case JSON_STREAM_STATE_KEY_OR_END:
+			if (c == '}') {
+				err = stream_close(stream, c);
+				p++;
+				break;
+			}
+			/* FALLTHROUGH */
+		case JSON_STREAM_STATE_KEY:
+			if (c == '"') {
+				token_clear(stream);
+				stream->is_key = true;
+				stream->state = JSON_STREAM_STATE_STRING;
+			} else if (!is_space(c)) {
+				err = stream_fail(stream, "expecting a key");
+			}
+			p++;
+			break;
+		case JSON_STREAM_STATE_COLON:
+			if (c == ':') {
+				stream->state = JSON_STREAM_STATE_VALUE;
+			} else if (!is_space(c)) {
+				err = stream_fail(stream, "expecting `:`");
+			}
+			p++;
+			break;
+		case JSON_STREAM_STATE_NEXT:
+			if (c == ',') {
+				stream->state =
+				    cJSON_IsObject(
+					stream->stack[stream->depth - 1]) ?
+					  JSON_STREAM_STATE_KEY :
+					  JSON_STREAM_STATE_VALUE;
+			} else if (c == '}' || c == ']') {
+				err = stream_close(stream, c);
+			} else if (!is_space(c)) {
+				err = stream_fail(stream, "expecting `,`");
+			}
+			p++;
+			break;
+		case JSON_STREAM_STATE_STRING:
+
+			/* copy a run of plain characters at once */
+			run = p;
+			while (p < end && *p != '"' && *p != '\\') {
+				p++;
+			}
+			if (p > run) {
+				err = stream_append(stream, run, p - run);
+			}
+			if (err != ESP_OK || p == end) {
+				break;
+			}
+			if (*p == '"') {
+				err = stream_end_string(stream);
+			} else {
+				stream->state = JSON_STREAM_STATE_ESCAPE;
+			}
+			p++;
+			break;
+		case JSON_STREAM_STATE_ESCAPE:
+			err = stream_escape(stream, c);
+			p++;
+			break;
+		case JSON_STREAM_STATE_UNICODE:
+			err = stream_hex(stream, c);
+			p++;
+			break;
+		case JSON_STREAM_STATE_SURROGATE:
+			if (c == '\\') {
+				stream->state = JSON_STREAM_STATE_SURROGATE_U;
+			} else {
+				err = stream_fail(stream,
+				    "invalid surrogate pair");
+			}
+			p++;
+			break;
+		case JSON_STREAM_STATE_SURROGATE_U:
+			if (c == 'u') {
+				stream->codepoint = 0;
+				stream->hex_digits = 0;
+				stream->state = JSON_STREAM_STATE_UNICODE;
+			} else {
+				err = stream_fail(stream,
+				    "invalid surrogate pair");
+			}
+			p++;
+			break;
+		case JSON_STREAM_STATE_NUMBER:
+			run = p;
+			while (p < end && is_number_char(*p)) {
+				p++;
+			}
+			if (p > run) {
+				err = stream_append(stream, run, p - run);
+			}
+
+			/* the character after the number is processed in the
+			 * next state
+			 */
+			if (err == ESP_OK && p < end) {
+				err = stream_end_number(stream);
+			}
+			break;
+		case JSON_STREAM_STATE_LITERAL:
+			if (c >= 'a' && c <= 'z') {
+				if (stream->literal_len >=
+				    (int)sizeof(stream->literal) - 1) {
+					err = stream_fail(stream,
+					    "invalid literal");
+					break;
+				}
+				stream->literal[stream->literal_len++] = c;
+				p++;
+				break;
+			}
+			err = stream_end_literal(stream);
+			break;
+		case JSON_STREAM_STATE_DONE:
+			if (!is_space(c)) {
+				err = stream_fail(stream,
+				    "garbage after the value");
+			}
+			p++;
+			break;
+		case JSON_STREAM_STATE_ERROR:
+		default:
+			err = ESP_FAIL;
+			break;
+		}
+	}
+	return err;
+}
+
+cJSON *
+esp_hass_json_stream_finish(esp_hass_json_stream_t *stream,
+    esp_hass_arena_t *arena)
+{
+	cJSON *root = NULL;
+
+	if (stream == NULL) {
+		goto fail;
+	}
+
+	/* a number, or a literal, at the root ends with the input */
+	if (stream->depth == 0) {
+		if (stream->state == JSON_STREAM_STATE_NUMBER) {
+			stream_end_number(stream);
+		} else if (stream->state == JSON_STREAM_STATE_LITERAL) {
+			stream_end_literal(stream);
+		}
+	}
+	if (stream->state != JSON_STREAM_STATE_DONE) {
+		ESP_LOGE(TAG, "incomplete JSON");
+		goto fail;
+	}
+	if (stream->use_arena) {
+		if (arena == NULL) {
+			ESP_LOGE(TAG, "arena is NULL");
+			goto fail;
+		}
+		esp_hass_arena_record(&stream->arena);
+		esp_hass_arena_move(arena, &stream->arena);
+	}
+	root = stream->root;
+	stream->root = NULL;
+fail:
+	if (stream != NULL) {
+		esp_hass_json_stream_reset(stream);
+	}
+	return root;
+}
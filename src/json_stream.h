@@ -0,0 +1,147 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __JSON_STREAM__H__
+#define __JSON_STREAM__H__
+
+#include <cJSON.h>
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "rx_buffer.h"
+
+#define ESP_HASS_JSON_STREAM_MAX_DEPTH CONFIG_ESP_HASS_JSON_MAX_DEPTH
+
+/**
+ * States of the streaming JSON parser.
+ */
+typedef enum {
+	JSON_STREAM_STATE_VALUE = 0,	 /*!< Expecting a value */
+	JSON_STREAM_STATE_VALUE_OR_END,	 /*!< Expecting a value or `]` */
+	JSON_STREAM_STATE_KEY,		 /*!< Expecting a key */
+	JSON_STREAM_STATE_KEY_OR_END,	 /*!< Expecting a key or `}` */
+	JSON_STREAM_STATE_COLON,	 /*!< Expecting `:` */
+	JSON_STREAM_STATE_NEXT,		 /*!< Expecting `,` or end of container */
+	JSON_STREAM_STATE_STRING,	 /*!< In a string */
+	JSON_STREAM_STATE_ESCAPE,	 /*!< After `\` in a string */
+	JSON_STREAM_STATE_UNICODE,	 /*!< In `\uXXXX` */
+	JSON_STREAM_STATE_SURROGATE,	 /*!< Expecting `\` of a low surrogate */
+	JSON_STREAM_STATE_SURROGATE_U,	 /*!< Expecting `u` of a low surrogate */
+	JSON_STREAM_STATE_NUMBER,	 /*!< In a number */
+	JSON_STREAM_STATE_LITERAL,	 /*!< In `true`, `false`, or `null` */
+	JSON_STREAM_STATE_DONE,		 /*!< The root value is complete */
+	JSON_STREAM_STATE_ERROR,	 /*!< Syntax error, or out of memory */
+} esp_hass_json_stream_state_t;
+
+/**
+ * An incremental JSON parser. The parser consumes input in arbitrary
+ * fragments, and builds a cJSON tree as the fragments arrive. Only the
+ * current token, i.e. a string or a number, is buffered.
+ *
+ * The items of the tree are allocated with cJSON_malloc(), or, when an
+ * arena block size is given, from an arena that is handed over with the
+ * tree.
+ */
+typedef struct {
+	esp_hass_json_stream_state_t state; /*!< The current state */
+	bool is_key;	       /*!< The current string is an object key */
+	int hex_digits;	       /*!< Number of hex digits read in `\uXXXX` */
+	uint32_t codepoint;    /*!< Code point being decoded in `\uXXXX` */
+	uint32_t high_surrogate; /*!< Pending high surrogate, or zero */
+	char literal[6];       /*!< The current literal */
+	int literal_len;       /*!< Length of `literal` */
+	int depth;	       /*!< Number of open containers */
+	cJSON *stack[ESP_HASS_JSON_STREAM_MAX_DEPTH]; /*!< Open containers */
+	cJSON *root;	       /*!< The root value */
+	char *key;	       /*!< Key of the next object member */
+	esp_hass_rx_buffer_t token; /*!< The current token */
+	bool use_arena;		    /*!< Allocate the tree from `arena` */
+	esp_hass_arena_t arena;	    /*!< The arena of the tree */
+} esp_hass_json_stream_t;
+
+/**
+ * @brief Initialize the parser.
+ *
+ * @param[in] stream The parser.
+ * @param[in] token_size Size of the token buffer to keep between messages.
+ * @param[in] token_max_size Maximum length of a token, including NULL.
+ * @param[in] arena_block_size Size of the first arena block, or zero to
+ * allocate the tree with cJSON_malloc().
+ * @param[in] caps Memory capabilities of the token buffer, and the arena.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if stream is NULL, or sizes are invalid
+ */
+esp_err_t esp_hass_json_stream_init(esp_hass_json_stream_t *stream,
+    size_t token_size, size_t token_max_size, size_t arena_block_size,
+    uint32_t caps);
+
+/**
+ * @brief Discard the partially parsed value, and prepare for a new value.
+ *
+ * @param[in] stream The parser.
+ */
+void esp_hass_json_stream_reset(esp_hass_json_stream_t *stream);
+
+/**
+ * @brief Free the memory held by the parser.
+ *
+ * @param[in] stream The parser.
+ */
+void esp_hass_json_stream_free(esp_hass_json_stream_t *stream);
+
+/**
+ * @brief Feed a fragment to the parser.
+ *
+ * After an error, the parser ignores input until
+ * `esp_hass_json_stream_reset()` is called.
+ *
+ * @param[in] stream The parser.
+ * @param[in] data The fragment.
+ * @param[in] len Length of `data`.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if stream or data is NULL
+ * - ESP_FAIL if the input is not a valid JSON, or the parser has failed
+ */
+esp_err_t esp_hass_json_stream_feed(esp_hass_json_stream_t *stream,
+    const char *data, size_t len);
+
+/**
+ * @brief Finish parsing, and take the parsed value. The parser is reset for
+ * the next value.
+ *
+ * @param[in] stream The parser.
+ * @param[out] arena An empty arena that receives the memory of the value.
+ * Must not be NULL when the parser uses an arena. Ignored otherwise.
+ *
+ * @return
+ * - Pointer to cJSON if the value is complete. Without an arena, the caller
+ *   must free it with cJSON_Delete(). With an arena, the caller must free the
+ *   arena with esp_hass_arena_free() instead.
+ * - NULL if the value is incomplete, or invalid.
+ */
+cJSON *esp_hass_json_stream_finish(esp_hass_json_stream_t *stream,
+    esp_hass_arena_t *arena);
+
+#endif
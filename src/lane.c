@@ -0,0 +1,265 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "lane.h"
+#include "parser.h"
+#include "ring.h"
+
+static const char *TAG = "esp_hass:lane";
+
+esp_err_t
+esp_hass_event_lane_init(esp_hass_event_lane_t *lane, QueueHandle_t queue,
+    esp_hass_ring_handle_t ring, esp_hass_overload_policy_t policy,
+    esp_hass_intern_t *entities, esp_hass_intern_t *event_types)
+{
+	size_t i;
+
+	if (lane == NULL || entities == NULL || event_types == NULL ||
+	    policy < HASS_OVERLOAD_POLICY_DROP_NEWEST ||
+	    policy > HASS_OVERLOAD_POLICY_COALESCE) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(lane, 0, sizeof(*lane));
+	lane->queue = queue;
+	lane->ring = ring;
+	lane->policy = policy;
+	lane->entities = entities;
+	lane->event_types = event_types;
+	atomic_init(&lane->n_dropped, 0);
+	atomic_init(&lane->n_coalesced, 0);
+	if (policy != HASS_OVERLOAD_POLICY_COALESCE ||
+	    entities->capacity == 0) {
+		return ESP_OK;
+	}
+	lane->slots = malloc(entities->capacity * sizeof(lane->slots[0]));
+	if (lane->slots == NULL) {
+		ESP_LOGE(TAG, "malloc(): Out of memory");
+		return ESP_ERR_NO_MEM;
+	}
+	lane->n_slots = entities->capacity;
+	for (i = 0; i < lane->n_slots; i++) {
+		atomic_init(&lane->slots[i], NULL);
+	}
+	return ESP_OK;
+}
+
+void
+esp_hass_event_lane_free(esp_hass_event_lane_t *lane)
+{
+	size_t i;
+
+	if (lane == NULL || lane->slots == NULL) {
+		return;
+	}
+	for (i = 0; i < lane->n_slots; i++) {
+		esp_hass_message_release(
+		    atomic_exchange(&lane->slots[i], NULL));
+	}
+	free(lane->slots);
+	lane->slots = NULL;
+	lane->n_slots = 0;
+}
+
+bool
+esp_hass_event_lane_is_enabled(const esp_hass_event_lane_t *lane)
+{
+	return lane->queue != NULL || lane->ring != NULL;
+}
+
+/* get the message of an item, taking it from the slot if the item is a
+ * slot
+ */
+static esp_hass_message_t *
+take_item(esp_hass_event_lane_t *lane, void *item)
+{
+	uintptr_t slots = (uintptr_t)lane->slots;
+
+	if (lane->slots != NULL && (uintptr_t)item >= slots &&
+	    (uintptr_t)item < slots + lane->n_slots * sizeof(lane->slots[0])) {
+		return atomic_exchange((esp_hass_coalesce_slot_t *)item, NULL);
+	}
+	return item;
+}
+
+/* the coalescing slot of a `state_changed` event, or NULL */
+static esp_hass_coalesce_slot_t *
+coalesce_slot(esp_hass_event_lane_t *lane, esp_hass_message_t *msg)
+{
+	esp_hass_entity_t entity;
+
+	if (lane->slots == NULL ||
+	    esp_hass_message_event_id(msg, lane->event_types) !=
+		ESP_HASS_EVENT_ID_STATE_CHANGED ||
+	    esp_hass_message_add_entity(msg, lane->entities, &entity) !=
+		ESP_OK ||
+	    entity >= lane->n_slots) {
+		return NULL;
+	}
+	return &lane->slots[entity];
+}
+
+static bool
+push(esp_hass_event_lane_t *lane, void *item, bool to_front)
+{
+	if (lane->ring != NULL) {
+		return esp_hass_ring_send(lane->ring, item, 0) == ESP_OK;
+	}
+	if (to_front) {
+		return xQueueSendToFront(lane->queue, &item, 0) == pdTRUE;
+	}
+	return xQueueSend(lane->queue, &item, 0) == pdTRUE;
+}
+
+/* release the oldest event in the lane to make space */
+static bool
+drop_oldest(esp_hass_event_lane_t *lane)
+{
+	void *item = NULL;
+
+	if (lane->ring != NULL) {
+		if (!esp_hass_ring_pop(lane->ring, &item)) {
+			return false;
+		}
+	} else if (xQueueReceive(lane->queue, &item, 0) != pdTRUE) {
+		return false;
+	}
+	esp_hass_message_release(take_item(lane, item));
+	atomic_fetch_add(&lane->n_dropped, 1);
+	return true;
+}
+
+esp_err_t
+esp_hass_event_lane_send(esp_hass_event_lane_t *lane, esp_hass_message_t *msg)
+{
+	esp_hass_coalesce_slot_t *slot = NULL;
+	esp_hass_message_t *queued = NULL;
+	void *item = msg;
+	bool to_front = false;
+	bool sent = false;
+
+	if (!esp_hass_event_lane_is_enabled(lane)) {
+		esp_hass_message_release(msg);
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (msg->type == HASS_MESSAGE_TYPE_PONG) {
+		to_front = true;
+	} else if (lane->policy == HASS_OVERLOAD_POLICY_COALESCE) {
+		slot = coalesce_slot(lane, msg);
+	}
+	if (slot != NULL) {
+		queued = atomic_exchange(slot, msg);
+		if (queued != NULL) {
+
+			/* the slot is still in the lane. the newer event
+			 * replaces the queued one
+			 */
+			esp_hass_message_release(queued);
+			atomic_fetch_add(&lane->n_coalesced, 1);
+			return ESP_OK;
+		}
+		item = slot;
+	}
+	sent = push(lane, item, to_front);
+	if (!sent && lane->policy == HASS_OVERLOAD_POLICY_DROP_OLDEST &&
+	    drop_oldest(lane)) {
+		sent = push(lane, item, to_front);
+	}
+	if (sent) {
+		lane->is_full = false;
+		return ESP_OK;
+	}
+	if (slot != NULL) {
+		/* the slot is not in the lane. take the event back */
+		msg = atomic_exchange(slot, NULL);
+	}
+	atomic_fetch_add(&lane->n_dropped, 1);
+
+	/* warn once until the lane has space again */
+	if (!lane->is_full) {
+		ESP_LOGW(TAG, "the event lane is full, dropping events");
+		lane->is_full = true;
+	}
+	esp_hass_message_release(msg);
+	return ESP_ERR_TIMEOUT;
+}
+
+esp_err_t
+esp_hass_event_lane_stop(esp_hass_event_lane_t *lane, TickType_t ticks)
+{
+	void *item = ESP_HASS_EVENT_LANE_STOP(lane);
+
+	if (!esp_hass_event_lane_is_enabled(lane)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (lane->ring != NULL) {
+		return esp_hass_ring_send(lane->ring, item, ticks);
+	}
+	if (xQueueSend(lane->queue, &item, ticks) != pdTRUE) {
+		return ESP_ERR_TIMEOUT;
+	}
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_event_lane_receive(esp_hass_event_lane_t *lane,
+    esp_hass_message_t **msgs, size_t max, size_t *n, TickType_t ticks)
+{
+	esp_err_t err = ESP_FAIL;
+	size_t i;
+
+	if (!esp_hass_event_lane_is_enabled(lane)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (lane->ring != NULL) {
+		err = esp_hass_ring_receive_batch(lane->ring, (void **)msgs,
+		    max, n, ticks);
+		if (err != ESP_OK) {
+			return err;
+		}
+	} else {
+		if (xQueueReceive(lane->queue, &msgs[0], ticks) != pdTRUE) {
+			*n = 0;
+			return ESP_ERR_TIMEOUT;
+		}
+		*n = 1;
+	}
+	for (i = 0; i < *n; i++) {
+		msgs[i] = take_item(lane, msgs[i]);
+	}
+	return ESP_OK;
+}
+
+void
+esp_hass_event_lane_get_stats(esp_hass_event_lane_t *lane,
+    esp_hass_overload_stats_t *stats)
+{
+	stats->dropped = atomic_load(&lane->n_dropped);
+	stats->coalesced = atomic_load(&lane->n_coalesced);
+}
@@ -0,0 +1,170 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __LANE__H__
+#define __LANE__H__
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "intern.h"
+
+/**
+ * The latest `state_changed` event of an entity, while the slot is in the
+ * lane.
+ */
+typedef _Atomic(esp_hass_message_t *) esp_hass_coalesce_slot_t;
+
+/**
+ * The lane of events from the websocket task to the event source task. The
+ * websocket task sends events without waiting, and applies the overload
+ * policy when the lane is full.
+ *
+ * An item in the lane is a message, or the coalescing slot of an entity.
+ * While the slot of an entity is in the lane, newer `state_changed` events
+ * of the entity replace the message in the slot instead of taking space.
+ */
+typedef struct {
+	QueueHandle_t queue;	       /*!< The queue, or NULL */
+	esp_hass_ring_handle_t ring;   /*!< The ring used instead of the
+					  queue, or NULL */
+	esp_hass_overload_policy_t policy; /*!< The overload policy */
+	esp_hass_intern_t *entities;	   /*!< The table of entities */
+	esp_hass_intern_t *event_types;	   /*!< The table of `event_type` */
+	esp_hass_coalesce_slot_t *slots;   /*!< The coalescing slots, indexed
+					      by the entity, or NULL */
+	size_t n_slots;			   /*!< Number of slots */
+	bool is_full; /*!< The last event was dropped. Used by the sender */
+	_Atomic uint32_t n_dropped;   /*!< Number of events dropped */
+	_Atomic uint32_t n_coalesced; /*!< Number of events replaced by newer
+					 ones */
+} esp_hass_event_lane_t;
+
+/**
+ * @brief Initialize an event lane.
+ *
+ * @param[in] lane The lane.
+ * @param[in] queue The queue of the lane, or NULL.
+ * @param[in] ring The ring of the lane, used instead of the queue, or NULL.
+ * @param[in] policy The overload policy.
+ * @param[in] entities The table of entities, which the lane adds entities
+ * of `state_changed` events to when policy is HASS_OVERLOAD_POLICY_COALESCE.
+ * @param[in] event_types The table of `event_type`.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_event_lane_init(esp_hass_event_lane_t *lane,
+    QueueHandle_t queue, esp_hass_ring_handle_t ring,
+    esp_hass_overload_policy_t policy, esp_hass_intern_t *entities,
+    esp_hass_intern_t *event_types);
+
+/**
+ * @brief Free an event lane, and release the messages in its slots. The
+ * queue, and the ring are not deleted.
+ *
+ * @param[in] lane The lane.
+ */
+void esp_hass_event_lane_free(esp_hass_event_lane_t *lane);
+
+/**
+ * @brief See if a lane has a queue, or a ring.
+ *
+ * @param[in] lane The lane.
+ *
+ * @return
+ * - true if the lane has a queue, or a ring
+ * - false if not
+ */
+bool esp_hass_event_lane_is_enabled(const esp_hass_event_lane_t *lane);
+
+/**
+ * @brief Send an event without waiting. The reference of the caller is
+ * passed to the lane, or released when the event is dropped. `pong`
+ * messages are sent ahead of events in the queue.
+ *
+ * @param[in] lane The lane.
+ * @param[in] msg The message.
+ *
+ * @return
+ * - ESP_OK if the event is sent, or coalesced
+ * - ESP_ERR_INVALID_STATE if the lane is not enabled
+ * - ESP_ERR_TIMEOUT if the lane is full, and the event is dropped
+ */
+esp_err_t esp_hass_event_lane_send(esp_hass_event_lane_t *lane,
+    esp_hass_message_t *msg);
+
+/**
+ * The message that esp_hass_event_lane_receive() returns for the item sent
+ * by esp_hass_event_lane_stop().
+ */
+#define ESP_HASS_EVENT_LANE_STOP(lane) ((esp_hass_message_t *)(lane))
+
+/**
+ * @brief Send an item that stops the receiver after the events in the lane,
+ * waiting for space. The sender must have stopped sending events.
+ *
+ * @param[in] lane The lane.
+ * @param[in] ticks Ticks to wait for space.
+ *
+ * @return
+ * - ESP_OK if the item is sent
+ * - ESP_ERR_INVALID_STATE if the lane is not enabled
+ * - ESP_ERR_TIMEOUT if the lane is full
+ */
+esp_err_t esp_hass_event_lane_stop(esp_hass_event_lane_t *lane,
+    TickType_t ticks);
+
+/**
+ * @brief Receive events. Waits for the first event, and takes the events in
+ * the ring without waiting, up to max.
+ *
+ * @param[in] lane The lane.
+ * @param[out] msgs The messages. A message is NULL when an item in the lane
+ * has no message, and ESP_HASS_EVENT_LANE_STOP(lane) for the item sent by
+ * esp_hass_event_lane_stop().
+ * @param[in] max Maximum number of messages.
+ * @param[out] n Number of messages received.
+ * @param[in] ticks Ticks to wait for an event.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_STATE if the lane is not enabled
+ * - ESP_ERR_TIMEOUT if the lane is empty
+ */
+esp_err_t esp_hass_event_lane_receive(esp_hass_event_lane_t *lane,
+    esp_hass_message_t **msgs, size_t max, size_t *n, TickType_t ticks);
+
+/**
+ * @brief Get the counters of an event lane.
+ *
+ * @param[in] lane The lane.
+ * @param[out] stats The counters.
+ */
+void esp_hass_event_lane_get_stats(esp_hass_event_lane_t *lane,
+    esp_hass_overload_stats_t *stats);
+
+#endif
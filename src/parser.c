@@ -16,79 +16,343 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <assert.h>
 #include <cJSON.h>
 #include <esp_err.h>
 #include <esp_log.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
 #include "esp_hass.h"
+#include "intern.h"
+#include "json_stream.h"
+#include "parser.h"
+#include "pool.h"
+#include "rx_buffer.h"
 
 const cJSON_bool require_null_terminated = 1;
 const char *TAG = "esp_hass:parser";
 
-static esp_hass_message_type_t
-string_to_type(const char *type)
+#define NUMBER_MAX_LEN (32)
+#define PATH_SEPARATOR '.'
+#define PARSER_TOKEN_SIZE (128)
+#define ENTITY_ID_MAX_LEN (256)
+#define STATE_CHANGED "state_changed"
+#define CALL_SERVICE "call_service"
+
+#if defined(CONFIG_ESP_HASS_MESSAGE_INLINE_TEXT_SIZE)
+#define MESSAGE_INLINE_TEXT_SIZE CONFIG_ESP_HASS_MESSAGE_INLINE_TEXT_SIZE
+#else
+#define MESSAGE_INLINE_TEXT_SIZE (0)
+#endif
+
+/*
+ * a message, and the arena of its JSON, are kept in one block, which is
+ * taken from the message pool of the client, or allocated. the text of a
+ * message parsed on demand is kept in `text` when it fits, or in the arena.
+ * esp_hass_message_t may be copied, i.e. sent by value through a queue, so
+ * the JSON parsed on demand, and the references to the message, are kept in
+ * the block, which the copies find through `block`.
+ */
+typedef struct {
+	esp_hass_message_t msg;
+	atomic_uint refs;
+	cJSON *json;
+	bool json_in_arena;
+	esp_hass_arena_t arena;
+	esp_hass_pool_t *pool;
+	esp_hass_projection_t projection;
+	esp_hass_state_changed_t state_changed;
+#if MESSAGE_INLINE_TEXT_SIZE > 0
+	/* the last member, which is not cleared when the block is taken */
+	char text[MESSAGE_INLINE_TEXT_SIZE];
+#endif
+} message_block_t;
+
+/* a cursor over a message text */
+typedef struct {
+	const char *p;
+	const char *end;
+} scanner_t;
+
+/* what the scanner found in a message. pointers point to the text */
+typedef struct {
+	const char *type;
+	size_t type_len;
+	const char *id;
+	size_t id_len;
+	const char *success;
+	size_t success_len;
+	const char *event_type;
+	size_t event_type_len;
+	bool has_escape;
+} scan_result_t;
+
+/*
+ * message types, and their names in the `type` field. type_names[] is
+ * generated from this table.
+ */
+#define MESSAGE_TYPES(X)                                                      \
+	X(HASS_MESSAGE_TYPE_AUTH, "auth")                                     \
+	X(HASS_MESSAGE_TYPE_AUTH_INVALID, "auth_invalid")                     \
+	X(HASS_MESSAGE_TYPE_AUTH_OK, "auth_ok")                               \
+	X(HASS_MESSAGE_TYPE_AUTH_REQUIRED, "auth_required")                   \
+	X(HASS_MESSAGE_TYPE_CALL_SERVICE, "call_service")                     \
+	X(HASS_MESSAGE_TYPE_EVENT, "event")                                   \
+	X(HASS_MESSAGE_TYPE_FIRE_EVENT, "fire_event")                         \
+	X(HASS_MESSAGE_TYPE_GET_CAMERA_THUMBNAIL, "camera_thumbnail")         \
+	X(HASS_MESSAGE_TYPE_GET_CONFIG, "get_config")                         \
+	X(HASS_MESSAGE_TYPE_GET_PANELS, "get_panels")                         \
+	X(HASS_MESSAGE_TYPE_GET_SERVICES, "get_services")                     \
+	X(HASS_MESSAGE_TYPE_GET_STATES, "get_states")                         \
+	X(HASS_MESSAGE_TYPE_MEDIA_PLAYER_THUMBNAIL, "media_player_thumbnail") \
+	X(HASS_MESSAGE_TYPE_PING, "ping")                                     \
+	X(HASS_MESSAGE_TYPE_PONG, "pong")                                     \
+	X(HASS_MESSAGE_TYPE_RESULT, "result")                                 \
+	X(HASS_MESSAGE_TYPE_SUBSCRIBE_EVENTS, "subscribe_events")             \
+	X(HASS_MESSAGE_TYPE_SUBSCRIBE_TRIGGER, "subscribe_trigger")           \
+	X(HASS_MESSAGE_TYPE_SUPPORTED_FEATURES, "supported_features")         \
+	X(HASS_MESSAGE_TYPE_UNSUBSCRIBE_EVENTS, "unsubscribe_events")         \
+	X(HASS_MESSAGE_TYPE_VALIDATE_CONFIG, "validate_config")
+
+static const char *const type_names[HASS_MESSAGE_TYPE_MAX] = {
+#define X(type, name) [type] = name,
+	MESSAGE_TYPES(X)
+#undef X
+};
+
+static const uint8_t type_lengths[HASS_MESSAGE_TYPE_MAX] = {
+#define X(type, name) [type] = sizeof(name) - 1,
+	MESSAGE_TYPES(X)
+#undef X
+};
+
+const char *
+esp_hass_message_type_to_string(esp_hass_message_type_t type)
+{
+	if (type < 0 || type >= HASS_MESSAGE_TYPE_MAX) {
+		return NULL;
+	}
+	return type_names[type];
+}
+
+esp_hass_message_type_t
+esp_hass_message_type_from_string(const char *type, size_t len)
 {
 	esp_hass_message_type_t message_type = HASS_MESSAGE_TYPE_UNKNOWN;
 
-	/* the function expects a message from Home Assistant server only. other
-	 * messages, such as `subscribe_events` or `call_service`, are ignored,
-	 * and the return value is HASS_MESSAGE_TYPE_UNKNOWN.
+	if (type == NULL || len == 0) {
+		return HASS_MESSAGE_TYPE_UNKNOWN;
+	}
+
+	/* the length, and a byte where names of the same length differ,
+	 * select the only name that can match, which is then compared with
+	 * memcmp(). a name added to MESSAGE_TYPES needs a case here.
 	 */
-	if (strcmp(type, "auth") == 0) {
-		message_type = HASS_MESSAGE_TYPE_AUTH;
-	} else if (strcmp(type, "auth_invalid") == 0) {
-		message_type = HASS_MESSAGE_TYPE_AUTH_INVALID;
-	} else if (strcmp(type, "auth_ok") == 0) {
+	switch (len) {
+	case 4:
+		if (type[0] == 'a') {
+			message_type = HASS_MESSAGE_TYPE_AUTH;
+		} else if (type[1] == 'i') {
+			message_type = HASS_MESSAGE_TYPE_PING;
+		} else {
+			message_type = HASS_MESSAGE_TYPE_PONG;
+		}
+		break;
+	case 5:
+		message_type = HASS_MESSAGE_TYPE_EVENT;
+		break;
+	case 6:
+		message_type = HASS_MESSAGE_TYPE_RESULT;
+		break;
+	case 7:
 		message_type = HASS_MESSAGE_TYPE_AUTH_OK;
-	} else if (strcmp(type, "auth_required") == 0) {
+		break;
+	case 10:
+		switch (type[4]) {
+		case 'c':
+			message_type = HASS_MESSAGE_TYPE_GET_CONFIG;
+			break;
+		case 'p':
+			message_type = HASS_MESSAGE_TYPE_GET_PANELS;
+			break;
+		case 's':
+			message_type = HASS_MESSAGE_TYPE_GET_STATES;
+			break;
+		default:
+			message_type = HASS_MESSAGE_TYPE_FIRE_EVENT;
+			break;
+		}
+		break;
+	case 12:
+		switch (type[0]) {
+		case 'a':
+			message_type = HASS_MESSAGE_TYPE_AUTH_INVALID;
+			break;
+		case 'c':
+			message_type = HASS_MESSAGE_TYPE_CALL_SERVICE;
+			break;
+		default:
+			message_type = HASS_MESSAGE_TYPE_GET_SERVICES;
+			break;
+		}
+		break;
+	case 13:
 		message_type = HASS_MESSAGE_TYPE_AUTH_REQUIRED;
-	} else if (strcmp(type, "auth_invalid") == 0) {
-		message_type = HASS_MESSAGE_TYPE_AUTH_INVALID;
-	} else if (strcmp(type, "result") == 0) {
-		message_type = HASS_MESSAGE_TYPE_RESULT;
-	} else if (strcmp(type, "event") == 0) {
-		message_type = HASS_MESSAGE_TYPE_EVENT;
-	} else if (strcmp(type, "pong") == 0) {
-		message_type = HASS_MESSAGE_TYPE_PONG;
+		break;
+	case 15:
+		message_type = HASS_MESSAGE_TYPE_VALIDATE_CONFIG;
+		break;
+	case 16:
+		message_type = type[0] == 'c' ?
+		    HASS_MESSAGE_TYPE_GET_CAMERA_THUMBNAIL :
+		    HASS_MESSAGE_TYPE_SUBSCRIBE_EVENTS;
+		break;
+	case 17:
+		message_type = HASS_MESSAGE_TYPE_SUBSCRIBE_TRIGGER;
+		break;
+	case 18:
+		message_type = type[0] == 's' ?
+		    HASS_MESSAGE_TYPE_SUPPORTED_FEATURES :
+		    HASS_MESSAGE_TYPE_UNSUBSCRIBE_EVENTS;
+		break;
+	case 22:
+		message_type = HASS_MESSAGE_TYPE_MEDIA_PLAYER_THUMBNAIL;
+		break;
+	default:
+		return HASS_MESSAGE_TYPE_UNKNOWN;
 	}
-
-	if (message_type == HASS_MESSAGE_TYPE_UNKNOWN) {
-		ESP_LOGW(TAG, "string_to_type(): Unknown message type: `%s`",
-		    type);
+	if (type_lengths[message_type] != len ||
+	    memcmp(type, type_names[message_type], len) != 0) {
+		return HASS_MESSAGE_TYPE_UNKNOWN;
 	}
 	return message_type;
 }
 
+esp_err_t
+esp_hass_message_pool_init(esp_hass_pool_t *pool, size_t capacity)
+{
+	return esp_hass_pool_init(pool, sizeof(message_block_t), capacity);
+}
+
+esp_hass_pool_t *
+esp_hass_message_pool_create(size_t capacity)
+{
+	return esp_hass_pool_create(sizeof(message_block_t), capacity);
+}
+
+/* take a block from the pool, or, without the pool, allocate one */
+static message_block_t *
+message_block_new(esp_hass_pool_t *pool, esp_hass_message_type_t type)
+{
+	message_block_t *block = NULL;
+
+	if (pool != NULL) {
+		block = esp_hass_pool_get(pool);
+
+		/* events held by handlers may take all the blocks. other
+		 * messages, results and auth messages among them, are then
+		 * allocated so that the client keeps working.
+		 */
+		if (block == NULL && type == HASS_MESSAGE_TYPE_EVENT) {
+			ESP_LOGD(TAG, "message pool exhausted, event dropped");
+			return NULL;
+		}
+		if (block == NULL) {
+			pool = NULL;
+		}
+	}
+	if (block == NULL) {
+		block = malloc(sizeof(message_block_t));
+		if (block == NULL) {
+			ESP_LOGE(TAG, "malloc(): Out of memory");
+			return NULL;
+		}
+	}
+#if MESSAGE_INLINE_TEXT_SIZE > 0
+	memset(block, 0, offsetof(message_block_t, text));
+#else
+	memset(block, 0, sizeof(*block));
+#endif
+	atomic_init(&block->refs, 1);
+	block->msg.block = block;
+	block->pool = pool;
+	return block;
+}
+
+/*
+ * parse a complete JSON text. with CONFIG_ESP_HASS_ARENA, the items are
+ * allocated from an arena, which is moved to `arena`.
+ */
+static cJSON *
+parse_json(const char *data, size_t data_len, esp_hass_arena_t *arena)
+{
+	esp_hass_json_stream_t stream;
+	cJSON *json = NULL;
+
+	if (ESP_HASS_ARENA_BLOCK_SIZE == 0) {
+		json = cJSON_ParseWithLength(data, data_len);
+		if (json == NULL) {
+			ESP_LOGE(TAG, "cJSON_ParseWithLength(): failed");
+		}
+		return json;
+	}
+	if (esp_hass_json_stream_init(&stream, PARSER_TOKEN_SIZE,
+		CONFIG_ESP_HASS_RX_BUFFER_MAX_SIZE, ESP_HASS_ARENA_BLOCK_SIZE,
+		ESP_HASS_RX_BUFFER_CAPS) != ESP_OK) {
+		ESP_LOGE(TAG, "esp_hass_json_stream_init(): failed");
+		return NULL;
+	}
+	if (esp_hass_json_stream_feed(&stream, data, data_len) == ESP_OK) {
+		json = esp_hass_json_stream_finish(&stream, arena);
+	}
+	esp_hass_json_stream_free(&stream);
+	return json;
+}
+
 esp_hass_message_t *
-esp_hass_message_parse(char *data, int data_len)
+esp_hass_message_from_json(cJSON *json, esp_hass_arena_t *arena,
+    esp_hass_pool_t *pool)
 {
+	message_block_t *block = NULL;
 	esp_hass_message_t *msg = NULL;
+	esp_hass_message_type_t message_type = HASS_MESSAGE_TYPE_UNKNOWN;
 	cJSON *type = NULL;
 	cJSON *id = NULL;
 	cJSON *success = NULL;
+	cJSON *event_type = NULL;
 
-	if (data == NULL) {
+	if (json == NULL) {
 		goto fail;
 	}
 
-	msg = calloc(1, sizeof(esp_hass_message_t));
-	if (msg == NULL) {
-		ESP_LOGE(TAG, "calloc(): Out of memory");
-		goto fail;
+	type = cJSON_GetObjectItem(json, "type");
+	if (cJSON_IsString(type)) {
+		message_type = esp_hass_message_type_from_string(
+		    type->valuestring, strlen(type->valuestring));
+		if (message_type == HASS_MESSAGE_TYPE_UNKNOWN) {
+			ESP_LOGW(TAG, "Unknown message type: `%s`",
+			    type->valuestring);
+		}
+	} else {
+		ESP_LOGW(TAG, "message type is not string");
 	}
 
-	msg->json = cJSON_Parse(data);
-	if (msg->json == NULL) {
-		ESP_LOGE(TAG, "cJSON_Parse(): failed");
+	block = message_block_new(pool, message_type);
+	if (block == NULL) {
 		goto fail;
 	}
-
-	type = cJSON_GetObjectItem(msg->json, "type");
-	if (cJSON_IsString(type)) {
-		msg->type = string_to_type(type->valuestring);
-	} else {
-		ESP_LOGW(TAG, "message type is not string");
-		msg->type = HASS_MESSAGE_TYPE_UNKNOWN;
+	msg = &block->msg;
+	msg->json = json;
+	msg->type = message_type;
+	if (arena != NULL && arena->head != NULL) {
+		esp_hass_arena_move(&block->arena, arena);
+		block->json_in_arena = true;
 	}
 
 	id = cJSON_GetObjectItem(msg->json, "id");
@@ -99,6 +363,16 @@ esp_hass_message_parse(char *data, int data_len)
 		msg->id = -1;
 	}
 
+	event_type = cJSON_GetObjectItem(cJSON_GetObjectItem(msg->json, "event"),
+	    "event_type");
+	if (cJSON_IsString(event_type) &&
+	    strlcpy(msg->event_type, event_type->valuestring,
+		sizeof(msg->event_type)) >= sizeof(msg->event_type)) {
+		ESP_LOGW(TAG, "event_type too long: `%s`",
+		    event_type->valuestring);
+		msg->event_type[0] = '\0';
+	}
+
 	switch (msg->type) {
 	case HASS_MESSAGE_TYPE_RESULT:
 		ESP_LOGD(TAG, "Message type: HASS_MESSAGE_TYPE_RESULT");
@@ -124,13 +398,1541 @@ esp_hass_message_parse(char *data, int data_len)
 
 	return msg;
 fail:
-	if (msg->json != NULL) {
-		cJSON_Delete(msg->json);
-		msg->json = NULL;
+	if (arena != NULL && arena->head != NULL) {
+		esp_hass_arena_free(arena);
+	} else if (json != NULL) {
+		cJSON_Delete(json);
+	}
+	return NULL;
+}
+
+esp_hass_message_t *
+esp_hass_message_parse(char *data, int data_len, esp_hass_pool_t *pool)
+{
+	esp_hass_arena_t arena = { 0 };
+	cJSON *json = NULL;
+
+	if (data == NULL || data_len <= 0) {
+		goto fail;
+	}
+
+	json = parse_json(data, data_len, &arena);
+	if (json == NULL) {
+		goto fail;
+	}
+	return esp_hass_message_from_json(json, &arena, pool);
+fail:
+	return NULL;
+}
+
+static void
+scan_whitespace(scanner_t *s)
+{
+	while (s->p < s->end &&
+	    (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r')) {
+		s->p++;
+	}
+}
+
+/* skip whitespace, and see if the next character is `c` */
+static bool
+scan_peek(scanner_t *s, char c)
+{
+	scan_whitespace(s);
+	return s->p < s->end && *s->p == c;
+}
+
+/* skip whitespace, and consume `c` if it is the next character */
+static bool
+scan_char(scanner_t *s, char c)
+{
+	if (!scan_peek(s, c)) {
+		return false;
+	}
+	s->p++;
+	return true;
+}
+
+/*
+ * scan a string. `str` points to the content between the quotes, which may
+ * include escapes.
+ */
+static bool
+scan_string(scanner_t *s, const char **str, size_t *len, bool *has_escape)
+{
+	const char *start = NULL;
+
+	if (!scan_char(s, '"')) {
+		return false;
+	}
+	start = s->p;
+	while (s->p < s->end && *s->p != '"') {
+		if (*s->p == '\\') {
+			*has_escape = true;
+			s->p++;
+		}
+		s->p++;
+	}
+	if (s->p >= s->end) {
+		return false;
+	}
+	*str = start;
+	*len = s->p - start;
+	s->p++;
+	return true;
+}
+
+/* scan a number, or a literal */
+static bool
+scan_scalar(scanner_t *s, const char **str, size_t *len)
+{
+	const char *start = NULL;
+
+	scan_whitespace(s);
+	start = s->p;
+	while (s->p < s->end && strchr(",}] \t\n\r", *s->p) == NULL) {
+		s->p++;
+	}
+	*str = start;
+	*len = s->p - start;
+	return *len > 0;
+}
+
+/* skip a value without looking into it */
+static bool
+scan_skip(scanner_t *s)
+{
+	const char *str = NULL;
+	size_t len = 0;
+	bool has_escape = false;
+	int depth = 0;
+
+	if (scan_peek(s, '"')) {
+		return scan_string(s, &str, &len, &has_escape);
+	}
+	if (!scan_peek(s, '{') && !scan_peek(s, '[')) {
+		return scan_scalar(s, &str, &len);
+	}
+	do {
+		if (s->p >= s->end) {
+			return false;
+		}
+		switch (*s->p) {
+		case '"':
+			if (!scan_string(s, &str, &len, &has_escape)) {
+				return false;
+			}
+			break;
+		case '{':
+		case '[':
+			depth++;
+			s->p++;
+			break;
+		case '}':
+		case ']':
+			depth--;
+			s->p++;
+			break;
+		default:
+			s->p++;
+		}
+	} while (depth > 0);
+	return true;
+}
+
+#define KEY_IS(key, key_len, name) \
+	((key_len) == sizeof(name) - 1 && memcmp((key), (name), (key_len)) == 0)
+
+/*
+ * scan the members of an object. in the root object, look for `type`, `id`,
+ * `success`, and `event`. in `event`, look for `event_type`. the first
+ * member wins when keys are duplicated, as cJSON_GetObjectItem() does.
+ */
+static bool
+scan_object(scanner_t *s, scan_result_t *r, bool is_root)
+{
+	const char *key = NULL;
+	size_t key_len = 0;
+	bool ok = false;
+
+	if (!scan_char(s, '{')) {
+		return false;
+	}
+	if (scan_char(s, '}')) {
+		return true;
+	}
+	do {
+		if (!scan_string(s, &key, &key_len, &r->has_escape) ||
+		    !scan_char(s, ':')) {
+			return false;
+		}
+		if (is_root && r->type == NULL && KEY_IS(key, key_len, "type") &&
+		    scan_peek(s, '"')) {
+			ok = scan_string(s, &r->type, &r->type_len,
+			    &r->has_escape);
+		} else if (is_root && r->id == NULL &&
+		    KEY_IS(key, key_len, "id") && !scan_peek(s, '"') &&
+		    !scan_peek(s, '{') && !scan_peek(s, '[')) {
+			ok = scan_scalar(s, &r->id, &r->id_len);
+		} else if (is_root && r->success == NULL &&
+		    KEY_IS(key, key_len, "success") && !scan_peek(s, '"') &&
+		    !scan_peek(s, '{') && !scan_peek(s, '[')) {
+			ok = scan_scalar(s, &r->success, &r->success_len);
+		} else if (is_root && r->event_type == NULL &&
+		    KEY_IS(key, key_len, "event") && scan_peek(s, '{')) {
+			ok = scan_object(s, r, false);
+		} else if (!is_root && r->event_type == NULL &&
+		    KEY_IS(key, key_len, "event_type") && scan_peek(s, '"')) {
+			ok = scan_string(s, &r->event_type, &r->event_type_len,
+			    &r->has_escape);
+		} else {
+			ok = scan_skip(s);
+		}
+		if (!ok) {
+			return false;
+		}
+	} while (scan_char(s, ','));
+	return scan_char(s, '}');
+}
+
+/* convert a number as cJSON does to valueint */
+static bool
+scan_result_id(const scan_result_t *r, int *id)
+{
+	char number[NUMBER_MAX_LEN];
+	char *end = NULL;
+	double d;
+
+	if (r->id == NULL || r->id_len >= sizeof(number)) {
+		return false;
+	}
+	memcpy(number, r->id, r->id_len);
+	number[r->id_len] = '\0';
+	d = strtod(number, &end);
+	if (end != number + r->id_len) {
+		return false;
+	}
+	if (d >= INT_MAX) {
+		*id = INT_MAX;
+	} else if (d <= (double)INT_MIN) {
+		*id = INT_MIN;
+	} else {
+		*id = (int)d;
+	}
+	return true;
+}
+
+/* the storage of the text of a message: the block, or the arena */
+static char *
+message_block_text(message_block_t *block, size_t size)
+{
+#if MESSAGE_INLINE_TEXT_SIZE > 0
+	if (size <= sizeof(block->text)) {
+		return block->text;
+	}
+#endif
+	if (esp_hass_arena_init(&block->arena, size,
+		ESP_HASS_RX_BUFFER_CAPS) != ESP_OK) {
+		return NULL;
+	}
+	return esp_hass_arena_alloc(&block->arena, size);
+}
+
+esp_hass_message_t *
+esp_hass_message_scan(const char *data, size_t data_len,
+    esp_hass_pool_t *pool)
+{
+	message_block_t *block = NULL;
+	esp_hass_message_t *msg = NULL;
+	esp_hass_message_type_t message_type = HASS_MESSAGE_TYPE_UNKNOWN;
+	char *raw = NULL;
+	scan_result_t r = { 0 };
+	scanner_t s = { 0 };
+
+	if (data == NULL || data_len == 0) {
+		goto fail;
+	}
+	s.p = data;
+	s.end = data + data_len;
+	if (!scan_object(&s, &r, true)) {
+		ESP_LOGE(TAG, "esp_hass_message_scan(): invalid message");
+		goto fail;
+	}
+
+	/* the fields would have to be unescaped. HA does not escape them, but
+	 * let cJSON handle such messages.
+	 */
+	if (r.has_escape) {
+		ESP_LOGD(TAG, "escaped keys or fields, parsing the message");
+		return esp_hass_message_parse((char *)data, data_len, pool);
+	}
+
+	if (r.type != NULL) {
+		message_type = esp_hass_message_type_from_string(r.type,
+		    r.type_len);
+		if (message_type == HASS_MESSAGE_TYPE_UNKNOWN) {
+			ESP_LOGW(TAG, "Unknown message type: `%.*s`",
+			    (int)r.type_len, r.type);
+		}
+	} else {
+		ESP_LOGW(TAG, "message type is not string");
+	}
+
+	block = message_block_new(pool, message_type);
+	if (block == NULL) {
+		goto fail;
+	}
+	raw = message_block_text(block, data_len + 1);
+	if (raw == NULL) {
+		goto fail;
+	}
+	memcpy(raw, data, data_len);
+	raw[data_len] = '\0';
+	msg = &block->msg;
+	msg->raw = raw;
+	msg->raw_len = data_len;
+
+	msg->type = message_type;
+	if (!scan_result_id(&r, &msg->id)) {
+		ESP_LOGD(TAG, "attribute `id` is not present");
+		msg->id = -1;
+	}
+	if (r.event_type != NULL) {
+		if (r.event_type_len < sizeof(msg->event_type)) {
+			memcpy(msg->event_type, r.event_type,
+			    r.event_type_len);
+			msg->event_type[r.event_type_len] = '\0';
+		} else {
+			ESP_LOGW(TAG, "event_type too long: `%.*s`",
+			    (int)r.event_type_len, r.event_type);
+		}
 	}
-	if (msg != NULL) {
-		free(msg);
-		msg = NULL;
+	if (msg->type == HASS_MESSAGE_TYPE_RESULT) {
+		msg->success = KEY_IS(r.success, r.success_len, "true");
+		if (r.success == NULL) {
+			ESP_LOGD(TAG, "attribute `success` does not exist");
+		} else if (!msg->success &&
+		    !KEY_IS(r.success, r.success_len, "false")) {
+			ESP_LOGW(TAG, "attribute `success` is not bool");
+		}
+	}
+	return msg;
+fail:
+	if (block != NULL) {
+		esp_hass_message_free(&block->msg);
 	}
 	return NULL;
 }
+
+void
+esp_hass_frame_init(esp_hass_frame_t *frame, const char *data,
+    size_t data_len)
+{
+	scanner_t s = { .p = data, .end = data + data_len };
+
+	frame->is_array = scan_char(&s, '[');
+	frame->done = frame->is_array && scan_char(&s, ']');
+	frame->p = frame->is_array ? s.p : data;
+	frame->end = s.end;
+}
+
+esp_err_t
+esp_hass_frame_next(esp_hass_frame_t *frame, const char **msg,
+    size_t *msg_len)
+{
+	scanner_t s = { .p = frame->p, .end = frame->end };
+
+	if (frame->done) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (!frame->is_array) {
+		*msg = frame->p;
+		*msg_len = frame->end - frame->p;
+		frame->done = true;
+		return ESP_OK;
+	}
+
+	/* an element, followed by `,` or `]` */
+	scan_whitespace(&s);
+	*msg = s.p;
+	if (!scan_skip(&s)) {
+		goto fail;
+	}
+	*msg_len = s.p - *msg;
+	if (scan_char(&s, ']')) {
+		frame->done = true;
+	} else if (!scan_char(&s, ',')) {
+		goto fail;
+	}
+	frame->p = s.p;
+	return ESP_OK;
+fail:
+	ESP_LOGE(TAG, "esp_hass_frame_next(): invalid array");
+	frame->done = true;
+	return ESP_FAIL;
+}
+
+esp_err_t
+esp_hass_projection_spec_init(esp_hass_projection_spec_t *spec,
+    const char *const *paths)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_projection_path_t *path = NULL;
+	size_t size = 0;
+	char *p = NULL;
+	char *key = NULL;
+	size_t i;
+
+	if (spec == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(spec, 0, sizeof(*spec));
+	if (paths == NULL || paths[0] == NULL) {
+		return ESP_OK;
+	}
+	for (i = 0; paths[i] != NULL; i++) {
+		if (i >= ESP_HASS_PROJECTION_MAX_FIELDS) {
+			ESP_LOGE(TAG, "too many paths, maximum: %d",
+			    ESP_HASS_PROJECTION_MAX_FIELDS);
+			return ESP_ERR_INVALID_ARG;
+		}
+		size += strlen(paths[i]) + 1;
+	}
+	spec->buf = malloc(size);
+	if (spec->buf == NULL) {
+		ESP_LOGE(TAG, "malloc(): Out of memory");
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+
+	/* copy the paths, and split them into keys in place */
+	p = spec->buf;
+	for (spec->n_paths = 0; paths[spec->n_paths] != NULL;
+	     spec->n_paths++) {
+		path = &spec->paths[spec->n_paths];
+		strcpy(p, paths[spec->n_paths]);
+		key = p;
+		for (;;) {
+			if (*p != PATH_SEPARATOR && *p != '\0') {
+				p++;
+				continue;
+			}
+			if (p == key ||
+			    path->depth >= ESP_HASS_PROJECTION_MAX_DEPTH) {
+				ESP_LOGE(TAG, "invalid path: `%s`",
+				    paths[spec->n_paths]);
+				err = ESP_ERR_INVALID_ARG;
+				goto fail;
+			}
+			path->keys[path->depth] = key;
+			path->key_lens[path->depth] = p - key;
+			path->depth++;
+			if (*p == '\0') {
+				break;
+			}
+			*p++ = '\0';
+			key = p;
+		}
+		p++;
+	}
+	return ESP_OK;
+fail:
+	esp_hass_projection_spec_free(spec);
+	return err;
+}
+
+void
+esp_hass_projection_spec_free(esp_hass_projection_spec_t *spec)
+{
+	if (spec == NULL) {
+		return;
+	}
+	free(spec->buf);
+	memset(spec, 0, sizeof(*spec));
+}
+
+/* copy as much as fits in `buf`, and keep it null-terminated */
+static void
+text_append(char *buf, size_t size, size_t *len, bool *truncated,
+    const char *str, size_t str_len)
+{
+	if (*len + str_len >= size) {
+		str_len = size - 1 - *len;
+		*truncated = true;
+	}
+	memcpy(buf + *len, str, str_len);
+	*len += str_len;
+	buf[*len] = '\0';
+}
+
+static void
+field_append(esp_hass_field_t *field, size_t *len, const char *str,
+    size_t str_len)
+{
+	text_append(field->value, sizeof(field->value), len, &field->truncated,
+	    str, str_len);
+}
+
+static bool
+scan_hex4(const char *p, const char *end, uint32_t *cp)
+{
+	int i;
+
+	*cp = 0;
+	if (end - p < 4) {
+		return false;
+	}
+	for (i = 0; i < 4; i++) {
+		*cp <<= 4;
+		if (p[i] >= '0' && p[i] <= '9') {
+			*cp |= p[i] - '0';
+		} else if (p[i] >= 'a' && p[i] <= 'f') {
+			*cp |= p[i] - 'a' + 10;
+		} else if (p[i] >= 'A' && p[i] <= 'F') {
+			*cp |= p[i] - 'A' + 10;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* unescape the content of a string into `buf` */
+static bool
+unescape(char *buf, size_t size, bool *truncated, const char *str,
+    size_t str_len)
+{
+	const char *p = str;
+	const char *end = str + str_len;
+	const char *run = NULL;
+	char utf8[4];
+	size_t len = 0;
+	size_t n;
+	uint32_t cp, low;
+
+	buf[0] = '\0';
+	while (p < end) {
+		run = p;
+		while (p < end && *p != '\\') {
+			p++;
+		}
+		text_append(buf, size, &len, truncated, run, p - run);
+		if (p == end) {
+			break;
+		}
+		if (++p == end) {
+			return false;
+		}
+		switch (*p++) {
+		case 'b':
+			text_append(buf, size, &len, truncated, "\b", 1);
+			continue;
+		case 'f':
+			text_append(buf, size, &len, truncated, "\f", 1);
+			continue;
+		case 'n':
+			text_append(buf, size, &len, truncated, "\n", 1);
+			continue;
+		case 'r':
+			text_append(buf, size, &len, truncated, "\r", 1);
+			continue;
+		case 't':
+			text_append(buf, size, &len, truncated, "\t", 1);
+			continue;
+		case 'u':
+			break;
+		default:
+			text_append(buf, size, &len, truncated, p - 1, 1);
+			continue;
+		}
+		if (!scan_hex4(p, end, &cp)) {
+			return false;
+		}
+		p += 4;
+		if (cp >= 0xd800 && cp <= 0xdbff) {
+			if (end - p < 6 || p[0] != '\\' || p[1] != 'u' ||
+			    !scan_hex4(p + 2, end, &low) || low < 0xdc00 ||
+			    low > 0xdfff) {
+				return false;
+			}
+			p += 6;
+			cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+		}
+		if (cp < 0x80) {
+			utf8[0] = (char)cp;
+			n = 1;
+		} else if (cp < 0x800) {
+			utf8[0] = (char)(0xc0 | (cp >> 6));
+			utf8[1] = (char)(0x80 | (cp & 0x3f));
+			n = 2;
+		} else if (cp < 0x10000) {
+			utf8[0] = (char)(0xe0 | (cp >> 12));
+			utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+			utf8[2] = (char)(0x80 | (cp & 0x3f));
+			n = 3;
+		} else {
+			utf8[0] = (char)(0xf0 | (cp >> 18));
+			utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+			utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+			utf8[3] = (char)(0x80 | (cp & 0x3f));
+			n = 4;
+		}
+		text_append(buf, size, &len, truncated, utf8, n);
+	}
+	return true;
+}
+
+static bool
+field_set_string(esp_hass_field_t *field, const char *str, size_t str_len)
+{
+	field->type = HASS_FIELD_TYPE_STRING;
+	return unescape(field->value, sizeof(field->value), &field->truncated,
+	    str, str_len);
+}
+
+/* set a number, or a literal, from its text */
+static bool
+field_set_scalar(esp_hass_field_t *field, const char *str, size_t str_len)
+{
+	char number[NUMBER_MAX_LEN];
+	char *end = NULL;
+	size_t len = 0;
+
+	if (KEY_IS(str, str_len, "true") || KEY_IS(str, str_len, "false")) {
+		field->type = HASS_FIELD_TYPE_BOOL;
+		field->number = str[0] == 't' ? 1 : 0;
+	} else if (KEY_IS(str, str_len, "null")) {
+		field->type = HASS_FIELD_TYPE_NULL;
+	} else {
+		if (str_len >= sizeof(number)) {
+			return false;
+		}
+		memcpy(number, str, str_len);
+		number[str_len] = '\0';
+		field->number = strtod(number, &end);
+		if (end != number + str_len) {
+			return false;
+		}
+		field->type = HASS_FIELD_TYPE_NUMBER;
+	}
+	field->value[0] = '\0';
+	field_append(field, &len, str, str_len);
+	return true;
+}
+
+/* the paths in `mask` whose key at `depth` is `key` */
+static uint32_t
+spec_match(const esp_hass_projection_spec_t *spec,
+    const esp_hass_projection_t *out, uint32_t mask, int depth,
+    const char *key, size_t key_len)
+{
+	uint32_t matched = 0;
+	size_t i;
+
+	for (i = 0; i < spec->n_paths; i++) {
+		if ((mask & (1u << i)) != 0 &&
+		    out->fields[i].type == HASS_FIELD_TYPE_MISSING &&
+		    spec->paths[i].key_lens[depth] == key_len &&
+		    memcmp(spec->paths[i].keys[depth], key, key_len) == 0) {
+			matched |= 1u << i;
+		}
+	}
+	return matched;
+}
+
+/* the paths in `mask` that end at `depth` */
+static uint32_t
+spec_leaves(const esp_hass_projection_spec_t *spec, uint32_t mask, int depth)
+{
+	uint32_t leaves = 0;
+	size_t i;
+
+	for (i = 0; i < spec->n_paths; i++) {
+		if ((mask & (1u << i)) != 0 &&
+		    spec->paths[i].depth == depth + 1) {
+			leaves |= 1u << i;
+		}
+	}
+	return leaves;
+}
+
+static bool scan_project(scanner_t *s, const esp_hass_projection_spec_t *spec,
+    int depth, uint32_t mask, esp_hass_projection_t *out);
+
+/* copy a value to the fields in `leaves`, and look into it for `mask` */
+static bool
+scan_project_value(scanner_t *s, const esp_hass_projection_spec_t *spec,
+    int depth, uint32_t leaves, uint32_t mask, esp_hass_projection_t *out)
+{
+	esp_hass_field_type_t type = HASS_FIELD_TYPE_MISSING;
+	esp_hass_field_t *first = NULL;
+	const char *str = NULL;
+	size_t len = 0;
+	size_t i;
+	bool is_string = false;
+	bool has_escape = false;
+	bool ok = false;
+
+	if (scan_peek(s, '{')) {
+		type = HASS_FIELD_TYPE_OBJECT;
+		ok = mask != 0 ? scan_project(s, spec, depth + 1, mask, out) :
+				 scan_skip(s);
+	} else if (scan_peek(s, '[')) {
+		type = HASS_FIELD_TYPE_ARRAY;
+		ok = scan_skip(s);
+	} else if (leaves == 0) {
+		return scan_skip(s);
+	} else if (scan_peek(s, '"')) {
+		is_string = true;
+		ok = scan_string(s, &str, &len, &has_escape);
+	} else {
+		ok = scan_scalar(s, &str, &len);
+	}
+	if (!ok) {
+		return false;
+	}
+
+	/* paths may be registered more than once */
+	for (i = 0; i < spec->n_paths; i++) {
+		if ((leaves & (1u << i)) == 0) {
+			continue;
+		}
+		if (first != NULL) {
+			out->fields[i] = *first;
+			continue;
+		}
+		first = &out->fields[i];
+		if (type != HASS_FIELD_TYPE_MISSING) {
+			first->type = type;
+		} else if (is_string) {
+			ok = field_set_string(first, str, len);
+		} else {
+			ok = field_set_scalar(first, str, len);
+		}
+		if (!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * scan the members of an object at `depth` of the paths in `mask`. other
+ * members are skipped without copying. the first member wins when keys are
+ * duplicated.
+ */
+static bool
+scan_project(scanner_t *s, const esp_hass_projection_spec_t *spec, int depth,
+    uint32_t mask, esp_hass_projection_t *out)
+{
+	const char *key = NULL;
+	size_t key_len = 0;
+	bool has_escape = false;
+	uint32_t matched, leaves;
+	bool ok = false;
+
+	if (!scan_char(s, '{')) {
+		return false;
+	}
+	if (scan_char(s, '}')) {
+		return true;
+	}
+	do {
+		if (!scan_string(s, &key, &key_len, &has_escape) ||
+		    !scan_char(s, ':')) {
+			return false;
+		}
+		matched = spec_match(spec, out, mask, depth, key, key_len);
+		if (matched == 0) {
+			ok = scan_skip(s);
+		} else {
+			leaves = spec_leaves(spec, matched, depth);
+			ok = scan_project_value(s, spec, depth, leaves,
+			    matched & ~leaves, out);
+		}
+		if (!ok) {
+			return false;
+		}
+	} while (scan_char(s, ','));
+	return scan_char(s, '}');
+}
+
+/* copy an item of the JSON to a field */
+static void
+field_set_item(esp_hass_field_t *field, const cJSON *item)
+{
+	double d;
+	size_t len = 0;
+
+	field->value[0] = '\0';
+	if (cJSON_IsString(item)) {
+		field->type = HASS_FIELD_TYPE_STRING;
+		field_append(field, &len, item->valuestring,
+		    strlen(item->valuestring));
+	} else if (cJSON_IsNumber(item)) {
+		field->type = HASS_FIELD_TYPE_NUMBER;
+		field->number = item->valuedouble;
+
+		/* print the shortest text that reads back, as cJSON does */
+		snprintf(field->value, sizeof(field->value), "%1.15g",
+		    field->number);
+		d = strtod(field->value, NULL);
+		if (d != field->number) {
+			snprintf(field->value, sizeof(field->value), "%1.17g",
+			    field->number);
+		}
+	} else if (cJSON_IsBool(item)) {
+		field->type = HASS_FIELD_TYPE_BOOL;
+		field->number = cJSON_IsTrue(item) ? 1 : 0;
+		field_append(field, &len, cJSON_IsTrue(item) ? "true" : "false",
+		    cJSON_IsTrue(item) ? 4 : 5);
+	} else if (cJSON_IsNull(item)) {
+		field->type = HASS_FIELD_TYPE_NULL;
+		field_append(field, &len, "null", 4);
+	} else if (cJSON_IsObject(item)) {
+		field->type = HASS_FIELD_TYPE_OBJECT;
+	} else if (cJSON_IsArray(item)) {
+		field->type = HASS_FIELD_TYPE_ARRAY;
+	}
+}
+
+esp_err_t
+esp_hass_message_project(esp_hass_message_t *msg,
+    const esp_hass_projection_spec_t *spec)
+{
+	message_block_t *block = NULL;
+	esp_hass_projection_t *out = NULL;
+	const esp_hass_projection_path_t *path = NULL;
+	const cJSON *item = NULL;
+	scanner_t s = { 0 };
+	uint32_t all;
+	size_t i;
+	int j;
+
+	if (msg == NULL || spec == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	block = msg->block;
+	out = &block->projection;
+	memset(out, 0, sizeof(*out));
+	out->n_fields = spec->n_paths;
+	msg->projection = out;
+	if (spec->n_paths == 0) {
+		return ESP_OK;
+	}
+
+	/* without the JSON, scan the text instead of parsing it */
+	if (msg->json == NULL && msg->raw != NULL) {
+		s.p = msg->raw;
+		s.end = msg->raw + msg->raw_len;
+		all = (uint32_t)((1ull << spec->n_paths) - 1);
+		if (!scan_project(&s, spec, 0, all, out)) {
+			ESP_LOGE(TAG,
+			    "esp_hass_message_project(): invalid message");
+			memset(out->fields, 0, sizeof(out->fields));
+			return ESP_FAIL;
+		}
+		return ESP_OK;
+	}
+	for (i = 0; i < spec->n_paths; i++) {
+		path = &spec->paths[i];
+		item = msg->json;
+		for (j = 0; j < path->depth && item != NULL; j++) {
+			item = cJSON_GetObjectItemCaseSensitive(item,
+			    path->keys[j]);
+		}
+		if (item != NULL) {
+			field_set_item(&out->fields[i], item);
+		}
+	}
+	return ESP_OK;
+}
+
+const esp_hass_field_t *
+esp_hass_message_get_field(const esp_hass_message_t *msg, size_t index)
+{
+	if (msg == NULL || msg->projection == NULL ||
+	    index >= msg->projection->n_fields ||
+	    msg->projection->fields[index].type == HASS_FIELD_TYPE_MISSING) {
+		return NULL;
+	}
+	return &msg->projection->fields[index];
+}
+
+/* see if a member of an object is `name` */
+static bool
+key_is(const char *key, size_t key_len, const char *name)
+{
+	return strncmp(key, name, key_len) == 0 && name[key_len] == '\0';
+}
+
+/*
+ * scan the members of an object until `name`, and leave the scanner at its
+ * value.
+ */
+static bool
+scan_find_member(scanner_t *s, const char *name)
+{
+	const char *key = NULL;
+	size_t key_len = 0;
+	bool has_escape = false;
+
+	if (!scan_char(s, '{') || scan_peek(s, '}')) {
+		return false;
+	}
+	do {
+		if (!scan_string(s, &key, &key_len, &has_escape) ||
+		    !scan_char(s, ':')) {
+			return false;
+		}
+		if (key_is(key, key_len, name)) {
+			return true;
+		}
+		if (!scan_skip(s)) {
+			return false;
+		}
+	} while (scan_char(s, ','));
+	return false;
+}
+
+/* read `n` digits of a timestamp */
+static bool
+time_digits(const char **p, const char *end, int n, int *value)
+{
+	*value = 0;
+	if (end - *p < n) {
+		return false;
+	}
+	while (n-- > 0) {
+		if (**p < '0' || **p > '9') {
+			return false;
+		}
+		*value = *value * 10 + (*(*p)++ - '0');
+	}
+	return true;
+}
+
+/* consume one of `chars` */
+static bool
+time_char(const char **p, const char *end, const char *chars)
+{
+	if (*p >= end || **p == '\0' || strchr(chars, **p) == NULL) {
+		return false;
+	}
+	(*p)++;
+	return true;
+}
+
+/*
+ * parse a timestamp in ISO 8601, such as `2022-06-30T01:02:03.456789+00:00`,
+ * into microseconds since the epoch. a timestamp without an offset is UTC.
+ */
+static bool
+parse_timestamp(const char *str, size_t len, int64_t *us)
+{
+	const char *p = str;
+	const char *end = str + len;
+	int year, month, day, hour, min, sec;
+	int tz_hour = 0;
+	int tz_min = 0;
+	int sign = 0;
+	int64_t fraction = 0;
+	int64_t scale = 1000000;
+	int64_t era, yoe, doy, doe, days;
+
+	if (!time_digits(&p, end, 4, &year) || !time_char(&p, end, "-") ||
+	    !time_digits(&p, end, 2, &month) || !time_char(&p, end, "-") ||
+	    !time_digits(&p, end, 2, &day) || !time_char(&p, end, "T ") ||
+	    !time_digits(&p, end, 2, &hour) || !time_char(&p, end, ":") ||
+	    !time_digits(&p, end, 2, &min) || !time_char(&p, end, ":") ||
+	    !time_digits(&p, end, 2, &sec)) {
+		return false;
+	}
+	if (time_char(&p, end, ".")) {
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (scale > 1) {
+				scale /= 10;
+				fraction += (*p - '0') * scale;
+			}
+			p++;
+		}
+	}
+	if (p < end && (*p == '+' || *p == '-')) {
+		sign = *p++ == '-' ? -1 : 1;
+		if (!time_digits(&p, end, 2, &tz_hour) ||
+		    !time_char(&p, end, ":") ||
+		    !time_digits(&p, end, 2, &tz_min)) {
+			return false;
+		}
+	} else {
+		time_char(&p, end, "Z");
+	}
+	if (p != end || month < 1 || month > 12 || day < 1 || day > 31 ||
+	    hour > 23 || min > 59 || sec > 60) {
+		return false;
+	}
+
+	/* days since the epoch in the proleptic Gregorian calendar */
+	year -= month <= 2;
+	era = year / 400;
+	yoe = year - era * 400;
+	doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	days = era * 146097 + doe - 719468;
+	*us = (((days * 24 + hour) * 60 + min) * 60 + sec) * 1000000 +
+	    fraction - (int64_t)sign * (tz_hour * 60 + tz_min) * 60 * 1000000;
+	return true;
+}
+
+/* see if the state is a number, such as the state of a sensor */
+static void
+state_set_number(esp_hass_state_t *state)
+{
+	char *end = NULL;
+
+	state->is_number = false;
+	if (state->truncated || state->value[0] == '\0' ||
+	    strchr("-0123456789", state->value[0]) == NULL) {
+		return;
+	}
+	state->number = strtod(state->value, &end);
+	state->is_number = *end == '\0';
+}
+
+static void
+state_set_last_changed(esp_hass_state_t *state, const char *str, size_t len)
+{
+	if (!parse_timestamp(str, len, &state->last_changed)) {
+		ESP_LOGW(TAG, "invalid last_changed: `%.*s`", (int)len, str);
+		state->last_changed = 0;
+	}
+}
+
+/* find the entity of `entity_id` in the text, and, with `add`, intern it */
+static esp_err_t
+entity_lookup(esp_hass_intern_t *entities, const char *str, size_t len,
+    bool has_escape, bool add, esp_hass_entity_t *entity)
+{
+	char entity_id[ENTITY_ID_MAX_LEN];
+	bool truncated = false;
+
+	if (has_escape) {
+		if (!unescape(entity_id, sizeof(entity_id), &truncated, str,
+			len) ||
+		    truncated) {
+			return ESP_ERR_INVALID_SIZE;
+		}
+		str = entity_id;
+		len = strlen(entity_id);
+	}
+	return esp_hass_intern(entities, str, len, add, entity);
+}
+
+/* intern `entity_id`. it is ESP_HASS_ENTITY_NONE when the table is full */
+static void
+state_changed_set_entity(esp_hass_state_changed_t *out,
+    esp_hass_intern_t *entities, const char *str, size_t len,
+    bool has_escape)
+{
+	if (entities == NULL ||
+	    entity_lookup(entities, str, len, has_escape, true,
+		&out->entity) != ESP_OK) {
+		out->entity = ESP_HASS_ENTITY_NONE;
+	}
+}
+
+/* keep where the values of `attributes` are in the text */
+static bool
+scan_attributes(scanner_t *s, const char *const *attributes,
+    const char **values)
+{
+	const char *key = NULL;
+	const char *value = NULL;
+	size_t key_len = 0;
+	bool has_escape = false;
+	size_t i;
+
+	if (!scan_char(s, '{')) {
+		return false;
+	}
+	if (scan_char(s, '}')) {
+		return true;
+	}
+	do {
+		if (!scan_string(s, &key, &key_len, &has_escape) ||
+		    !scan_char(s, ':')) {
+			return false;
+		}
+		scan_whitespace(s);
+		value = s->p;
+		if (!scan_skip(s)) {
+			return false;
+		}
+		for (i = 0; attributes[i] != NULL &&
+		     i < ESP_HASS_STATE_CHANGED_MAX_ATTRIBUTES;
+		     i++) {
+			if (values[i] == NULL &&
+			    key_is(key, key_len, attributes[i])) {
+				values[i] = value;
+			}
+		}
+	} while (scan_char(s, ','));
+	return scan_char(s, '}');
+}
+
+/* scan `old_state`, or `new_state`, which is `null`, or an object */
+static bool
+scan_state(scanner_t *s, const char *const *attributes,
+    esp_hass_state_t *state, const char **values)
+{
+	const char *key = NULL;
+	const char *str = NULL;
+	size_t key_len = 0;
+	size_t len = 0;
+	bool has_escape = false;
+	bool ok = false;
+
+	if (!scan_peek(s, '{')) {
+		return scan_skip(s);
+	}
+	state->present = true;
+	s->p++;
+	if (scan_char(s, '}')) {
+		return true;
+	}
+	do {
+		if (!scan_string(s, &key, &key_len, &has_escape) ||
+		    !scan_char(s, ':')) {
+			return false;
+		}
+		if (KEY_IS(key, key_len, "state") && scan_peek(s, '"')) {
+			ok = scan_string(s, &str, &len, &has_escape) &&
+			    unescape(state->value, sizeof(state->value),
+				&state->truncated, str, len);
+			state_set_number(state);
+		} else if (KEY_IS(key, key_len, "last_changed") &&
+		    scan_peek(s, '"')) {
+			ok = scan_string(s, &str, &len, &has_escape);
+			if (ok) {
+				state_set_last_changed(state, str, len);
+			}
+		} else if (KEY_IS(key, key_len, "attributes") &&
+		    attributes != NULL && scan_peek(s, '{')) {
+			ok = scan_attributes(s, attributes, values);
+		} else {
+			ok = scan_skip(s);
+		}
+		if (!ok) {
+			return false;
+		}
+	} while (scan_char(s, ','));
+	return scan_char(s, '}');
+}
+
+/* see if two values in the text are the same, or both missing */
+static bool
+scan_value_equal(const char *a, const char *b, const char *end)
+{
+	scanner_t sa = { .p = a, .end = end };
+	scanner_t sb = { .p = b, .end = end };
+
+	if (a == NULL || b == NULL) {
+		return a == b;
+	}
+	if (!scan_skip(&sa) || !scan_skip(&sb)) {
+		return false;
+	}
+	return sa.p - a == sb.p - b && memcmp(a, b, sa.p - a) == 0;
+}
+
+/* decode `event.data` of a state_changed event from the text */
+static bool
+scan_state_changed(scanner_t *s, esp_hass_intern_t *entities,
+    const char *const *attributes, esp_hass_state_changed_t *out)
+{
+	const char *old_values[ESP_HASS_STATE_CHANGED_MAX_ATTRIBUTES] = { 0 };
+	const char *new_values[ESP_HASS_STATE_CHANGED_MAX_ATTRIBUTES] = { 0 };
+	const char *key = NULL;
+	const char *str = NULL;
+	size_t key_len = 0;
+	size_t len = 0;
+	size_t i;
+	bool has_escape = false;
+	bool ok = false;
+
+	if (!scan_find_member(s, "event") || !scan_find_member(s, "data") ||
+	    !scan_char(s, '{')) {
+		return false;
+	}
+	if (!scan_peek(s, '}')) {
+		do {
+			if (!scan_string(s, &key, &key_len, &has_escape) ||
+			    !scan_char(s, ':')) {
+				return false;
+			}
+			has_escape = false;
+			if (KEY_IS(key, key_len, "entity_id") &&
+			    scan_peek(s, '"')) {
+				ok = scan_string(s, &str, &len, &has_escape);
+				if (ok) {
+					state_changed_set_entity(out, entities,
+					    str, len, has_escape);
+				}
+			} else if (KEY_IS(key, key_len, "old_state")) {
+				ok = scan_state(s, attributes, &out->old_state,
+				    old_values);
+			} else if (KEY_IS(key, key_len, "new_state")) {
+				ok = scan_state(s, attributes, &out->new_state,
+				    new_values);
+			} else {
+				ok = scan_skip(s);
+			}
+			if (!ok) {
+				return false;
+			}
+		} while (scan_char(s, ','));
+	}
+	for (i = 0; attributes != NULL && attributes[i] != NULL &&
+	     i < ESP_HASS_STATE_CHANGED_MAX_ATTRIBUTES;
+	     i++) {
+		if (!scan_value_equal(old_values[i], new_values[i], s->end)) {
+			out->attributes_changed |= 1u << i;
+		}
+	}
+	return true;
+}
+
+/* decode `old_state`, or `new_state`, from the JSON */
+static void
+item_set_state(esp_hass_state_t *state, const cJSON *item)
+{
+	const cJSON *value = NULL;
+	size_t len = 0;
+
+	if (!cJSON_IsObject(item)) {
+		return;
+	}
+	state->present = true;
+	value = cJSON_GetObjectItemCaseSensitive(item, "state");
+	if (cJSON_IsString(value)) {
+		text_append(state->value, sizeof(state->value), &len,
+		    &state->truncated, value->valuestring,
+		    strlen(value->valuestring));
+		state_set_number(state);
+	}
+	value = cJSON_GetObjectItemCaseSensitive(item, "last_changed");
+	if (cJSON_IsString(value)) {
+		state_set_last_changed(state, value->valuestring,
+		    strlen(value->valuestring));
+	}
+}
+
+/* decode `event.data` of a state_changed event from the JSON */
+static bool
+item_set_state_changed(const cJSON *json, esp_hass_intern_t *entities,
+    const char *const *attributes, esp_hass_state_changed_t *out)
+{
+	const cJSON *data = NULL;
+	const cJSON *entity_id = NULL;
+	const cJSON *old_state = NULL;
+	const cJSON *new_state = NULL;
+	const cJSON *old_value = NULL;
+	const cJSON *new_value = NULL;
+	size_t i;
+
+	data = cJSON_GetObjectItemCaseSensitive(
+	    cJSON_GetObjectItemCaseSensitive(json, "event"), "data");
+	if (!cJSON_IsObject(data)) {
+		return false;
+	}
+	entity_id = cJSON_GetObjectItemCaseSensitive(data, "entity_id");
+	if (cJSON_IsString(entity_id)) {
+		state_changed_set_entity(out, entities, entity_id->valuestring,
+		    strlen(entity_id->valuestring), false);
+	}
+	old_state = cJSON_GetObjectItemCaseSensitive(data, "old_state");
+	new_state = cJSON_GetObjectItemCaseSensitive(data, "new_state");
+	item_set_state(&out->old_state, old_state);
+	item_set_state(&out->new_state, new_state);
+	for (i = 0; attributes != NULL && attributes[i] != NULL &&
+	     i < ESP_HASS_STATE_CHANGED_MAX_ATTRIBUTES;
+	     i++) {
+		old_value = cJSON_GetObjectItemCaseSensitive(
+		    cJSON_GetObjectItemCaseSensitive(old_state, "attributes"),
+		    attributes[i]);
+		new_value = cJSON_GetObjectItemCaseSensitive(
+		    cJSON_GetObjectItemCaseSensitive(new_state, "attributes"),
+		    attributes[i]);
+		if ((old_value == NULL) != (new_value == NULL) ||
+		    (old_value != NULL &&
+			!cJSON_Compare(old_value, new_value, true))) {
+			out->attributes_changed |= 1u << i;
+		}
+	}
+	return true;
+}
+
+esp_err_t
+esp_hass_message_decode_state_changed(esp_hass_message_t *msg,
+    esp_hass_intern_t *entities, const char *const *attributes)
+{
+	message_block_t *block = NULL;
+	esp_hass_state_changed_t *out = NULL;
+	scanner_t s = { 0 };
+	bool ok = false;
+
+	if (msg == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (msg->type != HASS_MESSAGE_TYPE_EVENT ||
+	    strcmp(msg->event_type, STATE_CHANGED) != 0) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	block = msg->block;
+	out = &block->state_changed;
+	memset(out, 0, sizeof(*out));
+	out->entity = ESP_HASS_ENTITY_NONE;
+
+	/* without the JSON, scan the text instead of parsing it */
+	if (msg->json == NULL && msg->raw != NULL) {
+		s.p = msg->raw;
+		s.end = msg->raw + msg->raw_len;
+		ok = scan_state_changed(&s, entities, attributes, out);
+	} else {
+		ok = item_set_state_changed(msg->json, entities, attributes,
+		    out);
+	}
+	if (!ok) {
+		ESP_LOGE(TAG,
+		    "esp_hass_message_decode_state_changed(): invalid message");
+		return ESP_FAIL;
+	}
+	msg->state_changed = out;
+	return ESP_OK;
+}
+
+const esp_hass_state_changed_t *
+esp_hass_message_get_state_changed(const esp_hass_message_t *msg)
+{
+	return msg != NULL ? msg->state_changed : NULL;
+}
+
+/* find the entity of an event, and optionally add it */
+static esp_err_t
+message_entity(const esp_hass_message_t *msg, esp_hass_intern_t *entities,
+    bool add, esp_hass_entity_t *entity)
+{
+	const cJSON *entity_id = NULL;
+	const char *str = NULL;
+	size_t len = 0;
+	bool has_escape = false;
+	scanner_t s = { 0 };
+
+	if (msg == NULL || entities == NULL || entity == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (msg->state_changed != NULL) {
+		*entity = msg->state_changed->entity;
+		return *entity != ESP_HASS_ENTITY_NONE ? ESP_OK :
+							 ESP_ERR_NOT_FOUND;
+	}
+	if (msg->type != HASS_MESSAGE_TYPE_EVENT) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (msg->json == NULL && msg->raw != NULL) {
+		s.p = msg->raw;
+		s.end = msg->raw + msg->raw_len;
+		if (!scan_find_member(&s, "event") ||
+		    !scan_find_member(&s, "data") ||
+		    !scan_find_member(&s, "entity_id") || !scan_peek(&s, '"') ||
+		    !scan_string(&s, &str, &len, &has_escape)) {
+			return ESP_ERR_NOT_FOUND;
+		}
+	} else {
+		entity_id = cJSON_GetObjectItemCaseSensitive(
+		    cJSON_GetObjectItemCaseSensitive(
+			cJSON_GetObjectItemCaseSensitive(msg->json, "event"),
+			"data"),
+		    "entity_id");
+		if (!cJSON_IsString(entity_id)) {
+			return ESP_ERR_NOT_FOUND;
+		}
+		str = entity_id->valuestring;
+		len = strlen(str);
+	}
+	if (entity_lookup(entities, str, len, has_escape, add, entity) !=
+	    ESP_OK) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_message_get_entity(const esp_hass_message_t *msg,
+    esp_hass_intern_t *entities, esp_hass_entity_t *entity)
+{
+	return message_entity(msg, entities, false, entity);
+}
+
+esp_err_t
+esp_hass_message_add_entity(const esp_hass_message_t *msg,
+    esp_hass_intern_t *entities, esp_hass_entity_t *entity)
+{
+	return message_entity(msg, entities, true, entity);
+}
+
+/* `event_type` in the order of their IDs, from
+ * ESP_HASS_EVENT_ID_EVENT_TYPE_BASE */
+static const char *const well_known_event_types[] = {
+	STATE_CHANGED,
+	CALL_SERVICE,
+};
+#define N_WELL_KNOWN_EVENT_TYPES \
+	(sizeof(well_known_event_types) / sizeof(well_known_event_types[0]))
+
+esp_err_t
+esp_hass_event_types_init(esp_hass_intern_t *event_types, size_t capacity)
+{
+	esp_err_t err = ESP_FAIL;
+	int32_t id;
+	size_t i;
+
+	if (event_types == NULL || capacity < N_WELL_KNOWN_EVENT_TYPES) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	err = esp_hass_intern_init(event_types, capacity);
+	if (err != ESP_OK) {
+		return err;
+	}
+	for (i = 0; i < N_WELL_KNOWN_EVENT_TYPES; i++) {
+		err = esp_hass_event_types_get_id(event_types,
+		    well_known_event_types[i], true, &id);
+		if (err != ESP_OK) {
+			goto fail;
+		}
+		assert(id == ESP_HASS_EVENT_ID_EVENT_TYPE_BASE + i);
+	}
+	return ESP_OK;
+fail:
+	esp_hass_intern_free(event_types);
+	return err;
+}
+
+esp_err_t
+esp_hass_event_types_get_id(esp_hass_intern_t *event_types,
+    const char *event_type, bool add, int32_t *event_id)
+{
+	esp_err_t err = ESP_FAIL;
+	uint16_t id;
+
+	if (event_types == NULL || event_type == NULL || event_id == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	err = esp_hass_intern(event_types, event_type, strlen(event_type), add,
+	    &id);
+	if (err != ESP_OK) {
+		return err;
+	}
+	*event_id = ESP_HASS_EVENT_ID_EVENT_TYPE_BASE + id;
+	return ESP_OK;
+}
+
+int32_t
+esp_hass_message_event_id(const esp_hass_message_t *msg,
+    esp_hass_intern_t *event_types)
+{
+	int32_t id;
+
+	if (msg == NULL || msg->type <= HASS_MESSAGE_TYPE_UNKNOWN ||
+	    msg->type >= HASS_MESSAGE_TYPE_MAX) {
+		return ESP_HASS_EVENT_ID_UNKNOWN;
+	}
+	if (msg->type != HASS_MESSAGE_TYPE_EVENT || event_types == NULL ||
+	    esp_hass_event_types_get_id(event_types, msg->event_type, false,
+		&id) != ESP_OK) {
+		return msg->type;
+	}
+	return id;
+}
+
+cJSON *
+esp_hass_message_get_json(esp_hass_message_t *msg)
+{
+	message_block_t *block = NULL;
+	esp_hass_arena_t arena = { 0 };
+
+	if (msg == NULL || msg->json != NULL || msg->raw == NULL) {
+		return msg != NULL ? msg->json : NULL;
+	}
+	block = msg->block;
+	if (block->json == NULL) {
+		block->json = parse_json(msg->raw, msg->raw_len, &arena);
+		if (block->json == NULL) {
+			return NULL;
+		}
+		if (arena.head != NULL) {
+			esp_hass_arena_move(&block->arena, &arena);
+			block->json_in_arena = true;
+		}
+	}
+	msg->json = block->json;
+	return msg->json;
+}
+
+esp_hass_message_t *
+esp_hass_message_retain(esp_hass_message_t *msg)
+{
+	message_block_t *block = NULL;
+
+	if (msg == NULL) {
+		return NULL;
+	}
+	block = msg->block;
+	atomic_fetch_add_explicit(&block->refs, 1, memory_order_relaxed);
+	return &block->msg;
+}
+
+void
+esp_hass_message_release(esp_hass_message_t *msg)
+{
+	message_block_t *block = NULL;
+
+	if (msg == NULL) {
+		return;
+	}
+	block = msg->block;
+
+	/* the last owner must see what the others have written to the block,
+	 * i.e. the JSON parsed on demand.
+	 */
+	if (atomic_fetch_sub_explicit(&block->refs, 1, memory_order_acq_rel) ==
+	    1) {
+		esp_hass_message_free(&block->msg);
+	}
+}
+
+void
+esp_hass_message_free(esp_hass_message_t *msg)
+{
+	message_block_t *block = NULL;
+	cJSON *json = NULL;
+
+	if (msg == NULL) {
+		return;
+	}
+	block = msg->block;
+
+	/* the JSON is either in the arena, or allocated by cJSON. the arena
+	 * also keeps the text of a message parsed on demand.
+	 */
+	json = msg->raw != NULL ? block->json : msg->json;
+	if (json != NULL && !block->json_in_arena) {
+		cJSON_Delete(json);
+	}
+	esp_hass_arena_free(&block->arena);
+	if (block->pool != NULL) {
+		esp_hass_pool_put(block->pool, block);
+	} else {
+		free(block);
+	}
+}
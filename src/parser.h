@@ -19,7 +19,199 @@
 #if !defined __PARSER__H__
 #define __PARSER__H__
 
+#include "arena.h"
 #include "esp_hass.h"
+#include "intern.h"
+#include "pool.h"
+
+/**
+ * Maximum number of keys in a projected path.
+ */
+#define ESP_HASS_PROJECTION_MAX_DEPTH (8)
+
+/**
+ * A path to project, split into keys.
+ */
+typedef struct {
+	const char *keys[ESP_HASS_PROJECTION_MAX_DEPTH]; /*!< The keys */
+	size_t key_lens[ESP_HASS_PROJECTION_MAX_DEPTH];	 /*!< Lengths of keys */
+	int depth; /*!< Number of keys */
+} esp_hass_projection_path_t;
+
+/**
+ * Compiled `projection_paths` of `esp_hass_config_t`.
+ */
+typedef struct {
+	char *buf;	/*!< A copy of the paths that keys point to */
+	size_t n_paths; /*!< Number of paths */
+	esp_hass_projection_path_t
+	    paths[ESP_HASS_PROJECTION_MAX_FIELDS]; /*!< The paths */
+} esp_hass_projection_spec_t;
+
+/**
+ * @brief Compile paths to project.
+ *
+ * @param[out] spec The compiled paths.
+ * @param[in] paths A NULL-terminated array of paths, or NULL.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if spec is NULL, there are too many paths, or a
+ *   path is invalid
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_projection_spec_init(esp_hass_projection_spec_t *spec,
+    const char *const *paths);
+
+/**
+ * @brief Free compiled paths.
+ *
+ * @param[in] spec The compiled paths.
+ */
+void esp_hass_projection_spec_free(esp_hass_projection_spec_t *spec);
+
+/**
+ * @brief Fill `projection` of a message. The message text is scanned when
+ * the JSON has not been parsed, otherwise the JSON is looked up.
+ *
+ * @param[in] msg The message, not a copy of it.
+ * @param[in] spec The compiled paths.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if msg or spec is NULL
+ * - ESP_FAIL if the message text is invalid
+ */
+esp_err_t esp_hass_message_project(esp_hass_message_t *msg,
+    const esp_hass_projection_spec_t *spec);
+
+/**
+ * @brief Decode a `state_changed` event into `state_changed` of the message.
+ * The message text is scanned when the JSON has not been parsed, otherwise
+ * the JSON is looked up.
+ *
+ * @param[in] msg The message, not a copy of it.
+ * @param[in] entities The table to intern `entity_id` in, or NULL.
+ * @param[in] attributes A NULL-terminated array of attribute names whose
+ * changes are set in `attributes_changed`, or NULL.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if msg is NULL
+ * - ESP_ERR_NOT_FOUND if the message is not a `state_changed` event
+ * - ESP_FAIL if the message is invalid
+ */
+esp_err_t esp_hass_message_decode_state_changed(esp_hass_message_t *msg,
+    esp_hass_intern_t *entities, const char *const *attributes);
+
+/**
+ * @brief Get the entity of an event, i.e. `event.data.entity_id`, without
+ * adding it to the table. The entity of a decoded `state_changed` event is
+ * used when it is available. Otherwise, the message text is scanned when the
+ * JSON has not been parsed, or the JSON is looked up.
+ *
+ * @param[in] msg The message.
+ * @param[in] entities The table of entities.
+ * @param[out] entity The entity.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is NULL
+ * - ESP_ERR_NOT_FOUND if the message is not an event, the event does not
+ *   have a string `entity_id`, or the entity is not in the table
+ */
+esp_err_t esp_hass_message_get_entity(const esp_hass_message_t *msg,
+    esp_hass_intern_t *entities, esp_hass_entity_t *entity);
+
+/**
+ * @brief Get the entity of an event as esp_hass_message_get_entity() does,
+ * adding it to the table when it is not in the table.
+ *
+ * @param[in] msg The message.
+ * @param[in] entities The table of entities.
+ * @param[out] entity The entity.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is NULL
+ * - ESP_ERR_NOT_FOUND if the message is not an event, the event does not
+ *   have a string `entity_id`, or the table is full
+ */
+esp_err_t esp_hass_message_add_entity(const esp_hass_message_t *msg,
+    esp_hass_intern_t *entities, esp_hass_entity_t *entity);
+
+/**
+ * @brief Initialize a table of `event_type`, and register the types that have
+ * well-known IDs, i.e. ESP_HASS_EVENT_ID_STATE_CHANGED.
+ *
+ * @param[in] event_types The table.
+ * @param[in] capacity Maximum number of types, including the well-known
+ * types.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if event_types is NULL, or capacity is too small
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_event_types_init(esp_hass_intern_t *event_types,
+    size_t capacity);
+
+/**
+ * @brief Get the ID of an `event_type` in the table.
+ *
+ * @param[in] event_types The table.
+ * @param[in] event_type The `event_type`.
+ * @param[in] add Register the type if it is not in the table.
+ * @param[out] event_id The ID.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is NULL
+ * - ESP_ERR_NOT_FOUND if the type is not in the table, and `add` is false
+ * - ESP_ERR_NO_MEM if the table is full
+ */
+esp_err_t esp_hass_event_types_get_id(esp_hass_intern_t *event_types,
+    const char *event_type, bool add, int32_t *event_id);
+
+/**
+ * @brief Get the event ID of a message, which is passed to message handlers.
+ *
+ * @param[in] msg The message.
+ * @param[in] event_types The table of `event_type`, or NULL.
+ *
+ * @return
+ * - The ID of `event_type` if the message is an event of a registered type
+ * - HASS_MESSAGE_TYPE_EVENT if the message is an event of another type
+ * - The message type of other messages
+ * - ESP_HASS_EVENT_ID_UNKNOWN if the type is unknown, or msg is NULL
+ */
+int32_t esp_hass_message_event_id(const esp_hass_message_t *msg,
+    esp_hass_intern_t *event_types);
+
+/**
+ * @brief Initialize a pool of messages.
+ *
+ * @param[in] pool The pool.
+ * @param[in] capacity Number of messages in the pool.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if pool is NULL, or capacity is too large
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_message_pool_init(esp_hass_pool_t *pool, size_t capacity);
+
+/**
+ * @brief Create a pool of messages, which outlives the messages taken from
+ * it. Delete the pool with esp_hass_pool_delete().
+ *
+ * @param[in] capacity Number of messages in the pool.
+ *
+ * @return
+ * - Pointer to the pool
+ * - NULL if capacity is too large, or out of memory
+ */
+esp_hass_pool_t *esp_hass_message_pool_create(size_t capacity);
 
 /**
  * @brief Parse string as JSON. The returned pointer must be destroyed with
@@ -27,10 +219,100 @@
  *
  * @param[in] data JSON string.
  * @param[in] data_len length of `data`.
+ * @param[in] pool The pool to take the message from, or NULL to allocate the
+ * message. When the pool is empty, an event is dropped, and other messages
+ * are allocated.
  *
  * @return
  *  - Pointer to `esp_hass_message_t` if successfully parsed, or NULL.
  */
-esp_hass_message_t *esp_hass_message_parse(char *data, int data_len);
+esp_hass_message_t *esp_hass_message_parse(char *data, int data_len,
+    esp_hass_pool_t *pool);
+
+/**
+ * @brief Create a message from a parsed JSON. The returned pointer must be
+ * destroyed with `esp_hass_message_destroy`.
+ *
+ * @param[in] json cJSON object. The message takes the ownership of `json`.
+ * When the function fails, `json` is freed.
+ * @param[in] arena The arena `json` is allocated from, or NULL if `json` is
+ * allocated by cJSON. The memory of the arena is moved to the message.
+ * @param[in] pool The pool to take the message from, or NULL to allocate the
+ * message. When the pool is empty, an event is dropped, and other messages
+ * are allocated.
+ *
+ * @return
+ *  - Pointer to `esp_hass_message_t` if successful, or NULL.
+ */
+esp_hass_message_t *esp_hass_message_from_json(cJSON *json,
+    esp_hass_arena_t *arena, esp_hass_pool_t *pool);
+
+/**
+ * @brief Create a message from JSON string without parsing the whole string.
+ * `type`, `id`, `success`, and `event_type` are scanned from the string, and
+ * the string is copied to the message. The JSON is parsed when
+ * `esp_hass_message_get_json()` is called. The returned pointer must be
+ * destroyed with `esp_hass_message_destroy`.
+ *
+ * The scanner does not validate the whole string. An invalid JSON may be
+ * detected when the JSON is parsed.
+ *
+ * @param[in] data JSON string.
+ * @param[in] data_len length of `data`.
+ * @param[in] pool The pool to take the message from, or NULL to allocate the
+ * message. When the pool is empty, an event is dropped, and other messages
+ * are allocated.
+ *
+ * @return
+ *  - Pointer to `esp_hass_message_t` if successful, or NULL.
+ */
+esp_hass_message_t *esp_hass_message_scan(const char *data, size_t data_len,
+    esp_hass_pool_t *pool);
+
+/**
+ * A cursor over a WebSocket frame from the server. A frame is a message, or,
+ * with `coalesce_messages`, an array of messages.
+ */
+typedef struct {
+	const char *p;	/*!< The rest of the frame */
+	const char *end; /*!< End of the frame */
+	bool is_array;	/*!< The frame is an array of messages */
+	bool done;	/*!< No messages are left */
+} esp_hass_frame_t;
+
+/**
+ * @brief Start iterating messages in a frame.
+ *
+ * @param[out] frame The cursor.
+ * @param[in] data The frame.
+ * @param[in] data_len Length of `data`.
+ */
+void esp_hass_frame_init(esp_hass_frame_t *frame, const char *data,
+    size_t data_len);
+
+/**
+ * @brief Find the next message in a frame. Elements of an array are found
+ * without parsing them.
+ *
+ * @param[in] frame The cursor.
+ * @param[out] msg The text of the message, which points into the frame.
+ * @param[out] msg_len Length of `msg`.
+ *
+ * @return
+ * - ESP_OK if a message is found
+ * - ESP_ERR_NOT_FOUND if no messages are left
+ * - ESP_FAIL if the array is invalid. No messages are returned after this.
+ */
+esp_err_t esp_hass_frame_next(esp_hass_frame_t *frame, const char **msg,
+    size_t *msg_len);
+
+/**
+ * @brief Free a message, and its JSON, whether or not it has been parsed.
+ * A message taken from a pool is returned to the pool. References to the
+ * message are ignored; see esp_hass_message_release().
+ *
+ * @param[in] msg The message, or a copy of it.
+ */
+void esp_hass_message_free(esp_hass_message_t *msg);
 
 #endif
@@ -0,0 +1,368 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+#include "pending.h"
+
+static const char *TAG = "esp_hass:pending";
+
+esp_err_t
+esp_hass_pending_init(esp_hass_pending_t *pending, size_t capacity)
+{
+	size_t i;
+
+	if (pending == NULL || capacity == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	pending->capacity = 0;
+	pending->entries = calloc(capacity, sizeof(pending->entries[0]));
+	if (pending->entries == NULL) {
+		ESP_LOGE(TAG, "calloc(): Out of memory");
+		return ESP_ERR_NO_MEM;
+	}
+	for (i = 0; i < capacity; i++) {
+		pending->entries[i].done = xSemaphoreCreateBinary();
+		if (pending->entries[i].done == NULL) {
+			ESP_LOGE(TAG, "xSemaphoreCreateBinary(): Out of memory");
+			esp_hass_pending_free(pending);
+			return ESP_ERR_NO_MEM;
+		}
+		pending->capacity++;
+	}
+	return ESP_OK;
+}
+
+void
+esp_hass_pending_free(esp_hass_pending_t *pending)
+{
+	size_t i;
+
+	if (pending == NULL || pending->entries == NULL) {
+		return;
+	}
+	for (i = 0; i < pending->capacity; i++) {
+		esp_hass_message_release(pending->entries[i].msg);
+		vSemaphoreDelete(pending->entries[i].done);
+	}
+	free(pending->entries);
+	pending->entries = NULL;
+	pending->capacity = 0;
+}
+
+/* find the entry of a command, which is pending, or resolved */
+static esp_hass_pending_entry_t *
+find_entry(esp_hass_pending_t *pending, int id)
+{
+	esp_hass_pending_entry_t *entry = NULL;
+	int state;
+	size_t i;
+
+	for (i = 0; i < pending->capacity; i++) {
+		entry = &pending->entries[i];
+		state = atomic_load_explicit(&entry->state,
+		    memory_order_acquire);
+		if ((state == id || state == ESP_HASS_PENDING_RESOLVED) &&
+		    atomic_load_explicit(&entry->id, memory_order_relaxed) ==
+			id) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+esp_err_t
+esp_hass_pending_add(esp_hass_pending_t *pending, int id,
+    esp_hass_result_handler_t callback, void *args)
+{
+	esp_hass_pending_entry_t *entry = NULL;
+	int state;
+	size_t i;
+
+	if (id <= 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	for (i = 0; i < pending->capacity; i++) {
+		entry = &pending->entries[i];
+		state = ESP_HASS_PENDING_FREE;
+		if (!atomic_compare_exchange_strong_explicit(&entry->state,
+			&state, ESP_HASS_PENDING_BUSY, memory_order_acquire,
+			memory_order_relaxed)) {
+			continue;
+		}
+		atomic_store_explicit(&entry->id, id, memory_order_relaxed);
+		entry->callback = callback;
+		entry->args = args;
+		entry->msg = NULL;
+
+		/* the websocket task sees the entry when the state is the ID */
+		atomic_store_explicit(&entry->state, id, memory_order_release);
+		return ESP_OK;
+	}
+	ESP_LOGW(TAG, "too many commands in flight, maximum: %u",
+	    (unsigned)pending->capacity);
+	return ESP_ERR_NO_MEM;
+}
+
+esp_err_t
+esp_hass_pending_resolve(esp_hass_pending_t *pending, esp_hass_message_t *msg)
+{
+	esp_hass_pending_entry_t *entry = NULL;
+	int state;
+	size_t i;
+
+	if (msg == NULL || msg->id <= 0) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	for (i = 0; i < pending->capacity; i++) {
+		entry = &pending->entries[i];
+		state = msg->id;
+
+		/* take the entry from a task that gives up the command */
+		if (atomic_compare_exchange_strong_explicit(&entry->state,
+			&state, ESP_HASS_PENDING_ROUTING, memory_order_acquire,
+			memory_order_relaxed)) {
+			break;
+		}
+	}
+	if (i == pending->capacity) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (entry->callback != NULL) {
+		entry->callback(entry->args, msg->id, msg);
+		esp_hass_message_release(msg);
+		atomic_store_explicit(&entry->state, ESP_HASS_PENDING_FREE,
+		    memory_order_release);
+		return ESP_OK;
+	}
+	entry->msg = msg;
+	atomic_store_explicit(&entry->state, ESP_HASS_PENDING_RESOLVED,
+	    memory_order_release);
+	xSemaphoreGive(entry->done);
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_pending_wait(esp_hass_pending_t *pending, int id,
+    esp_hass_message_t **msg, TickType_t ticks)
+{
+	esp_hass_pending_entry_t *entry = NULL;
+	int state = id;
+
+	if (msg == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	entry = find_entry(pending, id);
+	if (entry == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (entry->callback != NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (xSemaphoreTake(entry->done, ticks) != pdTRUE) {
+
+		/* the websocket task may have taken the entry meanwhile. if
+		 * so, the result is about to be given.
+		 */
+		if (atomic_compare_exchange_strong_explicit(&entry->state,
+			&state, ESP_HASS_PENDING_FREE, memory_order_release,
+			memory_order_relaxed)) {
+			return ESP_ERR_TIMEOUT;
+		}
+		xSemaphoreTake(entry->done, portMAX_DELAY);
+	}
+	*msg = entry->msg;
+	entry->msg = NULL;
+	atomic_store_explicit(&entry->state, ESP_HASS_PENDING_FREE,
+	    memory_order_release);
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_pending_cancel(esp_hass_pending_t *pending, int id)
+{
+	esp_hass_pending_entry_t *entry = NULL;
+	int state = id;
+
+	entry = find_entry(pending, id);
+	if (entry == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (atomic_compare_exchange_strong_explicit(&entry->state, &state,
+		ESP_HASS_PENDING_FREE, memory_order_release,
+		memory_order_relaxed)) {
+		return ESP_OK;
+	}
+
+	/* the result is being routed to the callback, or to the entry */
+	while (state == ESP_HASS_PENDING_ROUTING) {
+		vTaskDelay(1);
+		state = atomic_load_explicit(&entry->state,
+		    memory_order_acquire);
+	}
+	if (state != ESP_HASS_PENDING_RESOLVED ||
+	    atomic_load_explicit(&entry->id, memory_order_relaxed) != id) {
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	/* the result has been received, and is about to be given */
+	xSemaphoreTake(entry->done, portMAX_DELAY);
+	esp_hass_message_release(entry->msg);
+	entry->msg = NULL;
+	atomic_store_explicit(&entry->state, ESP_HASS_PENDING_FREE,
+	    memory_order_release);
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_pending_fail(esp_hass_pending_t *pending, int id)
+{
+	char text[ESP_HASS_ERROR_MESSAGE_MAX_LEN * 3];
+	esp_hass_pending_entry_t *entry = NULL;
+	esp_hass_message_t *msg = NULL;
+	esp_err_t err = ESP_FAIL;
+
+	snprintf(text, sizeof(text),
+	    "{\"id\":%d,\"type\":\"result\",\"success\":false,"
+	    "\"error\":{\"code\":\"send_failed\","
+	    "\"message\":\"Failed to send the command.\"}}",
+	    id);
+	msg = esp_hass_message_scan(text, strlen(text), NULL);
+	if (msg == NULL) {
+		ESP_LOGE(TAG, "esp_hass_message_scan(): Out of memory");
+
+		/* no task waits for the result of a callback */
+		entry = find_entry(pending, id);
+		if (entry != NULL && entry->callback != NULL) {
+			esp_hass_pending_cancel(pending, id);
+		}
+		return ESP_ERR_NO_MEM;
+	}
+	err = esp_hass_pending_resolve(pending, msg);
+	if (err != ESP_OK) {
+		esp_hass_message_release(msg);
+	}
+	return err;
+}
+
+void
+esp_hass_pending_fail_all(esp_hass_pending_t *pending)
+{
+	int state;
+	size_t i;
+
+	if (pending == NULL || pending->entries == NULL) {
+		return;
+	}
+	for (i = 0; i < pending->capacity; i++) {
+		state = atomic_load_explicit(&pending->entries[i].state,
+		    memory_order_acquire);
+
+		/* the state of a command in flight is its ID */
+		if (state > 0) {
+			esp_hass_pending_fail(pending, state);
+		}
+	}
+}
+
+void
+esp_hass_command_result_set(esp_hass_command_result_t *result,
+    esp_hass_message_t *msg)
+{
+	cJSON *json_error_msg = NULL;
+
+	result->error_message[0] = '\0';
+	if (msg->success) {
+		result->err = ESP_OK;
+		return;
+	}
+	result->err = ESP_FAIL;
+	json_error_msg = cJSON_GetObjectItemCaseSensitive(
+	    cJSON_GetObjectItemCaseSensitive(esp_hass_message_get_json(msg),
+		"error"),
+	    "message");
+	if (cJSON_IsString(json_error_msg) &&
+	    json_error_msg->valuestring != NULL) {
+		strlcpy(result->error_message, json_error_msg->valuestring,
+		    sizeof(result->error_message));
+	}
+}
+
+/* wait for the result of a command in a pipeline */
+static void
+wait_command_result(esp_hass_pending_t *pending,
+    esp_hass_command_result_t *result, TickType_t ticks)
+{
+	esp_hass_message_t *msg = NULL;
+
+	if (result->id == 0) {
+		return;
+	}
+	result->err = esp_hass_pending_wait(pending, result->id, &msg, ticks);
+	if (result->err != ESP_OK) {
+		return;
+	}
+	esp_hass_command_result_set(result, msg);
+	esp_hass_message_release(msg);
+}
+
+esp_err_t
+esp_hass_pending_pipeline(esp_hass_pending_t *pending, size_t n,
+    esp_hass_pipeline_send_t send, void *context,
+    esp_hass_command_result_t *results, TickType_t ticks)
+{
+	esp_err_t err = ESP_OK;
+	size_t oldest = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		memset(&results[i], 0, sizeof(results[i]));
+
+		/* keep a window as large as the table in flight. the table
+		 * may still be full of commands of other tasks */
+		if (i - oldest >= pending->capacity) {
+			wait_command_result(pending, &results[oldest++], ticks);
+		}
+		while ((results[i].err = send(context, i, &results[i].id)) ==
+			ESP_ERR_NO_MEM &&
+		    oldest < i) {
+			wait_command_result(pending, &results[oldest++], ticks);
+		}
+		if (results[i].err != ESP_OK) {
+			results[i].id = 0;
+		}
+	}
+	for (; oldest < n; oldest++) {
+		wait_command_result(pending, &results[oldest], ticks);
+	}
+	for (i = 0; i < n; i++) {
+		if (results[i].err != ESP_OK) {
+			err = ESP_FAIL;
+		}
+	}
+	return err;
+}
@@ -0,0 +1,230 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __PENDING__H__
+#define __PENDING__H__
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * `state` of an entry that is not in use.
+ */
+#define ESP_HASS_PENDING_FREE (0)
+
+/**
+ * `state` of an entry that is being added, or removed.
+ */
+#define ESP_HASS_PENDING_BUSY (-1)
+
+/**
+ * `state` of an entry whose result has been received, and is waited for.
+ */
+#define ESP_HASS_PENDING_RESOLVED (-2)
+
+/**
+ * `state` of an entry whose result is being routed.
+ */
+#define ESP_HASS_PENDING_ROUTING (-3)
+
+/**
+ * A command waiting for its result.
+ */
+typedef struct {
+	_Atomic int state; /*!< ESP_HASS_PENDING_*, or the ID of the command
+			      while it waits for the result */
+	_Atomic int id;	   /*!< The ID of the command */
+	esp_hass_result_handler_t callback; /*!< The handler of the result, or
+					       NULL to wait for it */
+	void *args;		 /*!< Passed to callback */
+	esp_hass_message_t *msg; /*!< The result to wait for */
+	SemaphoreHandle_t done;	 /*!< Given when msg is set */
+} esp_hass_pending_entry_t;
+
+/**
+ * A table of commands waiting for their results, keyed by the ID of the
+ * commands. The websocket task routes a result to the callback, or to the
+ * task waiting for the command, so that many commands can be in flight, and
+ * tasks never take results of others.
+ */
+typedef struct {
+	esp_hass_pending_entry_t *entries; /*!< The entries */
+	size_t capacity;		   /*!< Number of entries */
+} esp_hass_pending_t;
+
+/**
+ * @brief Initialize a table of pending commands.
+ *
+ * @param[in] pending The table.
+ * @param[in] capacity Maximum number of commands in flight.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_pending_init(esp_hass_pending_t *pending, size_t capacity);
+
+/**
+ * @brief Free a table of pending commands, and release the results that
+ * have not been waited for.
+ *
+ * @param[in] pending The table.
+ */
+void esp_hass_pending_free(esp_hass_pending_t *pending);
+
+/**
+ * @brief Add a command before it is sent.
+ *
+ * @param[in] pending The table.
+ * @param[in] id The ID of the command.
+ * @param[in] callback The handler of the result, or NULL to wait for the
+ * result with esp_hass_pending_wait().
+ * @param[in] args Passed to callback.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if id is not positive
+ * - ESP_ERR_NO_MEM if the table is full
+ */
+esp_err_t esp_hass_pending_add(esp_hass_pending_t *pending, int id,
+    esp_hass_result_handler_t callback, void *args);
+
+/**
+ * @brief Route a result to its command. The callback of the command is
+ * called, and the result is released after the callback returns. Otherwise,
+ * the result is passed to the task waiting for it.
+ *
+ * @param[in] pending The table.
+ * @param[in] msg The result.
+ *
+ * @return
+ * - ESP_OK if the result has been routed, and the table has taken the
+ *   reference of the caller
+ * - ESP_ERR_NOT_FOUND if no command waits for the result
+ */
+esp_err_t esp_hass_pending_resolve(esp_hass_pending_t *pending,
+    esp_hass_message_t *msg);
+
+/**
+ * @brief Wait for the result of a command, which is removed from the table
+ * unless the result is not for the command. The caller must release the
+ * result.
+ *
+ * @param[in] pending The table.
+ * @param[in] id The ID of the command.
+ * @param[out] msg The result.
+ * @param[in] ticks Ticks to wait for the result.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_NOT_FOUND if the command is not in the table
+ * - ESP_ERR_INVALID_ARG if the command has a callback
+ * - ESP_ERR_TIMEOUT if the result has not been received
+ */
+esp_err_t esp_hass_pending_wait(esp_hass_pending_t *pending, int id,
+    esp_hass_message_t **msg, TickType_t ticks);
+
+/**
+ * @brief Remove a command whose result is no longer needed. No task must
+ * wait for the result. A received result that has not been waited for is
+ * released.
+ *
+ * @param[in] pending The table.
+ * @param[in] id The ID of the command.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_NOT_FOUND if the command is not in the table, or the callback
+ *   is being called with the result
+ */
+esp_err_t esp_hass_pending_cancel(esp_hass_pending_t *pending, int id);
+
+/**
+ * @brief Resolve a command that has been lost, i.e. not sent, or sent on a
+ * connection that has been closed, with a result of failure whose error
+ * code is `send_failed`, so that the callback, or the task waiting for the
+ * result, does not wait for a result that never comes.
+ *
+ * @param[in] pending The table.
+ * @param[in] id The ID of the command.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_NOT_FOUND if the command is not in the table
+ * - ESP_ERR_NO_MEM if out of memory. The command of a callback is removed,
+ *   and the task waiting for the result times out
+ */
+esp_err_t esp_hass_pending_fail(esp_hass_pending_t *pending, int id);
+
+/**
+ * @brief Resolve all the commands in flight with a result of failure. See
+ * esp_hass_pending_fail(). Call this when the connection is closed, as the
+ * results of the commands never arrive.
+ *
+ * @param[in] pending The table.
+ */
+void esp_hass_pending_fail_all(esp_hass_pending_t *pending);
+
+/**
+ * A function that sends the command `i` of a pipeline, and adds it to the
+ * table of pending commands without a callback.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_NO_MEM if the table is full
+ * - Other errors if the command is not sent
+ */
+typedef esp_err_t (*esp_hass_pipeline_send_t)(void *context, size_t i,
+    int *id);
+
+/**
+ * @brief Set the outcome of a command from its result.
+ *
+ * @param[out] result The outcome.
+ * @param[in] msg The result.
+ */
+void esp_hass_command_result_set(esp_hass_command_result_t *result,
+    esp_hass_message_t *msg);
+
+/**
+ * @brief Send commands back to back, and gather their results. When as many
+ * commands as the capacity of the table are in flight, or the table is full,
+ * the result of the oldest command in flight is waited for before the next
+ * command is sent.
+ *
+ * @param[in] pending The table.
+ * @param[in] n Number of commands.
+ * @param[in] send The function to send a command.
+ * @param[in] context Passed to send.
+ * @param[out] results The outcome of each command.
+ * @param[in] ticks Ticks to wait for each result.
+ *
+ * @return
+ * - ESP_OK if all the commands are successful
+ * - ESP_FAIL if any command has failed
+ */
+esp_err_t esp_hass_pending_pipeline(esp_hass_pending_t *pending, size_t n,
+    esp_hass_pipeline_send_t send, void *context,
+    esp_hass_command_result_t *results, TickType_t ticks);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "pool.h"
+
+#define POOL_NIL (0xffff)
+#define POOL_INDEX(head) ((uint16_t)((head)&0xffff))
+#define POOL_TAG(head) ((head) >> 16)
+#define POOL_HEAD(tag, index) (((uint32_t)(tag) << 16) | (index))
+#define POOL_ALIGN (alignof(max_align_t))
+
+static const char *TAG = "esp_hass:pool";
+
+esp_err_t
+esp_hass_pool_init(esp_hass_pool_t *pool, size_t object_size,
+    size_t capacity)
+{
+	esp_err_t err = ESP_FAIL;
+	size_t i;
+
+	if (pool == NULL || object_size == 0 ||
+	    capacity > ESP_HASS_POOL_MAX_CAPACITY) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(pool, 0, sizeof(*pool));
+	pool->object_size = (object_size + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+	pool->capacity = capacity;
+	atomic_init(&pool->head, POOL_HEAD(0, POOL_NIL));
+	atomic_init(&pool->exhausted, 0);
+	atomic_init(&pool->refs, 1);
+	if (capacity == 0) {
+		return ESP_OK;
+	}
+
+	pool->objects = heap_caps_calloc(capacity, pool->object_size,
+	    MALLOC_CAP_DEFAULT);
+	pool->next = heap_caps_calloc(capacity, sizeof(pool->next[0]),
+	    MALLOC_CAP_DEFAULT);
+	if (pool->objects == NULL || pool->next == NULL) {
+		ESP_LOGE(TAG, "heap_caps_calloc(): Out of memory");
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+
+	/* chain all the objects in order */
+	for (i = 0; i + 1 < capacity; i++) {
+		atomic_init(&pool->next[i], i + 1);
+	}
+	atomic_init(&pool->next[capacity - 1], POOL_NIL);
+	atomic_init(&pool->head, POOL_HEAD(0, 0));
+	return ESP_OK;
+fail:
+	esp_hass_pool_free(pool);
+	return err;
+}
+
+void
+esp_hass_pool_free(esp_hass_pool_t *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+	if (pool->objects != NULL) {
+		heap_caps_free(pool->objects);
+		pool->objects = NULL;
+	}
+	if (pool->next != NULL) {
+		heap_caps_free((void *)pool->next);
+		pool->next = NULL;
+	}
+	pool->capacity = 0;
+	atomic_store(&pool->head, POOL_HEAD(0, POOL_NIL));
+}
+
+esp_hass_pool_t *
+esp_hass_pool_create(size_t object_size, size_t capacity)
+{
+	esp_hass_pool_t *pool = NULL;
+
+	pool = heap_caps_malloc(sizeof(*pool), MALLOC_CAP_DEFAULT);
+	if (pool == NULL) {
+		ESP_LOGE(TAG, "heap_caps_malloc(): Out of memory");
+		return NULL;
+	}
+	if (esp_hass_pool_init(pool, object_size, capacity) != ESP_OK) {
+		heap_caps_free(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+/* drop a reference, and free a deleted pool with the last one */
+static void
+pool_unref(esp_hass_pool_t *pool)
+{
+	if (atomic_fetch_sub_explicit(&pool->refs, 1, memory_order_acq_rel) ==
+	    1) {
+		esp_hass_pool_free(pool);
+		heap_caps_free(pool);
+	}
+}
+
+void
+esp_hass_pool_delete(esp_hass_pool_t *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+	pool_unref(pool);
+}
+
+void *
+esp_hass_pool_get(esp_hass_pool_t *pool)
+{
+	uint32_t head, new_head;
+	uint16_t index;
+
+	/* the tag changes at every update so that the compare-and-swap fails
+	 * when other tasks have taken and returned the object in between
+	 */
+	head = atomic_load(&pool->head);
+	do {
+		index = POOL_INDEX(head);
+		if (index == POOL_NIL) {
+			atomic_fetch_add(&pool->exhausted, 1);
+			return NULL;
+		}
+		new_head = POOL_HEAD(POOL_TAG(head) + 1,
+		    atomic_load(&pool->next[index]));
+	} while (!atomic_compare_exchange_weak(&pool->head, &head, new_head));
+	atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
+	return pool->objects + (size_t)index * pool->object_size;
+}
+
+void
+esp_hass_pool_put(esp_hass_pool_t *pool, void *object)
+{
+	uint32_t head, new_head;
+	uint16_t index;
+
+	index = ((char *)object - pool->objects) / pool->object_size;
+	head = atomic_load(&pool->head);
+	do {
+		atomic_store(&pool->next[index], POOL_INDEX(head));
+		new_head = POOL_HEAD(POOL_TAG(head) + 1, index);
+	} while (!atomic_compare_exchange_weak(&pool->head, &head, new_head));
+	pool_unref(pool);
+}
@@ -0,0 +1,114 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __POOL__H__
+#define __POOL__H__
+
+#include <esp_err.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Maximum capacity of a pool.
+ */
+#define ESP_HASS_POOL_MAX_CAPACITY (0xfffe)
+
+/**
+ * A fixed-capacity pool of objects of the same size. Free objects are kept
+ * in a lock-free stack so that tasks can take and return objects without a
+ * lock, or an allocation.
+ */
+typedef struct {
+	char *objects;		   /*!< The memory of objects */
+	_Atomic uint16_t *next;	   /*!< The next free object of each object */
+	size_t object_size;	   /*!< Size of an object in bytes */
+	uint16_t capacity;	   /*!< Number of objects */
+	_Atomic uint32_t head;	   /*!< A tag in upper 16 bits, and the index
+				      of the first free object */
+	_Atomic uint32_t exhausted; /*!< Number of times the pool was empty */
+	_Atomic uint32_t refs;	    /*!< One for the owner, and one for each
+				       object taken from the pool */
+} esp_hass_pool_t;
+
+/**
+ * @brief Allocate the objects of a pool.
+ *
+ * @param[in] pool The pool.
+ * @param[in] object_size Size of an object in bytes.
+ * @param[in] capacity Number of objects. Zero is allowed, and the pool is
+ * always empty.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if pool is NULL, or arguments are out of range
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_pool_init(esp_hass_pool_t *pool, size_t object_size,
+    size_t capacity);
+
+/**
+ * @brief Free the objects of a pool. Objects taken from the pool must not be
+ * used after this call.
+ *
+ * @param[in] pool The pool.
+ */
+void esp_hass_pool_free(esp_hass_pool_t *pool);
+
+/**
+ * @brief Allocate a pool, and its objects.
+ *
+ * @param[in] object_size Size of an object in bytes.
+ * @param[in] capacity Number of objects.
+ *
+ * @return
+ * - Pointer to the pool
+ * - NULL if arguments are out of range, or out of memory
+ */
+esp_hass_pool_t *esp_hass_pool_create(size_t object_size, size_t capacity);
+
+/**
+ * @brief Delete a pool created by esp_hass_pool_create(). Objects taken from
+ * the pool may still be used, and returned, after this call. The pool is
+ * freed when the last object is returned.
+ *
+ * @param[in] pool The pool.
+ */
+void esp_hass_pool_delete(esp_hass_pool_t *pool);
+
+/**
+ * @brief Take an object from a pool.
+ *
+ * @param[in] pool The pool.
+ *
+ * @return
+ * - Pointer to the object, which is not initialized
+ * - NULL if the pool is empty
+ */
+void *esp_hass_pool_get(esp_hass_pool_t *pool);
+
+/**
+ * @brief Return an object to its pool. When the pool has been deleted, and
+ * the object is the last one, the pool is freed.
+ *
+ * @param[in] pool The pool.
+ * @param[in] object The object taken from the pool.
+ */
+void esp_hass_pool_put(esp_hass_pool_t *pool, void *object);
+
+#endif
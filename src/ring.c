@@ -0,0 +1,293 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ring.h"
+
+/* the maximum count of the semaphores, which must be larger than the number
+ * of tasks that wait at once
+ */
+#define RING_MAX_WAITERS (0x7fff)
+
+static const char *TAG = "esp_hass:ring";
+
+typedef bool (*ring_op_t)(struct esp_hass_ring *, void **);
+
+esp_hass_ring_handle_t
+esp_hass_ring_create(size_t capacity)
+{
+	struct esp_hass_ring *ring = NULL;
+	uint32_t size = 2;
+	uint32_t i;
+
+	if (capacity > ESP_HASS_RING_MAX_CAPACITY) {
+		ESP_LOGE(TAG, "capacity must be less than or equal to %d",
+		    ESP_HASS_RING_MAX_CAPACITY);
+		return NULL;
+	}
+	while (size < capacity) {
+		size <<= 1;
+	}
+	ring = heap_caps_calloc(1, sizeof(*ring), MALLOC_CAP_DEFAULT);
+	if (ring == NULL) {
+		goto fail;
+	}
+	ring->slots = heap_caps_calloc(size, sizeof(ring->slots[0]),
+	    MALLOC_CAP_DEFAULT);
+	ring->items = xSemaphoreCreateCounting(RING_MAX_WAITERS, 0);
+	ring->spaces = xSemaphoreCreateCounting(RING_MAX_WAITERS, 0);
+	if (ring->slots == NULL || ring->items == NULL ||
+	    ring->spaces == NULL) {
+		goto fail;
+	}
+	ring->mask = size - 1;
+	for (i = 0; i < size; i++) {
+		atomic_init(&ring->slots[i].seq, i);
+	}
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->receivers, 0);
+	atomic_init(&ring->senders, 0);
+	return ring;
+fail:
+	ESP_LOGE(TAG, "esp_hass_ring_create(): Out of memory");
+	esp_hass_ring_delete(ring);
+	return NULL;
+}
+
+void
+esp_hass_ring_delete(esp_hass_ring_handle_t ring)
+{
+	if (ring == NULL) {
+		return;
+	}
+	if (ring->items != NULL) {
+		vSemaphoreDelete(ring->items);
+	}
+	if (ring->spaces != NULL) {
+		vSemaphoreDelete(ring->spaces);
+	}
+	if (ring->slots != NULL) {
+		heap_caps_free(ring->slots);
+	}
+	heap_caps_free(ring);
+}
+
+bool
+esp_hass_ring_push(struct esp_hass_ring *ring, void *item)
+{
+	esp_hass_ring_slot_t *slot = NULL;
+	uint32_t pos, seq;
+	int32_t diff;
+
+	pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		diff = (int32_t)(seq - pos);
+		if (diff == 0) {
+			/* the slot is free for this position */
+			if (atomic_compare_exchange_weak_explicit(&ring->tail,
+				&pos, pos + 1, memory_order_relaxed,
+				memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			/* the slot still holds the pointer of the last lap */
+			return false;
+		} else {
+			pos = atomic_load_explicit(&ring->tail,
+			    memory_order_relaxed);
+		}
+	}
+	slot->item = item;
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+	return true;
+}
+
+bool
+esp_hass_ring_pop(struct esp_hass_ring *ring, void **item)
+{
+	esp_hass_ring_slot_t *slot = NULL;
+	uint32_t pos, seq;
+	int32_t diff;
+
+	pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		diff = (int32_t)(seq - (pos + 1));
+		if (diff == 0) {
+			/* the slot holds the pointer of this position */
+			if (atomic_compare_exchange_weak_explicit(&ring->head,
+				&pos, pos + 1, memory_order_relaxed,
+				memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			/* the pointer has not been sent yet */
+			return false;
+		} else {
+			pos = atomic_load_explicit(&ring->head,
+			    memory_order_relaxed);
+		}
+	}
+	*item = slot->item;
+	atomic_store_explicit(&slot->seq, pos + ring->mask + 1,
+	    memory_order_release);
+	return true;
+}
+
+static bool
+push(struct esp_hass_ring *ring, void **item)
+{
+	return esp_hass_ring_push(ring, *item);
+}
+
+/* take the registration of a waiting task, if any */
+static bool
+take_waiter(_Atomic int *waiters)
+{
+	int n;
+
+	n = atomic_load(waiters);
+	while (n > 0) {
+		if (atomic_compare_exchange_weak(waiters, &n, n - 1)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* wake up to n tasks waiting on the other side of the ring, if any. a
+ * task is given the semaphore once for its registration.
+ */
+static void
+ring_notify(_Atomic int *waiters, SemaphoreHandle_t semaphore, size_t n)
+{
+	size_t i;
+
+	/* pairs with the fence in ring_wait() so that either the waiter sees
+	 * the change of the ring, or this function sees the waiter
+	 */
+	atomic_thread_fence(memory_order_seq_cst);
+	for (i = 0; i < n && take_waiter(waiters); i++) {
+		xSemaphoreGive(semaphore);
+	}
+}
+
+/* retry op until it succeeds, blocking on the semaphore in between */
+static bool
+ring_wait(struct esp_hass_ring *ring, ring_op_t op, void **item,
+    _Atomic int *waiters, SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+	TickType_t start, elapsed;
+	bool success = false;
+
+	if (op(ring, item)) {
+		return true;
+	}
+	start = xTaskGetTickCount();
+	for (;;) {
+		elapsed = xTaskGetTickCount() - start;
+		if (ticks != portMAX_DELAY && elapsed >= ticks) {
+			return false;
+		}
+		atomic_fetch_add(waiters, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		success = op(ring, item);
+		if (!success &&
+		    xSemaphoreTake(semaphore,
+			ticks == portMAX_DELAY ? portMAX_DELAY :
+						 ticks - elapsed) == pdTRUE) {
+
+			/* the other side has taken the registration */
+			if (op(ring, item)) {
+				return true;
+			}
+			continue;
+		}
+
+		/* cancel the registration. when the other side has taken it,
+		 * take the semaphore that it gives
+		 */
+		if (!take_waiter(waiters)) {
+			xSemaphoreTake(semaphore, portMAX_DELAY);
+		}
+		if (success) {
+			return true;
+		}
+	}
+}
+
+esp_err_t
+esp_hass_ring_send(esp_hass_ring_handle_t ring, void *item, TickType_t ticks)
+{
+	if (ring == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (!ring_wait(ring, push, &item, &ring->senders, ring->spaces,
+		ticks)) {
+		return ESP_ERR_TIMEOUT;
+	}
+	ring_notify(&ring->receivers, ring->items, 1);
+	return ESP_OK;
+}
+
+esp_err_t
+esp_hass_ring_receive(esp_hass_ring_handle_t ring, void **item,
+    TickType_t ticks)
+{
+	size_t n = 0;
+
+	return esp_hass_ring_receive_batch(ring, item, 1, &n, ticks);
+}
+
+esp_err_t
+esp_hass_ring_receive_batch(esp_hass_ring_handle_t ring, void **items,
+    size_t max, size_t *n, TickType_t ticks)
+{
+	size_t i;
+
+	if (ring == NULL || items == NULL || n == NULL || max == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	*n = 0;
+	if (!ring_wait(ring, esp_hass_ring_pop, &items[0], &ring->receivers,
+		ring->items, ticks)) {
+		return ESP_ERR_TIMEOUT;
+	}
+	for (i = 1; i < max; i++) {
+		if (!esp_hass_ring_pop(ring, &items[i])) {
+			break;
+		}
+	}
+	*n = i;
+	ring_notify(&ring->senders, ring->spaces, i);
+	return ESP_OK;
+}
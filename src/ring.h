@@ -0,0 +1,86 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __RING__H__
+#define __RING__H__
+
+#include <esp_hass.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Maximum capacity of a ring.
+ */
+#define ESP_HASS_RING_MAX_CAPACITY (0x8000)
+
+/**
+ * A slot of a ring. `seq` tells whether the slot is free for the pointer
+ * of a position, or holds it.
+ */
+typedef struct {
+	_Atomic uint32_t seq; /*!< The sequence number of the slot */
+	void *item;	      /*!< The pointer */
+} esp_hass_ring_slot_t;
+
+/**
+ * A bounded lock-free queue of pointers for multiple producers, and
+ * multiple consumers. A producer claims the slot at `tail`, and a consumer
+ * the slot at `head`, by compare-and-swap. The sequence number of a slot
+ * orders the claim, and the pointer in the slot.
+ */
+struct esp_hass_ring {
+	esp_hass_ring_slot_t *slots; /*!< The slots */
+	uint32_t mask;		     /*!< Number of slots minus one */
+	_Atomic uint32_t head;	     /*!< The next position to receive */
+	_Atomic uint32_t tail;	     /*!< The next position to send */
+	_Atomic int receivers;	     /*!< Number of tasks waiting for a
+					pointer */
+	_Atomic int senders;	     /*!< Number of tasks waiting for space */
+	SemaphoreHandle_t items;     /*!< Given when a pointer is sent while
+					a task waits */
+	SemaphoreHandle_t spaces;    /*!< Given when a pointer is received
+					while a task waits */
+};
+
+/**
+ * @brief Send a pointer to a ring without waiting.
+ *
+ * @param[in] ring The ring.
+ * @param[in] item The pointer.
+ *
+ * @return
+ * - true if sent
+ * - false if the ring is full
+ */
+bool esp_hass_ring_push(struct esp_hass_ring *ring, void *item);
+
+/**
+ * @brief Receive a pointer from a ring without waiting.
+ *
+ * @param[in] ring The ring.
+ * @param[out] item The pointer.
+ *
+ * @return
+ * - true if received
+ * - false if the ring is empty
+ */
+bool esp_hass_ring_pop(struct esp_hass_ring *ring, void **item);
+
+#endif
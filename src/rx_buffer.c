@@ -0,0 +1,224 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <string.h>
+
+#include "rx_buffer.h"
+
+static const char *TAG = "esp_hass:rx_buffer";
+
+static void
+rx_buffer_release(esp_hass_rx_buffer_t *buf)
+{
+	if (buf->data != NULL) {
+		heap_caps_free(buf->data);
+		buf->data = NULL;
+	}
+	buf->size = 0;
+	buf->len = 0;
+}
+
+/*
+ * make sure that the buffer has at least `size` bytes. the content is not
+ * preserved because the buffer grows only at the first fragment.
+ */
+static esp_err_t
+rx_buffer_reserve(esp_hass_rx_buffer_t *buf, size_t size)
+{
+	esp_err_t err = ESP_FAIL;
+
+	if (buf->data != NULL && buf->size >= size) {
+		return ESP_OK;
+	}
+	rx_buffer_release(buf);
+
+	/* do not allocate less than default_size so that small messages do
+	 * not allocate memory every time
+	 */
+	if (size < buf->default_size) {
+		size = buf->default_size;
+	}
+	buf->data = heap_caps_malloc(size, buf->caps);
+	if (buf->data == NULL) {
+		ESP_LOGE(TAG, "heap_caps_malloc(): Out of memory: %u bytes",
+		    (unsigned int)size);
+		err = ESP_ERR_NO_MEM;
+		goto fail;
+	}
+	ESP_LOGD(TAG, "rx_buffer allocated: %u bytes", (unsigned int)size);
+	buf->size = size;
+	buf->data[0] = '\0';
+	err = ESP_OK;
+fail:
+	return err;
+}
+
+esp_err_t
+esp_hass_rx_buffer_init(esp_hass_rx_buffer_t *buf, size_t default_size,
+    size_t max_size, uint32_t caps)
+{
+	esp_err_t err = ESP_FAIL;
+
+	if (buf == NULL || default_size == 0 || max_size < default_size) {
+		err = ESP_ERR_INVALID_ARG;
+		goto fail;
+	}
+	buf->data = NULL;
+	buf->len = 0;
+	buf->size = 0;
+	buf->default_size = default_size;
+	buf->max_size = max_size;
+	buf->caps = caps;
+	err = ESP_OK;
+fail:
+	return err;
+}
+
+void
+esp_hass_rx_buffer_free(esp_hass_rx_buffer_t *buf)
+{
+	if (buf == NULL) {
+		return;
+	}
+	rx_buffer_release(buf);
+}
+
+void
+esp_hass_rx_buffer_reset(esp_hass_rx_buffer_t *buf)
+{
+	if (buf->size > buf->default_size) {
+		ESP_LOGD(TAG, "shrinking rx_buffer: %u bytes",
+		    (unsigned int)buf->size);
+		rx_buffer_release(buf);
+		return;
+	}
+	buf->len = 0;
+	if (buf->data != NULL) {
+		buf->data[0] = '\0';
+	}
+}
+
+esp_err_t
+esp_hass_rx_buffer_write(esp_hass_rx_buffer_t *buf, size_t offset,
+    const char *data, size_t data_len, size_t payload_len)
+{
+	esp_err_t err = ESP_FAIL;
+
+	if (buf == NULL || data == NULL) {
+		err = ESP_ERR_INVALID_ARG;
+		goto fail;
+	}
+
+	/* the first fragment of a payload. keep a byte for NULL */
+	if (offset == 0) {
+		buf->len = 0;
+		if (payload_len >= buf->max_size) {
+			ESP_LOGE(TAG,
+			    "payload too large. payload_len: %u, max_size: %u",
+			    (unsigned int)payload_len,
+			    (unsigned int)buf->max_size);
+			err = ESP_ERR_INVALID_SIZE;
+			goto fail;
+		}
+		err = rx_buffer_reserve(buf, payload_len + 1);
+		if (err != ESP_OK) {
+			goto fail;
+		}
+	}
+	if (buf->data == NULL || offset != buf->len) {
+		ESP_LOGE(TAG, "unexpected fragment offset: %u, expected: %u",
+		    (unsigned int)offset, (unsigned int)buf->len);
+		err = ESP_ERR_INVALID_STATE;
+		goto fail;
+	}
+	if (data_len >= buf->size - buf->len) {
+		ESP_LOGE(TAG,
+		    "rx_buffer overflow detected. rx_buffer size: %u, required: %u",
+		    (unsigned int)buf->size,
+		    (unsigned int)(buf->len + data_len + 1));
+		err = ESP_ERR_INVALID_SIZE;
+		goto fail;
+	}
+	memcpy(buf->data + buf->len, data, data_len);
+	buf->len += data_len;
+	buf->data[buf->len] = '\0';
+	err = ESP_OK;
+	return err;
+fail:
+	if (buf != NULL) {
+		esp_hass_rx_buffer_reset(buf);
+	}
+	return err;
+}
+
+esp_err_t
+esp_hass_rx_buffer_append(esp_hass_rx_buffer_t *buf, const char *data,
+    size_t data_len)
+{
+	esp_err_t err = ESP_FAIL;
+	size_t required, size;
+	char *data_new = NULL;
+
+	if (buf == NULL || data == NULL) {
+		err = ESP_ERR_INVALID_ARG;
+		goto fail;
+	}
+
+	/* keep a byte for NULL */
+	required = buf->len + data_len + 1;
+	if (required > buf->size) {
+		if (required > buf->max_size) {
+			ESP_LOGE(TAG,
+			    "rx_buffer overflow detected. max_size: %u, required: %u",
+			    (unsigned int)buf->max_size,
+			    (unsigned int)required);
+			err = ESP_ERR_INVALID_SIZE;
+			goto fail;
+		}
+
+		/* grow geometrically so that appending byte by byte does not
+		 * reallocate every time
+		 */
+		size = buf->size > 0 ? buf->size * 2 : buf->default_size;
+		if (size < required) {
+			size = required;
+		}
+		if (size > buf->max_size) {
+			size = buf->max_size;
+		}
+		data_new = heap_caps_realloc(buf->data, size, buf->caps);
+		if (data_new == NULL) {
+			ESP_LOGE(TAG,
+			    "heap_caps_realloc(): Out of memory: %u bytes",
+			    (unsigned int)size);
+			err = ESP_ERR_NO_MEM;
+			goto fail;
+		}
+		buf->data = data_new;
+		buf->size = size;
+	}
+	memcpy(buf->data + buf->len, data, data_len);
+	buf->len += data_len;
+	buf->data[buf->len] = '\0';
+	err = ESP_OK;
+fail:
+	return err;
+}
@@ -0,0 +1,128 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __RX_BUFFER__H__
+#define __RX_BUFFER__H__
+
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(CONFIG_ESP_HASS_RX_BUFFER_SPIRAM)
+#define ESP_HASS_RX_BUFFER_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define ESP_HASS_RX_BUFFER_CAPS (MALLOC_CAP_DEFAULT | MALLOC_CAP_8BIT)
+#endif
+
+/**
+ * A length-tracked buffer to reassemble fragmented WebSocket payloads, or to
+ * accumulate tokens in the streaming JSON parser.
+ *
+ * Fragments are copied to their payload offset without intermediate
+ * allocation. The content is always null-terminated so that it can be
+ * logged as a string.
+ *
+ * The buffer is allocated when the first fragment of a payload arrives, and
+ * sized from the payload length. A buffer larger than `default_size` is
+ * released when the buffer is reset so that a large message does not keep
+ * its memory after it has been parsed.
+ */
+typedef struct {
+	char *data;	     /*!< The buffer */
+	size_t len;	     /*!< Number of bytes written so far, excluding NULL */
+	size_t size;	     /*!< Size of `data` in bytes, including NULL */
+	size_t default_size; /*!< Size to keep between payloads */
+	size_t max_size;     /*!< Maximum size the buffer may grow to */
+	uint32_t caps;	     /*!< Memory capabilities for heap_caps_malloc() */
+} esp_hass_rx_buffer_t;
+
+/**
+ * @brief Initialize the buffer. Memory is not allocated until the first
+ * fragment arrives.
+ *
+ * @param[in] buf The buffer.
+ * @param[in] default_size Size of the buffer to keep between payloads in
+ * bytes, including NULL.
+ * @param[in] max_size Maximum size of the buffer in bytes, including NULL.
+ * @param[in] caps Memory capabilities passed to heap_caps_malloc(), i.e.
+ * MALLOC_CAP_SPIRAM to place the buffer in PSRAM.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if buf is NULL, or sizes are invalid
+ */
+esp_err_t esp_hass_rx_buffer_init(esp_hass_rx_buffer_t *buf,
+    size_t default_size, size_t max_size, uint32_t caps);
+
+/**
+ * @brief Free the memory held by the buffer.
+ *
+ * @param[in] buf The buffer.
+ */
+void esp_hass_rx_buffer_free(esp_hass_rx_buffer_t *buf);
+
+/**
+ * @brief Discard the content of the buffer. If the buffer has grown larger
+ * than `default_size`, the memory is released.
+ *
+ * @param[in] buf The buffer.
+ */
+void esp_hass_rx_buffer_reset(esp_hass_rx_buffer_t *buf);
+
+/**
+ * @brief Copy a fragment into the buffer at `offset`.
+ *
+ * A fragment at offset zero starts a new payload, discards previous
+ * content, and makes sure that the buffer is large enough for
+ * `payload_len`. Other fragments must start where the previous one ended.
+ *
+ * @param[in] buf The buffer.
+ * @param[in] offset Offset of the fragment in the payload.
+ * @param[in] data The fragment.
+ * @param[in] data_len Length of `data`.
+ * @param[in] payload_len Total length of the payload.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if buf or data is NULL
+ * - ESP_ERR_INVALID_STATE if the fragment is out of order
+ * - ESP_ERR_INVALID_SIZE if the payload is larger than `max_size`
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_rx_buffer_write(esp_hass_rx_buffer_t *buf, size_t offset,
+    const char *data, size_t data_len, size_t payload_len);
+
+/**
+ * @brief Append bytes to the buffer. The buffer grows as necessary, up to
+ * `max_size`.
+ *
+ * @param[in] buf The buffer.
+ * @param[in] data The bytes to append.
+ * @param[in] data_len Length of `data`.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if buf or data is NULL
+ * - ESP_ERR_INVALID_SIZE if the content would be larger than `max_size`
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_rx_buffer_append(esp_hass_rx_buffer_t *buf,
+    const char *data, size_t data_len);
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tx.h"
+#include "writer.h"
+
+static const char *TAG = "esp_hass:tx";
+
+/* return a frame to the free frames */
+static void
+put_frame(esp_hass_tx_t *tx, esp_hass_tx_frame_t *frame)
+{
+	if (frame->heap_text != NULL) {
+		cJSON_free(frame->heap_text);
+		frame->heap_text = NULL;
+	}
+	esp_hass_ring_send(tx->free_frames, frame, portMAX_DELAY);
+}
+
+/* drain the queue, and send the frames that have been queued together in a
+ * call */
+static void
+esp_hass_task_tx(void *args)
+{
+	esp_hass_tx_t *tx = args;
+	esp_hass_tx_frame_t *frames[ESP_HASS_TX_FRAMES_MAX + 1];
+	size_t n, i;
+	bool stop = false;
+
+	while (!stop) {
+		if (esp_hass_ring_receive_batch(tx->queued, (void **)frames,
+			ESP_HASS_TX_FRAMES_MAX + 1, &n, portMAX_DELAY) !=
+		    ESP_OK) {
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+
+			/* NULL is the last frame */
+			if (frames[i] == NULL) {
+				stop = true;
+				n = i;
+				break;
+			}
+		}
+		if (n == 0) {
+			continue;
+		}
+		tx->send(tx->context, frames, n);
+		atomic_fetch_add(&tx->n_sent, n);
+		atomic_fetch_add(&tx->n_batches, 1);
+		for (i = 0; i < n; i++) {
+			put_frame(tx, frames[i]);
+		}
+	}
+	xSemaphoreGive(tx->stopped);
+	vTaskDelete(NULL);
+}
+
+esp_err_t
+esp_hass_tx_init(esp_hass_tx_t *tx, const esp_hass_tx_config_t *config)
+{
+	esp_err_t err = ESP_ERR_NO_MEM;
+	size_t i;
+
+	if (tx == NULL || config == NULL || config->n_frames == 0 ||
+	    config->n_frames > ESP_HASS_TX_FRAMES_MAX ||
+	    config->send == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(tx, 0, sizeof(*tx));
+	tx->send = config->send;
+	tx->context = config->context;
+	tx->frames = calloc(config->n_frames, sizeof(tx->frames[0]));
+	tx->free_frames = esp_hass_ring_create(config->n_frames);
+
+	/* the queue has room for all the frames, and the last NULL */
+	tx->queued = esp_hass_ring_create(config->n_frames + 1);
+	tx->order = xSemaphoreCreateMutex();
+	tx->stopped = xSemaphoreCreateBinary();
+	if (tx->frames == NULL || tx->free_frames == NULL ||
+	    tx->queued == NULL || tx->order == NULL || tx->stopped == NULL) {
+		ESP_LOGE(TAG, "esp_hass_tx_init(): Out of memory");
+		goto fail;
+	}
+	for (i = 0; i < config->n_frames; i++) {
+		esp_hass_writer_init(&tx->frames[i].w, tx->frames[i].text,
+		    sizeof(tx->frames[i].text));
+		esp_hass_ring_send(tx->free_frames, &tx->frames[i], 0);
+	}
+	if (xTaskCreate(esp_hass_task_tx, "esp_hass_tx", config->stack_size,
+		tx, config->priority, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "xTaskCreate(): Out of memory");
+		goto fail;
+	}
+	return ESP_OK;
+fail:
+	if (tx->stopped != NULL) {
+		vSemaphoreDelete(tx->stopped);
+		tx->stopped = NULL;
+	}
+	esp_hass_tx_free(tx);
+	return err;
+}
+
+void
+esp_hass_tx_free(esp_hass_tx_t *tx)
+{
+	if (tx == NULL) {
+		return;
+	}
+
+	/* the writer is running when the pipeline is initialized */
+	if (tx->stopped != NULL) {
+		esp_hass_ring_send(tx->queued, NULL, portMAX_DELAY);
+		xSemaphoreTake(tx->stopped, portMAX_DELAY);
+		vSemaphoreDelete(tx->stopped);
+		tx->stopped = NULL;
+	}
+	if (tx->order != NULL) {
+		vSemaphoreDelete(tx->order);
+		tx->order = NULL;
+	}
+	esp_hass_ring_delete(tx->queued);
+	tx->queued = NULL;
+	esp_hass_ring_delete(tx->free_frames);
+	tx->free_frames = NULL;
+	free(tx->frames);
+	tx->frames = NULL;
+}
+
+esp_hass_tx_frame_t *
+esp_hass_tx_begin(esp_hass_tx_t *tx, TickType_t ticks)
+{
+	esp_hass_tx_frame_t *frame = NULL;
+
+	/* wait for a frame without holding the order */
+	if (esp_hass_ring_receive(tx->free_frames, (void **)&frame, ticks) !=
+	    ESP_OK) {
+		ESP_LOGW(TAG, "no frame is free, the network is slow");
+		return NULL;
+	}
+	frame->id = 0;
+	esp_hass_writer_reset(&frame->w);
+	xSemaphoreTake(tx->order, portMAX_DELAY);
+	return frame;
+}
+
+void
+esp_hass_tx_commit(esp_hass_tx_t *tx, esp_hass_tx_frame_t *frame)
+{
+	/* the queue never fills up */
+	esp_hass_ring_send(tx->queued, frame, portMAX_DELAY);
+	xSemaphoreGive(tx->order);
+}
+
+void
+esp_hass_tx_abort(esp_hass_tx_t *tx, esp_hass_tx_frame_t *frame)
+{
+	xSemaphoreGive(tx->order);
+	put_frame(tx, frame);
+}
@@ -0,0 +1,141 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __TX__H__
+#define __TX__H__
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "writer.h"
+
+/**
+ * Maximum number of frames.
+ */
+#define ESP_HASS_TX_FRAMES_MAX (64)
+
+/**
+ * A frame, the text of a message to send.
+ */
+typedef struct {
+	int id; /*!< The ID of the message, or 0 if it has none, i.e. auth */
+	esp_hass_writer_t w; /*!< The writer of the text */
+	char *heap_text; /*!< The text, allocated by cJSON, of a message that
+			    does not fit in `text`, or NULL. Its length is
+			    `w.len`. Freed when the frame is returned */
+
+	/** The text */
+	char text[CONFIG_ESP_HASS_TX_BUFFER_SIZE];
+} esp_hass_tx_frame_t;
+
+/**
+ * A function that the writer calls with the frames that have been queued
+ * since the last call, in the order of the queue.
+ */
+typedef void (*esp_hass_tx_send_t)(void *context,
+    esp_hass_tx_frame_t *const *frames, size_t n);
+
+/**
+ * Configuration of a transmit pipeline.
+ */
+typedef struct {
+	size_t n_frames;      /*!< Number of frames */
+	uint32_t stack_size;  /*!< Stack size of the writer */
+	UBaseType_t priority; /*!< Priority of the writer */
+	esp_hass_tx_send_t send; /*!< The function to send frames */
+	void *context;		 /*!< Passed to send */
+} esp_hass_tx_config_t;
+
+/**
+ * A transmit pipeline. Tasks write messages into frames, and queue them in
+ * the order of their IDs. A single writer task drains the queue, and sends
+ * the frames, so that no task waits for the network but the writer.
+ */
+typedef struct {
+	esp_hass_tx_frame_t *frames;	     /*!< The frames */
+	esp_hass_ring_handle_t free_frames; /*!< Frames to write into */
+	esp_hass_ring_handle_t queued;	     /*!< Frames to send */
+	SemaphoreHandle_t order; /*!< Held from taking an ID to queueing */
+	SemaphoreHandle_t stopped; /*!< Given when the writer stops */
+	esp_hass_tx_send_t send;   /*!< The function to send frames */
+	void *context;		   /*!< Passed to send */
+	_Atomic uint32_t n_sent;    /*!< Number of frames sent */
+	_Atomic uint32_t n_batches; /*!< Number of calls of send */
+} esp_hass_tx_t;
+
+/**
+ * @brief Initialize a transmit pipeline, and start the writer.
+ *
+ * @param[in] tx The pipeline.
+ * @param[in] config The configuration.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_tx_init(esp_hass_tx_t *tx,
+    const esp_hass_tx_config_t *config);
+
+/**
+ * @brief Send the queued frames, stop the writer, and free the pipeline.
+ * Does nothing if the pipeline has not been initialized. No task must call
+ * esp_hass_tx_begin() once this has been called.
+ *
+ * @param[in] tx The pipeline.
+ */
+void esp_hass_tx_free(esp_hass_tx_t *tx);
+
+/**
+ * @brief Take a frame to write a message into, and hold the order of the
+ * queue until esp_hass_tx_commit(), or esp_hass_tx_abort(). Take the ID of
+ * the message after this so that IDs are sent in order.
+ *
+ * @param[in] tx The pipeline.
+ * @param[in] ticks Ticks to wait for a frame when all frames are in use.
+ *
+ * @return
+ * - The frame, whose `id` is 0
+ * - NULL if no frame is free
+ */
+esp_hass_tx_frame_t *esp_hass_tx_begin(esp_hass_tx_t *tx, TickType_t ticks);
+
+/**
+ * @brief Queue a frame for the writer, and release the order of the queue.
+ * Never waits for the network.
+ *
+ * @param[in] tx The pipeline.
+ * @param[in] frame The frame from esp_hass_tx_begin().
+ */
+void esp_hass_tx_commit(esp_hass_tx_t *tx, esp_hass_tx_frame_t *frame);
+
+/**
+ * @brief Return a frame without sending it, and release the order of the
+ * queue. `heap_text` of the frame is freed.
+ *
+ * @param[in] tx The pipeline.
+ * @param[in] frame The frame from esp_hass_tx_begin().
+ */
+void esp_hass_tx_abort(esp_hass_tx_t *tx, esp_hass_tx_frame_t *frame);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "intern.h"
+#include "parser.h"
+#include "workers.h"
+
+#define WORKER_BATCH_MAX (8)
+#define WORKER_NAME_MAX_LEN (24)
+
+static const char *TAG = "esp_hass:workers";
+
+static void
+esp_hass_task_worker(void *args)
+{
+	esp_hass_worker_t *worker = args;
+	esp_hass_workers_t *workers = worker->workers;
+	esp_hass_message_t *msgs[WORKER_BATCH_MAX];
+	size_t n, i;
+
+	while (1) {
+		if (esp_hass_ring_receive_batch(worker->ring, (void **)msgs,
+			WORKER_BATCH_MAX, &n, portMAX_DELAY) != ESP_OK) {
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+
+			/* NULL is the last message */
+			if (msgs[i] == NULL) {
+				goto stop;
+			}
+			workers->dispatch(workers->context, msgs[i]);
+		}
+	}
+stop:
+	xSemaphoreGive(workers->stopped);
+	vTaskDelete(NULL);
+}
+
+esp_err_t
+esp_hass_workers_init(esp_hass_workers_t *workers,
+    const esp_hass_workers_config_t *config)
+{
+	esp_err_t err = ESP_FAIL;
+	esp_hass_worker_t *worker = NULL;
+	char name[WORKER_NAME_MAX_LEN];
+	BaseType_t core_id;
+	BaseType_t rtos_err;
+	size_t i;
+
+	if (workers == NULL || config == NULL || config->n_workers == 0 ||
+	    config->n_workers > ESP_HASS_WORKERS_MAX ||
+	    config->dispatch == NULL || config->entities == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(workers, 0, sizeof(*workers));
+	workers->dispatch = config->dispatch;
+	workers->context = config->context;
+	workers->entities = config->entities;
+	workers->stopped = xSemaphoreCreateCounting(ESP_HASS_WORKERS_MAX, 0);
+	if (workers->stopped == NULL) {
+		ESP_LOGE(TAG, "xSemaphoreCreateCounting(): Out of memory");
+		return ESP_ERR_NO_MEM;
+	}
+	for (i = 0; i < config->n_workers; i++) {
+		worker = &workers->workers[i];
+		worker->workers = workers;
+		worker->ring = esp_hass_ring_create(config->queue_size);
+		if (worker->ring == NULL) {
+			err = ESP_ERR_NO_MEM;
+			goto fail;
+		}
+		snprintf(name, sizeof(name), "esp_hass_worker_%u",
+		    (unsigned)i);
+		core_id = config->core_id;
+		if (core_id == ESP_HASS_WORKERS_SPREAD_CORES) {
+			core_id = i % portNUM_PROCESSORS;
+		}
+		if (core_id == ESP_HASS_WORKERS_ANY_CORE) {
+			rtos_err = xTaskCreate(esp_hass_task_worker, name,
+			    config->stack_size, worker, config->priority, NULL);
+		} else {
+			rtos_err = xTaskCreatePinnedToCore(esp_hass_task_worker,
+			    name, config->stack_size, worker, config->priority,
+			    NULL, core_id);
+		}
+		if (rtos_err != pdPASS) {
+			ESP_LOGE(TAG, "xTaskCreate(): Out of memory");
+			esp_hass_ring_delete(worker->ring);
+			worker->ring = NULL;
+			err = ESP_ERR_NO_MEM;
+			goto fail;
+		}
+		workers->n_workers++;
+	}
+	return ESP_OK;
+fail:
+	esp_hass_workers_free(workers);
+	return err;
+}
+
+void
+esp_hass_workers_free(esp_hass_workers_t *workers)
+{
+	size_t i;
+
+	if (workers == NULL) {
+		return;
+	}
+	for (i = 0; i < workers->n_workers; i++) {
+		esp_hass_ring_send(workers->workers[i].ring, NULL,
+		    portMAX_DELAY);
+	}
+	for (i = 0; i < workers->n_workers; i++) {
+		xSemaphoreTake(workers->stopped, portMAX_DELAY);
+	}
+	for (i = 0; i < workers->n_workers; i++) {
+		esp_hass_ring_delete(workers->workers[i].ring);
+		workers->workers[i].ring = NULL;
+	}
+	workers->n_workers = 0;
+	if (workers->stopped != NULL) {
+		vSemaphoreDelete(workers->stopped);
+		workers->stopped = NULL;
+	}
+}
+
+size_t
+esp_hass_workers_shard(esp_hass_workers_t *workers,
+    const esp_hass_message_t *msg)
+{
+	esp_hass_entity_t entity;
+
+	if (workers->n_workers < 2 ||
+	    esp_hass_message_add_entity(msg, workers->entities, &entity) !=
+		ESP_OK) {
+		return 0;
+	}
+	return entity % workers->n_workers;
+}
+
+esp_err_t
+esp_hass_workers_send(esp_hass_workers_t *workers, esp_hass_message_t *msg,
+    TickType_t ticks)
+{
+	if (msg == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return esp_hass_ring_send(
+	    workers->workers[esp_hass_workers_shard(workers, msg)].ring, msg,
+	    ticks);
+}
@@ -0,0 +1,147 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __WORKERS__H__
+#define __WORKERS__H__
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "intern.h"
+
+/**
+ * Maximum number of workers.
+ */
+#define ESP_HASS_WORKERS_MAX (8)
+
+/**
+ * `core_id` of workers that run on any core.
+ */
+#define ESP_HASS_WORKERS_ANY_CORE (-1)
+
+/**
+ * `core_id` of workers that are pinned to cores in turn, i.e. worker `i`
+ * runs on core `i % portNUM_PROCESSORS`.
+ */
+#define ESP_HASS_WORKERS_SPREAD_CORES (-2)
+
+/**
+ * A function that workers call with a message. The function releases the
+ * message.
+ */
+typedef void (*esp_hass_worker_dispatch_t)(void *context,
+    esp_hass_message_t *msg);
+
+/**
+ * Configuration of workers.
+ */
+typedef struct {
+	size_t n_workers;      /*!< Number of workers */
+	size_t queue_size;     /*!< Number of messages queued for a worker */
+	uint32_t stack_size;   /*!< Stack size of a worker */
+	UBaseType_t priority;  /*!< Priority of workers */
+	BaseType_t core_id;    /*!< The core of workers,
+				  ESP_HASS_WORKERS_ANY_CORE, or
+				  ESP_HASS_WORKERS_SPREAD_CORES */
+	esp_hass_worker_dispatch_t dispatch; /*!< The function to call */
+	void *context;			     /*!< Passed to dispatch */
+	esp_hass_intern_t *entities; /*!< The table of entities to shard
+					messages by */
+} esp_hass_workers_config_t;
+
+struct esp_hass_workers;
+
+/**
+ * A worker, a task that calls `dispatch` with messages in its ring.
+ */
+typedef struct {
+	struct esp_hass_workers *workers; /*!< The workers */
+	esp_hass_ring_handle_t ring;	  /*!< Messages for the worker */
+} esp_hass_worker_t;
+
+/**
+ * A pool of workers. Messages are sharded by their entity so that messages
+ * of an entity are dispatched in order by the same worker, while messages
+ * of other entities are dispatched by other workers in parallel.
+ */
+typedef struct esp_hass_workers {
+	esp_hass_worker_t workers[ESP_HASS_WORKERS_MAX]; /*!< The workers */
+	size_t n_workers;		     /*!< Number of started workers */
+	esp_hass_worker_dispatch_t dispatch; /*!< The function to call */
+	void *context;			     /*!< Passed to dispatch */
+	esp_hass_intern_t *entities;	     /*!< The table of entities */
+	SemaphoreHandle_t stopped; /*!< Given by a worker when it stops */
+} esp_hass_workers_t;
+
+/**
+ * @brief Start workers.
+ *
+ * @param[in] workers The workers.
+ * @param[in] config The configuration.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if an argument is invalid
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_workers_init(esp_hass_workers_t *workers,
+    const esp_hass_workers_config_t *config);
+
+/**
+ * @brief Stop workers after they have dispatched the queued messages.
+ *
+ * @param[in] workers The workers.
+ */
+void esp_hass_workers_free(esp_hass_workers_t *workers);
+
+/**
+ * @brief Get the worker of a message. Messages without an entity, or
+ * messages of an entity that is not in the full table, go to the first
+ * worker.
+ *
+ * @param[in] workers The workers.
+ * @param[in] msg The message.
+ *
+ * @return
+ * - The index of the worker
+ */
+size_t esp_hass_workers_shard(esp_hass_workers_t *workers,
+    const esp_hass_message_t *msg);
+
+/**
+ * @brief Send a message to its worker. The reference of the caller is
+ * passed to the worker.
+ *
+ * @param[in] workers The workers.
+ * @param[in] msg The message.
+ * @param[in] ticks Ticks to wait for space when the ring of the worker is
+ * full.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if msg is NULL
+ * - ESP_ERR_TIMEOUT if the ring of the worker is full
+ */
+esp_err_t esp_hass_workers_send(esp_hass_workers_t *workers,
+    esp_hass_message_t *msg, TickType_t ticks);
+
+#endif
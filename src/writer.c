@@ -0,0 +1,300 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "writer.h"
+
+/* append a string literal */
+#define WRITE_LITERAL(w, s) esp_hass_writer_raw((w), (s), sizeof(s) - 1)
+
+/* the start of every command */
+#define ID_PREFIX "{\"id\":"
+
+/* format an integer backwards from `end`, and return the first character */
+static char *
+format_int(char *end, int value)
+{
+	unsigned int u;
+
+	u = value < 0 ? 0U - (unsigned int)value : (unsigned int)value;
+	do {
+		*--end = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	if (value < 0) {
+		*--end = '-';
+	}
+	return end;
+}
+
+void
+esp_hass_writer_init(esp_hass_writer_t *w, char *buf, size_t size)
+{
+	w->buf = buf;
+	w->size = size;
+	esp_hass_writer_reset(w);
+}
+
+void
+esp_hass_writer_reset(esp_hass_writer_t *w)
+{
+	w->len = 0;
+	w->overflow = false;
+}
+
+void
+esp_hass_writer_raw(esp_hass_writer_t *w, const char *s, size_t len)
+{
+	/* keep a byte for the terminating null */
+	if (w->overflow || w->size - w->len <= len) {
+		w->overflow = true;
+		return;
+	}
+	memcpy(w->buf + w->len, s, len);
+	w->len += len;
+}
+
+void
+esp_hass_writer_string(esp_hass_writer_t *w, const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *run = s;
+	char escaped[6] = { '\\', 'u', '0', '0' };
+	unsigned char c;
+
+	WRITE_LITERAL(w, "\"");
+	for (; *s != '\0'; s++) {
+		c = (unsigned char)*s;
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+
+		/* copy the characters that need no escape at once */
+		esp_hass_writer_raw(w, run, s - run);
+		run = s + 1;
+		switch (c) {
+		case '"':
+			WRITE_LITERAL(w, "\\\"");
+			break;
+		case '\\':
+			WRITE_LITERAL(w, "\\\\");
+			break;
+		case '\b':
+			WRITE_LITERAL(w, "\\b");
+			break;
+		case '\f':
+			WRITE_LITERAL(w, "\\f");
+			break;
+		case '\n':
+			WRITE_LITERAL(w, "\\n");
+			break;
+		case '\r':
+			WRITE_LITERAL(w, "\\r");
+			break;
+		case '\t':
+			WRITE_LITERAL(w, "\\t");
+			break;
+		default:
+			escaped[4] = hex[c >> 4];
+			escaped[5] = hex[c & 0xf];
+			esp_hass_writer_raw(w, escaped, sizeof(escaped));
+			break;
+		}
+	}
+	esp_hass_writer_raw(w, run, s - run);
+	WRITE_LITERAL(w, "\"");
+}
+
+void
+esp_hass_writer_int(esp_hass_writer_t *w, int value)
+{
+	char digits[ESP_HASS_WRITER_INT_MAX_LEN];
+	char *end = digits + sizeof(digits);
+	char *start = format_int(end, value);
+
+	esp_hass_writer_raw(w, start, end - start);
+}
+
+esp_err_t
+esp_hass_writer_finish(esp_hass_writer_t *w)
+{
+	if (w->overflow) {
+		if (w->size > 0) {
+			w->buf[0] = '\0';
+		}
+		return ESP_ERR_INVALID_SIZE;
+	}
+	w->buf[w->len] = '\0';
+	return ESP_OK;
+}
+
+/* start a command with the ID, and the type */
+static void
+write_command(esp_hass_writer_t *w, int id, const char *type)
+{
+	esp_hass_writer_reset(w);
+	WRITE_LITERAL(w, ID_PREFIX);
+	esp_hass_writer_int(w, id);
+	WRITE_LITERAL(w, ",\"type\":\"");
+	esp_hass_writer_raw(w, type, strlen(type));
+	WRITE_LITERAL(w, "\"");
+}
+
+esp_err_t
+esp_hass_write_auth(esp_hass_writer_t *w, const char *access_token)
+{
+	esp_hass_writer_reset(w);
+	WRITE_LITERAL(w, "{\"type\":\"auth\",\"access_token\":");
+	esp_hass_writer_string(w, access_token);
+	WRITE_LITERAL(w, "}");
+	return esp_hass_writer_finish(w);
+}
+
+esp_err_t
+esp_hass_write_subscribe_events(esp_hass_writer_t *w, int id,
+    const char *event_type)
+{
+	write_command(w, id, "subscribe_events");
+	if (event_type != NULL) {
+		WRITE_LITERAL(w, ",\"event_type\":");
+		esp_hass_writer_string(w, event_type);
+	}
+	WRITE_LITERAL(w, "}");
+	return esp_hass_writer_finish(w);
+}
+
+esp_err_t
+esp_hass_write_unsubscribe_events(esp_hass_writer_t *w, int id,
+    int subscription)
+{
+	write_command(w, id, "unsubscribe_events");
+	WRITE_LITERAL(w, ",\"subscription\":");
+	esp_hass_writer_int(w, subscription);
+	WRITE_LITERAL(w, "}");
+	return esp_hass_writer_finish(w);
+}
+
+esp_err_t
+esp_hass_write_call_service(esp_hass_writer_t *w, int id,
+    const esp_hass_call_service_config_t *config)
+{
+	write_command(w, id, "call_service");
+	WRITE_LITERAL(w, ",\"domain\":");
+	esp_hass_writer_string(w, config->domain);
+	WRITE_LITERAL(w, ",\"service\":");
+	esp_hass_writer_string(w, config->service);
+	if (config->entity_id != NULL) {
+		WRITE_LITERAL(w, ",\"target\":{\"entity_id\":");
+		esp_hass_writer_string(w, config->entity_id);
+		WRITE_LITERAL(w, "}");
+	}
+	WRITE_LITERAL(w, "}");
+	return esp_hass_writer_finish(w);
+}
+
+esp_err_t
+esp_hass_write_fire_event(esp_hass_writer_t *w, int id,
+    const char *event_type, const char *event_data)
+{
+	write_command(w, id, "fire_event");
+	WRITE_LITERAL(w, ",\"event_type\":");
+	esp_hass_writer_string(w, event_type);
+	if (event_data != NULL) {
+		WRITE_LITERAL(w, ",\"event_data\":");
+		esp_hass_writer_raw(w, event_data, strlen(event_data));
+	}
+	WRITE_LITERAL(w, "}");
+	return esp_hass_writer_finish(w);
+}
+
+esp_err_t
+esp_hass_write_ping(esp_hass_writer_t *w, int id)
+{
+	write_command(w, id, "ping");
+	WRITE_LITERAL(w, "}");
+	return esp_hass_writer_finish(w);
+}
+
+esp_err_t
+esp_hass_write_supported_features(esp_hass_writer_t *w, int id)
+{
+	write_command(w, id, "supported_features");
+	WRITE_LITERAL(w, ",\"features\":{\"coalesce_messages\":1}}");
+	return esp_hass_writer_finish(w);
+}
+
+esp_err_t
+esp_hass_template_init(esp_hass_template_t *t, const esp_hass_writer_t *w)
+{
+	const char *body = NULL;
+
+	memset(t, 0, sizeof(*t));
+	if (w->overflow || w->len <= sizeof(ID_PREFIX) - 1 ||
+	    strncmp(w->buf, ID_PREFIX, sizeof(ID_PREFIX) - 1) != 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	/* the ID has no comma */
+	body = memchr(w->buf, ',', w->len);
+	if (body == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	t->body_len = w->len - (body - w->buf);
+
+	/* the command must fit in the writer with any ID, not only with the
+	 * ID it has been written with.
+	 */
+	if (sizeof(ID_PREFIX) - 1 + ESP_HASS_WRITER_INT_MAX_LEN + t->body_len +
+		1 >
+	    w->size) {
+		t->body_len = 0;
+		return ESP_ERR_INVALID_SIZE;
+	}
+	t->body = malloc(t->body_len);
+	if (t->body == NULL) {
+		t->body_len = 0;
+		return ESP_ERR_NO_MEM;
+	}
+	memcpy(t->body, body, t->body_len);
+	return ESP_OK;
+}
+
+void
+esp_hass_template_free(esp_hass_template_t *t)
+{
+	free(t->body);
+	t->body = NULL;
+	t->body_len = 0;
+}
+
+esp_err_t
+esp_hass_template_write(const esp_hass_template_t *t, esp_hass_writer_t *w,
+    int id)
+{
+	esp_hass_writer_reset(w);
+	WRITE_LITERAL(w, ID_PREFIX);
+	esp_hass_writer_int(w, id);
+	esp_hass_writer_raw(w, t->body, t->body_len);
+	return esp_hass_writer_finish(w);
+}
@@ -0,0 +1,221 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2022 Tomoyuki Sakurai <y@trombik.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined __WRITER__H__
+#define __WRITER__H__
+
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Maximum length of a formatted int.
+ */
+#define ESP_HASS_WRITER_INT_MAX_LEN (sizeof("-2147483648") - 1)
+
+/**
+ * A writer of compact JSON into a buffer. The buffer is reused for each
+ * command, and the writer never allocates memory.
+ */
+typedef struct {
+	char *buf;     /*!< The buffer */
+	size_t size;   /*!< The size of the buffer */
+	size_t len;    /*!< Length of the text, without the terminating null */
+	bool overflow; /*!< The text has not fit in the buffer */
+} esp_hass_writer_t;
+
+/**
+ * @brief Initialize a writer.
+ *
+ * @param[in] w The writer.
+ * @param[in] buf The buffer.
+ * @param[in] size The size of the buffer.
+ */
+void esp_hass_writer_init(esp_hass_writer_t *w, char *buf, size_t size);
+
+/**
+ * @brief Discard the text.
+ *
+ * @param[in] w The writer.
+ */
+void esp_hass_writer_reset(esp_hass_writer_t *w);
+
+/**
+ * @brief Append text as is.
+ *
+ * @param[in] w The writer.
+ * @param[in] s The text.
+ * @param[in] len Length of the text.
+ */
+void esp_hass_writer_raw(esp_hass_writer_t *w, const char *s, size_t len);
+
+/**
+ * @brief Append a string as a JSON string, quoted and escaped.
+ *
+ * @param[in] w The writer.
+ * @param[in] s The string.
+ */
+void esp_hass_writer_string(esp_hass_writer_t *w, const char *s);
+
+/**
+ * @brief Append an integer.
+ *
+ * @param[in] w The writer.
+ * @param[in] value The integer.
+ */
+void esp_hass_writer_int(esp_hass_writer_t *w, int value);
+
+/**
+ * @brief Terminate the text with a null.
+ *
+ * @param[in] w The writer.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_SIZE if the text has not fit in the buffer
+ */
+esp_err_t esp_hass_writer_finish(esp_hass_writer_t *w);
+
+/**
+ * @brief Write an `auth` message.
+ *
+ * @param[in] w The writer.
+ * @param[in] access_token The access token.
+ *
+ * @return See esp_hass_writer_finish().
+ */
+esp_err_t esp_hass_write_auth(esp_hass_writer_t *w, const char *access_token);
+
+/**
+ * @brief Write a `subscribe_events` command.
+ *
+ * @param[in] w The writer.
+ * @param[in] id The ID of the command.
+ * @param[in] event_type The type of events, or NULL for all events.
+ *
+ * @return See esp_hass_writer_finish().
+ */
+esp_err_t esp_hass_write_subscribe_events(esp_hass_writer_t *w, int id,
+    const char *event_type);
+
+/**
+ * @brief Write an `unsubscribe_events` command.
+ *
+ * @param[in] w The writer.
+ * @param[in] id The ID of the command.
+ * @param[in] subscription The ID of the subscribe_events command.
+ *
+ * @return See esp_hass_writer_finish().
+ */
+esp_err_t esp_hass_write_unsubscribe_events(esp_hass_writer_t *w, int id,
+    int subscription);
+
+/**
+ * @brief Write a `call_service` command.
+ *
+ * @param[in] w The writer.
+ * @param[in] id The ID of the command.
+ * @param[in] config The service. `entity_id` may be NULL.
+ *
+ * @return See esp_hass_writer_finish().
+ */
+esp_err_t esp_hass_write_call_service(esp_hass_writer_t *w, int id,
+    const esp_hass_call_service_config_t *config);
+
+/**
+ * @brief Write a `fire_event` command.
+ *
+ * @param[in] w The writer.
+ * @param[in] id The ID of the command.
+ * @param[in] event_type The type of the event.
+ * @param[in] event_data A JSON object as text, or NULL.
+ *
+ * @return See esp_hass_writer_finish().
+ */
+esp_err_t esp_hass_write_fire_event(esp_hass_writer_t *w, int id,
+    const char *event_type, const char *event_data);
+
+/**
+ * @brief Write a `ping` command.
+ *
+ * @param[in] w The writer.
+ * @param[in] id The ID of the command.
+ *
+ * @return See esp_hass_writer_finish().
+ */
+esp_err_t esp_hass_write_ping(esp_hass_writer_t *w, int id);
+
+/**
+ * @brief Write a `supported_features` command that enables
+ * `coalesce_messages`.
+ *
+ * @param[in] w The writer.
+ * @param[in] id The ID of the command.
+ *
+ * @return See esp_hass_writer_finish().
+ */
+esp_err_t esp_hass_write_supported_features(esp_hass_writer_t *w, int id);
+
+/**
+ * A command that has been written once, and is sent many times with other
+ * IDs. Writing the command formats the ID, and copies the body, the text
+ * after the ID, which has been escaped.
+ */
+typedef struct {
+	char *body;	 /*!< The body */
+	size_t body_len; /*!< Length of the body */
+} esp_hass_template_t;
+
+/**
+ * @brief Initialize a template from a command in a writer.
+ *
+ * @param[out] t The template.
+ * @param[in] w The writer, which has a command written with any ID.
+ *
+ * @return
+ * - ESP_OK if successful
+ * - ESP_ERR_INVALID_ARG if the text is not a command with an ID
+ * - ESP_ERR_INVALID_SIZE if the command with the longest ID does not fit in
+ *   a writer of the size of `w`
+ * - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_hass_template_init(esp_hass_template_t *t,
+    const esp_hass_writer_t *w);
+
+/**
+ * @brief Free a template.
+ *
+ * @param[in] t The template.
+ */
+void esp_hass_template_free(esp_hass_template_t *t);
+
+/**
+ * @brief Write the command of a template with an ID. A template is not
+ * changed, and is safe to write from many tasks.
+ *
+ * @param[in] t The template.
+ * @param[in] w The writer.
+ * @param[in] id The ID.
+ *
+ * @return See esp_hass_writer_finish().
+ */
+esp_err_t esp_hass_template_write(const esp_hass_template_t *t,
+    esp_hass_writer_t *w, int id);
+
+#endif
@@ -0,0 +1,207 @@
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "rx_buffer.h"
+
+#define PAYLOAD_LEN (1024 * 8)
+#define FRAGMENT_LEN (64)
+#define BENCHMARK_ITERATIONS (100)
+
+static const char *TAG = "context";
+static const uint32_t caps = MALLOC_CAP_DEFAULT | MALLOC_CAP_8BIT;
+
+static char *
+create_payload(size_t len)
+{
+	char *payload = NULL;
+
+	payload = malloc(len + 1);
+	if (payload == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < len; i++) {
+		payload[i] = 'a' + (i % 26);
+	}
+	payload[len] = '\0';
+	return payload;
+}
+
+/* the previous implementation in websocket_event_handler(), kept here to
+ * compare with esp_hass_rx_buffer_write()
+ */
+static esp_err_t
+legacy_append(char *rx_buffer, size_t size, const char *data, int data_len)
+{
+	int data_string_len;
+	char *data_string;
+
+	data_string_len = data_len + 1;
+	data_string = calloc(1, data_string_len);
+	if (data_string == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	snprintf(data_string, data_string_len, "%.*s", data_len, data);
+	if (strlcat(rx_buffer, data_string, size) >= size) {
+		free(data_string);
+		return ESP_ERR_INVALID_SIZE;
+	}
+	free(data_string);
+	return ESP_OK;
+}
+
+TEST_CASE("reassembles fragments[esp_hass_rx_buffer_write]",
+    "[esp_hass_rx_buffer_write]")
+{
+	esp_hass_rx_buffer_t buf = { 0 };
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_init(&buf, 16, 16, caps));
+
+	ESP_LOGI(TAG, "when fragments arrive in order");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_rx_buffer_write(&buf, 0, "{\"a\"", 4, 7));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_write(&buf, 4, ":1}", 3, 7));
+	TEST_ASSERT_EQUAL(7, buf.len);
+	TEST_ASSERT_EQUAL_STRING("{\"a\":1}", buf.data);
+
+	ESP_LOGI(TAG, "when a new payload starts");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_write(&buf, 0, "[]", 2, 2));
+	TEST_ASSERT_EQUAL(2, buf.len);
+	TEST_ASSERT_EQUAL_STRING("[]", buf.data);
+
+	esp_hass_rx_buffer_free(&buf);
+}
+
+TEST_CASE("return ESP_ERR_INVALID_STATE[esp_hass_rx_buffer_write]",
+    "[esp_hass_rx_buffer_write]")
+{
+	esp_hass_rx_buffer_t buf = { 0 };
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_init(&buf, 16, 16, caps));
+
+	ESP_LOGI(TAG, "when a fragment is out of order");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_write(&buf, 0, "abc", 3, 7));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE,
+	    esp_hass_rx_buffer_write(&buf, 4, "def", 3, 7));
+	TEST_ASSERT_EQUAL(0, buf.len);
+
+	ESP_LOGI(TAG, "when the first fragment is missing");
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE,
+	    esp_hass_rx_buffer_write(&buf, 3, "def", 3, 7));
+
+	esp_hass_rx_buffer_free(&buf);
+}
+
+TEST_CASE("return ESP_ERR_INVALID_SIZE[esp_hass_rx_buffer_write]",
+    "[esp_hass_rx_buffer_write]")
+{
+	esp_hass_rx_buffer_t buf = { 0 };
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_init(&buf, 4, 8, caps));
+
+	ESP_LOGI(TAG, "when the payload is larger than max_size");
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+	    esp_hass_rx_buffer_write(&buf, 0, "abcd", 4, 8));
+	TEST_ASSERT_EQUAL(0, buf.len);
+
+	ESP_LOGI(TAG, "when fragments exceed payload_len");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_write(&buf, 0, "ab", 2, 2));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+	    esp_hass_rx_buffer_write(&buf, 2, "cd", 2, 2));
+	TEST_ASSERT_EQUAL(0, buf.len);
+
+	esp_hass_rx_buffer_free(&buf);
+}
+
+TEST_CASE("grows and shrinks[esp_hass_rx_buffer_write]",
+    "[esp_hass_rx_buffer_write]")
+{
+	esp_hass_rx_buffer_t buf = { 0 };
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_init(&buf, 4, 64, caps));
+	TEST_ASSERT_NULL(buf.data);
+
+	ESP_LOGI(TAG, "when a small payload arrives");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_rx_buffer_write(&buf, 0, "ab", 2, 2));
+	TEST_ASSERT_EQUAL(4, buf.size);
+	esp_hass_rx_buffer_reset(&buf);
+	TEST_ASSERT_EQUAL(4, buf.size);
+
+	ESP_LOGI(TAG, "when a large payload arrives");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_rx_buffer_write(&buf, 0, "abcdefgh", 8, 16));
+	TEST_ASSERT_EQUAL(17, buf.size);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_rx_buffer_write(&buf, 8, "ijklmnop", 8, 16));
+	TEST_ASSERT_EQUAL_STRING("abcdefghijklmnop", buf.data);
+
+	ESP_LOGI(TAG, "when the buffer is reset after a large payload");
+	esp_hass_rx_buffer_reset(&buf);
+	TEST_ASSERT_NULL(buf.data);
+	TEST_ASSERT_EQUAL(0, buf.size);
+
+	esp_hass_rx_buffer_free(&buf);
+}
+
+TEST_CASE("compare fragment throughput[esp_hass_rx_buffer_write]",
+    "[esp_hass_rx_buffer_write][benchmark]")
+{
+	char *payload = NULL;
+	char *legacy_buffer = NULL;
+	esp_hass_rx_buffer_t buf = { 0 };
+	int64_t start, legacy_us, rx_buffer_us;
+	int fragments = PAYLOAD_LEN / FRAGMENT_LEN;
+	int64_t total = (int64_t)BENCHMARK_ITERATIONS * fragments;
+
+	payload = create_payload(PAYLOAD_LEN);
+	TEST_ASSERT_NOT_NULL(payload);
+	legacy_buffer = calloc(1, PAYLOAD_LEN + 1);
+	TEST_ASSERT_NOT_NULL(legacy_buffer);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_rx_buffer_init(&buf, PAYLOAD_LEN + 1, PAYLOAD_LEN + 1,
+		caps));
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		legacy_buffer[0] = '\0';
+		for (int j = 0; j < fragments; j++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    legacy_append(legacy_buffer, PAYLOAD_LEN + 1,
+				payload + j * FRAGMENT_LEN, FRAGMENT_LEN));
+		}
+	}
+	legacy_us = esp_timer_get_time() - start;
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (int j = 0; j < fragments; j++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_rx_buffer_write(&buf, j * FRAGMENT_LEN,
+				payload + j * FRAGMENT_LEN, FRAGMENT_LEN,
+				PAYLOAD_LEN));
+		}
+	}
+	rx_buffer_us = esp_timer_get_time() - start;
+
+	TEST_ASSERT_EQUAL_STRING(payload, legacy_buffer);
+	TEST_ASSERT_EQUAL(PAYLOAD_LEN, buf.len);
+	TEST_ASSERT_EQUAL_STRING(payload, buf.data);
+
+	ESP_LOGI(TAG, "%d payloads of %d bytes in %d byte fragments",
+	    BENCHMARK_ITERATIONS, PAYLOAD_LEN, FRAGMENT_LEN);
+	ESP_LOGI(TAG, "legacy: %lld us, %lld fragments/sec",
+	    (long long)legacy_us,
+	    (long long)(total * 1000000 / (legacy_us > 0 ? legacy_us : 1)));
+	ESP_LOGI(TAG, "esp_hass_rx_buffer_write: %lld us, %lld fragments/sec",
+	    (long long)rx_buffer_us,
+	    (long long)(total * 1000000 /
+		(rx_buffer_us > 0 ? rx_buffer_us : 1)));
+
+	esp_hass_rx_buffer_free(&buf);
+	free(legacy_buffer);
+	free(payload);
+}
@@ -0,0 +1,201 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "json_stream.h"
+#include "messages.h"
+#include "parser.h"
+
+#define TOKEN_SIZE (64)
+#define TOKEN_MAX_SIZE (1024)
+
+static const char *TAG = "context";
+static const uint32_t caps = MALLOC_CAP_DEFAULT | MALLOC_CAP_8BIT;
+
+static const char *invalid_messages[] = {
+	"{\"id\":1,\"type\":\"result\"",
+	"{\"id\":1,}",
+	"[1,2,]",
+	"{\"id\":1]",
+	"{\"id\":tru}",
+	"{\"id\":1} x",
+	"{\"id\" 1}",
+	"{\"a\":\"\\ud83d\"}",
+	"{\"a\":\"\\x\"}",
+	"{\"a\":1.2.3}",
+	"",
+};
+
+static char *
+print_reference(const char *message)
+{
+	cJSON *json = NULL;
+	char *printed = NULL;
+
+	json = cJSON_Parse(message);
+	if (json == NULL) {
+		return NULL;
+	}
+	printed = cJSON_PrintUnformatted(json);
+	cJSON_Delete(json);
+	return printed;
+}
+
+static char *
+print_stream(esp_hass_json_stream_t *stream)
+{
+	cJSON *json = NULL;
+	char *printed = NULL;
+
+	json = esp_hass_json_stream_finish(stream, NULL);
+	if (json == NULL) {
+		return NULL;
+	}
+	printed = cJSON_PrintUnformatted(json);
+	cJSON_Delete(json);
+	return printed;
+}
+
+TEST_CASE("parses messages split at every byte boundary[esp_hass_json_stream_feed]",
+    "[esp_hass_json_stream_feed]")
+{
+	esp_hass_json_stream_t stream;
+	char *expected = NULL;
+	char *actual = NULL;
+	const char *message = NULL;
+	size_t len;
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_json_stream_init(&stream, TOKEN_SIZE, TOKEN_MAX_SIZE, 0,
+		caps));
+	for (int i = 0; i < n_recorded_messages; i++) {
+		message = recorded_messages[i];
+		ESP_LOGI(TAG, "message %d", i);
+		expected = print_reference(message);
+		TEST_ASSERT_NOT_NULL(expected);
+		len = strlen(message);
+		for (size_t split = 0; split <= len; split++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_json_stream_feed(&stream, message, split));
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_json_stream_feed(&stream, message + split,
+				len - split));
+			actual = print_stream(&stream);
+			TEST_ASSERT_NOT_NULL(actual);
+			TEST_ASSERT_EQUAL_STRING(expected, actual);
+			cJSON_free(actual);
+		}
+		cJSON_free(expected);
+	}
+	esp_hass_json_stream_free(&stream);
+}
+
+TEST_CASE("parses messages fed byte by byte[esp_hass_json_stream_feed]",
+    "[esp_hass_json_stream_feed]")
+{
+	esp_hass_json_stream_t stream;
+	char *expected = NULL;
+	char *actual = NULL;
+	const char *message = NULL;
+	size_t len;
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_json_stream_init(&stream, TOKEN_SIZE, TOKEN_MAX_SIZE, 0,
+		caps));
+	for (int i = 0; i < n_recorded_messages; i++) {
+		message = recorded_messages[i];
+		expected = print_reference(message);
+		TEST_ASSERT_NOT_NULL(expected);
+		len = strlen(message);
+		for (size_t j = 0; j < len; j++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_json_stream_feed(&stream, message + j, 1));
+		}
+		actual = print_stream(&stream);
+		TEST_ASSERT_NOT_NULL(actual);
+		TEST_ASSERT_EQUAL_STRING(expected, actual);
+		cJSON_free(actual);
+		cJSON_free(expected);
+	}
+	esp_hass_json_stream_free(&stream);
+}
+
+TEST_CASE("creates the same message as esp_hass_message_parse[esp_hass_json_stream_finish]",
+    "[esp_hass_json_stream_finish]")
+{
+	esp_hass_json_stream_t stream;
+	esp_hass_message_t *expected = NULL;
+	esp_hass_message_t *actual = NULL;
+	const char *message = NULL;
+	size_t len;
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_json_stream_init(&stream, TOKEN_SIZE, TOKEN_MAX_SIZE, 0,
+		caps));
+	for (int i = 0; i < n_recorded_messages; i++) {
+		message = recorded_messages[i];
+		len = strlen(message);
+		expected = esp_hass_message_parse((char *)message, len,
+		    NULL);
+		TEST_ASSERT_NOT_NULL(expected);
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_json_stream_feed(&stream, message, len / 2));
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_json_stream_feed(&stream, message + len / 2,
+			len - len / 2));
+		actual = esp_hass_message_from_json(
+		    esp_hass_json_stream_finish(&stream, NULL), NULL, NULL);
+		TEST_ASSERT_NOT_NULL(actual);
+		TEST_ASSERT_EQUAL(expected->type, actual->type);
+		TEST_ASSERT_EQUAL(expected->id, actual->id);
+		TEST_ASSERT_EQUAL(expected->success, actual->success);
+		esp_hass_message_destroy(expected);
+		esp_hass_message_destroy(actual);
+	}
+	esp_hass_json_stream_free(&stream);
+}
+
+TEST_CASE("returns NULL[esp_hass_json_stream_finish]",
+    "[esp_hass_json_stream_finish]")
+{
+	esp_hass_json_stream_t stream;
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_json_stream_init(&stream, TOKEN_SIZE, TOKEN_MAX_SIZE, 0,
+		caps));
+
+	ESP_LOGI(TAG, "when JSON is invalid");
+	for (int i = 0;
+	     i < sizeof(invalid_messages) / sizeof(invalid_messages[0]); i++) {
+		esp_hass_json_stream_feed(&stream, invalid_messages[i],
+		    strlen(invalid_messages[i]));
+		TEST_ASSERT_NULL(esp_hass_json_stream_finish(&stream, NULL));
+	}
+
+	ESP_LOGI(TAG, "when a string is longer than token_max_size");
+	char *long_string = calloc(1, TOKEN_MAX_SIZE + 3);
+	TEST_ASSERT_NOT_NULL(long_string);
+	memset(long_string, 'a', TOKEN_MAX_SIZE + 2);
+	long_string[0] = '"';
+	long_string[TOKEN_MAX_SIZE + 1] = '"';
+	TEST_ASSERT_EQUAL(ESP_FAIL,
+	    esp_hass_json_stream_feed(&stream, long_string,
+		strlen(long_string)));
+	TEST_ASSERT_NULL(esp_hass_json_stream_finish(&stream, NULL));
+	free(long_string);
+
+	ESP_LOGI(TAG, "when the parser is reset after an error");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_json_stream_feed(&stream, recorded_messages[0],
+		strlen(recorded_messages[0])));
+	cJSON *json = esp_hass_json_stream_finish(&stream, NULL);
+	TEST_ASSERT_NOT_NULL(json);
+	cJSON_Delete(json);
+
+	esp_hass_json_stream_free(&stream);
+}
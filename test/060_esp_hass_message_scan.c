@@ -0,0 +1,163 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+#include <unity.h>
+
+#include "messages.h"
+#include "parser.h"
+
+#define BENCHMARK_ITERATIONS (1000)
+
+static const char *TAG = "context";
+
+static void
+assert_json_equal(cJSON *expected, cJSON *actual)
+{
+	char *expected_string = NULL;
+	char *actual_string = NULL;
+
+	TEST_ASSERT_NOT_NULL(expected);
+	TEST_ASSERT_NOT_NULL(actual);
+	expected_string = cJSON_PrintUnformatted(expected);
+	actual_string = cJSON_PrintUnformatted(actual);
+	TEST_ASSERT_EQUAL_STRING(expected_string, actual_string);
+	cJSON_free(expected_string);
+	cJSON_free(actual_string);
+}
+
+TEST_CASE("creates the same message as esp_hass_message_parse[esp_hass_message_scan]",
+    "[esp_hass_message_scan]")
+{
+	esp_hass_message_t *expected = NULL;
+	esp_hass_message_t *actual = NULL;
+	const char *message = NULL;
+	size_t len;
+
+	for (int i = 0; i < n_recorded_messages; i++) {
+		message = recorded_messages[i];
+		len = strlen(message);
+		expected = esp_hass_message_parse((char *)message, len,
+		    NULL);
+		TEST_ASSERT_NOT_NULL(expected);
+		actual = esp_hass_message_scan(message, len, NULL);
+		TEST_ASSERT_NOT_NULL(actual);
+
+		ESP_LOGI(TAG, "when the message has been scanned");
+		TEST_ASSERT_EQUAL(expected->type, actual->type);
+		TEST_ASSERT_EQUAL(expected->id, actual->id);
+		TEST_ASSERT_EQUAL(expected->success, actual->success);
+		TEST_ASSERT_EQUAL_STRING(expected->event_type,
+		    actual->event_type);
+		TEST_ASSERT_NULL(actual->json);
+		TEST_ASSERT_NOT_NULL(actual->raw);
+		TEST_ASSERT_EQUAL(len, actual->raw_len);
+
+		ESP_LOGI(TAG, "when the JSON is requested");
+		assert_json_equal(expected->json,
+		    esp_hass_message_get_json(actual));
+		TEST_ASSERT_EQUAL_PTR(actual->json,
+		    esp_hass_message_get_json(actual));
+
+		esp_hass_message_destroy(expected);
+		esp_hass_message_destroy(actual);
+	}
+}
+
+TEST_CASE("shares the JSON with copies[esp_hass_message_get_json]",
+    "[esp_hass_message_get_json]")
+{
+	esp_hass_message_t *msg = NULL;
+	esp_hass_message_t copy;
+	const char *message = recorded_messages[0];
+
+	msg = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+
+	ESP_LOGI(TAG, "when a copy is parsed first");
+	memcpy(&copy, msg, sizeof(copy));
+	TEST_ASSERT_NOT_NULL(esp_hass_message_get_json(&copy));
+	TEST_ASSERT_EQUAL_PTR(copy.json, esp_hass_message_get_json(msg));
+
+	/* the JSON is freed with the original */
+	esp_hass_message_destroy(msg);
+}
+
+TEST_CASE("parses messages with escaped fields[esp_hass_message_scan]",
+    "[esp_hass_message_scan]")
+{
+	esp_hass_message_t *msg = NULL;
+	const char *message =
+	    "{\"id\":5,\"type\":\"resul\\u0074\",\"success\":true}";
+
+	msg = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_RESULT, msg->type);
+	TEST_ASSERT_EQUAL(5, msg->id);
+	TEST_ASSERT_TRUE(msg->success);
+	TEST_ASSERT_NULL(msg->raw);
+	TEST_ASSERT_NOT_NULL(esp_hass_message_get_json(msg));
+	esp_hass_message_destroy(msg);
+}
+
+TEST_CASE("returns NULL[esp_hass_message_scan]", "[esp_hass_message_scan]")
+{
+	const char *invalid_messages[] = {
+		"",
+		"[]",
+		"{\"type\":\"result\"",
+		"{\"type\":\"result}",
+		"{\"type\" \"result\"}",
+		"{\"id\":1,\"event\":{\"event_type\":\"state_changed\"}",
+	};
+
+	ESP_LOGI(TAG, "when data is NULL");
+	TEST_ASSERT_NULL(esp_hass_message_scan(NULL, 0, NULL));
+
+	ESP_LOGI(TAG, "when the message is invalid");
+	for (int i = 0;
+	     i < sizeof(invalid_messages) / sizeof(invalid_messages[0]); i++) {
+		TEST_ASSERT_NULL(esp_hass_message_scan(invalid_messages[i],
+		    strlen(invalid_messages[i]), NULL));
+	}
+}
+
+TEST_CASE("compare scan and parse time[esp_hass_message_scan]",
+    "[esp_hass_message_scan][benchmark]")
+{
+	esp_hass_message_t *msg = NULL;
+	int64_t start, parse_us, scan_us;
+	size_t len[n_recorded_messages];
+
+	for (int i = 0; i < n_recorded_messages; i++) {
+		len[i] = strlen(recorded_messages[i]);
+	}
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (int j = 0; j < n_recorded_messages; j++) {
+			msg = esp_hass_message_parse(
+			    (char *)recorded_messages[j], len[j], NULL);
+			TEST_ASSERT_NOT_NULL(msg);
+			esp_hass_message_destroy(msg);
+		}
+	}
+	parse_us = esp_timer_get_time() - start;
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (int j = 0; j < n_recorded_messages; j++) {
+			msg = esp_hass_message_scan(recorded_messages[j],
+			    len[j], NULL);
+			TEST_ASSERT_NOT_NULL(msg);
+			esp_hass_message_destroy(msg);
+		}
+	}
+	scan_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "esp_hass_message_parse(): %lld us",
+	    (long long)parse_us);
+	ESP_LOGI(TAG, "esp_hass_message_scan(): %lld us", (long long)scan_us);
+}
@@ -0,0 +1,121 @@
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+#include <unity.h>
+
+#define BENCHMARK_ITERATIONS (100000)
+
+static const char *TAG = "context";
+
+/* the previous implementation, a chain of strcmp() */
+static esp_hass_message_type_t
+legacy_string_to_type(const char *type)
+{
+	esp_hass_message_type_t message_type = HASS_MESSAGE_TYPE_UNKNOWN;
+
+	if (strcmp(type, "auth") == 0) {
+		message_type = HASS_MESSAGE_TYPE_AUTH;
+	} else if (strcmp(type, "auth_invalid") == 0) {
+		message_type = HASS_MESSAGE_TYPE_AUTH_INVALID;
+	} else if (strcmp(type, "auth_ok") == 0) {
+		message_type = HASS_MESSAGE_TYPE_AUTH_OK;
+	} else if (strcmp(type, "auth_required") == 0) {
+		message_type = HASS_MESSAGE_TYPE_AUTH_REQUIRED;
+	} else if (strcmp(type, "auth_invalid") == 0) {
+		message_type = HASS_MESSAGE_TYPE_AUTH_INVALID;
+	} else if (strcmp(type, "result") == 0) {
+		message_type = HASS_MESSAGE_TYPE_RESULT;
+	} else if (strcmp(type, "event") == 0) {
+		message_type = HASS_MESSAGE_TYPE_EVENT;
+	} else if (strcmp(type, "pong") == 0) {
+		message_type = HASS_MESSAGE_TYPE_PONG;
+	}
+	return message_type;
+}
+
+TEST_CASE("maps every message type both ways[esp_hass_message_type_from_string]",
+    "[esp_hass_message_type_from_string]")
+{
+	const char *name = NULL;
+
+	for (esp_hass_message_type_t type = 0; type < HASS_MESSAGE_TYPE_MAX;
+	     type++) {
+		name = esp_hass_message_type_to_string(type);
+		TEST_ASSERT_NOT_NULL(name);
+		ESP_LOGI(TAG, "when type is `%s`", name);
+		TEST_ASSERT_EQUAL(type,
+		    esp_hass_message_type_from_string(name, strlen(name)));
+	}
+	TEST_ASSERT_EQUAL_STRING("call_service",
+	    esp_hass_message_type_to_string(HASS_MESSAGE_TYPE_CALL_SERVICE));
+	TEST_ASSERT_EQUAL_STRING("camera_thumbnail",
+	    esp_hass_message_type_to_string(
+		HASS_MESSAGE_TYPE_GET_CAMERA_THUMBNAIL));
+}
+
+TEST_CASE("returns HASS_MESSAGE_TYPE_UNKNOWN[esp_hass_message_type_from_string]",
+    "[esp_hass_message_type_from_string]")
+{
+	const char *names[] = { "", "a", "auth_", "aut", "resul", "results",
+		"Result", "get_statez", "xvent" };
+
+	for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		ESP_LOGI(TAG, "when type is `%s`", names[i]);
+		TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_UNKNOWN,
+		    esp_hass_message_type_from_string(names[i],
+			strlen(names[i])));
+	}
+
+	ESP_LOGI(TAG, "when type is NULL");
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_UNKNOWN,
+	    esp_hass_message_type_from_string(NULL, 0));
+
+	ESP_LOGI(TAG, "when the name is not null-terminated");
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_EVENT,
+	    esp_hass_message_type_from_string("events", 5));
+}
+
+TEST_CASE("returns NULL[esp_hass_message_type_to_string]",
+    "[esp_hass_message_type_to_string]")
+{
+	TEST_ASSERT_NULL(
+	    esp_hass_message_type_to_string(HASS_MESSAGE_TYPE_UNKNOWN));
+	TEST_ASSERT_NULL(
+	    esp_hass_message_type_to_string(HASS_MESSAGE_TYPE_MAX));
+}
+
+TEST_CASE("compare type lookup time[esp_hass_message_type_from_string]",
+    "[esp_hass_message_type_from_string][benchmark]")
+{
+	/* mostly events, some results and pongs */
+	const char *mix[] = { "event", "event", "event", "event", "event",
+		"event", "event", "result", "result", "pong" };
+	size_t len[sizeof(mix) / sizeof(mix[0])];
+	int n = sizeof(mix) / sizeof(mix[0]);
+	int64_t start, legacy_us, table_us;
+	volatile int sum_legacy = 0;
+	volatile int sum_table = 0;
+
+	for (int i = 0; i < n; i++) {
+		len[i] = strlen(mix[i]);
+	}
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		sum_legacy += legacy_string_to_type(mix[i % n]);
+	}
+	legacy_us = esp_timer_get_time() - start;
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		sum_table += esp_hass_message_type_from_string(mix[i % n],
+		    len[i % n]);
+	}
+	table_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "strcmp() chain: %lld us", (long long)legacy_us);
+	ESP_LOGI(TAG, "esp_hass_message_type_from_string(): %lld us",
+	    (long long)table_us);
+	TEST_ASSERT_EQUAL(sum_legacy, sum_table);
+}
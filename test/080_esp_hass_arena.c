@@ -0,0 +1,185 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+#include "arena.h"
+#include "json_stream.h"
+#include "messages.h"
+
+#define BLOCK_SIZE (256)
+#define TOKEN_SIZE (64)
+#define TOKEN_MAX_SIZE (1024)
+#define BENCHMARK_ITERATIONS (1000)
+
+static const char *TAG = "context";
+static const uint32_t caps = MALLOC_CAP_DEFAULT | MALLOC_CAP_8BIT;
+
+static char *
+print_reference(const char *message)
+{
+	cJSON *json = NULL;
+	char *printed = NULL;
+
+	json = cJSON_Parse(message);
+	if (json == NULL) {
+		return NULL;
+	}
+	printed = cJSON_PrintUnformatted(json);
+	cJSON_Delete(json);
+	return printed;
+}
+
+TEST_CASE("allocates from blocks[esp_hass_arena_alloc]",
+    "[esp_hass_arena_alloc]")
+{
+	esp_hass_arena_t arena;
+	void *ptr = NULL;
+	char *str = NULL;
+
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_arena_init(&arena, 0, caps));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_arena_init(&arena, BLOCK_SIZE, caps));
+
+	ESP_LOGI(TAG, "when nothing is allocated");
+	TEST_ASSERT_NULL(arena.head);
+	TEST_ASSERT_EQUAL(0, arena.blocks);
+
+	ESP_LOGI(TAG, "when memory is allocated");
+	str = esp_hass_arena_strndup(&arena, "foobar", 3);
+	TEST_ASSERT_EQUAL_STRING("foo", str);
+	ptr = esp_hass_arena_alloc(&arena, sizeof(cJSON));
+	TEST_ASSERT_NOT_NULL(ptr);
+	TEST_ASSERT_EQUAL(0, (uintptr_t)ptr % sizeof(double));
+	TEST_ASSERT_EQUAL(1, arena.blocks);
+
+	ESP_LOGI(TAG, "when the block is exhausted");
+	ptr = esp_hass_arena_alloc(&arena, BLOCK_SIZE);
+	TEST_ASSERT_NOT_NULL(ptr);
+	memset(ptr, 0, BLOCK_SIZE);
+	TEST_ASSERT_EQUAL(2, arena.blocks);
+	TEST_ASSERT_EQUAL_STRING("foo", str);
+
+	ESP_LOGI(TAG, "when the arena is freed");
+	esp_hass_arena_free(&arena);
+	TEST_ASSERT_NULL(arena.head);
+	TEST_ASSERT_EQUAL(0, arena.used);
+	TEST_ASSERT_NOT_NULL(esp_hass_arena_alloc(&arena, 1));
+	esp_hass_arena_free(&arena);
+}
+
+TEST_CASE("parses messages into an arena[esp_hass_json_stream_finish]",
+    "[esp_hass_json_stream_finish]")
+{
+	esp_hass_json_stream_t stream;
+	esp_hass_arena_t arena = { 0 };
+	esp_hass_arena_stats_t stats_before, stats_after;
+	const char *message = NULL;
+	char *expected = NULL;
+	char *actual = NULL;
+	cJSON *json = NULL;
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_json_stream_init(&stream, TOKEN_SIZE, TOKEN_MAX_SIZE,
+		BLOCK_SIZE, caps));
+	for (int i = 0; i < n_recorded_messages; i++) {
+		message = recorded_messages[i];
+		expected = print_reference(message);
+		TEST_ASSERT_NOT_NULL(expected);
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_get_arena_stats(&stats_before));
+
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_json_stream_feed(&stream, message,
+			strlen(message)));
+		ESP_LOGI(TAG, "when the arena is not given");
+		TEST_ASSERT_NULL(esp_hass_json_stream_finish(&stream, NULL));
+
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_json_stream_feed(&stream, message,
+			strlen(message)));
+		ESP_LOGI(TAG, "when the arena is given");
+		json = esp_hass_json_stream_finish(&stream, &arena);
+		TEST_ASSERT_NOT_NULL(json);
+		TEST_ASSERT_NOT_NULL(arena.head);
+		TEST_ASSERT_NULL(stream.arena.head);
+		actual = cJSON_PrintUnformatted(json);
+		TEST_ASSERT_EQUAL_STRING(expected, actual);
+
+		ESP_LOGI(TAG, "message %d: %u bytes, %u block(s)", i,
+		    (unsigned int)arena.used, (unsigned int)arena.blocks);
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_get_arena_stats(&stats_after));
+		TEST_ASSERT_EQUAL(stats_before.messages + 1,
+		    stats_after.messages);
+		TEST_ASSERT_EQUAL(arena.used, stats_after.last);
+		TEST_ASSERT_TRUE(stats_after.peak >= arena.used);
+		TEST_ASSERT_EQUAL(stats_before.overflows +
+			(arena.blocks > 1 ? 1 : 0),
+		    stats_after.overflows);
+
+		esp_hass_arena_free(&arena);
+		cJSON_free(actual);
+		cJSON_free(expected);
+	}
+	esp_hass_json_stream_free(&stream);
+
+	ESP_LOGI(TAG, "when stats is NULL");
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_hass_get_arena_stats(NULL));
+}
+
+TEST_CASE("compare parse and destroy time[esp_hass_json_stream_finish]",
+    "[esp_hass_json_stream_finish][benchmark]")
+{
+	esp_hass_json_stream_t heap_stream, arena_stream;
+	esp_hass_arena_t arena = { 0 };
+	int64_t start, heap_us, arena_us;
+	cJSON *json = NULL;
+	size_t len[n_recorded_messages];
+
+	for (int i = 0; i < n_recorded_messages; i++) {
+		len[i] = strlen(recorded_messages[i]);
+	}
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_json_stream_init(&heap_stream, TOKEN_SIZE, TOKEN_MAX_SIZE,
+		0, caps));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_json_stream_init(&arena_stream, TOKEN_SIZE,
+		TOKEN_MAX_SIZE, 4096, caps));
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (int j = 0; j < n_recorded_messages; j++) {
+			esp_hass_json_stream_feed(&heap_stream,
+			    recorded_messages[j], len[j]);
+			json = esp_hass_json_stream_finish(&heap_stream, NULL);
+			TEST_ASSERT_NOT_NULL(json);
+			cJSON_Delete(json);
+		}
+	}
+	heap_us = esp_timer_get_time() - start;
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (int j = 0; j < n_recorded_messages; j++) {
+			esp_hass_json_stream_feed(&arena_stream,
+			    recorded_messages[j], len[j]);
+			json = esp_hass_json_stream_finish(&arena_stream,
+			    &arena);
+			TEST_ASSERT_NOT_NULL(json);
+			esp_hass_arena_free(&arena);
+		}
+	}
+	arena_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "cJSON_malloc(): %lld us", (long long)heap_us);
+	ESP_LOGI(TAG, "arena: %lld us", (long long)arena_us);
+	esp_hass_json_stream_free(&heap_stream);
+	esp_hass_json_stream_free(&arena_stream);
+}
@@ -0,0 +1,207 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "messages.h"
+#include "parser.h"
+#include "pool.h"
+
+#define CAPACITY (4)
+
+static const char *TAG = "context";
+
+static const char *event = "{\"id\":1,\"type\":\"event\",\"event\":{}}";
+static const char *result = "{\"id\":2,\"type\":\"result\",\"success\":true}";
+
+TEST_CASE("takes and returns objects[esp_hass_pool_get]", "[esp_hass_pool_get]")
+{
+	esp_hass_pool_t pool;
+	void *objects[CAPACITY];
+	void *object = NULL;
+
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_pool_init(NULL, sizeof(int), CAPACITY));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_pool_init(&pool, 0, CAPACITY));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_pool_init(&pool, sizeof(int),
+		ESP_HASS_POOL_MAX_CAPACITY + 1));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pool_init(&pool, sizeof(int), CAPACITY));
+
+	ESP_LOGI(TAG, "when objects are taken");
+	for (int i = 0; i < CAPACITY; i++) {
+		objects[i] = esp_hass_pool_get(&pool);
+		TEST_ASSERT_NOT_NULL(objects[i]);
+		TEST_ASSERT_EQUAL(0, (uintptr_t)objects[i] % sizeof(double));
+		for (int j = 0; j < i; j++) {
+			TEST_ASSERT_NOT_EQUAL(objects[j], objects[i]);
+		}
+	}
+	TEST_ASSERT_EQUAL(0, pool.exhausted);
+
+	ESP_LOGI(TAG, "when the pool is exhausted");
+	TEST_ASSERT_NULL(esp_hass_pool_get(&pool));
+	TEST_ASSERT_NULL(esp_hass_pool_get(&pool));
+	TEST_ASSERT_EQUAL(2, pool.exhausted);
+
+	ESP_LOGI(TAG, "when an object is returned");
+	esp_hass_pool_put(&pool, objects[1]);
+	object = esp_hass_pool_get(&pool);
+	TEST_ASSERT_EQUAL_PTR(objects[1], object);
+	TEST_ASSERT_NULL(esp_hass_pool_get(&pool));
+	TEST_ASSERT_EQUAL(3, pool.exhausted);
+
+	for (int i = 0; i < CAPACITY; i++) {
+		esp_hass_pool_put(&pool, objects[i]);
+	}
+	esp_hass_pool_free(&pool);
+
+	ESP_LOGI(TAG, "when the capacity is zero");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_pool_init(&pool, sizeof(int), 0));
+	TEST_ASSERT_NULL(esp_hass_pool_get(&pool));
+	TEST_ASSERT_EQUAL(1, pool.exhausted);
+	esp_hass_pool_free(&pool);
+}
+
+TEST_CASE("frees a deleted pool with the last object[esp_hass_pool_delete]",
+    "[esp_hass_pool_delete]")
+{
+	esp_hass_pool_t *pool = NULL;
+	esp_hass_message_t *msgs[2];
+
+	TEST_ASSERT_NULL(
+	    esp_hass_pool_create(sizeof(int), ESP_HASS_POOL_MAX_CAPACITY + 1));
+	pool = esp_hass_message_pool_create(CAPACITY);
+	TEST_ASSERT_NOT_NULL(pool);
+	for (int i = 0; i < 2; i++) {
+		msgs[i] = esp_hass_message_scan(event, strlen(event), pool);
+		TEST_ASSERT_NOT_NULL(msgs[i]);
+	}
+	TEST_ASSERT_EQUAL(3, pool->refs);
+
+	ESP_LOGI(TAG, "when the pool is deleted with messages in use");
+	esp_hass_pool_delete(pool);
+	TEST_ASSERT_NOT_NULL(esp_hass_message_get_json(msgs[0]));
+	esp_hass_message_release(msgs[0]);
+
+	ESP_LOGI(TAG, "when the last message is released");
+	esp_hass_message_release(msgs[1]);
+
+	ESP_LOGI(TAG, "when the pool is NULL");
+	esp_hass_pool_delete(NULL);
+}
+
+#if CONFIG_ESP_HASS_MESSAGE_INLINE_TEXT_SIZE > 0
+static bool
+is_in_pool(esp_hass_pool_t *pool, const char *p)
+{
+	return p >= pool->objects &&
+	    p < pool->objects + pool->capacity * pool->object_size;
+}
+
+TEST_CASE("keeps a short text in the message[esp_hass_message_scan]",
+    "[esp_hass_message_scan]")
+{
+	esp_hass_pool_t pool;
+	esp_hass_message_t *msg = NULL;
+	char text[CONFIG_ESP_HASS_MESSAGE_INLINE_TEXT_SIZE + 64];
+	int len;
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_message_pool_init(&pool, CAPACITY));
+
+	ESP_LOGI(TAG, "when the text fits in the message");
+	msg = esp_hass_message_scan(result, strlen(result), &pool);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_TRUE(is_in_pool(&pool, msg->raw));
+	TEST_ASSERT_EQUAL_STRING(result, msg->raw);
+	TEST_ASSERT_NOT_NULL(esp_hass_message_get_json(msg));
+	esp_hass_message_release(msg);
+
+	ESP_LOGI(TAG, "when the text does not fit in the message");
+	len = snprintf(text, sizeof(text),
+	    "{\"id\":1,\"type\":\"event\",\"event\":{\"data\":\"%*s\"}}",
+	    CONFIG_ESP_HASS_MESSAGE_INLINE_TEXT_SIZE, "");
+	TEST_ASSERT_LESS_THAN(sizeof(text), len);
+	msg = esp_hass_message_scan(text, len, &pool);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_FALSE(is_in_pool(&pool, msg->raw));
+	TEST_ASSERT_EQUAL_STRING(text, msg->raw);
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_EVENT, msg->type);
+	esp_hass_message_release(msg);
+	esp_hass_pool_free(&pool);
+}
+#endif
+
+TEST_CASE("takes messages from the pool[esp_hass_message_pool_init]",
+    "[esp_hass_message_pool_init]")
+{
+	esp_hass_pool_t pool;
+	esp_hass_message_t *msgs[CAPACITY];
+	esp_hass_message_t *msg = NULL;
+	esp_hass_message_t copy;
+	const char *message = NULL;
+	size_t len;
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_message_pool_init(&pool, CAPACITY));
+
+	ESP_LOGI(TAG, "when messages are scanned, and parsed");
+	for (int i = 0; i < n_recorded_messages; i++) {
+		message = recorded_messages[i];
+		len = strlen(message);
+		msgs[0] = esp_hass_message_scan(message, len, &pool);
+		TEST_ASSERT_NOT_NULL(msgs[0]);
+		msgs[1] = esp_hass_message_parse((char *)message, len, &pool);
+		TEST_ASSERT_NOT_NULL(msgs[1]);
+		TEST_ASSERT_EQUAL(msgs[1]->type, msgs[0]->type);
+		TEST_ASSERT_EQUAL(msgs[1]->id, msgs[0]->id);
+
+		/* a copy, as esp_event passes to handlers */
+		memcpy(&copy, msgs[0], sizeof(copy));
+		TEST_ASSERT_NOT_NULL(esp_hass_message_get_json(&copy));
+		TEST_ASSERT_EQUAL_PTR(esp_hass_message_get_json(&copy),
+		    esp_hass_message_get_json(msgs[0]));
+		esp_hass_message_free(msgs[0]);
+		esp_hass_message_free(msgs[1]);
+	}
+	TEST_ASSERT_EQUAL(0, pool.exhausted);
+
+	ESP_LOGI(TAG, "when the pool is exhausted by events");
+	message = event;
+	len = strlen(message);
+	for (int i = 0; i < CAPACITY; i++) {
+		msgs[i] = esp_hass_message_scan(message, len, &pool);
+		TEST_ASSERT_NOT_NULL(msgs[i]);
+	}
+	TEST_ASSERT_NULL(esp_hass_message_scan(message, len, &pool));
+	TEST_ASSERT_NULL(esp_hass_message_parse((char *)message, len, &pool));
+	TEST_ASSERT_EQUAL(2, pool.exhausted);
+
+	ESP_LOGI(TAG, "when a result arrives while the pool is exhausted");
+	msg = esp_hass_message_scan(result, strlen(result), &pool);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_RESULT, msg->type);
+	TEST_ASSERT_TRUE(msg->success);
+	esp_hass_message_free(msg);
+	msg = esp_hass_message_parse((char *)result, strlen(result), &pool);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_RESULT, msg->type);
+	esp_hass_message_free(msg);
+	TEST_ASSERT_EQUAL(4, pool.exhausted);
+
+	ESP_LOGI(TAG, "when a message is freed");
+	esp_hass_message_free(msgs[0]);
+	msg = esp_hass_message_scan(message, len, &pool);
+	TEST_ASSERT_EQUAL_PTR(msgs[0], msg);
+	msgs[0] = msg;
+
+	for (int i = 0; i < CAPACITY; i++) {
+		esp_hass_message_free(msgs[i]);
+	}
+	esp_hass_pool_free(&pool);
+}
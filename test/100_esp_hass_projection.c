@@ -0,0 +1,212 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+#include "messages.h"
+#include "parser.h"
+
+#define STATE_CHANGED (5)
+#define BENCHMARK_ITERATIONS (1000)
+
+static const char *TAG = "context";
+static const char *const paths[] = {
+	"event.data.entity_id",
+	"event.data.new_state.state",
+	"event.data.new_state.attributes.friendly_name",
+	"id",
+	NULL,
+};
+
+TEST_CASE("compiles paths[esp_hass_projection_spec_init]",
+    "[esp_hass_projection_spec_init]")
+{
+	esp_hass_projection_spec_t spec;
+	const char *too_many[ESP_HASS_PROJECTION_MAX_FIELDS + 2];
+	const char *const empty_key[] = { "event..entity_id", NULL };
+	const char *const trailing_dot[] = { "event.", NULL };
+	const char *const too_deep[] = { "a.b.c.d.e.f.g.h.i", NULL };
+
+	ESP_LOGI(TAG, "when paths are valid");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_projection_spec_init(&spec, paths));
+	TEST_ASSERT_EQUAL(4, spec.n_paths);
+	TEST_ASSERT_EQUAL(3, spec.paths[0].depth);
+	TEST_ASSERT_EQUAL_STRING("event", spec.paths[0].keys[0]);
+	TEST_ASSERT_EQUAL_STRING("data", spec.paths[0].keys[1]);
+	TEST_ASSERT_EQUAL_STRING("entity_id", spec.paths[0].keys[2]);
+	TEST_ASSERT_EQUAL(9, spec.paths[0].key_lens[2]);
+	TEST_ASSERT_EQUAL(1, spec.paths[3].depth);
+	esp_hass_projection_spec_free(&spec);
+
+	ESP_LOGI(TAG, "when paths are NULL");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_projection_spec_init(&spec, NULL));
+	TEST_ASSERT_EQUAL(0, spec.n_paths);
+	esp_hass_projection_spec_free(&spec);
+
+	ESP_LOGI(TAG, "when paths are invalid");
+	for (int i = 0; i < ESP_HASS_PROJECTION_MAX_FIELDS + 1; i++) {
+		too_many[i] = "id";
+	}
+	too_many[ESP_HASS_PROJECTION_MAX_FIELDS + 1] = NULL;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_projection_spec_init(&spec, too_many));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_projection_spec_init(&spec, empty_key));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_projection_spec_init(&spec, trailing_dot));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_projection_spec_init(&spec, too_deep));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_projection_spec_init(NULL, paths));
+}
+
+TEST_CASE("projects the same fields from text and JSON[esp_hass_message_project]",
+    "[esp_hass_message_project]")
+{
+	esp_hass_projection_spec_t spec;
+	esp_hass_message_t *scanned = NULL;
+	esp_hass_message_t *parsed = NULL;
+	const esp_hass_field_t *expected = NULL;
+	const esp_hass_field_t *actual = NULL;
+	const char *message = NULL;
+	size_t len;
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_projection_spec_init(&spec, paths));
+	for (int i = 0; i < n_recorded_messages; i++) {
+		message = recorded_messages[i];
+		len = strlen(message);
+		scanned = esp_hass_message_scan(message, len, NULL);
+		TEST_ASSERT_NOT_NULL(scanned);
+		parsed = esp_hass_message_parse((char *)message, len, NULL);
+		TEST_ASSERT_NOT_NULL(parsed);
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_message_project(scanned, &spec));
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_message_project(parsed, &spec));
+		TEST_ASSERT_NULL(scanned->json);
+
+		for (int j = 0; j < spec.n_paths; j++) {
+			expected = esp_hass_message_get_field(parsed, j);
+			actual = esp_hass_message_get_field(scanned, j);
+			if (expected == NULL) {
+				TEST_ASSERT_NULL(actual);
+				continue;
+			}
+			TEST_ASSERT_NOT_NULL(actual);
+			TEST_ASSERT_EQUAL(expected->type, actual->type);
+			TEST_ASSERT_EQUAL_STRING(expected->value,
+			    actual->value);
+			TEST_ASSERT_EQUAL_DOUBLE(expected->number,
+			    actual->number);
+		}
+		esp_hass_message_free(scanned);
+		esp_hass_message_free(parsed);
+	}
+
+	ESP_LOGI(TAG, "when the message is state_changed");
+	message = recorded_messages[STATE_CHANGED];
+	scanned = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(scanned);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_message_project(scanned, &spec));
+	TEST_ASSERT_EQUAL_STRING("light.kitchen",
+	    esp_hass_message_get_field(scanned, 0)->value);
+	TEST_ASSERT_EQUAL_STRING("on",
+	    esp_hass_message_get_field(scanned, 1)->value);
+	TEST_ASSERT_EQUAL_STRING("Kitchen \xc3\xa9\xf0\x9f\x92\xa1",
+	    esp_hass_message_get_field(scanned, 2)->value);
+	TEST_ASSERT_EQUAL(HASS_FIELD_TYPE_NUMBER,
+	    esp_hass_message_get_field(scanned, 3)->type);
+	TEST_ASSERT_EQUAL_DOUBLE(1,
+	    esp_hass_message_get_field(scanned, 3)->number);
+	TEST_ASSERT_NULL(esp_hass_message_get_field(scanned, 4));
+	esp_hass_message_free(scanned);
+	esp_hass_projection_spec_free(&spec);
+}
+
+TEST_CASE("projects types, and truncates values[esp_hass_message_project]",
+    "[esp_hass_message_project]")
+{
+	esp_hass_projection_spec_t spec;
+	esp_hass_message_t *msg = NULL;
+	const esp_hass_field_t *field = NULL;
+	const char *const typed_paths[] = { "a", "b.c", "b", "d", NULL };
+	const char *message =
+	    "{\"a\":true,\"b\":{\"c\":null},\"d\":\"0123456789012345678901234567890"
+	    "1234567890123456789012345678901234567890123456789\",\"e\":[1]}";
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_projection_spec_init(&spec, typed_paths));
+	msg = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_message_project(msg, &spec));
+
+	field = esp_hass_message_get_field(msg, 0);
+	TEST_ASSERT_EQUAL(HASS_FIELD_TYPE_BOOL, field->type);
+	TEST_ASSERT_EQUAL_DOUBLE(1, field->number);
+	field = esp_hass_message_get_field(msg, 1);
+	TEST_ASSERT_EQUAL(HASS_FIELD_TYPE_NULL, field->type);
+
+	ESP_LOGI(TAG, "when a path is a prefix of another");
+	field = esp_hass_message_get_field(msg, 2);
+	TEST_ASSERT_EQUAL(HASS_FIELD_TYPE_OBJECT, field->type);
+	TEST_ASSERT_EQUAL_STRING("", field->value);
+
+	ESP_LOGI(TAG, "when the value is too long");
+	field = esp_hass_message_get_field(msg, 3);
+	TEST_ASSERT_EQUAL(HASS_FIELD_TYPE_STRING, field->type);
+	TEST_ASSERT_TRUE(field->truncated);
+	TEST_ASSERT_EQUAL(ESP_HASS_FIELD_VALUE_MAX_LEN - 1,
+	    strlen(field->value));
+	TEST_ASSERT_EQUAL_MEMORY(strstr(message, "0123"), field->value,
+	    strlen(field->value));
+	esp_hass_message_free(msg);
+	esp_hass_projection_spec_free(&spec);
+}
+
+TEST_CASE("compare projection and JSON time[esp_hass_message_project]",
+    "[esp_hass_message_project][benchmark]")
+{
+	esp_hass_projection_spec_t spec;
+	esp_hass_message_t *msg = NULL;
+	const char *message = recorded_messages[STATE_CHANGED];
+	size_t len = strlen(message);
+	cJSON *entity_id = NULL;
+	int64_t start, json_us, project_us;
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_projection_spec_init(&spec, paths));
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		msg = esp_hass_message_scan(message, len, NULL);
+		TEST_ASSERT_NOT_NULL(msg);
+		entity_id = cJSON_GetObjectItemCaseSensitive(
+		    cJSON_GetObjectItemCaseSensitive(
+			cJSON_GetObjectItemCaseSensitive(
+			    esp_hass_message_get_json(msg), "event"),
+			"data"),
+		    "entity_id");
+		TEST_ASSERT_TRUE(cJSON_IsString(entity_id));
+		esp_hass_message_free(msg);
+	}
+	json_us = esp_timer_get_time() - start;
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		msg = esp_hass_message_scan(message, len, NULL);
+		TEST_ASSERT_NOT_NULL(msg);
+		TEST_ASSERT_EQUAL(ESP_OK, esp_hass_message_project(msg, &spec));
+		TEST_ASSERT_NOT_NULL(esp_hass_message_get_field(msg, 0));
+		esp_hass_message_free(msg);
+	}
+	project_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "esp_hass_message_get_json(): %lld us",
+	    (long long)json_us);
+	ESP_LOGI(TAG, "esp_hass_message_project(): %lld us",
+	    (long long)project_us);
+	esp_hass_projection_spec_free(&spec);
+}
@@ -0,0 +1,90 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <string.h>
+#include <unity.h>
+
+#include "messages.h"
+#include "parser.h"
+
+static const char *TAG = "context";
+
+TEST_CASE("finds a message in a frame[esp_hass_frame_next]",
+    "[esp_hass_frame_next]")
+{
+	esp_hass_frame_t frame;
+	const char *message = recorded_messages[0];
+	const char *msg = NULL;
+	size_t msg_len = 0;
+
+	esp_hass_frame_init(&frame, message, strlen(message));
+	TEST_ASSERT_FALSE(frame.is_array);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_frame_next(&frame, &msg, &msg_len));
+	TEST_ASSERT_EQUAL_PTR(message, msg);
+	TEST_ASSERT_EQUAL(strlen(message), msg_len);
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_frame_next(&frame, &msg, &msg_len));
+}
+
+TEST_CASE("finds coalesced messages in a frame[esp_hass_frame_next]",
+    "[esp_hass_frame_next]")
+{
+	esp_hass_frame_t frame;
+	esp_hass_message_t *msg = NULL;
+	const char *text = NULL;
+	size_t text_len = 0;
+	const char *coalesced =
+	    "[{\"id\":1,\"type\":\"result\",\"success\":true,\"result\":null},"
+	    " {\"id\":2,\"type\":\"event\",\"event\":{\"event_type\":"
+	    "\"state_changed\",\"data\":{\"text\":\"],[\\\"\"}}}\n,"
+	    "{\"id\":3,\"type\":\"pong\"} ]";
+	const int ids[] = { 1, 2, 3 };
+	int i = 0;
+
+	esp_hass_frame_init(&frame, coalesced, strlen(coalesced));
+	TEST_ASSERT_TRUE(frame.is_array);
+	while (esp_hass_frame_next(&frame, &text, &text_len) == ESP_OK) {
+		TEST_ASSERT_LESS_THAN(3, i);
+		TEST_ASSERT_EQUAL('{', text[0]);
+		TEST_ASSERT_EQUAL('}', text[text_len - 1]);
+		msg = esp_hass_message_scan(text, text_len, NULL);
+		TEST_ASSERT_NOT_NULL(msg);
+		TEST_ASSERT_EQUAL(ids[i], msg->id);
+		TEST_ASSERT_NOT_NULL(esp_hass_message_get_json(msg));
+		esp_hass_message_free(msg);
+		i++;
+	}
+	TEST_ASSERT_EQUAL(3, i);
+
+	ESP_LOGI(TAG, "when the array is empty");
+	esp_hass_frame_init(&frame, " [ ] ", 5);
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_frame_next(&frame, &text, &text_len));
+}
+
+TEST_CASE("returns ESP_FAIL[esp_hass_frame_next]", "[esp_hass_frame_next]")
+{
+	esp_hass_frame_t frame;
+	const char *text = NULL;
+	size_t text_len = 0;
+	esp_err_t err = ESP_FAIL;
+	const char *invalid_frames[] = {
+		"[{\"id\":1}",
+		"[{\"id\":1} {\"id\":2}]",
+		"[{\"id\":1},]",
+		"[,]",
+	};
+
+	for (int i = 0;
+	     i < sizeof(invalid_frames) / sizeof(invalid_frames[0]); i++) {
+		ESP_LOGI(TAG, "when the frame is `%s`", invalid_frames[i]);
+		esp_hass_frame_init(&frame, invalid_frames[i],
+		    strlen(invalid_frames[i]));
+		do {
+			err = esp_hass_frame_next(&frame, &text, &text_len);
+		} while (err == ESP_OK);
+		TEST_ASSERT_EQUAL(ESP_FAIL, err);
+		TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+		    esp_hass_frame_next(&frame, &text, &text_len));
+	}
+}
@@ -0,0 +1,241 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "intern.h"
+#include "messages.h"
+#include "parser.h"
+
+#define STATE_CHANGED (5)
+#define CAPACITY (4)
+#define BENCHMARK_ITERATIONS (1000)
+
+static const char *TAG = "context";
+static const char *const attributes[] = {
+	"brightness",
+	"friendly_name",
+	"supported_features",
+	"color_mode",
+	"unknown",
+	NULL,
+};
+
+TEST_CASE("interns strings[esp_hass_intern]", "[esp_hass_intern]")
+{
+	esp_hass_intern_t table;
+	uint16_t ids[CAPACITY];
+	uint16_t id;
+	char name[16];
+
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_intern_init(NULL, CAPACITY));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_intern_init(&table, ESP_HASS_INTERN_MAX_CAPACITY + 1));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_intern_init(&table, CAPACITY));
+
+	ESP_LOGI(TAG, "when strings are added");
+	for (int i = 0; i < CAPACITY; i++) {
+		snprintf(name, sizeof(name), "light.%d", i);
+		TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+		    esp_hass_intern(&table, name, strlen(name), false, &id));
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_intern(&table, name, strlen(name), true, &ids[i]));
+		TEST_ASSERT_EQUAL(i, ids[i]);
+		TEST_ASSERT_EQUAL_STRING(name,
+		    esp_hass_intern_string(&table, ids[i]));
+	}
+
+	ESP_LOGI(TAG, "when strings are found");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_intern(&table, "light.2xxx", 7, false, &id));
+	TEST_ASSERT_EQUAL(ids[2], id);
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_intern(&table, "light.", 6, false, &id));
+
+	ESP_LOGI(TAG, "when the table is full");
+	TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM,
+	    esp_hass_intern(&table, "light.kitchen", 13, true, &id));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_intern(&table, "light.0", 7, true, &id));
+	TEST_ASSERT_EQUAL(ids[0], id);
+	TEST_ASSERT_NULL(esp_hass_intern_string(&table, CAPACITY));
+	esp_hass_intern_free(&table);
+
+	ESP_LOGI(TAG, "when the capacity is zero");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_intern_init(&table, 0));
+	TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM,
+	    esp_hass_intern(&table, "light.0", 7, true, &id));
+	esp_hass_intern_free(&table);
+}
+
+TEST_CASE("decodes the same event from text and JSON[esp_hass_message_decode_state_changed]",
+    "[esp_hass_message_decode_state_changed]")
+{
+	esp_hass_intern_t entities;
+	esp_hass_message_t *msgs[2];
+	const esp_hass_state_changed_t *event = NULL;
+	const char *message = recorded_messages[STATE_CHANGED];
+	size_t len = strlen(message);
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_intern_init(&entities, CAPACITY));
+	msgs[0] = esp_hass_message_scan(message, len, NULL);
+	msgs[1] = esp_hass_message_parse((char *)message, len, NULL);
+	for (int i = 0; i < 2; i++) {
+		ESP_LOGI(TAG, "when the message is %s",
+		    i == 0 ? "scanned" : "parsed");
+		TEST_ASSERT_NOT_NULL(msgs[i]);
+		TEST_ASSERT_NULL(esp_hass_message_get_state_changed(msgs[i]));
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_message_decode_state_changed(msgs[i], &entities,
+			attributes));
+		TEST_ASSERT_TRUE(i == 0 ? msgs[i]->json == NULL :
+					  msgs[i]->json != NULL);
+		event = esp_hass_message_get_state_changed(msgs[i]);
+		TEST_ASSERT_NOT_NULL(event);
+		TEST_ASSERT_EQUAL(0, event->entity);
+		TEST_ASSERT_EQUAL_STRING("light.kitchen",
+		    esp_hass_intern_string(&entities, event->entity));
+		TEST_ASSERT_TRUE(event->old_state.present);
+		TEST_ASSERT_EQUAL_STRING("off", event->old_state.value);
+		TEST_ASSERT_FALSE(event->old_state.is_number);
+		TEST_ASSERT_TRUE(event->new_state.present);
+		TEST_ASSERT_EQUAL_STRING("on", event->new_state.value);
+		TEST_ASSERT_TRUE(event->old_state.last_changed ==
+		    1656550923456789LL);
+		TEST_ASSERT_TRUE(event->new_state.last_changed ==
+		    1656550924000000LL);
+
+		/* brightness, and color_mode are added */
+		TEST_ASSERT_EQUAL_HEX32(0x9, event->attributes_changed);
+		esp_hass_message_free(msgs[i]);
+	}
+	esp_hass_intern_free(&entities);
+}
+
+TEST_CASE("decodes states[esp_hass_message_decode_state_changed]",
+    "[esp_hass_message_decode_state_changed]")
+{
+	esp_hass_intern_t entities;
+	esp_hass_message_t *msg = NULL;
+	const esp_hass_state_changed_t *event = NULL;
+	const char *added =
+	    "{\"id\":2,\"type\":\"event\",\"event\":{\"event_type\":"
+	    "\"state_changed\",\"data\":{\"entity_id\":\"sensor.t\\u0065mp\","
+	    "\"old_state\":null,\"new_state\":{\"state\":\"-21.5\","
+	    "\"attributes\":{\"unit\":\"C\"},\"last_changed\":"
+	    "\"2022-06-30T10:02:04.5+09:00\"}}}}";
+	const char *invalid =
+	    "{\"id\":2,\"type\":\"event\",\"event\":{\"event_type\":"
+	    "\"state_changed\",\"data\":{\"entity_id\" \"x\"}}}";
+	const char *const unit[] = { "unit", NULL };
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_intern_init(&entities, CAPACITY));
+
+	ESP_LOGI(TAG, "when the entity is added");
+	msg = esp_hass_message_scan(added, strlen(added), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_message_decode_state_changed(msg, &entities, unit));
+	event = esp_hass_message_get_state_changed(msg);
+	TEST_ASSERT_EQUAL_STRING("sensor.temp",
+	    esp_hass_intern_string(&entities, event->entity));
+	TEST_ASSERT_FALSE(event->old_state.present);
+	TEST_ASSERT_TRUE(event->new_state.is_number);
+	TEST_ASSERT_EQUAL_DOUBLE(-21.5, event->new_state.number);
+	TEST_ASSERT_TRUE(event->new_state.last_changed == 1656550924500000LL);
+	TEST_ASSERT_EQUAL_HEX32(0x1, event->attributes_changed);
+	esp_hass_message_free(msg);
+
+	ESP_LOGI(TAG, "when the message is not state_changed");
+	msg = esp_hass_message_scan(recorded_messages[2],
+	    strlen(recorded_messages[2]), NULL);
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_message_decode_state_changed(msg, &entities, NULL));
+	TEST_ASSERT_NULL(esp_hass_message_get_state_changed(msg));
+	esp_hass_message_free(msg);
+
+	ESP_LOGI(TAG, "when the message is invalid");
+	msg = esp_hass_message_scan(invalid, strlen(invalid), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(ESP_FAIL,
+	    esp_hass_message_decode_state_changed(msg, &entities, NULL));
+	TEST_ASSERT_NULL(esp_hass_message_get_state_changed(msg));
+	esp_hass_message_free(msg);
+
+	ESP_LOGI(TAG, "when entities are not interned");
+	msg = esp_hass_message_scan(added, strlen(added), NULL);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_message_decode_state_changed(msg, NULL, NULL));
+	TEST_ASSERT_EQUAL(ESP_HASS_ENTITY_NONE,
+	    esp_hass_message_get_state_changed(msg)->entity);
+	esp_hass_message_free(msg);
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_message_decode_state_changed(NULL, &entities, NULL));
+	esp_hass_intern_free(&entities);
+}
+
+TEST_CASE("compare decode and JSON time[esp_hass_message_decode_state_changed]",
+    "[esp_hass_message_decode_state_changed][benchmark]")
+{
+	esp_hass_intern_t entities;
+	esp_hass_message_t *msg = NULL;
+	esp_hass_entity_t kitchen;
+	const esp_hass_state_changed_t *event = NULL;
+	const char *message = recorded_messages[STATE_CHANGED];
+	size_t len = strlen(message);
+	cJSON *data = NULL;
+	cJSON *entity_id = NULL;
+	cJSON *state = NULL;
+	int64_t start, json_us, decode_us;
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_intern_init(&entities, CAPACITY));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_intern(&entities, "light.kitchen", 13, true, &kitchen));
+
+	/* as the handler of examples/button does */
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		msg = esp_hass_message_scan(message, len, NULL);
+		TEST_ASSERT_NOT_NULL(msg);
+		data = cJSON_GetObjectItemCaseSensitive(
+		    cJSON_GetObjectItemCaseSensitive(
+			esp_hass_message_get_json(msg), "event"),
+		    "data");
+		entity_id = cJSON_GetObjectItemCaseSensitive(data, "entity_id");
+		TEST_ASSERT_TRUE(cJSON_IsString(entity_id));
+		TEST_ASSERT_EQUAL(0,
+		    strcmp(entity_id->valuestring, "light.kitchen"));
+		state = cJSON_GetObjectItemCaseSensitive(
+		    cJSON_GetObjectItemCaseSensitive(data, "new_state"),
+		    "state");
+		TEST_ASSERT_TRUE(cJSON_IsString(state));
+		esp_hass_message_free(msg);
+	}
+	json_us = esp_timer_get_time() - start;
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		msg = esp_hass_message_scan(message, len, NULL);
+		TEST_ASSERT_NOT_NULL(msg);
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_message_decode_state_changed(msg, &entities,
+			attributes));
+		event = esp_hass_message_get_state_changed(msg);
+		TEST_ASSERT_EQUAL(kitchen, event->entity);
+		TEST_ASSERT_TRUE(event->new_state.present);
+		esp_hass_message_free(msg);
+	}
+	decode_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "esp_hass_message_get_json(): %lld us",
+	    (long long)json_us);
+	ESP_LOGI(TAG, "esp_hass_message_decode_state_changed(): %lld us",
+	    (long long)decode_us);
+	esp_hass_intern_free(&entities);
+}
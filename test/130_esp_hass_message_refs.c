@@ -0,0 +1,191 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+#include "messages.h"
+#include "parser.h"
+#include "pool.h"
+
+#define STATE_CHANGED (5)
+#define CAPACITY (16)
+#define BENCHMARK_MESSAGES (100)
+
+/* the queue size of the event loop, when the loop had its own task */
+#define QUEUE_SIZE (10)
+
+/* the delay, and the timeout of the handshake, that the event source task
+ * used to have */
+#define DELAY_MS (3)
+#define SEMAPHORE_TAKE_TIMEOUT_MS (1000)
+
+static const char *TAG = "context";
+
+/* an event in the queue of the event loop */
+typedef enum {
+	DELIVER,
+	RELEASE,
+	STOP,
+} delivery_kind_t;
+
+typedef struct {
+	delivery_kind_t kind;
+	esp_hass_message_t msg; /* a copy, as esp_event copies `event_data` */
+} delivery_t;
+
+typedef struct {
+	QueueHandle_t events;
+	SemaphoreHandle_t handled;
+	SemaphoreHandle_t done;
+	bool handshake;
+	int n_handled;
+} loop_t;
+
+/* the task of the event loop, which calls a handler */
+static void
+loop_task(void *args)
+{
+	loop_t *loop = args;
+	delivery_t d;
+
+	while (xQueueReceive(loop->events, &d, portMAX_DELAY) == pdTRUE) {
+		switch (d.kind) {
+		case DELIVER:
+			if (d.msg.type == HASS_MESSAGE_TYPE_EVENT) {
+				loop->n_handled++;
+			}
+			if (loop->handshake) {
+				xSemaphoreGive(loop->handled);
+			}
+			break;
+		case RELEASE:
+			esp_hass_message_release(&d.msg);
+			break;
+		case STOP:
+			xSemaphoreGive(loop->done);
+			vTaskDelete(NULL);
+			return;
+		}
+	}
+}
+
+/* deliver messages as the event source task did, or does */
+static int64_t
+deliver(loop_t *loop, esp_hass_pool_t *pool)
+{
+	const char *message = recorded_messages[STATE_CHANGED];
+	size_t len = strlen(message);
+	esp_hass_message_t *msg = NULL;
+	delivery_t d;
+	int64_t start;
+
+	loop->n_handled = 0;
+	TEST_ASSERT_EQUAL(pdPASS,
+	    xTaskCreate(loop_task, "loop_task", 4096, loop, 5, NULL));
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_MESSAGES; i++) {
+		msg = esp_hass_message_scan(message, len, pool);
+		TEST_ASSERT_NOT_NULL(msg);
+		d.kind = DELIVER;
+		memcpy(&d.msg, msg, sizeof(d.msg));
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xQueueSend(loop->events, &d, portMAX_DELAY));
+		if (loop->handshake) {
+			TEST_ASSERT_EQUAL(pdTRUE,
+			    xSemaphoreTake(loop->handled,
+				pdMS_TO_TICKS(SEMAPHORE_TAKE_TIMEOUT_MS)));
+			esp_hass_message_release(msg);
+			vTaskDelay(pdMS_TO_TICKS(DELAY_MS));
+		} else {
+			d.kind = RELEASE;
+			TEST_ASSERT_EQUAL(pdTRUE,
+			    xQueueSend(loop->events, &d, portMAX_DELAY));
+		}
+	}
+	d.kind = STOP;
+	TEST_ASSERT_EQUAL(pdTRUE, xQueueSend(loop->events, &d, portMAX_DELAY));
+	TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(loop->done, portMAX_DELAY));
+	TEST_ASSERT_EQUAL(BENCHMARK_MESSAGES, loop->n_handled);
+	return esp_timer_get_time() - start;
+}
+
+TEST_CASE("frees a message when the last reference is released[esp_hass_message_release]",
+    "[esp_hass_message_release]")
+{
+	esp_hass_pool_t pool;
+	esp_hass_message_t *msg = NULL;
+	esp_hass_message_t *retained = NULL;
+	esp_hass_message_t copy;
+	const char *message = recorded_messages[STATE_CHANGED];
+	size_t len = strlen(message);
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_message_pool_init(&pool, 1));
+	msg = esp_hass_message_scan(message, len, &pool);
+	TEST_ASSERT_NOT_NULL(msg);
+
+	ESP_LOGI(TAG, "when a copy is retained");
+	memcpy(&copy, msg, sizeof(copy));
+	retained = esp_hass_message_retain(&copy);
+	TEST_ASSERT_EQUAL_PTR(msg, retained);
+
+	ESP_LOGI(TAG, "when a reference remains");
+	esp_hass_message_release(&copy);
+	TEST_ASSERT_NULL(esp_hass_pool_get(&pool));
+	TEST_ASSERT_NOT_NULL(esp_hass_message_get_json(retained));
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_EVENT, retained->type);
+
+	ESP_LOGI(TAG, "when the last reference is released");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_message_destroy(retained));
+	msg = esp_hass_message_scan(message, len, &pool);
+	TEST_ASSERT_EQUAL_PTR(retained, msg);
+	esp_hass_message_release(msg);
+
+	ESP_LOGI(TAG, "when the message is NULL");
+	TEST_ASSERT_NULL(esp_hass_message_retain(NULL));
+	esp_hass_message_release(NULL);
+	esp_hass_pool_free(&pool);
+}
+
+TEST_CASE("compare release and handshake time[esp_hass_message_release]",
+    "[esp_hass_message_release][benchmark]")
+{
+	esp_hass_pool_t pool;
+	loop_t loop = { 0 };
+	int64_t handshake_us, release_us;
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_message_pool_init(&pool, CAPACITY));
+	loop.events = xQueueCreate(QUEUE_SIZE, sizeof(delivery_t));
+	TEST_ASSERT_NOT_NULL(loop.events);
+	loop.handled = xSemaphoreCreateBinary();
+	TEST_ASSERT_NOT_NULL(loop.handled);
+	loop.done = xSemaphoreCreateBinary();
+	TEST_ASSERT_NOT_NULL(loop.done);
+
+	ESP_LOGI(TAG, "when the handler gives the semaphore");
+	loop.handshake = true;
+	handshake_us = deliver(&loop, &pool);
+
+	ESP_LOGI(TAG, "when the message is released after the handler");
+	loop.handshake = false;
+	release_us = deliver(&loop, &pool);
+	TEST_ASSERT_EQUAL(0, pool.exhausted);
+
+	ESP_LOGI(TAG, "semaphore handshake: %lld us, %lld messages/s",
+	    (long long)handshake_us,
+	    (long long)(BENCHMARK_MESSAGES * 1000000LL / handshake_us));
+	ESP_LOGI(TAG, "reference counting: %lld us, %lld messages/s",
+	    (long long)release_us,
+	    (long long)(BENCHMARK_MESSAGES * 1000000LL /
+		(release_us > 0 ? release_us : 1)));
+	vSemaphoreDelete(loop.done);
+	vSemaphoreDelete(loop.handled);
+	vQueueDelete(loop.events);
+	esp_hass_pool_free(&pool);
+}
@@ -0,0 +1,217 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+#include "messages.h"
+#include "parser.h"
+
+#define STATE_CHANGED (5)
+#define QUEUE_SIZE (5)
+#define BENCHMARK_MESSAGES (1000)
+#define STACK_SIZE (4096)
+
+static const char *TAG = "context";
+
+/* an event in the queue of an event loop that has its own task */
+typedef struct {
+	bool stop;
+	esp_hass_message_t msg;
+} loop_event_t;
+
+typedef enum {
+	TWO_STAGES, /* the event loop has its own task */
+	ONE_STAGE,  /* the event source task runs the event loop */
+} stages_t;
+
+typedef struct {
+	stages_t stages;
+	QueueHandle_t event_queue;
+	QueueHandle_t loop_queue;
+	SemaphoreHandle_t handled;
+	SemaphoreHandle_t done;
+	int64_t sent_at;
+	int64_t latency_us;
+} dispatcher_t;
+
+static void
+handler(dispatcher_t *d, esp_hass_message_t *msg)
+{
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_EVENT, msg->type);
+	d->latency_us += esp_timer_get_time() - d->sent_at;
+	xSemaphoreGive(d->handled);
+}
+
+static void
+loop_task(void *args)
+{
+	dispatcher_t *d = args;
+	loop_event_t e;
+
+	while (xQueueReceive(d->loop_queue, &e, portMAX_DELAY) == pdTRUE) {
+		if (e.stop) {
+			break;
+		}
+		handler(d, &e.msg);
+	}
+	xSemaphoreGive(d->done);
+	vTaskDelete(NULL);
+}
+
+static void
+event_source_task(void *args)
+{
+	dispatcher_t *d = args;
+	esp_hass_message_t *msg = NULL;
+	loop_event_t e = { 0 };
+
+	while (xQueueReceive(d->event_queue, &msg, portMAX_DELAY) == pdTRUE) {
+		if (msg == NULL) {
+			break;
+		}
+		memcpy(&e.msg, msg, sizeof(e.msg));
+		xQueueSend(d->loop_queue, &e, portMAX_DELAY);
+		if (d->stages == ONE_STAGE &&
+		    xQueueReceive(d->loop_queue, &e, 0) == pdTRUE) {
+			handler(d, &e.msg);
+		}
+	}
+	if (d->stages == TWO_STAGES) {
+		e.stop = true;
+		xQueueSend(d->loop_queue, &e, portMAX_DELAY);
+	} else {
+		xSemaphoreGive(d->done);
+	}
+	vTaskDelete(NULL);
+}
+
+static void
+count_events(esp_hass_message_t *msg, int *n_events)
+{
+	if (msg->type == HASS_MESSAGE_TYPE_EVENT) {
+		(*n_events)++;
+	}
+}
+
+/* the average latency from the event queue to the handler */
+static int64_t
+dispatch(dispatcher_t *d, stages_t stages, esp_hass_message_t *msg)
+{
+	esp_hass_message_t *stop = NULL;
+
+	d->stages = stages;
+	d->latency_us = 0;
+	if (stages == TWO_STAGES) {
+		TEST_ASSERT_EQUAL(pdPASS,
+		    xTaskCreate(loop_task, "loop_task", STACK_SIZE, d, 5,
+			NULL));
+	}
+	TEST_ASSERT_EQUAL(pdPASS,
+	    xTaskCreate(event_source_task, "event_source_task", STACK_SIZE, d,
+		5, NULL));
+	for (int i = 0; i < BENCHMARK_MESSAGES; i++) {
+		d->sent_at = esp_timer_get_time();
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xQueueSend(d->event_queue, &msg, portMAX_DELAY));
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xSemaphoreTake(d->handled, portMAX_DELAY));
+	}
+	TEST_ASSERT_EQUAL(pdTRUE,
+	    xQueueSend(d->event_queue, &stop, portMAX_DELAY));
+	TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(d->done, portMAX_DELAY));
+	return d->latency_us / BENCHMARK_MESSAGES;
+}
+
+static void
+dispatcher_init(dispatcher_t *d)
+{
+	d->event_queue = xQueueCreate(QUEUE_SIZE, sizeof(esp_hass_message_t *));
+	TEST_ASSERT_NOT_NULL(d->event_queue);
+	d->loop_queue = xQueueCreate(QUEUE_SIZE, sizeof(loop_event_t));
+	TEST_ASSERT_NOT_NULL(d->loop_queue);
+	d->handled = xSemaphoreCreateBinary();
+	TEST_ASSERT_NOT_NULL(d->handled);
+	d->done = xSemaphoreCreateBinary();
+	TEST_ASSERT_NOT_NULL(d->done);
+}
+
+static void
+dispatcher_free(dispatcher_t *d)
+{
+	vSemaphoreDelete(d->done);
+	vSemaphoreDelete(d->handled);
+	vQueueDelete(d->loop_queue);
+	vQueueDelete(d->event_queue);
+}
+
+TEST_CASE("compare one and two stage latency[esp_hass_task_event_source]",
+    "[esp_hass_task_event_source][benchmark]")
+{
+	dispatcher_t d = { 0 };
+	esp_hass_message_t *msg = NULL;
+	const char *message = recorded_messages[STATE_CHANGED];
+	int64_t two_stages_us, one_stage_us;
+
+	msg = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	dispatcher_init(&d);
+
+	ESP_LOGI(TAG, "when the event loop has its own task");
+	two_stages_us = dispatch(&d, TWO_STAGES, msg);
+
+	ESP_LOGI(TAG, "when the event source task runs the event loop");
+	one_stage_us = dispatch(&d, ONE_STAGE, msg);
+
+	ESP_LOGI(TAG, "two stages: %lld us per event, %d bytes of stacks",
+	    (long long)two_stages_us, STACK_SIZE * 2);
+	ESP_LOGI(TAG, "one stage: %lld us per event, %d bytes of stacks",
+	    (long long)one_stage_us, STACK_SIZE);
+	dispatcher_free(&d);
+	esp_hass_message_free(msg);
+}
+
+TEST_CASE("dispatches the message itself[esp_hass_task_event_source]",
+    "[esp_hass_task_event_source][benchmark]")
+{
+	esp_hass_message_t *msg = NULL;
+	QueueHandle_t loop_queue = NULL;
+	loop_event_t e = { 0 };
+	const char *message = recorded_messages[STATE_CHANGED];
+	int n_events = 0;
+	int64_t start, copy_us, zero_copy_us;
+
+	msg = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	loop_queue = xQueueCreate(1, sizeof(loop_event_t));
+	TEST_ASSERT_NOT_NULL(loop_queue);
+
+	/* as esp_event_post_to(), and esp_event_loop_run() do */
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_MESSAGES; i++) {
+		memcpy(&e.msg, msg, sizeof(e.msg));
+		TEST_ASSERT_EQUAL(pdTRUE, xQueueSend(loop_queue, &e, 0));
+		TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(loop_queue, &e, 0));
+		count_events(&e.msg, &n_events);
+	}
+	copy_us = esp_timer_get_time() - start;
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_MESSAGES; i++) {
+		count_events(msg, &n_events);
+	}
+	zero_copy_us = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL(BENCHMARK_MESSAGES * 2, n_events);
+
+	ESP_LOGI(TAG, "copy: %lld us, %u bytes per event", (long long)copy_us,
+	    (unsigned)sizeof(esp_hass_message_t));
+	ESP_LOGI(TAG, "zero copy: %lld us", (long long)zero_copy_us);
+	vQueueDelete(loop_queue);
+	esp_hass_message_free(msg);
+}
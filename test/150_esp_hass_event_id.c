@@ -0,0 +1,107 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+#include "intern.h"
+#include "messages.h"
+#include "parser.h"
+
+#define PONG (4)
+#define STATE_CHANGED (5)
+#define CAPACITY (3)
+
+static const char *TAG = "context";
+
+TEST_CASE("registers event types[esp_hass_event_types_get_id]",
+    "[esp_hass_event_types_get_id]")
+{
+	esp_hass_intern_t event_types;
+	int32_t id;
+
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_event_types_init(&event_types, 1));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_types_init(&event_types, CAPACITY));
+
+	ESP_LOGI(TAG, "when the type is well-known");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_types_get_id(&event_types, "state_changed", false,
+		&id));
+	TEST_ASSERT_EQUAL(ESP_HASS_EVENT_ID_STATE_CHANGED, id);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_types_get_id(&event_types, "call_service", false,
+		&id));
+	TEST_ASSERT_EQUAL(ESP_HASS_EVENT_ID_CALL_SERVICE, id);
+
+	ESP_LOGI(TAG, "when the type is registered");
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_event_types_get_id(&event_types, "custom", false, &id));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_types_get_id(&event_types, "custom", true, &id));
+	TEST_ASSERT_EQUAL(ESP_HASS_EVENT_ID_EVENT_TYPE_BASE + 2, id);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_types_get_id(&event_types, "custom", true, &id));
+	TEST_ASSERT_EQUAL(ESP_HASS_EVENT_ID_EVENT_TYPE_BASE + 2, id);
+
+	ESP_LOGI(TAG, "when the table is full");
+	TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM,
+	    esp_hass_event_types_get_id(&event_types, "another", true, &id));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_event_types_get_id(&event_types, NULL, true, &id));
+	esp_hass_intern_free(&event_types);
+}
+
+TEST_CASE("maps messages to event IDs[esp_hass_message_event_id]",
+    "[esp_hass_message_event_id]")
+{
+	esp_hass_intern_t event_types;
+	esp_hass_message_t *msg = NULL;
+	int32_t id;
+	const char *custom =
+	    "{\"id\":3,\"type\":\"event\",\"event\":{\"event_type\":\"custom\"}}";
+	const char *unknown = "{\"id\":3,\"type\":\"unknown\"}";
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_types_init(&event_types, CAPACITY));
+
+	ESP_LOGI(TAG, "when the message is state_changed");
+	msg = esp_hass_message_scan(recorded_messages[STATE_CHANGED],
+	    strlen(recorded_messages[STATE_CHANGED]), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(ESP_HASS_EVENT_ID_STATE_CHANGED,
+	    esp_hass_message_event_id(msg, &event_types));
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_EVENT,
+	    esp_hass_message_event_id(msg, NULL));
+	esp_hass_message_free(msg);
+
+	ESP_LOGI(TAG, "when the event type is not registered");
+	msg = esp_hass_message_scan(custom, strlen(custom), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_EVENT,
+	    esp_hass_message_event_id(msg, &event_types));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_types_get_id(&event_types, "custom", true, &id));
+	TEST_ASSERT_EQUAL(id, esp_hass_message_event_id(msg, &event_types));
+	esp_hass_message_free(msg);
+
+	ESP_LOGI(TAG, "when the message is not an event");
+	msg = esp_hass_message_scan(recorded_messages[PONG],
+	    strlen(recorded_messages[PONG]), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_PONG,
+	    esp_hass_message_event_id(msg, &event_types));
+	esp_hass_message_free(msg);
+
+	ESP_LOGI(TAG, "when the message type is unknown");
+	msg = esp_hass_message_scan(unknown, strlen(unknown), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(ESP_HASS_EVENT_ID_UNKNOWN,
+	    esp_hass_message_event_id(msg, &event_types));
+	esp_hass_message_free(msg);
+	TEST_ASSERT_EQUAL(ESP_HASS_EVENT_ID_UNKNOWN,
+	    esp_hass_message_event_id(NULL, &event_types));
+	esp_hass_intern_free(&event_types);
+}
@@ -0,0 +1,173 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "intern.h"
+#include "messages.h"
+#include "parser.h"
+
+#define PONG (4)
+#define STATE_CHANGED (5)
+#define CAPACITY (32)
+#define N_HANDLERS (20)
+#define BENCHMARK_ITERATIONS (1000)
+
+static const char *TAG = "context";
+
+TEST_CASE("gets the entity of an event[esp_hass_message_get_entity]",
+    "[esp_hass_message_get_entity]")
+{
+	esp_hass_intern_t entities;
+	esp_hass_message_t *msgs[2];
+	esp_hass_message_t *msg = NULL;
+	esp_hass_entity_t kitchen, entity;
+	const char *message = recorded_messages[STATE_CHANGED];
+	size_t len = strlen(message);
+	const char *escaped =
+	    "{\"id\":2,\"type\":\"event\",\"event\":{\"event_type\":"
+	    "\"call_service\",\"data\":{\"entity_id\":\"light.kitch\\u0065n\"}}}";
+	const char *const no_entity_id[] = {
+		"{\"id\":2,\"type\":\"event\",\"event\":{\"data\":{}}}",
+		"{\"id\":2,\"type\":\"event\",\"event\":{\"data\":"
+		"{\"entity_id\":[\"light.kitchen\"]}}}",
+	};
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_intern_init(&entities, CAPACITY));
+	msgs[0] = esp_hass_message_scan(message, len, NULL);
+	msgs[1] = esp_hass_message_parse((char *)message, len, NULL);
+	for (int i = 0; i < 2; i++) {
+		ESP_LOGI(TAG, "when the message is %s",
+		    i == 0 ? "scanned" : "parsed");
+		TEST_ASSERT_NOT_NULL(msgs[i]);
+		TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+		    esp_hass_message_get_entity(msgs[i], &entities, &entity));
+	}
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_intern(&entities, "light.kitchen", 13, true, &kitchen));
+	for (int i = 0; i < 2; i++) {
+		entity = ESP_HASS_ENTITY_NONE;
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_message_get_entity(msgs[i], &entities, &entity));
+		TEST_ASSERT_EQUAL(kitchen, entity);
+		TEST_ASSERT_TRUE(i == 0 ? msgs[i]->json == NULL :
+					  msgs[i]->json != NULL);
+	}
+
+	ESP_LOGI(TAG, "when the message is decoded");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_message_decode_state_changed(msgs[0], &entities, NULL));
+	entity = ESP_HASS_ENTITY_NONE;
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_message_get_entity(msgs[0], &entities, &entity));
+	TEST_ASSERT_EQUAL(kitchen, entity);
+	esp_hass_message_free(msgs[0]);
+	esp_hass_message_free(msgs[1]);
+
+	ESP_LOGI(TAG, "when entity_id is escaped");
+	msg = esp_hass_message_scan(escaped, strlen(escaped), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_message_get_entity(msg, &entities, &entity));
+	TEST_ASSERT_EQUAL(kitchen, entity);
+	esp_hass_message_free(msg);
+
+	ESP_LOGI(TAG, "when the event does not have an entity_id string");
+	for (int i = 0; i < 2; i++) {
+		msg = esp_hass_message_scan(no_entity_id[i],
+		    strlen(no_entity_id[i]), NULL);
+		TEST_ASSERT_NOT_NULL(msg);
+		TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+		    esp_hass_message_get_entity(msg, &entities, &entity));
+		esp_hass_message_free(msg);
+	}
+
+	ESP_LOGI(TAG, "when the message is not an event");
+	msg = esp_hass_message_scan(recorded_messages[PONG],
+	    strlen(recorded_messages[PONG]), NULL);
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_message_get_entity(msg, &entities, &entity));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_message_get_entity(msg, NULL, &entity));
+	esp_hass_message_free(msg);
+	esp_hass_intern_free(&entities);
+}
+
+TEST_CASE("compare routing and filtering time[esp_hass_message_get_entity]",
+    "[esp_hass_message_get_entity][benchmark]")
+{
+	esp_hass_intern_t entities;
+	esp_hass_message_t *msg = NULL;
+	esp_hass_entity_t entity;
+	esp_hass_entity_t handler_entities[N_HANDLERS];
+	char entity_ids[N_HANDLERS][32];
+	const char *message = recorded_messages[STATE_CHANGED];
+	size_t len = strlen(message);
+	cJSON *entity_id = NULL;
+	int n_called = 0;
+	int64_t start, filter_us, route_us;
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_intern_init(&entities, CAPACITY));
+	for (int i = 0; i < N_HANDLERS; i++) {
+		snprintf(entity_ids[i], sizeof(entity_ids[i]), "light.%d", i);
+	}
+
+	/* the last handler is for light.kitchen */
+	snprintf(entity_ids[N_HANDLERS - 1], sizeof(entity_ids[0]),
+	    "light.kitchen");
+	for (int i = 0; i < N_HANDLERS; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_intern(&entities, entity_ids[i],
+			strlen(entity_ids[i]), true, &handler_entities[i]));
+	}
+
+	/* every handler looks up entity_id, as examples/button did */
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		msg = esp_hass_message_scan(message, len, NULL);
+		TEST_ASSERT_NOT_NULL(msg);
+		for (int j = 0; j < N_HANDLERS; j++) {
+			entity_id = cJSON_GetObjectItemCaseSensitive(
+			    cJSON_GetObjectItemCaseSensitive(
+				cJSON_GetObjectItemCaseSensitive(
+				    esp_hass_message_get_json(msg), "event"),
+				"data"),
+			    "entity_id");
+			if (cJSON_IsString(entity_id) &&
+			    strcmp(entity_id->valuestring, entity_ids[j]) ==
+				0) {
+				n_called++;
+			}
+		}
+		esp_hass_message_free(msg);
+	}
+	filter_us = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL(BENCHMARK_ITERATIONS, n_called);
+
+	/* the dispatcher looks up the entity once */
+	n_called = 0;
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		msg = esp_hass_message_scan(message, len, NULL);
+		TEST_ASSERT_NOT_NULL(msg);
+		if (esp_hass_message_get_entity(msg, &entities, &entity) ==
+			ESP_OK &&
+		    entity == handler_entities[N_HANDLERS - 1]) {
+			n_called++;
+		}
+		esp_hass_message_free(msg);
+	}
+	route_us = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL(BENCHMARK_ITERATIONS, n_called);
+
+	ESP_LOGI(TAG, "%d handlers filter events: %lld us", N_HANDLERS,
+	    (long long)filter_us);
+	ESP_LOGI(TAG, "esp_hass_message_get_entity(): %lld us",
+	    (long long)route_us);
+	esp_hass_intern_free(&entities);
+}
@@ -0,0 +1,234 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdint.h>
+#include <unity.h>
+
+#include "ring.h"
+
+#define CAPACITY (16)
+#define BATCH (8)
+#define PRODUCERS (4)
+#define BENCHMARK_ITEMS (20000)
+#define STACK_SIZE (4096)
+
+static const char *TAG = "context";
+
+/* producers send items through a queue, or a ring */
+typedef struct {
+	QueueHandle_t queue;
+	esp_hass_ring_handle_t ring;
+	SemaphoreHandle_t done;
+	int n_items;
+} channel_t;
+
+typedef struct {
+	channel_t *channel;
+	int producer;
+} producer_t;
+
+/* an item tells the producer, and the order */
+#define ITEM(producer, i) ((void *)(uintptr_t)((producer) << 24 | ((i) + 1)))
+#define ITEM_PRODUCER(item) ((int)((uintptr_t)(item) >> 24))
+#define ITEM_INDEX(item) ((int)((uintptr_t)(item)&0xffffff) - 1)
+
+static void
+producer_task(void *args)
+{
+	producer_t *p = args;
+	channel_t *c = p->channel;
+	void *item = NULL;
+
+	for (int i = 0; i < c->n_items; i++) {
+		item = ITEM(p->producer, i);
+		if (c->ring != NULL) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_ring_send(c->ring, item, portMAX_DELAY));
+		} else {
+			TEST_ASSERT_EQUAL(pdTRUE,
+			    xQueueSend(c->queue, &item, portMAX_DELAY));
+		}
+	}
+	xSemaphoreGive(c->done);
+	vTaskDelete(NULL);
+}
+
+/* receive the items of all the producers, and check the order */
+static int64_t
+transfer(channel_t *c)
+{
+	producer_t producers[PRODUCERS];
+	int next[PRODUCERS] = { 0 };
+	void *items[BATCH];
+	size_t n = 0;
+	int64_t start;
+
+	start = esp_timer_get_time();
+	for (int i = 0; i < PRODUCERS; i++) {
+		producers[i].channel = c;
+		producers[i].producer = i;
+		TEST_ASSERT_EQUAL(pdPASS,
+		    xTaskCreate(producer_task, "producer_task", STACK_SIZE,
+			&producers[i], 5, NULL));
+	}
+	for (int received = 0; received < PRODUCERS * c->n_items;
+	     received += n) {
+		if (c->ring != NULL) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_ring_receive_batch(c->ring, items, BATCH,
+				&n, portMAX_DELAY));
+		} else {
+			TEST_ASSERT_EQUAL(pdTRUE,
+			    xQueueReceive(c->queue, &items[0], portMAX_DELAY));
+			n = 1;
+		}
+		for (int i = 0; i < n; i++) {
+			TEST_ASSERT_EQUAL(next[ITEM_PRODUCER(items[i])],
+			    ITEM_INDEX(items[i]));
+			next[ITEM_PRODUCER(items[i])]++;
+		}
+	}
+	for (int i = 0; i < PRODUCERS; i++) {
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xSemaphoreTake(c->done, portMAX_DELAY));
+		TEST_ASSERT_EQUAL(c->n_items, next[i]);
+	}
+	return esp_timer_get_time() - start;
+}
+
+TEST_CASE("sends, and receives pointers in order[esp_hass_ring_send]",
+    "[esp_hass_ring_send]")
+{
+	esp_hass_ring_handle_t ring = NULL;
+	void *item = NULL;
+	int values[4];
+
+	ESP_LOGI(TAG, "when the capacity is out of range");
+	TEST_ASSERT_NULL(esp_hass_ring_create(ESP_HASS_RING_MAX_CAPACITY + 1));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_ring_send(NULL, &values[0], 0));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_ring_receive(NULL, &item, 0));
+
+	ESP_LOGI(TAG, "when the capacity is rounded up");
+	ring = esp_hass_ring_create(3);
+	TEST_ASSERT_NOT_NULL(ring);
+	TEST_ASSERT_EQUAL(3, ring->mask);
+
+	/* several laps so that positions wrap around the slots */
+	for (int lap = 0; lap < 3; lap++) {
+		ESP_LOGI(TAG, "when the ring is full, lap %d", lap);
+		for (int i = 0; i < 4; i++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_ring_send(ring, &values[i], 0));
+		}
+		TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT,
+		    esp_hass_ring_send(ring, &values[0], 0));
+
+		ESP_LOGI(TAG, "when the ring is empty, lap %d", lap);
+		for (int i = 0; i < 4; i++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_ring_receive(ring, &item, 0));
+			TEST_ASSERT_EQUAL_PTR(&values[i], item);
+		}
+		TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT,
+		    esp_hass_ring_receive(ring, &item, 0));
+	}
+
+	ESP_LOGI(TAG, "when the ring is empty for a while");
+	TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT,
+	    esp_hass_ring_receive(ring, &item, pdMS_TO_TICKS(10)));
+	esp_hass_ring_delete(ring);
+	esp_hass_ring_delete(NULL);
+}
+
+TEST_CASE("receives pointers in a batch[esp_hass_ring_receive_batch]",
+    "[esp_hass_ring_receive_batch]")
+{
+	esp_hass_ring_handle_t ring = NULL;
+	void *items[BATCH];
+	int values[5];
+	size_t n = 0;
+
+	ring = esp_hass_ring_create(CAPACITY);
+	TEST_ASSERT_NOT_NULL(ring);
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_ring_receive_batch(ring, items, 0, &n, 0));
+	for (int i = 0; i < 5; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_ring_send(ring, &values[i], 0));
+	}
+
+	ESP_LOGI(TAG, "when the batch is smaller than the ring");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_ring_receive_batch(ring, items, 2, &n, 0));
+	TEST_ASSERT_EQUAL(2, n);
+	TEST_ASSERT_EQUAL_PTR(&values[0], items[0]);
+	TEST_ASSERT_EQUAL_PTR(&values[1], items[1]);
+
+	ESP_LOGI(TAG, "when the batch is larger than the ring");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_ring_receive_batch(ring, items, BATCH, &n, 0));
+	TEST_ASSERT_EQUAL(3, n);
+	for (int i = 0; i < 3; i++) {
+		TEST_ASSERT_EQUAL_PTR(&values[i + 2], items[i]);
+	}
+
+	ESP_LOGI(TAG, "when the ring is empty");
+	TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT,
+	    esp_hass_ring_receive_batch(ring, items, BATCH, &n, 0));
+	TEST_ASSERT_EQUAL(0, n);
+	esp_hass_ring_delete(ring);
+}
+
+TEST_CASE("passes pointers between tasks[esp_hass_ring_receive_batch]",
+    "[esp_hass_ring_receive_batch]")
+{
+	channel_t c = { 0 };
+
+	/* the smallest ring so that both sides wait */
+	c.ring = esp_hass_ring_create(2);
+	TEST_ASSERT_NOT_NULL(c.ring);
+	c.done = xSemaphoreCreateCounting(PRODUCERS, 0);
+	TEST_ASSERT_NOT_NULL(c.done);
+	c.n_items = 1000;
+	transfer(&c);
+	vSemaphoreDelete(c.done);
+	esp_hass_ring_delete(c.ring);
+}
+
+TEST_CASE("compare ring and queue throughput[esp_hass_ring_receive_batch]",
+    "[esp_hass_ring_receive_batch][benchmark]")
+{
+	channel_t c = { 0 };
+	int64_t queue_us, ring_us;
+
+	c.done = xSemaphoreCreateCounting(PRODUCERS, 0);
+	TEST_ASSERT_NOT_NULL(c.done);
+	c.n_items = BENCHMARK_ITEMS / PRODUCERS;
+
+	ESP_LOGI(TAG, "when %d tasks send to a queue", PRODUCERS);
+	c.queue = xQueueCreate(CAPACITY, sizeof(void *));
+	TEST_ASSERT_NOT_NULL(c.queue);
+	queue_us = transfer(&c);
+	vQueueDelete(c.queue);
+	c.queue = NULL;
+
+	ESP_LOGI(TAG, "when %d tasks send to a ring", PRODUCERS);
+	c.ring = esp_hass_ring_create(CAPACITY);
+	TEST_ASSERT_NOT_NULL(c.ring);
+	ring_us = transfer(&c);
+	esp_hass_ring_delete(c.ring);
+
+	ESP_LOGI(TAG, "queue: %lld us, %lld items/s", (long long)queue_us,
+	    (long long)(BENCHMARK_ITEMS * 1000000LL / queue_us));
+	ESP_LOGI(TAG, "ring: %lld us, %lld items/s", (long long)ring_us,
+	    (long long)(BENCHMARK_ITEMS * 1000000LL /
+		(ring_us > 0 ? ring_us : 1)));
+	vSemaphoreDelete(c.done);
+}
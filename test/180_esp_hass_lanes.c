@@ -0,0 +1,140 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdint.h>
+#include <unity.h>
+
+#define QUEUE_SIZE (5)
+#define BURST (50)
+#define ROUNDS (10)
+#define STACK_SIZE (4096)
+
+/* the wait of message_handler() before events had a lane */
+#define QUEUE_SEND_WAIT_MS (1000)
+
+static const char *TAG = "context";
+
+typedef struct {
+	QueueHandle_t event_queue;
+	QueueHandle_t result_queue;
+	SemaphoreHandle_t done;
+	bool blocking; /* wait for space in event_queue */
+	int n_dropped;
+	int64_t sent_at[ROUNDS]; /* when frames arrived */
+} lanes_t;
+
+/* a slow handler of events */
+static void
+event_task(void *args)
+{
+	lanes_t *l = args;
+	void *item = NULL;
+
+	while (xQueueReceive(l->event_queue, &item, portMAX_DELAY) == pdTRUE) {
+		if (item == NULL) {
+			break;
+		}
+		vTaskDelay(1);
+	}
+	xSemaphoreGive(l->done);
+	vTaskDelete(NULL);
+}
+
+/* a storm of events, and a result after each burst, as the websocket task
+ * receives them. a burst, and its result arrive in a frame at once.
+ */
+static void
+websocket_task(void *args)
+{
+	lanes_t *l = args;
+	void *item = NULL;
+	TickType_t ticks;
+
+	ticks = l->blocking ? pdMS_TO_TICKS(QUEUE_SEND_WAIT_MS) : 0;
+	for (int i = 0; i < ROUNDS; i++) {
+		l->sent_at[i] = esp_timer_get_time();
+		for (int j = 0; j < BURST; j++) {
+			item = l;
+			if (xQueueSend(l->event_queue, &item, ticks) !=
+			    pdTRUE) {
+				l->n_dropped++;
+			}
+		}
+		item = &l->sent_at[i];
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xQueueSend(l->result_queue, &item,
+			pdMS_TO_TICKS(QUEUE_SEND_WAIT_MS)));
+	}
+	item = NULL;
+	TEST_ASSERT_EQUAL(pdTRUE,
+	    xQueueSend(l->event_queue, &item, portMAX_DELAY));
+	vTaskDelete(NULL);
+}
+
+/* the worst latency of results, as esp_hass_call_service() receives them */
+static int64_t
+receive_results(lanes_t *l, bool blocking)
+{
+	int64_t *sent_at = NULL;
+	int64_t latency_us, max_us = 0;
+
+	l->blocking = blocking;
+	l->n_dropped = 0;
+	TEST_ASSERT_EQUAL(pdPASS,
+	    xTaskCreate(event_task, "event_task", STACK_SIZE, l, 5, NULL));
+	TEST_ASSERT_EQUAL(pdPASS,
+	    xTaskCreate(websocket_task, "websocket_task", STACK_SIZE, l, 5,
+		NULL));
+	for (int i = 0; i < ROUNDS; i++) {
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xQueueReceive(l->result_queue, &sent_at, portMAX_DELAY));
+		TEST_ASSERT_EQUAL_PTR(&l->sent_at[i], sent_at);
+		latency_us = esp_timer_get_time() - *sent_at;
+		if (latency_us > max_us) {
+			max_us = latency_us;
+		}
+	}
+	TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(l->done, portMAX_DELAY));
+	return max_us;
+}
+
+TEST_CASE("compare result latency under event overload[message_handler]",
+    "[message_handler][benchmark]")
+{
+	lanes_t l = { 0 };
+	int64_t blocking_us, lane_us;
+	int64_t start, blocking_total_us, lane_total_us;
+
+	l.event_queue = xQueueCreate(QUEUE_SIZE, sizeof(void *));
+	TEST_ASSERT_NOT_NULL(l.event_queue);
+	l.result_queue = xQueueCreate(QUEUE_SIZE, sizeof(void *));
+	TEST_ASSERT_NOT_NULL(l.result_queue);
+	l.done = xSemaphoreCreateBinary();
+	TEST_ASSERT_NOT_NULL(l.done);
+
+	ESP_LOGI(TAG, "when the websocket task waits for space for events");
+	start = esp_timer_get_time();
+	blocking_us = receive_results(&l, true);
+	blocking_total_us = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL(0, l.n_dropped);
+
+	ESP_LOGI(TAG, "when events are sent without waiting");
+	start = esp_timer_get_time();
+	lane_us = receive_results(&l, false);
+	lane_total_us = esp_timer_get_time() - start;
+	TEST_ASSERT_GREATER_THAN(0, l.n_dropped);
+
+	ESP_LOGI(TAG, "waiting: worst result latency %lld us, %lld us in total",
+	    (long long)blocking_us, (long long)blocking_total_us);
+	ESP_LOGI(TAG,
+	    "without waiting: worst result latency %lld us, %lld us in total, %d events dropped",
+	    (long long)lane_us, (long long)lane_total_us, l.n_dropped);
+	vSemaphoreDelete(l.done);
+	vQueueDelete(l.result_queue);
+	vQueueDelete(l.event_queue);
+}
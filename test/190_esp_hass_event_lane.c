@@ -0,0 +1,288 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "intern.h"
+#include "lane.h"
+#include "messages.h"
+#include "parser.h"
+
+#define PONG (4)
+#define LANE_SIZE (2)
+#define N_ENTITIES (8)
+#define N_UPDATES (100)
+
+static const char *TAG = "context";
+
+typedef struct {
+	esp_hass_intern_t entities;
+	esp_hass_intern_t event_types;
+	esp_hass_event_lane_t lane;
+	QueueHandle_t queue;
+	esp_hass_ring_handle_t ring;
+} fixture_t;
+
+static void
+fixture_init(fixture_t *f, bool use_ring, size_t size,
+    esp_hass_overload_policy_t policy)
+{
+	memset(f, 0, sizeof(*f));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_intern_init(&f->entities, 16));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_types_init(&f->event_types, 4));
+	if (use_ring) {
+		f->ring = esp_hass_ring_create(size);
+		TEST_ASSERT_NOT_NULL(f->ring);
+	} else {
+		f->queue = xQueueCreate(size, sizeof(void *));
+		TEST_ASSERT_NOT_NULL(f->queue);
+	}
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_lane_init(&f->lane, f->queue, f->ring, policy,
+		&f->entities, &f->event_types));
+}
+
+static void
+fixture_free(fixture_t *f)
+{
+	esp_hass_message_t *msg = NULL;
+	size_t n = 0;
+
+	while (esp_hass_event_lane_receive(&f->lane, &msg, 1, &n, 0) ==
+	    ESP_OK) {
+		esp_hass_message_release(msg);
+	}
+	esp_hass_event_lane_free(&f->lane);
+	if (f->ring != NULL) {
+		esp_hass_ring_delete(f->ring);
+	}
+	if (f->queue != NULL) {
+		vQueueDelete(f->queue);
+	}
+	esp_hass_intern_free(&f->event_types);
+	esp_hass_intern_free(&f->entities);
+}
+
+/* a state_changed event of `light.<entity>` whose state is `s<state>` */
+static esp_hass_message_t *
+state_changed(int entity, int state)
+{
+	char text[256];
+	esp_hass_message_t *msg = NULL;
+
+	snprintf(text, sizeof(text),
+	    "{\"id\":2,\"type\":\"event\",\"event\":{\"event_type\":"
+	    "\"state_changed\",\"data\":{\"entity_id\":\"light.%d\","
+	    "\"new_state\":{\"state\":\"s%d\"}}}}",
+	    entity, state);
+	msg = esp_hass_message_scan(text, strlen(text), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	return msg;
+}
+
+/* the state of a received state_changed event */
+static const char *
+received_state(fixture_t *f)
+{
+	esp_hass_message_t *msg = NULL;
+	static char state[ESP_HASS_STATE_MAX_LEN];
+	size_t n = 0;
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_lane_receive(&f->lane, &msg, 1, &n, 0));
+	TEST_ASSERT_EQUAL(1, n);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_message_decode_state_changed(msg, NULL, NULL));
+	strlcpy(state, esp_hass_message_get_state_changed(msg)->new_state.value,
+	    sizeof(state));
+	esp_hass_message_release(msg);
+	return state;
+}
+
+TEST_CASE("applies overload policies[esp_hass_event_lane_send]",
+    "[esp_hass_event_lane_send]")
+{
+	fixture_t f;
+	esp_hass_overload_stats_t stats;
+
+	for (int use_ring = 0; use_ring < 2; use_ring++) {
+		ESP_LOGI(TAG, "when the lane has a %s",
+		    use_ring ? "ring" : "queue");
+
+		ESP_LOGI(TAG, "when the newest event is dropped");
+		fixture_init(&f, use_ring, LANE_SIZE,
+		    HASS_OVERLOAD_POLICY_DROP_NEWEST);
+		for (int i = 0; i < 3; i++) {
+			TEST_ASSERT_EQUAL(i < LANE_SIZE ? ESP_OK :
+							  ESP_ERR_TIMEOUT,
+			    esp_hass_event_lane_send(&f.lane,
+				state_changed(i, i)));
+		}
+		TEST_ASSERT_EQUAL_STRING("s0", received_state(&f));
+		TEST_ASSERT_EQUAL_STRING("s1", received_state(&f));
+		esp_hass_event_lane_get_stats(&f.lane, &stats);
+		TEST_ASSERT_EQUAL(1, stats.dropped);
+		TEST_ASSERT_EQUAL(0, stats.coalesced);
+		fixture_free(&f);
+
+		ESP_LOGI(TAG, "when the oldest event is dropped");
+		fixture_init(&f, use_ring, LANE_SIZE,
+		    HASS_OVERLOAD_POLICY_DROP_OLDEST);
+		for (int i = 0; i < 3; i++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_event_lane_send(&f.lane,
+				state_changed(i, i)));
+		}
+		TEST_ASSERT_EQUAL_STRING("s1", received_state(&f));
+		TEST_ASSERT_EQUAL_STRING("s2", received_state(&f));
+		esp_hass_event_lane_get_stats(&f.lane, &stats);
+		TEST_ASSERT_EQUAL(1, stats.dropped);
+		fixture_free(&f);
+
+		ESP_LOGI(TAG, "when events of an entity are coalesced");
+		fixture_init(&f, use_ring, LANE_SIZE,
+		    HASS_OVERLOAD_POLICY_COALESCE);
+		for (int i = 0; i < 3; i++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_event_lane_send(&f.lane,
+				state_changed(0, i)));
+		}
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_event_lane_send(&f.lane, state_changed(1, 0)));
+		TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT,
+		    esp_hass_event_lane_send(&f.lane, state_changed(2, 0)));
+		TEST_ASSERT_EQUAL_STRING("s2", received_state(&f));
+
+		/* the entity is no longer in the lane */
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_event_lane_send(&f.lane, state_changed(0, 3)));
+		TEST_ASSERT_EQUAL_STRING("s0", received_state(&f));
+		TEST_ASSERT_EQUAL_STRING("s3", received_state(&f));
+		esp_hass_event_lane_get_stats(&f.lane, &stats);
+		TEST_ASSERT_EQUAL(1, stats.dropped);
+		TEST_ASSERT_EQUAL(2, stats.coalesced);
+		fixture_free(&f);
+	}
+}
+
+TEST_CASE("sends pongs ahead of events[esp_hass_event_lane_send]",
+    "[esp_hass_event_lane_send]")
+{
+	fixture_t f;
+	esp_hass_message_t *msg = NULL;
+	const char *pong = recorded_messages[PONG];
+	size_t n = 0;
+
+	fixture_init(&f, false, LANE_SIZE, HASS_OVERLOAD_POLICY_DROP_NEWEST);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_lane_send(&f.lane, state_changed(0, 0)));
+	msg = esp_hass_message_scan(pong, strlen(pong), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_event_lane_send(&f.lane, msg));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_lane_receive(&f.lane, &msg, 1, &n, 0));
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_PONG, msg->type);
+	esp_hass_message_release(msg);
+	TEST_ASSERT_EQUAL_STRING("s0", received_state(&f));
+
+	ESP_LOGI(TAG, "when the lane is not enabled");
+	esp_hass_event_lane_free(&f.lane);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_lane_init(&f.lane, NULL, NULL,
+		HASS_OVERLOAD_POLICY_DROP_NEWEST, &f.entities,
+		&f.event_types));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE,
+	    esp_hass_event_lane_send(&f.lane, state_changed(0, 0)));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_event_lane_init(&f.lane, f.queue, NULL,
+		HASS_OVERLOAD_POLICY_COALESCE + 1, &f.entities,
+		&f.event_types));
+	fixture_free(&f);
+}
+
+TEST_CASE("keeps the newest state of each entity in a burst[esp_hass_event_lane_send]",
+    "[esp_hass_event_lane_send]")
+{
+	fixture_t f;
+	esp_hass_overload_stats_t stats;
+	char newest[16];
+	esp_hass_overload_policy_t policies[] = {
+		HASS_OVERLOAD_POLICY_DROP_NEWEST,
+		HASS_OVERLOAD_POLICY_COALESCE,
+	};
+
+	snprintf(newest, sizeof(newest), "s%d", N_UPDATES - 1);
+	for (int p = 0; p < 2; p++) {
+		ESP_LOGI(TAG, "when the policy is %s",
+		    p == 0 ? "drop-newest" : "coalesce");
+		fixture_init(&f, true, N_ENTITIES, policies[p]);
+
+		/* the handler is behind, and receives nothing in the burst */
+		for (int i = 0; i < N_UPDATES; i++) {
+			for (int j = 0; j < N_ENTITIES; j++) {
+				esp_hass_event_lane_send(&f.lane,
+				    state_changed(j, i));
+			}
+		}
+		esp_hass_event_lane_get_stats(&f.lane, &stats);
+		ESP_LOGI(TAG, "dropped: %u, coalesced: %u",
+		    (unsigned)stats.dropped, (unsigned)stats.coalesced);
+		TEST_ASSERT_EQUAL(N_ENTITIES * N_UPDATES,
+		    N_ENTITIES + stats.dropped + stats.coalesced);
+		for (int j = 0; j < N_ENTITIES; j++) {
+			TEST_ASSERT_EQUAL_STRING(p == 0 ? "s0" : newest,
+			    received_state(&f));
+		}
+		fixture_free(&f);
+	}
+}
+
+TEST_CASE("stops the receiver after the events[esp_hass_event_lane_stop]",
+    "[esp_hass_event_lane_stop]")
+{
+	fixture_t f;
+	esp_hass_message_t *msgs[LANE_SIZE + 1];
+	size_t n = 0;
+
+	for (int use_ring = 0; use_ring < 2; use_ring++) {
+		ESP_LOGI(TAG, "when the lane has %s",
+		    use_ring ? "a ring" : "a queue");
+		fixture_init(&f, use_ring, LANE_SIZE + 1,
+		    HASS_OVERLOAD_POLICY_DROP_NEWEST);
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_event_lane_send(&f.lane, state_changed(0, 0)));
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_event_lane_send(&f.lane, state_changed(1, 0)));
+		TEST_ASSERT_EQUAL(ESP_OK, esp_hass_event_lane_stop(&f.lane, 0));
+		for (int i = 0; i < LANE_SIZE + 1; i += n) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_event_lane_receive(&f.lane, &msgs[i],
+				LANE_SIZE + 1 - i, &n, 0));
+		}
+		TEST_ASSERT_EQUAL_STRING("state_changed", msgs[0]->event_type);
+		TEST_ASSERT_EQUAL_STRING("state_changed", msgs[1]->event_type);
+		TEST_ASSERT_EQUAL_PTR(ESP_HASS_EVENT_LANE_STOP(&f.lane),
+		    msgs[LANE_SIZE]);
+		esp_hass_message_release(msgs[0]);
+		esp_hass_message_release(msgs[1]);
+		fixture_free(&f);
+	}
+
+	ESP_LOGI(TAG, "when the lane is not enabled");
+	fixture_init(&f, false, LANE_SIZE, HASS_OVERLOAD_POLICY_DROP_NEWEST);
+	esp_hass_event_lane_free(&f.lane);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_event_lane_init(&f.lane, NULL, NULL,
+		HASS_OVERLOAD_POLICY_DROP_NEWEST, &f.entities,
+		&f.event_types));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE,
+	    esp_hass_event_lane_stop(&f.lane, 0));
+	fixture_free(&f);
+}
@@ -0,0 +1,266 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "intern.h"
+#include "messages.h"
+#include "parser.h"
+#include "workers.h"
+
+#define PONG (4)
+#define N_WORKERS (4)
+#define QUEUE_SIZE (8)
+#define STACK_SIZE (4096)
+#define N_ENTITIES (16)
+#define N_UPDATES (50)
+#define BENCHMARK_EVENTS (160)
+
+/* the time that a handler takes, e.g. to drive a peripheral */
+#define HANDLER_DELAY_MS (1)
+
+static const char *TAG = "context";
+
+typedef struct {
+	esp_hass_intern_t entities;
+	esp_hass_workers_t workers;
+	SemaphoreHandle_t handled;
+	bool delay;
+	int last_states[N_ENTITIES];
+	_Atomic int n_out_of_order;
+} fixture_t;
+
+/* a state_changed event of `light.<entity>` whose state is
+ * `<entity>.<state>` */
+static esp_hass_message_t *
+state_changed(int entity, int state)
+{
+	char text[256];
+	esp_hass_message_t *msg = NULL;
+
+	snprintf(text, sizeof(text),
+	    "{\"id\":2,\"type\":\"event\",\"event\":{\"event_type\":"
+	    "\"state_changed\",\"data\":{\"entity_id\":\"light.%d\","
+	    "\"new_state\":{\"state\":\"%d.%d\"}}}}",
+	    entity, entity, state);
+	msg = esp_hass_message_scan(text, strlen(text), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	return msg;
+}
+
+static void
+dispatch(void *context, esp_hass_message_t *msg)
+{
+	fixture_t *f = context;
+	int entity, state;
+
+	/* workers do not assert, as they are not the task of the test */
+	if (esp_hass_message_decode_state_changed(msg, NULL, NULL) == ESP_OK &&
+	    sscanf(esp_hass_message_get_state_changed(msg)->new_state.value,
+		"%d.%d", &entity, &state) == 2) {
+
+		/* each entity is handled by one worker at a time */
+		if (state <= f->last_states[entity]) {
+			atomic_fetch_add(&f->n_out_of_order, 1);
+		}
+		f->last_states[entity] = state;
+	}
+	if (f->delay) {
+		vTaskDelay(pdMS_TO_TICKS(HANDLER_DELAY_MS));
+	}
+	esp_hass_message_release(msg);
+	xSemaphoreGive(f->handled);
+}
+
+static void
+fixture_init(fixture_t *f, size_t n_workers, bool delay)
+{
+	esp_hass_workers_config_t config = {
+		.n_workers = n_workers,
+		.queue_size = QUEUE_SIZE,
+		.stack_size = STACK_SIZE,
+		.priority = 5,
+		.core_id = ESP_HASS_WORKERS_SPREAD_CORES,
+		.dispatch = dispatch,
+		.entities = NULL,
+	};
+
+	memset(f, 0, sizeof(*f));
+	f->delay = delay;
+	for (int i = 0; i < N_ENTITIES; i++) {
+		f->last_states[i] = -1;
+	}
+	f->handled = xSemaphoreCreateCounting(N_UPDATES * N_ENTITIES, 0);
+	TEST_ASSERT_NOT_NULL(f->handled);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_intern_init(&f->entities, N_ENTITIES));
+	config.context = f;
+	config.entities = &f->entities;
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_workers_init(&f->workers, &config));
+}
+
+static void
+fixture_free(fixture_t *f)
+{
+	esp_hass_workers_free(&f->workers);
+	esp_hass_intern_free(&f->entities);
+	vSemaphoreDelete(f->handled);
+}
+
+static void
+wait_handled(fixture_t *f, int n)
+{
+	for (int i = 0; i < n; i++) {
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xSemaphoreTake(f->handled, pdMS_TO_TICKS(10000)));
+	}
+}
+
+/* the time to handle events of entities in turn */
+static int64_t
+handle(size_t n_workers)
+{
+	fixture_t f;
+	int64_t start, elapsed_us;
+
+	fixture_init(&f, n_workers, true);
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_EVENTS; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_workers_send(&f.workers,
+			state_changed(i % N_ENTITIES, i), portMAX_DELAY));
+	}
+	wait_handled(&f, BENCHMARK_EVENTS);
+	elapsed_us = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL(0, f.n_out_of_order);
+	fixture_free(&f);
+	return elapsed_us;
+}
+
+TEST_CASE("returns ESP_ERR_INVALID_ARG[esp_hass_workers_init]",
+    "[esp_hass_workers_init]")
+{
+	esp_hass_workers_t workers;
+	esp_hass_intern_t entities;
+	esp_hass_workers_config_t config = {
+		.n_workers = 0,
+		.queue_size = QUEUE_SIZE,
+		.stack_size = STACK_SIZE,
+		.priority = 5,
+		.core_id = ESP_HASS_WORKERS_ANY_CORE,
+		.dispatch = dispatch,
+		.entities = &entities,
+	};
+
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_workers_init(&workers, &config));
+	config.n_workers = ESP_HASS_WORKERS_MAX + 1;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_workers_init(&workers, &config));
+	config.n_workers = 1;
+	config.dispatch = NULL;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_workers_init(&workers, &config));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_workers_init(NULL, &config));
+}
+
+TEST_CASE("shards messages by entity[esp_hass_workers_shard]",
+    "[esp_hass_workers_shard]")
+{
+	fixture_t f;
+	esp_hass_message_t *msg = NULL;
+	esp_hass_message_t *other = NULL;
+	size_t shards[N_WORKERS] = { 0 };
+	const char *message = recorded_messages[PONG];
+
+	fixture_init(&f, N_WORKERS, false);
+
+	ESP_LOGI(TAG, "when messages are of the same entity");
+	msg = state_changed(1, 0);
+	other = state_changed(1, 1);
+	TEST_ASSERT_EQUAL(esp_hass_workers_shard(&f.workers, msg),
+	    esp_hass_workers_shard(&f.workers, other));
+	esp_hass_message_release(msg);
+	esp_hass_message_release(other);
+
+	ESP_LOGI(TAG, "when messages are of other entities");
+	for (int i = 0; i < N_ENTITIES; i++) {
+		msg = state_changed(i, 0);
+		shards[esp_hass_workers_shard(&f.workers, msg)]++;
+		esp_hass_message_release(msg);
+	}
+	for (int i = 0; i < N_WORKERS; i++) {
+		TEST_ASSERT_EQUAL(N_ENTITIES / N_WORKERS, shards[i]);
+	}
+
+	ESP_LOGI(TAG, "when the message has no entity");
+	msg = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	TEST_ASSERT_EQUAL(0, esp_hass_workers_shard(&f.workers, msg));
+	esp_hass_message_release(msg);
+
+	ESP_LOGI(TAG, "when the table of entities is full");
+	msg = state_changed(N_ENTITIES, 0);
+	TEST_ASSERT_EQUAL(0, esp_hass_workers_shard(&f.workers, msg));
+	esp_hass_message_release(msg);
+	fixture_free(&f);
+}
+
+TEST_CASE("keeps the order of each entity[esp_hass_workers_send]",
+    "[esp_hass_workers_send]")
+{
+	fixture_t f;
+
+	fixture_init(&f, N_WORKERS, false);
+	for (int i = 0; i < N_UPDATES; i++) {
+		for (int entity = 0; entity < N_ENTITIES; entity++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_workers_send(&f.workers,
+				state_changed(entity, i), portMAX_DELAY));
+		}
+	}
+	wait_handled(&f, N_UPDATES * N_ENTITIES);
+	TEST_ASSERT_EQUAL(0, f.n_out_of_order);
+	for (int i = 0; i < N_ENTITIES; i++) {
+		TEST_ASSERT_EQUAL(N_UPDATES - 1, f.last_states[i]);
+	}
+
+	ESP_LOGI(TAG, "when the message is NULL");
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_workers_send(&f.workers, NULL, 0));
+
+	ESP_LOGI(TAG, "when workers are stopped with queued messages");
+	for (int i = 0; i < QUEUE_SIZE; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_workers_send(&f.workers, state_changed(0, i + 100),
+			portMAX_DELAY));
+	}
+	esp_hass_workers_free(&f.workers);
+	TEST_ASSERT_EQUAL(100 + QUEUE_SIZE - 1, f.last_states[0]);
+	esp_hass_intern_free(&f.entities);
+	vSemaphoreDelete(f.handled);
+}
+
+TEST_CASE("compare event time with more workers[esp_hass_workers_send]",
+    "[benchmark]")
+{
+	int64_t elapsed_us[N_WORKERS + 1] = { 0 };
+
+	for (int n = 1; n <= N_WORKERS; n *= 2) {
+		ESP_LOGI(TAG, "when there are %d workers", n);
+		elapsed_us[n] = handle(n);
+		ESP_LOGI(TAG, "%d workers: %lld us, %lld events/s", n,
+		    (long long)elapsed_us[n],
+		    (long long)(BENCHMARK_EVENTS * 1000000LL /
+			(elapsed_us[n] > 0 ? elapsed_us[n] : 1)));
+	}
+}
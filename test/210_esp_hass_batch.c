@@ -0,0 +1,200 @@
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+#include "batch.h"
+#include "messages.h"
+#include "parser.h"
+
+#define PONG (4)
+#define STATE_CHANGED (5)
+#define MAX_MESSAGES (4)
+#define MAX_WAIT_MS (100)
+#define BENCHMARK_MESSAGES (1000)
+#define BENCHMARK_BATCH (16)
+
+/* the frame buffer of a small display, e.g. 128x64 at 1 bit per pixel */
+#define FRAME_BUFFER_SIZE (1024)
+
+static const char *TAG = "context";
+
+typedef struct {
+	int n_calls;
+	int n_messages;
+	size_t last_n;
+	int32_t last_type;
+	uint8_t frame_buffer[FRAME_BUFFER_SIZE];
+	uint8_t data_register; /* written as the display is */
+} display_t;
+
+static void
+count(void *args, esp_hass_message_t *const *msgs, size_t n)
+{
+	display_t *d = args;
+
+	d->n_calls++;
+	d->n_messages += n;
+	d->last_n = n;
+	d->last_type = msgs[n - 1]->type;
+}
+
+/* draw messages, and transfer the frame buffer to the display once */
+static void
+redraw(void *args, esp_hass_message_t *const *msgs, size_t n)
+{
+	display_t *d = args;
+	volatile uint8_t *data_register = &d->data_register;
+
+	for (size_t i = 0; i < n; i++) {
+		d->frame_buffer[i % FRAME_BUFFER_SIZE] ^=
+		    (uint8_t)msgs[i]->type;
+	}
+	for (int i = 0; i < FRAME_BUFFER_SIZE; i++) {
+		*data_register = d->frame_buffer[i];
+	}
+	d->n_calls++;
+	d->n_messages += n;
+}
+
+TEST_CASE("returns ESP_ERR_INVALID_ARG[esp_hass_batch_init]",
+    "[esp_hass_batch_init]")
+{
+	esp_hass_batch_t batch;
+	esp_hass_batch_config_t config = ESP_HASS_BATCH_CONFIG_DEFAULT();
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_batch_init(&batch, &config, count, NULL));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_batch_init(&batch, &config, NULL, NULL));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_batch_init(&batch, NULL, count, NULL));
+	config.max_messages = 0;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_batch_init(&batch, &config, count, NULL));
+	config.max_messages = ESP_HASS_BATCH_MAX_MESSAGES + 1;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_batch_init(&batch, &config, count, NULL));
+}
+
+TEST_CASE("calls the handler with batches[esp_hass_batch_add]",
+    "[esp_hass_batch_add]")
+{
+	esp_hass_batch_t batch;
+	esp_hass_batch_config_t config = {
+		.event_id = ESP_EVENT_ANY_ID,
+		.max_messages = MAX_MESSAGES,
+		.max_wait_ms = MAX_WAIT_MS,
+	};
+	esp_hass_message_t *msg = NULL;
+	esp_hass_message_t *pong = NULL;
+	display_t d = { 0 };
+	const char *message = recorded_messages[STATE_CHANGED];
+	TickType_t now = 0;
+
+	msg = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	pong = esp_hass_message_scan(recorded_messages[PONG],
+	    strlen(recorded_messages[PONG]), NULL);
+	TEST_ASSERT_NOT_NULL(pong);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_batch_init(&batch, &config, count, &d));
+	TEST_ASSERT_EQUAL(portMAX_DELAY,
+	    esp_hass_batch_ticks_to_wait(&batch, now));
+
+	ESP_LOGI(TAG, "when the batch is full");
+	for (int i = 0; i < MAX_MESSAGES * 2; i++) {
+		esp_hass_batch_add(&batch, i % 2 ? pong : msg,
+		    (i % 2 ? pong : msg)->type, now);
+	}
+	TEST_ASSERT_EQUAL(2, d.n_calls);
+	TEST_ASSERT_EQUAL(MAX_MESSAGES, d.last_n);
+	TEST_ASSERT_EQUAL(HASS_MESSAGE_TYPE_PONG, d.last_type);
+	TEST_ASSERT_EQUAL(0, batch.n);
+
+	ESP_LOGI(TAG, "when the first message has waited");
+	esp_hass_batch_add(&batch, msg, msg->type, now);
+	now += pdMS_TO_TICKS(MAX_WAIT_MS) / 2;
+	esp_hass_batch_add(&batch, msg, msg->type, now);
+	TEST_ASSERT_EQUAL(pdMS_TO_TICKS(MAX_WAIT_MS) / 2,
+	    esp_hass_batch_ticks_to_wait(&batch, now));
+	esp_hass_batch_poll(&batch, now);
+	TEST_ASSERT_EQUAL(2, d.n_calls);
+	now += pdMS_TO_TICKS(MAX_WAIT_MS) / 2;
+	TEST_ASSERT_EQUAL(0, esp_hass_batch_ticks_to_wait(&batch, now));
+	esp_hass_batch_poll(&batch, now);
+	TEST_ASSERT_EQUAL(3, d.n_calls);
+	TEST_ASSERT_EQUAL(2, d.last_n);
+
+	ESP_LOGI(TAG, "when the tick count wraps around");
+	now = (TickType_t)-1;
+	esp_hass_batch_add(&batch, msg, msg->type, now);
+	now += pdMS_TO_TICKS(MAX_WAIT_MS) - 1;
+	TEST_ASSERT_EQUAL(1, esp_hass_batch_ticks_to_wait(&batch, now));
+	esp_hass_batch_flush(&batch);
+	TEST_ASSERT_EQUAL(4, d.n_calls);
+
+	ESP_LOGI(TAG, "when the handler is for an event ID");
+	config.event_id = HASS_MESSAGE_TYPE_PONG;
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_batch_init(&batch, &config, count, &d));
+	esp_hass_batch_add(&batch, msg, msg->type, now);
+	esp_hass_batch_add(&batch, pong, pong->type, now);
+	TEST_ASSERT_EQUAL(1, batch.n);
+	TEST_ASSERT_EQUAL_PTR(pong, batch.msgs[0]);
+
+	ESP_LOGI(TAG, "when pending messages are released");
+	esp_hass_batch_free(&batch);
+	TEST_ASSERT_EQUAL(4, d.n_calls);
+	TEST_ASSERT_EQUAL(0, batch.n);
+	esp_hass_message_release(pong);
+	esp_hass_message_release(msg);
+}
+
+TEST_CASE("compare batch and message time[esp_hass_batch_add]",
+    "[esp_hass_batch_add][benchmark]")
+{
+	esp_hass_batch_t batch;
+	esp_hass_batch_config_t config = ESP_HASS_BATCH_CONFIG_DEFAULT();
+	esp_hass_message_t *msg = NULL;
+	display_t d = { 0 };
+	const char *message = recorded_messages[STATE_CHANGED];
+	int64_t start, message_us, batch_us;
+
+	msg = esp_hass_message_scan(message, strlen(message), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+
+	ESP_LOGI(TAG, "when the display is redrawn for each message");
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_MESSAGES; i++) {
+		redraw(&d, &msg, 1);
+	}
+	message_us = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL(BENCHMARK_MESSAGES, d.n_calls);
+
+	ESP_LOGI(TAG, "when the display is redrawn for each batch");
+	memset(&d, 0, sizeof(d));
+	config.max_messages = BENCHMARK_BATCH;
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_batch_init(&batch, &config, redraw, &d));
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_MESSAGES; i++) {
+		esp_hass_batch_add(&batch, msg, msg->type, 0);
+	}
+	esp_hass_batch_flush(&batch);
+	batch_us = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL(BENCHMARK_MESSAGES, d.n_messages);
+	TEST_ASSERT_EQUAL((BENCHMARK_MESSAGES + BENCHMARK_BATCH - 1) /
+		BENCHMARK_BATCH,
+	    d.n_calls);
+
+	ESP_LOGI(TAG, "each message: %lld us", (long long)message_us);
+	ESP_LOGI(TAG, "batches of %d: %lld us", BENCHMARK_BATCH,
+	    (long long)batch_us);
+	esp_hass_message_release(msg);
+}
@@ -0,0 +1,342 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "parser.h"
+#include "pending.h"
+
+#define CAPACITY (4)
+#define N_TASKS (4)
+#define N_COMMANDS (50)
+#define STACK_SIZE (4096)
+#define BENCHMARK_COMMANDS (CAPACITY * 8)
+
+/* the round trip time to the server */
+#define RTT_MS (2)
+
+static const char *TAG = "context";
+
+/* the server, which sends results of commands in a ring */
+typedef struct {
+	esp_hass_pending_t pending;
+	esp_hass_ring_handle_t commands;
+	SemaphoreHandle_t done;
+	_Atomic int message_id;
+	_Atomic int n_mismatched;
+	int n_results;
+	int n_failed;
+	int last_id;
+} server_t;
+
+static esp_hass_message_t *
+result(int id)
+{
+	char text[128];
+	esp_hass_message_t *msg = NULL;
+
+	snprintf(text, sizeof(text),
+	    "{\"id\":%d,\"type\":\"result\",\"success\":true,\"result\":null}",
+	    id);
+	msg = esp_hass_message_scan(text, strlen(text), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	return msg;
+}
+
+static void
+count_result(void *args, int id, esp_hass_message_t *msg)
+{
+	server_t *server = args;
+
+	server->n_results++;
+	if (!msg->success) {
+		server->n_failed++;
+	}
+	server->last_id = msg->id;
+}
+
+/* receive the commands in flight, and send their results in reverse order
+ * after the round trip time */
+static void
+server_task(void *args)
+{
+	server_t *server = args;
+	void *commands[CAPACITY * N_TASKS];
+	size_t n;
+	int id;
+
+	while (esp_hass_ring_receive_batch(server->commands, commands,
+		   CAPACITY * N_TASKS, &n, portMAX_DELAY) == ESP_OK) {
+		vTaskDelay(pdMS_TO_TICKS(RTT_MS));
+		while (n > 0) {
+			id = (int)(intptr_t)commands[--n];
+			if (id == 0) {
+				xSemaphoreGive(server->done);
+				vTaskDelete(NULL);
+				return;
+			}
+			esp_hass_pending_resolve(&server->pending, result(id));
+		}
+	}
+}
+
+/* send commands, and wait for their results, one at a time */
+static void
+client_task(void *args)
+{
+	server_t *server = args;
+	esp_hass_message_t *msg = NULL;
+	int id;
+
+	for (int i = 0; i < N_COMMANDS; i++) {
+		id = atomic_fetch_add(&server->message_id, 1) + 1;
+		while (esp_hass_pending_add(&server->pending, id, NULL, NULL) !=
+		    ESP_OK) {
+			vTaskDelay(1);
+		}
+		esp_hass_ring_send(server->commands, (void *)(intptr_t)id,
+		    portMAX_DELAY);
+		if (esp_hass_pending_wait(&server->pending, id, &msg,
+			portMAX_DELAY) != ESP_OK ||
+		    msg->id != id) {
+			atomic_fetch_add(&server->n_mismatched, 1);
+		}
+		esp_hass_message_release(msg);
+	}
+	xSemaphoreGive(server->done);
+	vTaskDelete(NULL);
+}
+
+static void
+server_init(server_t *server, size_t capacity)
+{
+	memset(server, 0, sizeof(*server));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_init(&server->pending, capacity));
+	server->commands = esp_hass_ring_create(capacity * N_TASKS + 1);
+	TEST_ASSERT_NOT_NULL(server->commands);
+	server->done = xSemaphoreCreateCounting(N_TASKS + 1, 0);
+	TEST_ASSERT_NOT_NULL(server->done);
+}
+
+static void
+server_start(server_t *server)
+{
+	TEST_ASSERT_EQUAL(pdPASS,
+	    xTaskCreate(server_task, "server_task", STACK_SIZE, server, 5,
+		NULL));
+}
+
+static void
+server_free(server_t *server)
+{
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_ring_send(server->commands, NULL, portMAX_DELAY));
+	TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(server->done, portMAX_DELAY));
+	vSemaphoreDelete(server->done);
+	esp_hass_ring_delete(server->commands);
+	esp_hass_pending_free(&server->pending);
+}
+
+TEST_CASE("routes results by ID[esp_hass_pending_resolve]",
+    "[esp_hass_pending_resolve]")
+{
+	server_t server;
+	esp_hass_message_t *msg = NULL;
+	esp_hass_message_t *unknown = NULL;
+
+	memset(&server, 0, sizeof(server));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_pending_init(&server.pending, 0));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_init(&server.pending, CAPACITY));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_pending_add(&server.pending, 0, NULL, NULL));
+
+	ESP_LOGI(TAG, "when the command has a callback");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_add(&server.pending, 1, count_result, &server));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+	    esp_hass_pending_wait(&server.pending, 1, &msg, 0));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_resolve(&server.pending, result(1)));
+	TEST_ASSERT_EQUAL(1, server.n_results);
+	TEST_ASSERT_EQUAL(1, server.last_id);
+
+	ESP_LOGI(TAG, "when results arrive out of order");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_add(&server.pending, 2, NULL, NULL));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_add(&server.pending, 3, NULL, NULL));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_resolve(&server.pending, result(3)));
+	TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT,
+	    esp_hass_pending_wait(&server.pending, 2, &msg, 0));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_wait(&server.pending, 3, &msg, 0));
+	TEST_ASSERT_EQUAL(3, msg->id);
+	esp_hass_message_release(msg);
+
+	ESP_LOGI(TAG, "when the command has been removed");
+	unknown = result(2);
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_pending_resolve(&server.pending, unknown));
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_pending_wait(&server.pending, 2, &msg, 0));
+	esp_hass_message_release(unknown);
+
+	ESP_LOGI(TAG, "when the table is full");
+	for (int i = 0; i < CAPACITY; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_pending_add(&server.pending, 10 + i, NULL, NULL));
+	}
+	TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM,
+	    esp_hass_pending_add(&server.pending, 20, NULL, NULL));
+
+	ESP_LOGI(TAG, "when commands are cancelled");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_pending_cancel(&server.pending, 10));
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_pending_cancel(&server.pending, 10));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_resolve(&server.pending, result(11)));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_pending_cancel(&server.pending, 11));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_add(&server.pending, 20, NULL, NULL));
+
+	ESP_LOGI(TAG, "when results have not been waited for");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_resolve(&server.pending, result(12)));
+	esp_hass_pending_free(&server.pending);
+}
+
+TEST_CASE("fails commands in flight[esp_hass_pending_fail_all]",
+    "[esp_hass_pending_fail_all]")
+{
+	server_t server;
+	esp_hass_message_t *msg = NULL;
+	esp_hass_command_result_t r;
+
+	memset(&server, 0, sizeof(server));
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_init(&server.pending, CAPACITY));
+
+	ESP_LOGI(TAG, "when the connection is closed with callbacks in flight");
+	for (int i = 1; i <= CAPACITY; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_pending_add(&server.pending, i, count_result,
+			&server));
+	}
+	TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM,
+	    esp_hass_pending_add(&server.pending, CAPACITY + 1, NULL, NULL));
+	esp_hass_pending_fail_all(&server.pending);
+	TEST_ASSERT_EQUAL(CAPACITY, server.n_results);
+	TEST_ASSERT_EQUAL(CAPACITY, server.n_failed);
+
+	ESP_LOGI(TAG, "when commands are added again, and waited for");
+	for (int i = 1; i <= CAPACITY; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_pending_add(&server.pending, CAPACITY + i, NULL,
+			NULL));
+	}
+	esp_hass_pending_fail_all(&server.pending);
+	for (int i = 1; i <= CAPACITY; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_pending_wait(&server.pending, CAPACITY + i, &msg,
+			0));
+		esp_hass_command_result_set(&r, msg);
+		TEST_ASSERT_EQUAL(ESP_FAIL, r.err);
+		TEST_ASSERT_EQUAL_STRING("Failed to send the command.",
+		    r.error_message);
+		esp_hass_message_release(msg);
+	}
+
+	ESP_LOGI(TAG, "when the command is not in the table");
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND,
+	    esp_hass_pending_fail(&server.pending, 1));
+	esp_hass_pending_fail_all(&server.pending);
+	TEST_ASSERT_EQUAL(CAPACITY, server.n_results);
+	esp_hass_pending_free(&server.pending);
+}
+
+TEST_CASE("never passes results of others[esp_hass_pending_wait]",
+    "[esp_hass_pending_wait]")
+{
+	server_t server;
+
+	server_init(&server, CAPACITY);
+	server_start(&server);
+	for (int i = 0; i < N_TASKS; i++) {
+		TEST_ASSERT_EQUAL(pdPASS,
+		    xTaskCreate(client_task, "client_task", STACK_SIZE,
+			&server, 5, NULL));
+	}
+	for (int i = 0; i < N_TASKS; i++) {
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xSemaphoreTake(server.done, pdMS_TO_TICKS(10000)));
+	}
+	TEST_ASSERT_EQUAL(0, server.n_mismatched);
+	TEST_ASSERT_EQUAL(N_TASKS * N_COMMANDS, server.message_id);
+	server_free(&server);
+}
+
+TEST_CASE("compare commands in flight time[esp_hass_pending_wait]",
+    "[esp_hass_pending_wait][benchmark]")
+{
+	server_t server;
+	esp_hass_message_t *msg = NULL;
+	int ids[CAPACITY];
+	int64_t start, one_us, in_flight_us;
+
+	server_init(&server, CAPACITY);
+	server_start(&server);
+
+	ESP_LOGI(TAG, "when one command is in flight");
+	start = esp_timer_get_time();
+	for (int i = 1; i <= BENCHMARK_COMMANDS; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_pending_add(&server.pending, i, NULL, NULL));
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_ring_send(server.commands, (void *)(intptr_t)i,
+			portMAX_DELAY));
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_pending_wait(&server.pending, i, &msg,
+			portMAX_DELAY));
+		esp_hass_message_release(msg);
+	}
+	one_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "when %d commands are in flight", CAPACITY);
+	start = esp_timer_get_time();
+	for (int i = 1; i <= BENCHMARK_COMMANDS; i += CAPACITY) {
+		for (int j = 0; j < CAPACITY; j++) {
+			ids[j] = BENCHMARK_COMMANDS + i + j;
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_pending_add(&server.pending, ids[j], NULL,
+				NULL));
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_ring_send(server.commands,
+				(void *)(intptr_t)ids[j], portMAX_DELAY));
+		}
+		for (int j = 0; j < CAPACITY; j++) {
+			TEST_ASSERT_EQUAL(ESP_OK,
+			    esp_hass_pending_wait(&server.pending, ids[j], &msg,
+				portMAX_DELAY));
+			TEST_ASSERT_EQUAL(ids[j], msg->id);
+			esp_hass_message_release(msg);
+		}
+	}
+	in_flight_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "one in flight: %lld us", (long long)one_us);
+	ESP_LOGI(TAG, "%d in flight: %lld us", CAPACITY,
+	    (long long)in_flight_us);
+	server_free(&server);
+}
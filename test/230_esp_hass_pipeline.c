@@ -0,0 +1,258 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "parser.h"
+#include "pending.h"
+
+#define CAPACITY (4)
+#define N_COMMANDS (10)
+#define STACK_SIZE (4096)
+#define BENCHMARK_COMMANDS (16)
+
+/* the command that fails to be sent */
+#define UNSENT (5)
+
+/* the server returns failure for IDs that are multiples of this */
+#define FAILING_ID (3)
+
+/* the round trip time to the server */
+#define RTT_MS (2)
+
+static const char *TAG = "context";
+
+/* the server, which sends results of commands in a ring */
+typedef struct {
+	esp_hass_pending_t pending;
+	esp_hass_ring_handle_t commands;
+	SemaphoreHandle_t done;
+	int message_id;
+	int unsent;
+} server_t;
+
+static esp_hass_message_t *
+result(int id)
+{
+	char text[192];
+	esp_hass_message_t *msg = NULL;
+
+	if (id % FAILING_ID == 0) {
+		snprintf(text, sizeof(text),
+		    "{\"id\":%d,\"type\":\"result\",\"success\":false,"
+		    "\"error\":{\"code\":\"not_found\","
+		    "\"message\":\"Service %d not found.\"}}",
+		    id, id);
+	} else {
+		snprintf(text, sizeof(text),
+		    "{\"id\":%d,\"type\":\"result\",\"success\":true,"
+		    "\"result\":null}",
+		    id);
+	}
+	msg = esp_hass_message_scan(text, strlen(text), NULL);
+	TEST_ASSERT_NOT_NULL(msg);
+	return msg;
+}
+
+/* receive the commands in flight, and send their results after the round
+ * trip time */
+static void
+server_task(void *args)
+{
+	server_t *server = args;
+	void *commands[BENCHMARK_COMMANDS];
+	size_t n;
+	int id;
+
+	while (esp_hass_ring_receive_batch(server->commands, commands,
+		   BENCHMARK_COMMANDS, &n, portMAX_DELAY) == ESP_OK) {
+		vTaskDelay(pdMS_TO_TICKS(RTT_MS));
+		for (size_t i = 0; i < n; i++) {
+			id = (int)(intptr_t)commands[i];
+			if (id == 0) {
+				xSemaphoreGive(server->done);
+				vTaskDelete(NULL);
+				return;
+			}
+			esp_hass_pending_resolve(&server->pending, result(id));
+		}
+	}
+}
+
+/* send a command, as esp_hass_call_service_async() does */
+static esp_err_t
+send(void *context, size_t i, int *id)
+{
+	server_t *server = context;
+	esp_err_t err;
+
+	if ((int)i == server->unsent) {
+		return ESP_FAIL;
+	}
+	err = esp_hass_pending_add(&server->pending, server->message_id + 1,
+	    NULL, NULL);
+	if (err != ESP_OK) {
+		return err;
+	}
+	*id = ++server->message_id;
+	return esp_hass_ring_send(server->commands, (void *)(intptr_t)*id,
+	    portMAX_DELAY);
+}
+
+static void
+server_init(server_t *server, size_t capacity)
+{
+	memset(server, 0, sizeof(*server));
+	server->unsent = -1;
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_init(&server->pending, capacity));
+	server->commands = esp_hass_ring_create(BENCHMARK_COMMANDS + 1);
+	TEST_ASSERT_NOT_NULL(server->commands);
+	server->done = xSemaphoreCreateBinary();
+	TEST_ASSERT_NOT_NULL(server->done);
+	TEST_ASSERT_EQUAL(pdPASS,
+	    xTaskCreate(server_task, "server_task", STACK_SIZE, server, 5,
+		NULL));
+}
+
+static void
+server_free(server_t *server)
+{
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_ring_send(server->commands, NULL, portMAX_DELAY));
+	TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(server->done, portMAX_DELAY));
+	vSemaphoreDelete(server->done);
+	esp_hass_ring_delete(server->commands);
+	esp_hass_pending_free(&server->pending);
+}
+
+/* the time to complete commands in a pipeline on a table of `capacity` */
+static int64_t
+pipeline(size_t capacity)
+{
+	server_t server;
+	esp_hass_command_result_t results[BENCHMARK_COMMANDS];
+	int64_t start, elapsed_us;
+
+	server_init(&server, capacity);
+	start = esp_timer_get_time();
+	esp_hass_pending_pipeline(&server.pending, BENCHMARK_COMMANDS, send,
+	    &server, results, portMAX_DELAY);
+	elapsed_us = esp_timer_get_time() - start;
+	for (int i = 0; i < BENCHMARK_COMMANDS; i++) {
+		TEST_ASSERT_EQUAL(i + 1, results[i].id);
+		TEST_ASSERT_EQUAL(
+		    results[i].id % FAILING_ID ? ESP_OK : ESP_FAIL,
+		    results[i].err);
+	}
+	server_free(&server);
+	return elapsed_us;
+}
+
+TEST_CASE("sets the outcome from the result[esp_hass_command_result_set]",
+    "[esp_hass_command_result_set]")
+{
+	esp_hass_command_result_t r;
+	esp_hass_message_t *msg = NULL;
+
+	ESP_LOGI(TAG, "when the result is successful");
+	msg = result(1);
+	esp_hass_command_result_set(&r, msg);
+	TEST_ASSERT_EQUAL(ESP_OK, r.err);
+	TEST_ASSERT_EQUAL_STRING("", r.error_message);
+	esp_hass_message_release(msg);
+
+	ESP_LOGI(TAG, "when the server has returned failure");
+	msg = result(FAILING_ID);
+	esp_hass_command_result_set(&r, msg);
+	TEST_ASSERT_EQUAL(ESP_FAIL, r.err);
+	TEST_ASSERT_EQUAL_STRING("Service 3 not found.", r.error_message);
+	esp_hass_message_release(msg);
+}
+
+TEST_CASE("reports the outcome of each command[esp_hass_pending_pipeline]",
+    "[esp_hass_pending_pipeline]")
+{
+	server_t server;
+	esp_hass_command_result_t results[N_COMMANDS];
+	char expected[ESP_HASS_ERROR_MESSAGE_MAX_LEN];
+
+	server_init(&server, CAPACITY);
+
+	ESP_LOGI(TAG, "when there are more commands than the table");
+	server.unsent = UNSENT;
+	TEST_ASSERT_EQUAL(ESP_FAIL,
+	    esp_hass_pending_pipeline(&server.pending, N_COMMANDS, send,
+		&server, results, portMAX_DELAY));
+	TEST_ASSERT_EQUAL(N_COMMANDS - 1, server.message_id);
+	for (int i = 0; i < N_COMMANDS; i++) {
+		if (i == UNSENT) {
+			TEST_ASSERT_EQUAL(0, results[i].id);
+			TEST_ASSERT_EQUAL(ESP_FAIL, results[i].err);
+			TEST_ASSERT_EQUAL_STRING("", results[i].error_message);
+		} else if (results[i].id % FAILING_ID == 0) {
+			snprintf(expected, sizeof(expected),
+			    "Service %d not found.", results[i].id);
+			TEST_ASSERT_EQUAL(ESP_FAIL, results[i].err);
+			TEST_ASSERT_EQUAL_STRING(expected,
+			    results[i].error_message);
+		} else {
+			TEST_ASSERT_EQUAL(ESP_OK, results[i].err);
+		}
+	}
+
+	ESP_LOGI(TAG, "when the table is nearly full of other commands");
+	server.unsent = -1;
+	server.message_id = 102;
+	for (int i = 0; i < CAPACITY - 1; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_pending_add(&server.pending, 200 + i, NULL, NULL));
+	}
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_pipeline(&server.pending, 2, send, &server,
+		results, portMAX_DELAY));
+	TEST_ASSERT_EQUAL(103, results[0].id);
+	TEST_ASSERT_EQUAL(104, results[1].id);
+
+	ESP_LOGI(TAG, "when the table is full of other commands");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_add(&server.pending, 200 + CAPACITY - 1, NULL,
+		NULL));
+	TEST_ASSERT_EQUAL(ESP_FAIL,
+	    esp_hass_pending_pipeline(&server.pending, 1, send, &server,
+		results, portMAX_DELAY));
+	TEST_ASSERT_EQUAL(0, results[0].id);
+	TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, results[0].err);
+	for (int i = 0; i < CAPACITY; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_pending_cancel(&server.pending, 200 + i));
+	}
+
+	ESP_LOGI(TAG, "when there are no commands");
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_pending_pipeline(&server.pending, 0, send, &server,
+		results, portMAX_DELAY));
+	server_free(&server);
+}
+
+TEST_CASE("compare pipelined command time[esp_hass_pending_pipeline]",
+    "[esp_hass_pending_pipeline][benchmark]")
+{
+	int64_t one_us, pipelined_us;
+
+	ESP_LOGI(TAG, "when one command is in flight");
+	one_us = pipeline(1);
+
+	ESP_LOGI(TAG, "when %d commands are in flight", BENCHMARK_COMMANDS);
+	pipelined_us = pipeline(BENCHMARK_COMMANDS);
+
+	ESP_LOGI(TAG, "one in flight: %lld us", (long long)one_us);
+	ESP_LOGI(TAG, "pipelined: %lld us", (long long)pipelined_us);
+}
@@ -0,0 +1,214 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "writer.h"
+
+#define BUFFER_SIZE (256)
+#define BENCHMARK_COMMANDS (1000)
+
+static const char *TAG = "context";
+
+/* a call_service command as esp_hass_call_service() used to create */
+static char *
+print_call_service(int id, const esp_hass_call_service_config_t *config)
+{
+	cJSON *json = NULL;
+	cJSON *target = NULL;
+	char *text = NULL;
+
+	json = cJSON_CreateObject();
+	TEST_ASSERT_NOT_NULL(json);
+	cJSON_AddStringToObject(json, "type", "call_service");
+	cJSON_AddStringToObject(json, "domain", config->domain);
+	cJSON_AddStringToObject(json, "service", config->service);
+	target = cJSON_CreateObject();
+	TEST_ASSERT_NOT_NULL(target);
+	cJSON_AddStringToObject(target, "entity_id", config->entity_id);
+	cJSON_AddItemToObject(json, "target", target);
+	cJSON_AddNumberToObject(json, "id", id);
+	text = cJSON_Print(json);
+	cJSON_Delete(json);
+	TEST_ASSERT_NOT_NULL(text);
+	return text;
+}
+
+TEST_CASE("escapes strings[esp_hass_writer_string]",
+    "[esp_hass_writer_string]")
+{
+	esp_hass_writer_t w;
+	char buf[BUFFER_SIZE];
+
+	esp_hass_writer_init(&w, buf, sizeof(buf));
+
+	ESP_LOGI(TAG, "when the string needs no escape");
+	esp_hass_writer_string(&w, "light.kitchen");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_writer_finish(&w));
+	TEST_ASSERT_EQUAL_STRING("\"light.kitchen\"", buf);
+
+	ESP_LOGI(TAG, "when the string has quotes, and backslashes");
+	esp_hass_writer_reset(&w);
+	esp_hass_writer_string(&w, "a\"b\\c");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_writer_finish(&w));
+	TEST_ASSERT_EQUAL_STRING("\"a\\\"b\\\\c\"", buf);
+
+	ESP_LOGI(TAG, "when the string has control characters");
+	esp_hass_writer_reset(&w);
+	esp_hass_writer_string(&w, "\b\f\n\r\t\x01\x1f");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_writer_finish(&w));
+	TEST_ASSERT_EQUAL_STRING("\"\\b\\f\\n\\r\\t\\u0001\\u001f\"", buf);
+
+	ESP_LOGI(TAG, "when the string has UTF-8");
+	esp_hass_writer_reset(&w);
+	esp_hass_writer_string(&w, "K\xc3\xbc"
+				   "che");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_writer_finish(&w));
+	TEST_ASSERT_EQUAL_STRING("\"K\xc3\xbc"
+				 "che\"",
+	    buf);
+
+	ESP_LOGI(TAG, "when integers are written");
+	esp_hass_writer_reset(&w);
+	esp_hass_writer_int(&w, 0);
+	esp_hass_writer_raw(&w, ",", 1);
+	esp_hass_writer_int(&w, -42);
+	esp_hass_writer_raw(&w, ",", 1);
+	esp_hass_writer_int(&w, INT_MIN);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_writer_finish(&w));
+	TEST_ASSERT_EQUAL_STRING("0,-42,-2147483648", buf);
+}
+
+TEST_CASE("writes compact commands[esp_hass_write_call_service]",
+    "[esp_hass_write_call_service]")
+{
+	esp_hass_writer_t w;
+	char buf[BUFFER_SIZE];
+	esp_hass_call_service_config_t config =
+	    ESP_HASS_CALL_SERVICE_CONFIG_DEFAULT();
+
+	esp_hass_writer_init(&w, buf, sizeof(buf));
+	config.domain = "light";
+	config.service = "turn_on";
+	config.entity_id = "light.kitchen";
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_auth(&w, "t\"k"));
+	TEST_ASSERT_EQUAL_STRING(
+	    "{\"type\":\"auth\",\"access_token\":\"t\\\"k\"}", buf);
+	TEST_ASSERT_EQUAL(strlen(buf), w.len);
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_write_subscribe_events(&w, 1, "state_changed"));
+	TEST_ASSERT_EQUAL_STRING("{\"id\":1,\"type\":\"subscribe_events\","
+				 "\"event_type\":\"state_changed\"}",
+	    buf);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_subscribe_events(&w, 2, NULL));
+	TEST_ASSERT_EQUAL_STRING("{\"id\":2,\"type\":\"subscribe_events\"}",
+	    buf);
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_unsubscribe_events(&w, 3, 1));
+	TEST_ASSERT_EQUAL_STRING(
+	    "{\"id\":3,\"type\":\"unsubscribe_events\",\"subscription\":1}",
+	    buf);
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_call_service(&w, 4, &config));
+	TEST_ASSERT_EQUAL_STRING("{\"id\":4,\"type\":\"call_service\","
+				 "\"domain\":\"light\",\"service\":\"turn_on\","
+				 "\"target\":{\"entity_id\":\"light.kitchen\"}}",
+	    buf);
+	config.entity_id = NULL;
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_call_service(&w, 5, &config));
+	TEST_ASSERT_EQUAL_STRING("{\"id\":5,\"type\":\"call_service\","
+				 "\"domain\":\"light\",\"service\":\"turn_on\"}",
+	    buf);
+
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_write_fire_event(&w, 6, "button", "{\"button\":1}"));
+	TEST_ASSERT_EQUAL_STRING("{\"id\":6,\"type\":\"fire_event\","
+				 "\"event_type\":\"button\","
+				 "\"event_data\":{\"button\":1}}",
+	    buf);
+	TEST_ASSERT_EQUAL(ESP_OK,
+	    esp_hass_write_fire_event(&w, 7, "button", NULL));
+	TEST_ASSERT_EQUAL_STRING(
+	    "{\"id\":7,\"type\":\"fire_event\",\"event_type\":\"button\"}",
+	    buf);
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_ping(&w, 8));
+	TEST_ASSERT_EQUAL_STRING("{\"id\":8,\"type\":\"ping\"}", buf);
+
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_supported_features(&w, 9));
+	TEST_ASSERT_EQUAL_STRING("{\"id\":9,\"type\":\"supported_features\","
+				 "\"features\":{\"coalesce_messages\":1}}",
+	    buf);
+}
+
+TEST_CASE("returns ESP_ERR_INVALID_SIZE[esp_hass_writer_finish]",
+    "[esp_hass_writer_finish]")
+{
+	esp_hass_writer_t w;
+	char buf[BUFFER_SIZE];
+	const char *ping = "{\"id\":8,\"type\":\"ping\"}";
+
+	ESP_LOGI(TAG, "when the command fits with the terminating null");
+	esp_hass_writer_init(&w, buf, strlen(ping) + 1);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_ping(&w, 8));
+	TEST_ASSERT_EQUAL_STRING(ping, buf);
+
+	ESP_LOGI(TAG, "when the command does not fit");
+	esp_hass_writer_init(&w, buf, strlen(ping));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_hass_write_ping(&w, 8));
+	TEST_ASSERT_EQUAL_STRING("", buf);
+
+	ESP_LOGI(TAG, "when the writer is reused");
+	esp_hass_writer_init(&w, buf, sizeof(buf));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_ping(&w, 8));
+	TEST_ASSERT_EQUAL_STRING(ping, buf);
+}
+
+TEST_CASE("compare writer and cJSON time[esp_hass_write_call_service]",
+    "[esp_hass_write_call_service][benchmark]")
+{
+	esp_hass_writer_t w;
+	char buf[BUFFER_SIZE];
+	esp_hass_call_service_config_t config =
+	    ESP_HASS_CALL_SERVICE_CONFIG_DEFAULT();
+	char *text = NULL;
+	size_t cjson_bytes = 0;
+	size_t writer_bytes = 0;
+	int64_t start, cjson_us, writer_us;
+
+	config.domain = "light";
+	config.service = "turn_on";
+	config.entity_id = "light.kitchen";
+	esp_hass_writer_init(&w, buf, sizeof(buf));
+
+	ESP_LOGI(TAG, "when a cJSON tree is built, and printed");
+	start = esp_timer_get_time();
+	for (int i = 1; i <= BENCHMARK_COMMANDS; i++) {
+		text = print_call_service(i, &config);
+		cjson_bytes += strlen(text);
+		free(text);
+	}
+	cjson_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "when the command is written into the buffer");
+	start = esp_timer_get_time();
+	for (int i = 1; i <= BENCHMARK_COMMANDS; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_write_call_service(&w, i, &config));
+		writer_bytes += w.len;
+	}
+	writer_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "cJSON: %lld us, %u bytes", (long long)cjson_us,
+	    (unsigned)cjson_bytes);
+	ESP_LOGI(TAG, "writer: %lld us, %u bytes", (long long)writer_us,
+	    (unsigned)writer_bytes);
+	TEST_ASSERT_LESS_OR_EQUAL(cjson_bytes, writer_bytes);
+}
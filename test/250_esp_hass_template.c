@@ -0,0 +1,145 @@
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <limits.h>
+#include <string.h>
+#include <unity.h>
+
+#include "writer.h"
+
+#define BUFFER_SIZE (256)
+#define BENCHMARK_COMMANDS (10000)
+
+static const char *TAG = "context";
+
+static void
+config_init(esp_hass_call_service_config_t *config)
+{
+	config->domain = "light";
+	config->service = "toggle";
+	config->entity_id = "light.kitchen";
+}
+
+TEST_CASE("writes the command with the ID[esp_hass_template_write]",
+    "[esp_hass_template_write]")
+{
+	esp_hass_writer_t w;
+	esp_hass_writer_t prepared;
+	esp_hass_template_t t;
+	char buf[BUFFER_SIZE];
+	char prepared_buf[BUFFER_SIZE];
+	esp_hass_call_service_config_t config =
+	    ESP_HASS_CALL_SERVICE_CONFIG_DEFAULT();
+	const int ids[] = { 1, 10, 12345, INT_MAX };
+
+	config_init(&config);
+	esp_hass_writer_init(&w, buf, sizeof(buf));
+	esp_hass_writer_init(&prepared, prepared_buf, sizeof(prepared_buf));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_call_service(&w, 0, &config));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_template_init(&t, &w));
+
+	for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+		ESP_LOGI(TAG, "when the ID is %d", ids[i]);
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_template_write(&t, &prepared, ids[i]));
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_write_call_service(&w, ids[i], &config));
+		TEST_ASSERT_EQUAL(w.len, prepared.len);
+		TEST_ASSERT_EQUAL_STRING(buf, prepared_buf);
+	}
+
+	ESP_LOGI(TAG, "when the command does not fit");
+	esp_hass_writer_init(&prepared, prepared_buf, t.body_len);
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+	    esp_hass_template_write(&t, &prepared, 1));
+	esp_hass_template_free(&t);
+	TEST_ASSERT_NULL(t.body);
+}
+
+TEST_CASE("returns ESP_ERR_INVALID_ARG[esp_hass_template_init]",
+    "[esp_hass_template_init]")
+{
+	esp_hass_writer_t w;
+	esp_hass_template_t t;
+	char buf[BUFFER_SIZE];
+
+	ESP_LOGI(TAG, "when the message has no ID");
+	esp_hass_writer_init(&w, buf, sizeof(buf));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_auth(&w, "token"));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_hass_template_init(&t, &w));
+
+	ESP_LOGI(TAG, "when the command has not fit in the buffer");
+	esp_hass_writer_init(&w, buf, 8);
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_hass_write_ping(&w, 1));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_hass_template_init(&t, &w));
+}
+
+TEST_CASE("returns ESP_ERR_INVALID_SIZE[esp_hass_template_init]",
+    "[esp_hass_template_init]")
+{
+	esp_hass_writer_t w;
+	esp_hass_template_t t;
+	char buf[BUFFER_SIZE];
+	esp_hass_call_service_config_t config =
+	    ESP_HASS_CALL_SERVICE_CONFIG_DEFAULT();
+	size_t len;
+
+	config_init(&config);
+	esp_hass_writer_init(&w, buf, sizeof(buf));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_call_service(&w, 0, &config));
+	len = w.len;
+
+	ESP_LOGI(TAG, "when the command fits only with a short ID");
+	esp_hass_writer_init(&w, buf, len + 1);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_call_service(&w, 0, &config));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_hass_template_init(&t, &w));
+	TEST_ASSERT_NULL(t.body);
+
+	ESP_LOGI(TAG, "when the command fits with any ID");
+	esp_hass_writer_init(&w, buf, len + ESP_HASS_WRITER_INT_MAX_LEN);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_call_service(&w, 0, &config));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_template_init(&t, &w));
+	esp_hass_writer_init(&w, buf, len + ESP_HASS_WRITER_INT_MAX_LEN);
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_template_write(&t, &w, INT_MIN));
+	esp_hass_template_free(&t);
+}
+
+TEST_CASE("compare prepared and written command time[esp_hass_template_write]",
+    "[esp_hass_template_write][benchmark]")
+{
+	esp_hass_writer_t w;
+	esp_hass_template_t t;
+	char buf[BUFFER_SIZE];
+	esp_hass_call_service_config_t config =
+	    ESP_HASS_CALL_SERVICE_CONFIG_DEFAULT();
+	volatile size_t sent = 0;
+	int64_t start, write_us, prepared_us;
+
+	config_init(&config);
+	esp_hass_writer_init(&w, buf, sizeof(buf));
+
+	ESP_LOGI(TAG, "when the command is written on each click");
+	start = esp_timer_get_time();
+	for (int i = 1; i <= BENCHMARK_COMMANDS; i++) {
+		esp_hass_write_call_service(&w, i, &config);
+		sent += w.len;
+	}
+	write_us = esp_timer_get_time() - start;
+
+	ESP_LOGI(TAG, "when a prepared command is written");
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_call_service(&w, 0, &config));
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_template_init(&t, &w));
+	start = esp_timer_get_time();
+	for (int i = 1; i <= BENCHMARK_COMMANDS; i++) {
+		esp_hass_template_write(&t, &w, i);
+		sent += w.len;
+	}
+	prepared_us = esp_timer_get_time() - start;
+	esp_hass_template_free(&t);
+
+	ESP_LOGI(TAG, "written: %lld ns per command",
+	    (long long)(write_us * 1000 / BENCHMARK_COMMANDS));
+	ESP_LOGI(TAG, "prepared: %lld ns per command",
+	    (long long)(prepared_us * 1000 / BENCHMARK_COMMANDS));
+}
@@ -0,0 +1,296 @@
+#include <cJSON.h>
+#include <esp_err.h>
+#include <esp_hass.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "tx.h"
+#include "writer.h"
+
+#define N_FRAMES (4)
+#define N_TASKS (4)
+#define N_MESSAGES (50)
+#define STACK_SIZE (4096)
+#define BENCHMARK_MESSAGES (32)
+
+/* the time to write to the socket, once for each call of send */
+#define SEND_MS (1)
+
+static const char *TAG = "context";
+
+/* the server, which receives the frames that the writer sends */
+typedef struct {
+	esp_hass_tx_t tx;
+	SemaphoreHandle_t lock;
+	SemaphoreHandle_t done;
+	_Atomic int message_id;
+	_Atomic int n_out_of_order;
+	_Atomic int n_corrupted;
+	int last_id;
+	int n_received;
+	bool delay;
+} server_t;
+
+/* receive frames. the writer does not assert, as it is not the task of the
+ * test */
+static void
+receive(void *context, esp_hass_tx_frame_t *const *frames, size_t n)
+{
+	server_t *server = context;
+	char expected[64];
+	const char *text = NULL;
+
+	for (size_t i = 0; i < n; i++) {
+		if (frames[i]->id <= server->last_id) {
+			atomic_fetch_add(&server->n_out_of_order, 1);
+		}
+		server->last_id = frames[i]->id;
+		snprintf(expected, sizeof(expected),
+		    "{\"id\":%d,\"type\":\"ping\"}", frames[i]->id);
+		text = frames[i]->heap_text != NULL ? frames[i]->heap_text :
+						      frames[i]->text;
+		if (strcmp(expected, text) != 0 ||
+		    frames[i]->w.len != strlen(expected)) {
+			atomic_fetch_add(&server->n_corrupted, 1);
+		}
+		server->n_received++;
+	}
+	if (server->delay) {
+		vTaskDelay(pdMS_TO_TICKS(SEND_MS));
+	}
+}
+
+/* write a ping with the next ID into a frame, and queue it */
+static esp_err_t
+queue_ping(server_t *server)
+{
+	esp_hass_tx_frame_t *frame = NULL;
+	esp_err_t err;
+
+	frame = esp_hass_tx_begin(&server->tx, portMAX_DELAY);
+	if (frame == NULL) {
+		return ESP_ERR_TIMEOUT;
+	}
+	frame->id = atomic_fetch_add(&server->message_id, 1) + 1;
+	err = esp_hass_write_ping(&frame->w, frame->id);
+	if (err != ESP_OK) {
+		esp_hass_tx_abort(&server->tx, frame);
+		return err;
+	}
+	esp_hass_tx_commit(&server->tx, frame);
+	return ESP_OK;
+}
+
+static void
+client_task(void *args)
+{
+	server_t *server = args;
+
+	for (int i = 0; i < N_MESSAGES; i++) {
+		if (queue_ping(server) != ESP_OK) {
+			atomic_fetch_add(&server->n_corrupted, 1);
+		}
+	}
+	xSemaphoreGive(server->done);
+	vTaskDelete(NULL);
+}
+
+static void
+server_init(server_t *server, size_t n_frames, bool delay)
+{
+	esp_hass_tx_config_t config = {
+		.n_frames = n_frames,
+		.stack_size = STACK_SIZE,
+		.priority = 5,
+		.send = receive,
+	};
+
+	memset(server, 0, sizeof(*server));
+	server->delay = delay;
+	server->lock = xSemaphoreCreateMutex();
+	TEST_ASSERT_NOT_NULL(server->lock);
+	server->done = xSemaphoreCreateCounting(N_TASKS, 0);
+	TEST_ASSERT_NOT_NULL(server->done);
+	config.context = server;
+	TEST_ASSERT_EQUAL(ESP_OK, esp_hass_tx_init(&server->tx, &config));
+}
+
+static void
+server_free(server_t *server)
+{
+	esp_hass_tx_free(&server->tx);
+	vSemaphoreDelete(server->done);
+	vSemaphoreDelete(server->lock);
+}
+
+TEST_CASE("returns ESP_ERR_INVALID_ARG[esp_hass_tx_init]",
+    "[esp_hass_tx_init]")
+{
+	esp_hass_tx_t tx;
+	esp_hass_tx_config_t config = {
+		.n_frames = 0,
+		.stack_size = STACK_SIZE,
+		.priority = 5,
+		.send = receive,
+	};
+
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_hass_tx_init(&tx, &config));
+	config.n_frames = ESP_HASS_TX_FRAMES_MAX + 1;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_hass_tx_init(&tx, &config));
+	config.n_frames = 1;
+	config.send = NULL;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_hass_tx_init(&tx, &config));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_hass_tx_init(&tx, NULL));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_hass_tx_init(NULL, &config));
+}
+
+TEST_CASE("sends frames in the order of IDs[esp_hass_tx_commit]",
+    "[esp_hass_tx_commit]")
+{
+	server_t server;
+
+	server_init(&server, N_FRAMES, true);
+	for (int i = 0; i < N_TASKS; i++) {
+		TEST_ASSERT_EQUAL(pdPASS,
+		    xTaskCreate(client_task, "client_task", STACK_SIZE,
+			&server, 5, NULL));
+	}
+	for (int i = 0; i < N_TASKS; i++) {
+		TEST_ASSERT_EQUAL(pdTRUE,
+		    xSemaphoreTake(server.done, pdMS_TO_TICKS(10000)));
+	}
+
+	ESP_LOGI(TAG, "when the pipeline is freed with queued frames");
+	server_free(&server);
+	TEST_ASSERT_EQUAL(N_TASKS * N_MESSAGES, server.n_received);
+	TEST_ASSERT_EQUAL(N_TASKS * N_MESSAGES, server.last_id);
+	TEST_ASSERT_EQUAL(0, server.n_out_of_order);
+	TEST_ASSERT_EQUAL(0, server.n_corrupted);
+	TEST_ASSERT_EQUAL(N_TASKS * N_MESSAGES, server.tx.n_sent);
+
+	/* the frames queued while the writer is sending are sent together */
+	ESP_LOGI(TAG, "%u frames in %u calls", (unsigned)server.tx.n_sent,
+	    (unsigned)server.tx.n_batches);
+	TEST_ASSERT_LESS_THAN(server.tx.n_sent, server.tx.n_batches);
+}
+
+TEST_CASE("returns frames without sending[esp_hass_tx_abort]",
+    "[esp_hass_tx_abort]")
+{
+	server_t server;
+	esp_hass_tx_frame_t *frame = NULL;
+
+	server_init(&server, N_FRAMES, false);
+
+	ESP_LOGI(TAG, "when written frames are aborted");
+	for (int i = 0; i < N_FRAMES * 2; i++) {
+		frame = esp_hass_tx_begin(&server.tx, 0);
+		TEST_ASSERT_NOT_NULL(frame);
+		TEST_ASSERT_EQUAL(0, frame->id);
+		TEST_ASSERT_EQUAL(0, frame->w.len);
+		frame->id = 100 + i;
+		TEST_ASSERT_EQUAL(ESP_OK,
+		    esp_hass_write_ping(&frame->w, frame->id));
+		esp_hass_tx_abort(&server.tx, frame);
+	}
+
+	ESP_LOGI(TAG, "when a frame is queued after aborted frames");
+	TEST_ASSERT_EQUAL(ESP_OK, queue_ping(&server));
+	server_free(&server);
+	TEST_ASSERT_EQUAL(1, server.n_received);
+	TEST_ASSERT_EQUAL(1, server.last_id);
+	TEST_ASSERT_EQUAL(0, server.n_corrupted);
+}
+
+/* print a ping into memory allocated by cJSON */
+static char *
+print_ping(int id)
+{
+	cJSON *json = NULL;
+	char *text = NULL;
+
+	json = cJSON_CreateObject();
+	TEST_ASSERT_NOT_NULL(json);
+	TEST_ASSERT_NOT_NULL(cJSON_AddNumberToObject(json, "id", id));
+	TEST_ASSERT_NOT_NULL(cJSON_AddStringToObject(json, "type", "ping"));
+	text = cJSON_PrintUnformatted(json);
+	TEST_ASSERT_NOT_NULL(text);
+	cJSON_Delete(json);
+	return text;
+}
+
+TEST_CASE("sends, and frees allocated texts[esp_hass_tx_commit]",
+    "[esp_hass_tx_commit]")
+{
+	server_t server;
+	esp_hass_tx_frame_t *frame = NULL;
+
+	server_init(&server, 1, false);
+
+	ESP_LOGI(TAG, "when the text of an aborted frame is allocated");
+	frame = esp_hass_tx_begin(&server.tx, 0);
+	TEST_ASSERT_NOT_NULL(frame);
+	frame->heap_text = print_ping(100);
+	esp_hass_tx_abort(&server.tx, frame);
+
+	ESP_LOGI(TAG, "when the text of a queued frame is allocated");
+	frame = esp_hass_tx_begin(&server.tx, portMAX_DELAY);
+	TEST_ASSERT_NOT_NULL(frame);
+	TEST_ASSERT_NULL(frame->heap_text);
+	frame->id = atomic_fetch_add(&server.message_id, 1) + 1;
+	frame->heap_text = print_ping(frame->id);
+	frame->w.len = strlen(frame->heap_text);
+	esp_hass_tx_commit(&server.tx, frame);
+
+	ESP_LOGI(TAG, "when the frame is reused");
+	TEST_ASSERT_EQUAL(ESP_OK, queue_ping(&server));
+	server_free(&server);
+	TEST_ASSERT_EQUAL(2, server.n_received);
+	TEST_ASSERT_EQUAL(0, server.n_corrupted);
+	TEST_ASSERT_EQUAL(0, server.n_out_of_order);
+}
+
+TEST_CASE("compare locked and queued send time[esp_hass_tx_commit]",
+    "[esp_hass_tx_commit][benchmark]")
+{
+	server_t server;
+	esp_hass_tx_frame_t frame = { 0 };
+	int64_t start, locked_us, queued_us;
+
+	server_init(&server, ESP_HASS_TX_FRAMES_MAX, true);
+	esp_hass_writer_init(&frame.w, frame.text, sizeof(frame.text));
+
+	ESP_LOGI(TAG, "when the caller sends under a lock");
+	start = esp_timer_get_time();
+	for (int i = 1; i <= BENCHMARK_MESSAGES; i++) {
+		xSemaphoreTake(server.lock, portMAX_DELAY);
+		frame.id = i;
+		TEST_ASSERT_EQUAL(ESP_OK, esp_hass_write_ping(&frame.w, i));
+		receive(&server, (esp_hass_tx_frame_t *const[]) { &frame }, 1);
+		xSemaphoreGive(server.lock);
+	}
+	locked_us = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL(0, server.n_out_of_order);
+
+	ESP_LOGI(TAG, "when the caller queues frames for the writer");
+	server.message_id = BENCHMARK_MESSAGES;
+	start = esp_timer_get_time();
+	for (int i = 0; i < BENCHMARK_MESSAGES; i++) {
+		TEST_ASSERT_EQUAL(ESP_OK, queue_ping(&server));
+	}
+	queued_us = esp_timer_get_time() - start;
+	server_free(&server);
+	TEST_ASSERT_EQUAL(BENCHMARK_MESSAGES * 2, server.n_received);
+	TEST_ASSERT_EQUAL(0, server.n_out_of_order);
+	TEST_ASSERT_EQUAL(0, server.n_corrupted);
+
+	ESP_LOGI(TAG, "under a lock: %lld us", (long long)locked_us);
+	ESP_LOGI(TAG, "queued: %lld us", (long long)queued_us);
+}
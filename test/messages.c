@@ -0,0 +1,42 @@
+#include <stddef.h>
+
+#include "messages.h"
+
+const char *recorded_messages[] = {
+	"{\"type\":\"auth_required\",\"ha_version\":\"2022.6.7\"}",
+	"{\"type\":\"auth_ok\",\"ha_version\":\"2022.6.7\"}",
+	"{\"id\":1,\"type\":\"result\",\"success\":true,\"result\":null}",
+	"{\"id\":2,\"type\":\"result\",\"success\":false,\"error\":{\"code\":"
+	"\"not_found\",\"message\":\"Service light.turn_of not found.\"}}",
+	"{\"id\":3,\"type\":\"pong\"}",
+	"{\"id\":1,\"type\":\"event\",\"event\":{\"event_type\":"
+	"\"state_changed\",\"data\":{\"entity_id\":\"light.kitchen\","
+	"\"old_state\":{\"entity_id\":\"light.kitchen\",\"state\":\"off\","
+	"\"attributes\":{\"supported_color_modes\":[\"brightness\"],"
+	"\"friendly_name\":\"Kitchen \\u00e9\\ud83d\\udca1\","
+	"\"supported_features\":40},\"last_changed\":"
+	"\"2022-06-30T01:02:03.456789+00:00\",\"last_updated\":"
+	"\"2022-06-30T01:02:03.456789+00:00\",\"context\":{\"id\":"
+	"\"01G6RZ1R0B2ZK4Q8V5N6M7P8Q9\",\"parent_id\":null,\"user_id\":null}},"
+	"\"new_state\":{\"entity_id\":\"light.kitchen\",\"state\":\"on\","
+	"\"attributes\":{\"supported_color_modes\":[\"brightness\"],"
+	"\"color_mode\":\"brightness\",\"brightness\":255,\"friendly_name\":"
+	"\"Kitchen \\u00e9\\ud83d\\udca1\",\"supported_features\":40},"
+	"\"last_changed\":\"2022-06-30T01:02:04.000000+00:00\","
+	"\"last_updated\":\"2022-06-30T01:02:04.000000+00:00\",\"context\":"
+	"{\"id\":\"01G6RZ1R0C3YK4Q8V5N6M7P8Q9\",\"parent_id\":null,"
+	"\"user_id\":\"8d7e1c0c2f0a4c0f9b1e5f6a7b8c9d0e\"}}},\"origin\":"
+	"\"LOCAL\",\"time_fired\":\"2022-06-30T01:02:04.000000+00:00\","
+	"\"context\":{\"id\":\"01G6RZ1R0C3YK4Q8V5N6M7P8Q9\",\"parent_id\":"
+	"null,\"user_id\":\"8d7e1c0c2f0a4c0f9b1e5f6a7b8c9d0e\"}}}",
+	"{\n  \"id\": 4,\n  \"type\": \"result\",\n  \"success\": true,\n"
+	"  \"result\": [\n    {\"entity_id\": \"sensor.temperature\", "
+	"\"state\": \"21.5\", \"attributes\": {\"unit_of_measurement\": "
+	"\"\\u00b0C\", \"friendly_name\": \"Temperature \\\"living\\\" "
+	"\\\\ room\\/1\\n\", \"elevation\": -12.5e0, \"azimuth\": 1.25E+2, "
+	"\"rising\": true, \"setting\": false, \"empty\": {}, \"none\": []}}\n"
+	"  ]\n}\n",
+};
+
+const size_t n_recorded_messages = sizeof(recorded_messages) /
+    sizeof(recorded_messages[0]);
@@ -0,0 +1,10 @@
+#if !defined(__MESSAGES_H__)
+#define __MESSAGES_H__
+
+#include <stddef.h>
+
+/* messages recorded from a Home Assistant server */
+extern const char *recorded_messages[];
+extern const size_t n_recorded_messages;
+
+#endif